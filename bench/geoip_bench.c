@@ -0,0 +1,624 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "geoip.h"
+#include "workload.h"
+#include "sqlite3.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#   include <x86intrin.h>
+#   define BENCH_HAVE_CYCLES 1
+#endif
+
+#ifdef __linux__
+#   include <linux/perf_event.h>
+#   include <sys/syscall.h>
+#   define BENCH_HAVE_PERF 1
+#endif
+
+/* The extension is linked in statically, so its entry point is called directly. */
+int sqlite3_maxminddbext_init(sqlite3 *db, char **pzErrMsg, const sqlite3_api_routines *pApi);
+
+#define BENCH_DEFAULT_ITERATIONS 5 /**< The default number of passes over the workload per stage. */
+
+/**
+ * The state shared by every benchmark stage.
+ */
+typedef struct bench_ctx {
+    char **ips;                      /**< The textual addresses of the workload. */
+    geoip_addr *addrs;               /**< The parsed addresses, only meaningful where valid is set. */
+    bool *valid;                     /**< Whether every address parsed. */
+    struct sockaddr_storage *sockaddrs; /**< The parsed addresses as socket addresses for the raw tree walk. */
+    MMDB_lookup_result_s *results;   /**< The search results of every valid address. */
+    MMDB_entry_data_s *values;       /**< The decoded country names of every address that has one. */
+    size_t count;                    /**< The number of addresses in the workload. */
+    geoip_db *db;                    /**< The database the stages run against. */
+    MMDB_s file_view;                /**< The database as read through its file mapping, when lookups use a copy. */
+    sqlite3 *sqlite;                 /**< A connection with the extension loaded and the workload in table "ips". */
+    volatile uint64_t sink;          /**< Keeps the compiler from discarding the work being measured. */
+} bench_ctx;
+
+/**
+ * The result of measuring one stage.
+ */
+typedef struct bench_result {
+    uint64_t ops;     /**< The number of operations performed. */
+    uint64_t ns;      /**< The elapsed wall-clock time in nanoseconds. */
+    uint64_t cycles;  /**< The elapsed time stamp counter cycles, 0 where unavailable. */
+    uint64_t dtlb;    /**< The data TLB load misses, 0 where unavailable. */
+} bench_result;
+
+static const char *const country_path[] = { "country", "names", "en", NULL };
+static const char *const open_modes[] = { "mmap", "tree", "all", "blocked" }; /**< Indexed by the GEOIP_OPEN_* enum. */
+static int dtlb_fd = -1; /**< The perf event counting data TLB load misses of this thread, -1 when unavailable. */
+
+static const char *const sql_functions[] = {
+    "geoip_asn_number", "geoip_asn_owner", "geoip_timezone", "geoip_zipcode", "geoip_continent",
+    "geoip_country", "geoip_state", "geoip_city", "geoip"
+};
+
+/**
+ * Read the cycle counter.
+ * 
+ * @return  The time stamp counter, or 0 on platforms without one.
+ */
+static inline uint64_t bench_cycles(void) {
+#ifdef BENCH_HAVE_CYCLES
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Start counting data TLB load misses in user space.
+ * 
+ * Fails quietly, for example when perf_event_paranoid forbids it, and the column then reads n/a.
+ */
+static void bench_dtlb_open(void) {
+#ifdef BENCH_HAVE_PERF
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    dtlb_fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+}
+
+/**
+ * Read the data TLB load miss counter.
+ * 
+ * @return  The misses counted so far, or 0 when unavailable.
+ */
+static inline uint64_t bench_dtlb(void) {
+    uint64_t value;
+
+    if (dtlb_fd < 0 || read(dtlb_fd, &value, sizeof(value)) != (ssize_t)sizeof(value))
+        return 0;
+
+    return value;
+}
+
+static void stage_parse(bench_ctx *ctx, bench_result *out) {
+    geoip_addr addr;
+
+    for (size_t i = 0; i < ctx->count; i++)
+        ctx->sink += (uint64_t)geoip_parse_address(ctx->ips[i], &addr) + addr.bytes[15];
+
+    out->ops += ctx->count;
+}
+
+static void stage_walk(bench_ctx *ctx, bench_result *out) {
+    for (size_t i = 0; i < ctx->count; i++) {
+        int mmdb_error;
+
+        if (!ctx->valid[i])
+            continue;
+
+        MMDB_lookup_result_s result = MMDB_lookup_sockaddr(&ctx->db->mmdb, (const struct sockaddr *)&ctx->sockaddrs[i], &mmdb_error);
+        ctx->sink += result.entry.offset + (uint64_t)mmdb_error;
+        out->ops++;
+    }
+}
+
+/* The same walk through the file mapping, for comparison when lookups were pointed at a copy. */
+static void stage_walk_file(bench_ctx *ctx, bench_result *out) {
+    for (size_t i = 0; i < ctx->count; i++) {
+        int mmdb_error;
+
+        if (!ctx->valid[i])
+            continue;
+
+        MMDB_lookup_result_s result = MMDB_lookup_sockaddr(&ctx->file_view, (const struct sockaddr *)&ctx->sockaddrs[i], &mmdb_error);
+        ctx->sink += result.entry.offset + (uint64_t)mmdb_error;
+        out->ops++;
+    }
+}
+
+/* The walk the extension picked for the database, which the lookup stage runs on cache misses. */
+static void stage_walk_kernel(bench_ctx *ctx, bench_result *out) {
+    for (size_t i = 0; i < ctx->count; i++) {
+        MMDB_lookup_result_s result;
+
+        if (!ctx->valid[i])
+            continue;
+
+        ctx->sink += (uint64_t)geoip_tree_walk(ctx->db, &ctx->addrs[i], &result) + result.entry.offset;
+        out->ops++;
+    }
+}
+
+static void stage_lookup(bench_ctx *ctx, bench_result *out) {
+    for (size_t i = 0; i < ctx->count; i++) {
+        MMDB_lookup_result_s result;
+
+        if (!ctx->valid[i])
+            continue;
+
+        ctx->sink += (uint64_t)geoip_lookup(ctx->db, &ctx->addrs[i], &result, -1) + result.entry.offset;
+        out->ops++;
+    }
+}
+
+static void stage_decode(bench_ctx *ctx, bench_result *out) {
+    for (size_t i = 0; i < ctx->count; i++) {
+        MMDB_entry_data_s entry_data;
+
+        if (!ctx->valid[i] || !ctx->results[i].found_entry)
+            continue;
+
+        ctx->sink += (uint64_t)MMDB_aget_value(&ctx->results[i].entry, &entry_data, country_path) + entry_data.data_size;
+        out->ops++;
+    }
+}
+
+/* Copy the value out the way send_data() hands it to SQLite: strings by their length, they are not NUL-terminated in
+ * the data section, and 32-bit numbers as text. */
+static void stage_marshal(bench_ctx *ctx, bench_result *out) {
+    char zOut[4096];
+
+    for (size_t i = 0; i < ctx->count; i++) {
+        const MMDB_entry_data_s *entry_data = &ctx->values[i];
+        size_t length;
+
+        if (!entry_data->has_data)
+            continue;
+
+        if (entry_data->type == MMDB_DATA_TYPE_BYTES || entry_data->type == MMDB_DATA_TYPE_UTF8_STRING) {
+            length = entry_data->data_size < sizeof(zOut) ? entry_data->data_size : sizeof(zOut) - 1;
+            memcpy(zOut, entry_data->bytes, length);
+            zOut[length] = '\0';
+        } else {
+            length = (size_t)snprintf(zOut, sizeof(zOut), "%u", entry_data->uint32);
+        }
+
+        ctx->sink += length + (uint8_t)zOut[0];
+        out->ops++;
+    }
+}
+
+/**
+ * Time one pass of a stage.
+ * 
+ * @param ctx   The benchmark state.
+ * @param stage The stage to run.
+ * @param out   The totals to add the pass to.
+ */
+static void bench_pass(bench_ctx *ctx, void (*stage)(bench_ctx *, bench_result *), bench_result *out) {
+    uint64_t dtlb = bench_dtlb();
+    uint64_t start = geoip_stats_now();
+    uint64_t cycles = bench_cycles();
+
+    stage(ctx, out);
+
+    out->cycles += bench_cycles() - cycles;
+    out->ns += geoip_stats_now() - start;
+    out->dtlb += bench_dtlb() - dtlb;
+}
+
+/**
+ * Print the result of a stage.
+ * 
+ * @param name      The name of the stage.
+ * @param result    The measured totals.
+ */
+static void bench_report(const char *name, const bench_result *result) {
+    double ns = result->ops ? (double)result->ns / (double)result->ops : 0.0;
+    double ops = result->ns ? (double)result->ops * 1e9 / (double)result->ns : 0.0;
+
+    printf("%-24s %12llu %12.1f %14.0f", name, (unsigned long long)result->ops, ns, ops);
+
+#ifdef BENCH_HAVE_CYCLES
+    printf(" %12.1f", result->ops ? (double)result->cycles / (double)result->ops : 0.0);
+#else
+    printf(" %12s", "n/a");
+#endif
+
+    if (dtlb_fd >= 0)
+        printf(" %10.3f\n", result->ops ? (double)result->dtlb / (double)result->ops : 0.0);
+    else
+        printf(" %10s\n", "n/a");
+}
+
+/**
+ * Time a full "SELECT fn(ip) FROM ips" over the workload.
+ * 
+ * @param ctx           The benchmark state.
+ * @param function      The SQL function to call.
+ * @param iterations    The number of passes.
+ * @param out           The totals to add to.
+ * @return              0 on success, -1 on an SQLite error.
+ */
+static int bench_sql(bench_ctx *ctx, const char *function, int iterations, bench_result *out) {
+    char sql[128];
+    sqlite3_stmt *stmt;
+
+    snprintf(sql, sizeof(sql), "SELECT %s(ip) FROM ips", function);
+    if (sqlite3_prepare_v2(ctx->sqlite, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "%s: %s\n", sql, sqlite3_errmsg(ctx->sqlite));
+        return -1;
+    }
+
+    for (int pass = 0; pass < iterations; pass++) {
+        uint64_t dtlb = bench_dtlb();
+        uint64_t start = geoip_stats_now();
+        uint64_t cycles = bench_cycles();
+        int rc;
+
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW || rc == SQLITE_ERROR) {
+            if (rc == SQLITE_ERROR) {
+                /* Lookup errors abort the statement, the remaining rows are not counted. */
+                break;
+            }
+
+            ctx->sink += (uint64_t)sqlite3_column_bytes(stmt, 0);
+            out->ops++;
+        }
+
+        out->cycles += bench_cycles() - cycles;
+        out->ns += geoip_stats_now() - start;
+        out->dtlb += bench_dtlb() - dtlb;
+        sqlite3_reset(stmt);
+    }
+
+    sqlite3_finalize(stmt);
+    return 0;
+}
+
+/**
+ * Load the workload into an in-memory table of a fresh connection with the extension loaded.
+ * 
+ * @param ctx   The benchmark state.
+ * @return      0 on success, -1 on failure.
+ */
+static int bench_open_sqlite(bench_ctx *ctx) {
+    char *errmsg = NULL;
+    sqlite3_stmt *stmt;
+
+    if (sqlite3_open(":memory:", &ctx->sqlite) != SQLITE_OK)
+        return -1;
+
+    if (sqlite3_maxminddbext_init(ctx->sqlite, &errmsg, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Unable to initialize the extension: %s\n", errmsg ? errmsg : "unknown error");
+        sqlite3_free(errmsg);
+        return -1;
+    }
+
+    if (sqlite3_exec(ctx->sqlite, "CREATE TABLE ips(ip TEXT); BEGIN", NULL, NULL, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(ctx->sqlite, "INSERT INTO ips VALUES (?)", -1, &stmt, NULL) != SQLITE_OK)
+        return -1;
+
+    for (size_t i = 0; i < ctx->count; i++) {
+        sqlite3_bind_text(stmt, 1, ctx->ips[i], -1, SQLITE_STATIC);
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+    }
+
+    sqlite3_finalize(stmt);
+    return sqlite3_exec(ctx->sqlite, "COMMIT", NULL, NULL, NULL) == SQLITE_OK ? 0 : -1;
+}
+
+/**
+ * Precompute the inputs of the later stages so every stage can be measured in isolation.
+ * 
+ * @param ctx   The benchmark state.
+ */
+static void bench_prepare(bench_ctx *ctx) {
+    for (size_t i = 0; i < ctx->count; i++) {
+        ctx->valid[i] = geoip_parse_address(ctx->ips[i], &ctx->addrs[i]) == 0;
+        if (!ctx->valid[i])
+            continue;
+
+        memset(&ctx->sockaddrs[i], 0, sizeof(ctx->sockaddrs[i]));
+        if (ctx->addrs[i].family == AF_INET) {
+            struct sockaddr_in *sin = (struct sockaddr_in *)&ctx->sockaddrs[i];
+
+            sin->sin_family = AF_INET;
+            memcpy(&sin->sin_addr, ctx->addrs[i].bytes + 12, 4);
+        } else {
+            struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&ctx->sockaddrs[i];
+
+            sin6->sin6_family = AF_INET6;
+            memcpy(&sin6->sin6_addr, ctx->addrs[i].bytes, 16);
+        }
+
+        if (geoip_lookup(ctx->db, &ctx->addrs[i], &ctx->results[i], -1) != MMDB_SUCCESS)
+            ctx->results[i].found_entry = false;
+
+        if (ctx->results[i].found_entry && MMDB_aget_value(&ctx->results[i].entry, &ctx->values[i], country_path) != MMDB_SUCCESS)
+            ctx->values[i].has_data = false;
+    }
+}
+
+/**
+ * Check the walk the extension picked against libmaxminddb for every address of the workload.
+ * 
+ * With a blocked relayout the cache lines a walk touches are counted in both layouts as well.
+ * 
+ * @param ctx   The benchmark state.
+ * @return      0 when every walk found what libmaxminddb found, -1 otherwise.
+ */
+static int bench_check_walk(bench_ctx *ctx) {
+    const geoip_tree *tree = &ctx->db->tree;
+    uint64_t mmdb_lines = 0, tree_lines = 0, walks = 0, mismatches = 0;
+
+    for (size_t i = 0; i < ctx->count; i++) {
+        MMDB_lookup_result_s expected, result;
+        int mmdb_error, lines;
+
+        if (!ctx->valid[i])
+            continue;
+
+        expected = MMDB_lookup_sockaddr(&ctx->db->mmdb, (const struct sockaddr *)&ctx->sockaddrs[i], &mmdb_error);
+        if (geoip_tree_walk(ctx->db, &ctx->addrs[i], &result) != mmdb_error ||
+            (mmdb_error == MMDB_SUCCESS && (result.found_entry != expected.found_entry || result.netmask != expected.netmask ||
+                (result.found_entry && result.entry.offset != expected.entry.offset)))) {
+            if (mismatches++ == 0)
+                fprintf(stderr, "The %s walk disagrees with libmaxminddb on %s\n", ctx->db->walk.name, ctx->ips[i]);
+        }
+
+        if (tree->nodes == NULL)
+            continue;
+
+        int tree_walk = geoip_tree_lines(tree, &ctx->db->mmdb, &ctx->addrs[i], &lines);
+        if (tree_walk >= 0) {
+            mmdb_lines += (uint64_t)lines;
+            tree_lines += (uint64_t)tree_walk;
+            walks++;
+        }
+    }
+
+    printf("walk %s: %llu mismatches", ctx->db->walk.name, (unsigned long long)mismatches);
+    if (tree->nodes != NULL) {
+        printf(", %u of %u slots used (%s pages), cache lines per walk %.2f in the file, %.2f blocked",
+            tree->used, tree->node_count, geoip_pages_names[tree->pages],
+            walks ? (double)mmdb_lines / (double)walks : 0.0, walks ? (double)tree_lines / (double)walks : 0.0);
+    }
+    printf("\n");
+
+    return mismatches == 0 ? 0 : -1;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --dir PATH         Directory holding GeoLite2-ASN.mmdb and GeoLite2-City.mmdb (default: current directory)\n"
+        "  --db asn|city      Database the stage benchmarks run against (default: city)\n"
+        "  --open-mode MODE   Open the database with mmap, a huge page copy of its tree or of all of it, or a blocked\n"
+        "                     relayout of its tree: mmap, tree, all or blocked (default: mmap)\n"
+        "  --iterations N     Passes over the workload per stage (default: %d)\n"
+        "  --stages LIST      Comma separated stages: parse,walk,lookup,decode,marshal,sql (default: all)\n"
+        "  --replay FILE      Replay addresses from FILE, one per line, instead of a synthetic workload\n"
+        "  --replay-sqlite DB Replay addresses from a column of a SQLite database, see --table and --column\n"
+        "  --table NAME       Table to replay from (default: ips)\n"
+        "  --column NAME      Column to replay from (default: ip)\n"
+        "Synthetic workload:\n",
+        argv0, BENCH_DEFAULT_ITERATIONS);
+    workload_usage(stderr);
+}
+
+int main(int argc, char **argv) {
+    bench_ctx ctx;
+    workload_options options;
+    workload w;
+    const char *dir = NULL, *replay = NULL, *replay_sqlite = NULL, *table = "ips", *column = "ip";
+    const char *stages = "parse,walk,lookup,decode,marshal,sql", *dbname = "city", *open_mode = "mmap";
+    int iterations = BENCH_DEFAULT_ITERATIONS, mode = -1;
+    char error[256];
+    int rc;
+
+    memset(&ctx, 0, sizeof(ctx));
+    workload_defaults(&options);
+
+    for (int i = 1; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (value == NULL) {
+            usage(argv[0]);
+            return 1;
+        }
+
+        if (strcmp(argv[i], "--dir") == 0)
+            dir = value;
+        else if (strcmp(argv[i], "--db") == 0)
+            dbname = value;
+        else if (strcmp(argv[i], "--open-mode") == 0)
+            open_mode = value;
+        else if (strcmp(argv[i], "--iterations") == 0)
+            iterations = atoi(value);
+        else if (strcmp(argv[i], "--replay") == 0)
+            replay = value;
+        else if (strcmp(argv[i], "--replay-sqlite") == 0)
+            replay_sqlite = value;
+        else if (strcmp(argv[i], "--table") == 0)
+            table = value;
+        else if (strcmp(argv[i], "--column") == 0)
+            column = value;
+        else if (strcmp(argv[i], "--stages") == 0)
+            stages = value;
+        else if (!workload_parse_option(&options, argv[i], value)) {
+            usage(argv[0]);
+            return 1;
+        }
+
+        i++;
+    }
+
+    for (int i = 0; i < GEOIP_OPEN_MODE_COUNT; i++) {
+        if (strcmp(open_mode, open_modes[i]) == 0)
+            mode = i;
+    }
+
+    if (options.count == 0 || iterations <= 0 || mode < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (replay != NULL)
+        rc = workload_replay_file(replay, options.count, &w, error, sizeof(error));
+    else if (replay_sqlite != NULL)
+        rc = workload_replay_sqlite(replay_sqlite, table, column, options.count, &w, error, sizeof(error));
+    else
+        rc = workload_generate(&options, &w, error, sizeof(error));
+
+    if (rc != 0) {
+        fprintf(stderr, "%s\n", error);
+        return 1;
+    }
+
+    /* Replay files are resolved first, relative to where the benchmark was started. */
+    if (dir != NULL && chdir(dir) != 0) {
+        fprintf(stderr, "Unable to enter %s: %s\n", dir, strerror(errno));
+        return 1;
+    }
+
+    ctx.ips = w.ips;
+    ctx.count = w.count;
+    ctx.addrs = calloc(ctx.count, sizeof(geoip_addr));
+    ctx.valid = calloc(ctx.count, sizeof(bool));
+    ctx.sockaddrs = calloc(ctx.count, sizeof(struct sockaddr_storage));
+    ctx.results = calloc(ctx.count, sizeof(MMDB_lookup_result_s));
+    ctx.values = calloc(ctx.count, sizeof(MMDB_entry_data_s));
+
+    if (ctx.addrs == NULL || ctx.valid == NULL || ctx.sockaddrs == NULL || ctx.results == NULL || ctx.values == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    if (bench_open_sqlite(&ctx) != 0) {
+        fprintf(stderr, "Unable to set up SQLite: %s\n", ctx.sqlite ? sqlite3_errmsg(ctx.sqlite) : "out of memory");
+        return 1;
+    }
+
+    ctx.db = strcmp(dbname, "asn") == 0 ? &db_asn : &db_cnt;
+    ctx.db->map.open_mode = mode;
+    if (geoip_db_acquire(ctx.db) != MMDB_SUCCESS) {
+        fprintf(stderr, "Unable to open the %s database, is it in the working directory?\n", dbname);
+        return 1;
+    }
+
+    /* The sql stage queries both databases, no pass should pay for opening the other one. */
+    geoip_db_acquire(ctx.db == &db_asn ? &db_cnt : &db_asn);
+
+    if (ctx.db->map.copy != NULL) {
+        ctx.file_view = ctx.db->mmdb;
+        ctx.file_view.file_content = ctx.db->map.file_content;
+        ctx.file_view.data_section = ctx.db->map.data_section;
+        ctx.file_view.metadata_section = ctx.db->map.metadata_section;
+    } else if (mode == GEOIP_OPEN_BLOCKED ? ctx.db->tree.nodes == NULL : mode != GEOIP_OPEN_MMAP) {
+        fprintf(stderr, "Unable to %s the database, running against the file mapping\n", mode == GEOIP_OPEN_BLOCKED ? "relay out" : "copy");
+    }
+
+    bench_prepare(&ctx);
+    bench_dtlb_open();
+
+    if (bench_check_walk(&ctx) != 0)
+        return 1;
+
+    printf("workload: %zu addresses (%s), %d iterations, database %s, open mode %s",
+        ctx.count, replay != NULL ? replay : replay_sqlite != NULL ? replay_sqlite : "synthetic", iterations, ctx.db->mmdb.filename, open_mode);
+    if (ctx.db->map.copy != NULL)
+        printf(" (%s pages)", geoip_pages_names[ctx.db->map.copy_pages]);
+    printf("\n%-24s %12s %12s %14s %12s %10s\n", "stage", "ops", "ns/op", "ops/s", "cycles/op", "dTLB/op");
+
+    static const struct {
+        const char *name;
+        void (*run)(bench_ctx *, bench_result *);
+    } stage_table[] = {
+        { "parse", stage_parse },
+        { "walk", stage_walk },
+        { "lookup", stage_lookup },
+        { "decode", stage_decode },
+        { "marshal", stage_marshal }
+    };
+
+    char *list = strdup(stages);
+    for (char *save = NULL, *stage = strtok_r(list, ",", &save); stage != NULL; stage = strtok_r(NULL, ",", &save)) {
+        bool known = false;
+
+        for (size_t i = 0; i < sizeof(stage_table) / sizeof(stage_table[0]); i++) {
+            bench_result result = {0};
+
+            if (strcmp(stage, stage_table[i].name) != 0)
+                continue;
+
+            for (int pass = 0; pass < iterations; pass++)
+                bench_pass(&ctx, stage_table[i].run, &result);
+
+            bench_report(stage, &result);
+            known = true;
+
+            if (stage_table[i].run == stage_walk && ctx.db->map.copy != NULL) {
+                memset(&result, 0, sizeof(result));
+                for (int pass = 0; pass < iterations; pass++)
+                    bench_pass(&ctx, stage_walk_file, &result);
+
+                bench_report("walk:mmap", &result);
+            }
+
+            if (stage_table[i].run == stage_walk) {
+                char name[64];
+
+                memset(&result, 0, sizeof(result));
+                for (int pass = 0; pass < iterations; pass++)
+                    bench_pass(&ctx, stage_walk_kernel, &result);
+
+                snprintf(name, sizeof(name), "walk:%s", ctx.db->walk.name);
+                bench_report(name, &result);
+            }
+        }
+
+        if (strcmp(stage, "sql") == 0) {
+            for (size_t i = 0; i < sizeof(sql_functions) / sizeof(sql_functions[0]); i++) {
+                bench_result result = {0};
+                char name[64];
+
+                if (bench_sql(&ctx, sql_functions[i], iterations, &result) != 0)
+                    return 1;
+
+                snprintf(name, sizeof(name), "sql:%s", sql_functions[i]);
+                bench_report(name, &result);
+            }
+            known = true;
+        }
+
+        if (!known)
+            fprintf(stderr, "Unknown stage \"%s\"\n", stage);
+    }
+
+    free(list);
+    sqlite3_close(ctx.sqlite);
+
+    workload_free(&w);
+    free(ctx.addrs);
+    free(ctx.valid);
+    free(ctx.sockaddrs);
+    free(ctx.results);
+    free(ctx.values);
+    return 0;
+}
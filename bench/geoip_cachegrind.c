@@ -0,0 +1,130 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "geoip.h"
+#include "workload.h"
+#include "sqlite3.h"
+
+/* The extension is linked in statically, so its entry point is called directly. */
+int sqlite3_maxminddbext_init(sqlite3 *db, char **pzErrMsg, const sqlite3_api_routines *pApi);
+
+/**
+ * The fixed workload driver of the Cachegrind regression tests.
+ * 
+ * Every run performs the same setup: it generates the same address stream, loads it into a table and initializes
+ * the extension. Only when --lookups is 1 does it then call the function once per row. Running it under Cachegrind
+ * both ways and subtracting the totals leaves the instructions and LL misses of the lookups alone, see
+ * cmake/CachegrindCheck.cmake.
+ */
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "Usage: %s --dir PATH --function NAME --networks FILE [--count N] [--lookups 0|1]\n"
+        "  --dir PATH         Directory holding the GeoLite2-ASN.mmdb and GeoLite2-City.mmdb fixtures\n"
+        "  --function NAME    SQL function to call, such as geoip_country\n"
+        "  --networks FILE    Networks of the fixture the addresses are drawn from\n"
+        "  --count N          Number of rows (default: 20000)\n"
+        "  --lookups 0|1      Whether to run the lookups or only the setup (default: 1)\n",
+        argv0);
+}
+
+int main(int argc, char **argv) {
+    workload_options options;
+    workload w;
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    const char *dir = NULL, *function = NULL;
+    char error[256], sql[128];
+    char *errmsg = NULL;
+    int lookups = 1;
+    unsigned long long found = 0;
+
+    workload_defaults(&options);
+    options.count = 20000;
+    options.distinct = 10000;
+    options.invalid_rate = 0.01;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--dir") == 0)
+            dir = argv[i + 1];
+        else if (strcmp(argv[i], "--function") == 0)
+            function = argv[i + 1];
+        else if (strcmp(argv[i], "--networks") == 0)
+            options.networks_path = argv[i + 1];
+        else if (strcmp(argv[i], "--count") == 0)
+            options.count = strtoull(argv[i + 1], NULL, 10);
+        else if (strcmp(argv[i], "--lookups") == 0)
+            lookups = atoi(argv[i + 1]);
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (dir == NULL || function == NULL || options.networks_path == NULL || argc % 2 == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (workload_generate(&options, &w, error, sizeof(error)) != 0) {
+        fprintf(stderr, "%s\n", error);
+        return 1;
+    }
+
+    if (chdir(dir) != 0) {
+        fprintf(stderr, "Unable to enter %s: %s\n", dir, strerror(errno));
+        return 1;
+    }
+
+    if (sqlite3_open(":memory:", &db) != SQLITE_OK || sqlite3_maxminddbext_init(db, &errmsg, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Unable to initialize the extension: %s\n", errmsg ? errmsg : sqlite3_errmsg(db));
+        return 1;
+    }
+
+    /* Databases open on first use, which belongs to the setup and not to the lookups being measured. */
+    if (geoip_db_acquire(&db_asn) != MMDB_SUCCESS || geoip_db_acquire(&db_cnt) != MMDB_SUCCESS) {
+        fprintf(stderr, "Unable to open the fixtures in %s\n", dir);
+        return 1;
+    }
+
+    if (sqlite3_exec(db, "CREATE TABLE ips(ip TEXT); BEGIN", NULL, NULL, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(db, "INSERT INTO ips VALUES (?)", -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "%s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+
+    for (size_t i = 0; i < w.count; i++) {
+        sqlite3_bind_text(stmt, 1, w.ips[i], -1, SQLITE_STATIC);
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+    }
+
+    sqlite3_finalize(stmt);
+    sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
+
+    /* Malformed rows raise an error per call, so every row is its own statement execution. */
+    snprintf(sql, sizeof(sql), "SELECT %s(ip) FROM ips WHERE rowid = ?", function);
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "%s: %s\n", sql, sqlite3_errmsg(db));
+        return 1;
+    }
+
+    for (size_t i = 1; lookups && i <= w.count; i++) {
+        sqlite3_bind_int64(stmt, 1, (sqlite3_int64)i);
+        if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL)
+            found++;
+
+        sqlite3_reset(stmt);
+    }
+
+    sqlite3_finalize(stmt);
+    printf("%s: %llu of %zu lookups found a value\n", function, found, lookups ? w.count : 0);
+
+    /*
+     * The connection is left open on purpose: closing the last one can write warm-start files next to the fixtures,
+     * which would change what the next run measures.
+     */
+    workload_free(&w);
+    return 0;
+}
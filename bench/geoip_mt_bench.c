@@ -0,0 +1,524 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "geoip.h"
+#include "workload.h"
+#include "sqlite3.h"
+
+/* The extension is linked in statically, so its entry point is called directly. */
+int sqlite3_maxminddbext_init(sqlite3 *db, char **pzErrMsg, const sqlite3_api_routines *pApi);
+
+#define MT_MAX_THREADS  1024   /**< The largest thread count accepted. */
+#define MT_MAX_RUNS     32     /**< The largest number of thread counts in one scaling run. */
+#define MT_SUB_BUCKETS  16     /**< Linear sub-buckets per power of two in the latency histogram. */
+#define MT_BUCKETS      (64 * MT_SUB_BUCKETS)
+#define MT_STATIC_MUTEXES (SQLITE_MUTEX_STATIC_VFS3 + 1)
+
+/**
+ * A SQLite mutex wrapped to count how often taking it had to wait.
+ */
+typedef struct mt_mutex {
+    sqlite3_mutex *real;            /**< The mutex of the default implementation. */
+    _Atomic uint64_t enters;        /**< The number of times the mutex was taken, only counted for static mutexes. */
+    _Atomic uint64_t contended;     /**< The number of times the mutex was held by another thread. */
+    _Atomic uint64_t wait_ns;       /**< The total time spent waiting for it. */
+} mt_mutex;
+
+/**
+ * The result of one thread.
+ */
+typedef struct mt_thread {
+    pthread_t thread;
+    size_t index;                   /**< The index of the thread in its run. */
+    uint64_t init_ns;               /**< The time sqlite3_maxminddbext_init() took on this thread. */
+    uint64_t queries;               /**< The number of queries executed. */
+    uint64_t errors;                /**< The number of queries that raised an error. */
+    uint64_t histogram[MT_BUCKETS]; /**< The latency histogram of the queries. */
+    int failed;                     /**< Set when the connection could not be set up. */
+} mt_thread;
+
+static sqlite3_mutex_methods real_mutex;            /**< The default mutex implementation being wrapped. */
+static mt_mutex static_mutexes[MT_STATIC_MUTEXES];  /**< The wrappers of the static mutexes, indexed by type. */
+static mt_mutex dynamic_mutexes;                    /**< The summed up counters of all connection and other dynamic mutexes. */
+static bool track_mutexes = true;                   /**< Whether contention is being counted. */
+
+static const char *const static_mutex_names[MT_STATIC_MUTEXES] = {
+    [SQLITE_MUTEX_STATIC_MAIN] = "STATIC_MAIN",
+    [SQLITE_MUTEX_STATIC_MEM]  = "STATIC_MEM (allocator statistics)",
+    [SQLITE_MUTEX_STATIC_OPEN] = "STATIC_OPEN",
+    [SQLITE_MUTEX_STATIC_PRNG] = "STATIC_PRNG",
+    [SQLITE_MUTEX_STATIC_LRU]  = "STATIC_LRU",
+    [SQLITE_MUTEX_STATIC_PMEM] = "STATIC_PMEM",
+    [SQLITE_MUTEX_STATIC_APP1] = "STATIC_APP1 (extension init and open)",
+    [SQLITE_MUTEX_STATIC_APP2] = "STATIC_APP2",
+    [SQLITE_MUTEX_STATIC_APP3] = "STATIC_APP3",
+    [SQLITE_MUTEX_STATIC_VFS1] = "STATIC_VFS1",
+    [SQLITE_MUTEX_STATIC_VFS2] = "STATIC_VFS2",
+    [SQLITE_MUTEX_STATIC_VFS3] = "STATIC_VFS3"
+};
+
+static const char *const default_functions[] = {
+    "geoip_country", "geoip_city", "geoip_asn_number", "geoip_asn_owner", "geoip_continent",
+    "geoip_state", "geoip_timezone", "geoip_zipcode", "geoip"
+};
+
+static const char *functions[16];       /**< The functions of the query mix. */
+static size_t function_count;           /**< The number of functions in the query mix. */
+static workload stream;                 /**< The addresses shared by all threads. */
+static uint64_t queries_per_thread;     /**< The number of queries every thread runs. */
+static pthread_barrier_t barrier;       /**< Lines the threads up for concurrent init and for the query phase. */
+static uint64_t phase_start;           /**< When the threads passed the query phase barrier. */
+
+static void mt_mutex_init_once(void) {
+    for (int type = SQLITE_MUTEX_STATIC_MAIN; type < MT_STATIC_MUTEXES; type++)
+        static_mutexes[type].real = real_mutex.xMutexAlloc(type);
+}
+
+/* SQLite calls this again on every sqlite3_mutex_alloc() of a static mutex, from any thread. */
+static int mt_mutex_init(void) {
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    int rc = real_mutex.xMutexInit();
+
+    if (rc == SQLITE_OK)
+        pthread_once(&once, mt_mutex_init_once);
+
+    return rc;
+}
+
+static int mt_mutex_end(void) {
+    return real_mutex.xMutexEnd();
+}
+
+static sqlite3_mutex *mt_mutex_alloc(int type) {
+    mt_mutex *mutex;
+
+    if (type >= SQLITE_MUTEX_STATIC_MAIN)
+        return type < MT_STATIC_MUTEXES && static_mutexes[type].real ? (sqlite3_mutex *)&static_mutexes[type] : NULL;
+
+    mutex = calloc(1, sizeof(mt_mutex));
+    if (mutex == NULL || (mutex->real = real_mutex.xMutexAlloc(type)) == NULL) {
+        free(mutex);
+        return NULL;
+    }
+
+    return (sqlite3_mutex *)mutex;
+}
+
+static void mt_mutex_free(sqlite3_mutex *m) {
+    mt_mutex *mutex = (mt_mutex *)m;
+
+    real_mutex.xMutexFree(mutex->real);
+    free(mutex);
+}
+
+static void mt_mutex_enter(sqlite3_mutex *m) {
+    mt_mutex *mutex = (mt_mutex *)m;
+    bool is_static = mutex >= &static_mutexes[0] && mutex < &static_mutexes[MT_STATIC_MUTEXES];
+    mt_mutex *counters = is_static ? mutex : &dynamic_mutexes;
+
+    if (!track_mutexes) {
+        real_mutex.xMutexEnter(mutex->real);
+        return;
+    }
+
+    if (real_mutex.xMutexTry(mutex->real) != SQLITE_OK) {
+        uint64_t start = geoip_stats_now();
+
+        real_mutex.xMutexEnter(mutex->real);
+        atomic_fetch_add_explicit(&counters->contended, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&counters->wait_ns, geoip_stats_now() - start, memory_order_relaxed);
+    }
+
+    /* Counted while holding the mutex, so the counter adds no contention of its own. */
+    if (is_static)
+        atomic_fetch_add_explicit(&counters->enters, 1, memory_order_relaxed);
+}
+
+static int mt_mutex_try(sqlite3_mutex *m) {
+    return real_mutex.xMutexTry(((mt_mutex *)m)->real);
+}
+
+static void mt_mutex_leave(sqlite3_mutex *m) {
+    real_mutex.xMutexLeave(((mt_mutex *)m)->real);
+}
+
+static int mt_mutex_held(sqlite3_mutex *m) {
+    return real_mutex.xMutexHeld(((mt_mutex *)m)->real);
+}
+
+static int mt_mutex_notheld(sqlite3_mutex *m) {
+    return real_mutex.xMutexNotheld(((mt_mutex *)m)->real);
+}
+
+/**
+ * Install the counting mutex wrappers, must run before SQLite is used.
+ * 
+ * @return  SQLITE_OK on success.
+ */
+static int mt_install_mutexes(void) {
+    sqlite3_mutex_methods methods = {
+        mt_mutex_init, mt_mutex_end, mt_mutex_alloc, mt_mutex_free,
+        mt_mutex_enter, mt_mutex_try, mt_mutex_leave, NULL, NULL
+    };
+    int rc;
+
+    /* The default methods are only filled in once SQLite has been initialized. */
+    if ((rc = sqlite3_initialize()) != SQLITE_OK || (rc = sqlite3_shutdown()) != SQLITE_OK)
+        return rc;
+
+    rc = sqlite3_config(SQLITE_CONFIG_GETMUTEX, &real_mutex);
+    if (rc != SQLITE_OK || real_mutex.xMutexAlloc == NULL)
+        return rc;
+
+    /* xMutexHeld and xMutexNotheld only exist in debug builds of SQLite. */
+    if (real_mutex.xMutexHeld != NULL)
+        methods.xMutexHeld = mt_mutex_held;
+
+    if (real_mutex.xMutexNotheld != NULL)
+        methods.xMutexNotheld = mt_mutex_notheld;
+
+    return sqlite3_config(SQLITE_CONFIG_MUTEX, &methods);
+}
+
+static void mt_reset_mutexes(void) {
+    for (int type = 0; type < MT_STATIC_MUTEXES; type++) {
+        atomic_store(&static_mutexes[type].enters, 0);
+        atomic_store(&static_mutexes[type].contended, 0);
+        atomic_store(&static_mutexes[type].wait_ns, 0);
+    }
+
+    atomic_store(&dynamic_mutexes.contended, 0);
+    atomic_store(&dynamic_mutexes.wait_ns, 0);
+}
+
+static inline unsigned int histogram_index(uint64_t ns) {
+    unsigned int msb;
+
+    if (ns < MT_SUB_BUCKETS)
+        return (unsigned int)ns;
+
+    msb = 63 - (unsigned int)__builtin_clzll(ns);
+    return (msb - 3) * MT_SUB_BUCKETS + (unsigned int)((ns >> (msb - 4)) & (MT_SUB_BUCKETS - 1));
+}
+
+static uint64_t histogram_value(unsigned int index) {
+    unsigned int msb;
+
+    if (index < MT_SUB_BUCKETS)
+        return index;
+
+    msb = index / MT_SUB_BUCKETS + 3;
+    return (uint64_t)(MT_SUB_BUCKETS + index % MT_SUB_BUCKETS) << (msb - 4);
+}
+
+/**
+ * Find a percentile in a latency histogram.
+ * 
+ * @param histogram The histogram.
+ * @param total     The number of samples in it.
+ * @param fraction  The percentile as a fraction, such as 0.99.
+ * @return          The lower bound of the bucket holding the percentile, in nanoseconds.
+ */
+static uint64_t histogram_percentile(const uint64_t *histogram, uint64_t total, double fraction) {
+    uint64_t rank = (uint64_t)((double)total * fraction), seen = 0;
+
+    for (unsigned int i = 0; i < MT_BUCKETS; i++) {
+        seen += histogram[i];
+        if (seen > rank)
+            return histogram_value(i);
+    }
+
+    return histogram_value(MT_BUCKETS - 1);
+}
+
+static void *mt_worker(void *arg) {
+    mt_thread *self = arg;
+    sqlite3 *db = NULL;
+    sqlite3_stmt *stmts[16] = { 0 };
+    char *errmsg = NULL;
+    uint64_t start;
+    size_t offset = self->index * 7919;
+
+    /* Every thread loads the extension at the same moment to exercise concurrent initialization. */
+    pthread_barrier_wait(&barrier);
+
+    start = geoip_stats_now();
+    if (sqlite3_open(":memory:", &db) != SQLITE_OK || sqlite3_maxminddbext_init(db, &errmsg, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Thread %zu: %s\n", self->index, errmsg ? errmsg : sqlite3_errmsg(db));
+        sqlite3_free(errmsg);
+        self->failed = 1;
+    }
+    self->init_ns = geoip_stats_now() - start;
+
+    for (size_t i = 0; !self->failed && i < function_count; i++) {
+        char sql[64];
+
+        snprintf(sql, sizeof(sql), "SELECT %s(?1)", functions[i]);
+        if (sqlite3_prepare_v2(db, sql, -1, &stmts[i], NULL) != SQLITE_OK) {
+            fprintf(stderr, "Thread %zu: %s\n", self->index, sqlite3_errmsg(db));
+            self->failed = 1;
+        }
+    }
+
+    if (pthread_barrier_wait(&barrier) == PTHREAD_BARRIER_SERIAL_THREAD)
+        phase_start = geoip_stats_now();
+
+    for (uint64_t q = 0; !self->failed && q < queries_per_thread; q++) {
+        sqlite3_stmt *stmt = stmts[(q + self->index) % function_count];
+        const char *ip = stream.ips[(offset + q) % stream.count];
+        uint64_t t0 = geoip_stats_now();
+
+        sqlite3_bind_text(stmt, 1, ip, -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) == SQLITE_ERROR)
+            self->errors++;
+
+        sqlite3_reset(stmt);
+        self->histogram[histogram_index(geoip_stats_now() - t0)]++;
+        self->queries++;
+    }
+
+    for (size_t i = 0; i < function_count; i++)
+        sqlite3_finalize(stmts[i]);
+
+    sqlite3_close(db);
+    return NULL;
+}
+
+/**
+ * Run the benchmark with a given number of threads and print one row of results.
+ * 
+ * @param threads       The number of threads.
+ * @param single_qps    The single thread throughput scaling is measured against, 0 to derive it from this run.
+ * @return              The throughput in queries per second, or a negative value on failure.
+ */
+static double mt_run(size_t threads, double single_qps) {
+    mt_thread *workers = calloc(threads, sizeof(mt_thread));
+    uint64_t *histogram = calloc(MT_BUCKETS, sizeof(uint64_t));
+    uint64_t queries = 0, errors = 0, init_max = 0, init_sum = 0, end;
+    double seconds, qps;
+
+    if (workers == NULL || histogram == NULL) {
+        free(workers);
+        free(histogram);
+        return -1.0;
+    }
+
+    mt_reset_mutexes();
+    pthread_barrier_init(&barrier, NULL, (unsigned int)threads);
+
+    for (size_t i = 0; i < threads; i++) {
+        workers[i].index = i;
+        if (pthread_create(&workers[i].thread, NULL, mt_worker, &workers[i]) != 0) {
+            fprintf(stderr, "Unable to start thread %zu\n", i);
+            exit(1);
+        }
+    }
+
+    for (size_t i = 0; i < threads; i++)
+        pthread_join(workers[i].thread, NULL);
+
+    end = geoip_stats_now();
+    pthread_barrier_destroy(&barrier);
+
+    for (size_t i = 0; i < threads; i++) {
+        if (workers[i].failed) {
+            free(workers);
+            free(histogram);
+            return -1.0;
+        }
+
+        queries += workers[i].queries;
+        errors += workers[i].errors;
+        init_sum += workers[i].init_ns;
+        init_max = workers[i].init_ns > init_max ? workers[i].init_ns : init_max;
+
+        for (unsigned int b = 0; b < MT_BUCKETS; b++)
+            histogram[b] += workers[i].histogram[b];
+    }
+
+    seconds = (double)(end - phase_start) / 1e9;
+    qps = seconds > 0 ? (double)queries / seconds : 0.0;
+    if (single_qps <= 0)
+        single_qps = qps / (double)threads;
+
+    printf("%7zu %12.0f %8.2f %8.0f%% %9llu %9llu %9llu %10.1f %10.1f %9llu\n",
+        threads, qps,
+        qps / single_qps, 100.0 * qps / (single_qps * (double)threads),
+        (unsigned long long)histogram_percentile(histogram, queries, 0.50),
+        (unsigned long long)histogram_percentile(histogram, queries, 0.99),
+        (unsigned long long)histogram_percentile(histogram, queries, 0.999),
+        (double)init_sum / (double)threads / 1e3, (double)init_max / 1e3,
+        (unsigned long long)errors);
+
+    free(workers);
+    free(histogram);
+    return qps;
+}
+
+static void mt_report_mutexes(void) {
+    bool contended = atomic_load(&dynamic_mutexes.contended) != 0;
+
+    for (int type = SQLITE_MUTEX_STATIC_MAIN; type < MT_STATIC_MUTEXES; type++)
+        contended |= atomic_load(&static_mutexes[type].contended) != 0;
+
+    if (!contended) {
+        printf("    no SQLite mutex contention\n");
+        return;
+    }
+
+    printf("    %-36s %12s %12s %10s %12s\n", "mutex", "enters", "contended", "rate", "wait ms");
+
+    for (int type = SQLITE_MUTEX_STATIC_MAIN; type < MT_STATIC_MUTEXES; type++) {
+        uint64_t enters = atomic_load(&static_mutexes[type].enters);
+        uint64_t contended = atomic_load(&static_mutexes[type].contended);
+
+        if (contended == 0)
+            continue;
+
+        printf("    %-36s %12llu %12llu %9.2f%% %12.2f\n", static_mutex_names[type],
+            (unsigned long long)enters, (unsigned long long)contended,
+            enters ? 100.0 * (double)contended / (double)enters : 0.0,
+            (double)atomic_load(&static_mutexes[type].wait_ns) / 1e6);
+    }
+
+    if (atomic_load(&dynamic_mutexes.contended) != 0) {
+        printf("    %-36s %12s %12llu %10s %12.2f\n", "connection and other dynamic mutexes", "-",
+            (unsigned long long)atomic_load(&dynamic_mutexes.contended), "-",
+            (double)atomic_load(&dynamic_mutexes.wait_ns) / 1e6);
+    }
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --dir PATH         Directory holding GeoLite2-ASN.mmdb and GeoLite2-City.mmdb (default: current directory)\n"
+        "  --threads LIST     Comma separated thread counts to run, one connection per thread (default: 1,2,4,8)\n"
+        "  --queries N        Queries per thread (default: 100000)\n"
+        "  --functions LIST   Comma separated functions of the query mix (default: all)\n"
+        "  --no-mutex-stats   Do not count SQLite mutex contention\n"
+        "  --replay FILE      Replay addresses from FILE, one per line, instead of a synthetic workload\n"
+        "Synthetic workload:\n",
+        argv0);
+    workload_usage(stderr);
+}
+
+int main(int argc, char **argv) {
+    workload_options options;
+    size_t runs[MT_MAX_RUNS], run_count = 0;
+    const char *dir = NULL, *replay = NULL, *thread_list = "1,2,4,8", *function_list = NULL;
+    char error[256];
+    double baseline_qps = 0.0;
+    int rc;
+
+    workload_defaults(&options);
+    queries_per_thread = 100000;
+
+    for (int i = 1; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(argv[i], "--no-mutex-stats") == 0) {
+            track_mutexes = false;
+            continue;
+        }
+
+        if (value == NULL) {
+            usage(argv[0]);
+            return 1;
+        }
+
+        if (strcmp(argv[i], "--dir") == 0)
+            dir = value;
+        else if (strcmp(argv[i], "--threads") == 0)
+            thread_list = value;
+        else if (strcmp(argv[i], "--queries") == 0)
+            queries_per_thread = strtoull(value, NULL, 10);
+        else if (strcmp(argv[i], "--functions") == 0)
+            function_list = value;
+        else if (strcmp(argv[i], "--replay") == 0)
+            replay = value;
+        else if (!workload_parse_option(&options, argv[i], value)) {
+            usage(argv[0]);
+            return 1;
+        }
+
+        i++;
+    }
+
+    for (const char *p = thread_list; *p != '\0' && run_count < MT_MAX_RUNS; p += strspn(p, ",")) {
+        char *end;
+        unsigned long threads = strtoul(p, &end, 10);
+
+        if (end == p || threads == 0 || threads > MT_MAX_THREADS) {
+            usage(argv[0]);
+            return 1;
+        }
+
+        runs[run_count++] = threads;
+        p = end;
+    }
+
+    if (function_list == NULL) {
+        function_count = sizeof(default_functions) / sizeof(default_functions[0]);
+        memcpy(functions, default_functions, sizeof(default_functions));
+    } else {
+        char *list = strdup(function_list);
+
+        for (char *save = NULL, *f = strtok_r(list, ",", &save); f != NULL && function_count < 16; f = strtok_r(NULL, ",", &save))
+            functions[function_count++] = f;
+    }
+
+    if (run_count == 0 || function_count == 0 || queries_per_thread == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    rc = replay != NULL ? workload_replay_file(replay, options.count, &stream, error, sizeof(error))
+                        : workload_generate(&options, &stream, error, sizeof(error));
+    if (rc != 0) {
+        fprintf(stderr, "%s\n", error);
+        return 1;
+    }
+
+    if (dir != NULL && chdir(dir) != 0) {
+        fprintf(stderr, "Unable to enter %s: %s\n", dir, strerror(errno));
+        return 1;
+    }
+
+    if (track_mutexes && mt_install_mutexes() != SQLITE_OK) {
+        fprintf(stderr, "Unable to install the mutex wrappers, contention is not counted\n");
+        track_mutexes = false;
+    }
+
+    /* SQLite itself is initialized up front, the extension is what has to cope with concurrent loading. */
+    if (sqlite3_initialize() != SQLITE_OK || sqlite3_threadsafe() == 0) {
+        fprintf(stderr, "SQLite failed to initialize or was built without thread safety\n");
+        return 1;
+    }
+
+    printf("workload: %zu addresses, %llu queries per thread, %zu functions\n",
+        stream.count, (unsigned long long)queries_per_thread, function_count);
+    printf("%7s %12s %8s %9s %9s %9s %9s %10s %10s %9s\n",
+        "threads", "queries/s", "speedup", "per-core", "p50 ns", "p99 ns", "p999 ns", "init us", "init max", "errors");
+
+    for (size_t r = 0; r < run_count; r++) {
+        double qps = mt_run(runs[r], baseline_qps);
+
+        if (qps < 0) {
+            fprintf(stderr, "The run with %zu threads failed\n", runs[r]);
+            return 1;
+        }
+
+        /* Scaling is reported against the first run, normalized to a single thread. */
+        if (r == 0)
+            baseline_qps = qps / (double)runs[0];
+
+        if (track_mutexes)
+            mt_report_mutexes();
+    }
+
+    workload_free(&stream);
+    return 0;
+}
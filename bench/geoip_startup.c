@@ -0,0 +1,305 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "sqlite3.h"
+
+#ifndef GEOIP_EXTENSION_PATH
+#   define GEOIP_EXTENSION_PATH "./libmaxminddb_ext"
+#endif
+
+#define STARTUP_MAX_RUNS 1000 /**< The largest number of runs per function and mode. */
+
+/**
+ * Startup cost of the extension as a short-lived process sees it.
+ * 
+ * Every run is a fresh child process that opens an in-memory connection, loads the shared extension the way `.load`
+ * does and runs a single query. It measures the load time, the resident set size after the load and after the first
+ * result, and the time to that first result. Cold runs first ask the kernel to drop the MMDB files from the page
+ * cache, warm runs find them there.
+ */
+
+/**
+ * The measurements of one run, sent from the child to the parent through a pipe.
+ */
+typedef struct startup_run {
+    double load_us;     /**< sqlite3_load_extension(). */
+    double first_us;    /**< Preparing and stepping the first query. */
+    double second_us;   /**< The same query again, for comparison with a warmed up connection. */
+    long base_kib;      /**< Resident set size before loading the extension. */
+    long load_kib;      /**< Resident set size after loading the extension. */
+    long first_kib;     /**< Resident set size after the first result. */
+    int failed;         /**< Set when any step failed, the error has been printed by the child. */
+} startup_run;
+
+static const char *const default_functions[] = { "geoip_asn_number", "geoip_country", "geoip" };
+static const char *const mmdb_files[] = { "GeoLite2-ASN.mmdb", "GeoLite2-City.mmdb" };
+
+static double now_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+/**
+ * Read the resident set size of the process.
+ * 
+ * @return  The current RSS in KiB where /proc is available, the peak RSS otherwise.
+ */
+static long rss_kib(void) {
+    FILE *statm = fopen("/proc/self/statm", "r");
+    long size, resident;
+    struct rusage usage;
+
+    if (statm != NULL) {
+        int n = fscanf(statm, "%ld %ld", &size, &resident);
+
+        fclose(statm);
+        if (n == 2)
+            return resident * (sysconf(_SC_PAGESIZE) / 1024);
+    }
+
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+/**
+ * Drop the MMDB files from the page cache, as far as the kernel lets an unprivileged process do that.
+ * 
+ * Pages still mapped by another process stay resident, so cold runs are only truly cold when nothing else has the
+ * databases open.
+ */
+static void evict_databases(void) {
+#ifdef POSIX_FADV_DONTNEED
+    for (size_t i = 0; i < sizeof(mmdb_files) / sizeof(mmdb_files[0]); i++) {
+        int fd = open(mmdb_files[i], O_RDONLY);
+
+        if (fd < 0)
+            continue;
+
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+#endif
+}
+
+static int run_query(sqlite3 *db, sqlite3_stmt *stmt) {
+    int rc = sqlite3_step(stmt);
+
+    sqlite3_reset(stmt);
+    if (rc != SQLITE_ROW) {
+        fprintf(stderr, "%s: %s\n", sqlite3_sql(stmt), sqlite3_errmsg(db));
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Measure a single startup, this runs in the child process.
+ * 
+ * The connection is never closed, closing the last one could write warm-start files and change what the next run
+ * measures.
+ */
+static void startup_child(const char *extension, const char *function, const char *ip, startup_run *run) {
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    char *errmsg = NULL, sql[128];
+    double start;
+
+    if (sqlite3_open(":memory:", &db) != SQLITE_OK) {
+        fprintf(stderr, "Unable to open a connection\n");
+        run->failed = 1;
+        return;
+    }
+
+    sqlite3_db_config(db, SQLITE_DBCONFIG_ENABLE_LOAD_EXTENSION, 1, NULL);
+    run->base_kib = rss_kib();
+
+    start = now_us();
+    if (sqlite3_load_extension(db, extension, "sqlite3_maxminddbext_init", &errmsg) != SQLITE_OK) {
+        fprintf(stderr, "Unable to load %s: %s\n", extension, errmsg ? errmsg : sqlite3_errmsg(db));
+        run->failed = 1;
+        return;
+    }
+    run->load_us = now_us() - start;
+    run->load_kib = rss_kib();
+
+    snprintf(sql, sizeof(sql), "SELECT %s(?1)", function);
+
+    start = now_us();
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "%s: %s\n", sql, sqlite3_errmsg(db));
+        run->failed = 1;
+        return;
+    }
+
+    sqlite3_bind_text(stmt, 1, ip, -1, SQLITE_STATIC);
+    if (run_query(db, stmt) != 0) {
+        run->failed = 1;
+        return;
+    }
+    run->first_us = now_us() - start;
+    run->first_kib = rss_kib();
+
+    start = now_us();
+    if (run_query(db, stmt) != 0) {
+        run->failed = 1;
+        return;
+    }
+    run->second_us = now_us() - start;
+}
+
+/**
+ * Measure a single startup in a fresh process.
+ * 
+ * @return  0 on success, -1 when the child failed.
+ */
+static int startup_run_once(const char *extension, const char *function, const char *ip, int cold, startup_run *run) {
+    int fds[2], status;
+    pid_t pid;
+
+    memset(run, 0, sizeof(*run));
+    if (cold)
+        evict_databases();
+
+    if (pipe(fds) != 0)
+        return -1;
+
+    fflush(stdout);
+    pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+
+    if (pid == 0) {
+        close(fds[0]);
+        startup_child(extension, function, ip, run);
+        if (write(fds[1], run, sizeof(*run)) != (ssize_t)sizeof(*run))
+            _exit(2);
+        _exit(run->failed);
+    }
+
+    close(fds[1]);
+    ssize_t n = read(fds[0], run, sizeof(*run));
+    close(fds[0]);
+
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0 || n != (ssize_t)sizeof(*run))
+        return -1;
+
+    return 0;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double median(double *values, int count) {
+    qsort(values, (size_t)count, sizeof(double), compare_double);
+    return count % 2 ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2.0;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "  --dir PATH         Directory holding GeoLite2-ASN.mmdb and GeoLite2-City.mmdb (default: current directory)\n"
+        "  --extension PATH   The shared extension to load (default: %s)\n"
+        "  --runs N           Processes per function and mode, the median is reported (default: 5)\n"
+        "  --functions LIST   Comma separated functions to query (default: geoip_asn_number,geoip_country,geoip)\n"
+        "  --ip ADDRESS       The address to look up (default: 1.1.1.1)\n",
+        argv0, GEOIP_EXTENSION_PATH);
+}
+
+int main(int argc, char **argv) {
+    const char *dir = NULL, *extension = GEOIP_EXTENSION_PATH, *function_list = NULL, *ip = "1.1.1.1";
+    const char *functions[16];
+    size_t function_count = 0;
+    int runs = 5;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--dir") == 0)
+            dir = argv[i + 1];
+        else if (strcmp(argv[i], "--extension") == 0)
+            extension = argv[i + 1];
+        else if (strcmp(argv[i], "--runs") == 0)
+            runs = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--functions") == 0)
+            function_list = argv[i + 1];
+        else if (strcmp(argv[i], "--ip") == 0)
+            ip = argv[i + 1];
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (argc % 2 == 0 || runs <= 0 || runs > STARTUP_MAX_RUNS) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (function_list == NULL) {
+        function_count = sizeof(default_functions) / sizeof(default_functions[0]);
+        memcpy(functions, default_functions, sizeof(default_functions));
+    } else {
+        char *list = strdup(function_list);
+
+        for (char *save = NULL, *f = strtok_r(list, ",", &save); f != NULL && function_count < 16; f = strtok_r(NULL, ",", &save))
+            functions[function_count++] = f;
+    }
+
+    /* The extension looks for the databases in the working directory of the first connection. */
+    if (dir != NULL && chdir(dir) != 0) {
+        fprintf(stderr, "Unable to enter %s: %s\n", dir, strerror(errno));
+        return 1;
+    }
+
+    printf("extension %s, %d runs per row, medians\n", extension, runs);
+    printf("%-18s %5s %10s %10s %10s %10s %12s %12s\n",
+        "function", "mode", "load us", "first us", "next us", "base KiB", "+load KiB", "+first KiB");
+
+    for (size_t f = 0; f < function_count; f++) {
+        for (int cold = 1; cold >= 0; cold--) {
+            double load[STARTUP_MAX_RUNS], first[STARTUP_MAX_RUNS], second[STARTUP_MAX_RUNS];
+            double base[STARTUP_MAX_RUNS], load_rss[STARTUP_MAX_RUNS], first_rss[STARTUP_MAX_RUNS];
+            startup_run run;
+
+            /* A warm row starts from a page cache the previous runs have filled. */
+            if (!cold && startup_run_once(extension, functions[f], ip, 0, &run) != 0)
+                return 1;
+
+            for (int i = 0; i < runs; i++) {
+                if (startup_run_once(extension, functions[f], ip, cold, &run) != 0)
+                    return 1;
+
+                load[i] = run.load_us;
+                first[i] = run.first_us;
+                second[i] = run.second_us;
+                base[i] = (double)run.base_kib;
+                load_rss[i] = (double)(run.load_kib - run.base_kib);
+                first_rss[i] = (double)(run.first_kib - run.base_kib);
+            }
+
+            printf("%-18s %5s %10.1f %10.1f %10.1f %10.0f %12.0f %12.0f\n", functions[f], cold ? "cold" : "warm",
+                median(load, runs), median(first, runs), median(second, runs),
+                median(base, runs), median(load_rss, runs), median(first_rss, runs));
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,46 @@
+add_executable(geoip_bench ${CMAKE_SOURCE_DIR}/bench/geoip_bench.c)
+target_link_libraries(geoip_bench PRIVATE maxminddb_ext_static workload)
+
+# The multi-threaded benchmark, one connection per thread.
+add_executable(geoip_mt_bench ${CMAKE_SOURCE_DIR}/bench/geoip_mt_bench.c)
+target_link_libraries(geoip_mt_bench PRIVATE maxminddb_ext_static workload Threads::Threads)
+
+if(NOT CMAKE_SYSTEM_NAME STREQUAL "Windows")
+    # Startup cost of the shared extension, loaded like `.load` does in a fresh process per run.
+    add_executable(geoip_startup ${CMAKE_SOURCE_DIR}/bench/geoip_startup.c)
+    target_include_directories(geoip_startup PRIVATE ${CMAKE_SOURCE_DIR}/source)
+    target_compile_definitions(geoip_startup PRIVATE GEOIP_EXTENSION_PATH="$<TARGET_FILE:maxminddb_ext>")
+    target_link_libraries(geoip_startup PRIVATE sqlite3)
+    add_dependencies(geoip_startup maxminddb_ext)
+
+    enable_testing()
+    include(${CMAKE_SOURCE_DIR}/cmake/Fixtures.cmake)
+    GEOIP_FIXTURES(mt_bench MT_BENCH_FIXTURES)
+
+    set(MT_BENCH_ARGS --dir ${MT_BENCH_FIXTURES} --networks ${MT_BENCH_FIXTURES}/city-networks.txt --invalid-rate 0.01)
+
+    # The same benchmark against a ThreadSanitizer build of the extension, any report fails the test.
+    if(CMAKE_C_COMPILER_ID MATCHES "GNU|Clang")
+        add_library(maxminddb_ext_tsan STATIC ${MAXMINDDB_EXT_SOURCES})
+        target_include_directories(maxminddb_ext_tsan PUBLIC ${CMAKE_SOURCE_DIR}/source)
+        target_compile_definitions(maxminddb_ext_tsan PUBLIC SQLITE_CORE)
+        target_compile_options(maxminddb_ext_tsan PUBLIC -fsanitize=thread -g)
+        target_link_options(maxminddb_ext_tsan PUBLIC -fsanitize=thread)
+        target_link_libraries(maxminddb_ext_tsan PUBLIC mmdb sqlite3 Threads::Threads ${MATH_LIBRARY})
+
+        add_executable(geoip_mt_bench_tsan ${CMAKE_SOURCE_DIR}/bench/geoip_mt_bench.c)
+        target_link_libraries(geoip_mt_bench_tsan PRIVATE maxminddb_ext_tsan workload)
+
+        add_test(NAME MT_BENCH_TSAN_TEST COMMAND geoip_mt_bench_tsan ${MT_BENCH_ARGS} --threads 1,4,16 --queries 2000)
+        set_tests_properties(MT_BENCH_TSAN_TEST PROPERTIES ENVIRONMENT "TSAN_OPTIONS=halt_on_error=1:second_deadlock_stack=1")
+    endif()
+
+    find_program(VALGRIND_FOUND NAMES valgrind)
+    if(VALGRIND_FOUND)
+        add_test(NAME MT_BENCH_HELGRIND_TEST
+            COMMAND ${VALGRIND_FOUND} --tool=helgrind --error-exitcode=1
+                --suppressions=${CMAKE_SOURCE_DIR}/bench/helgrind.supp
+                $<TARGET_FILE:geoip_mt_bench> ${MT_BENCH_ARGS} --threads 4 --queries 200 --no-mutex-stats
+        )
+    endif()
+endif()
@@ -0,0 +1,84 @@
+find_program(VALGRIND_FOUND NAMES valgrind)
+
+if(NOT VALGRIND_FOUND)
+    message(FATAL_ERROR "Valgrind is required for the Cachegrind tests, you can disable them with -DENABLE_CACHEGRIND_TESTS=OFF")
+endif()
+
+enable_testing()
+
+set(CACHEGRIND_THRESHOLD 2 CACHE STRING "Allowed growth of instructions per lookup, in percent.")
+set(CACHEGRIND_LL_THRESHOLD 10 CACHE STRING "Allowed growth of LL misses per lookup, in percent.")
+set(CACHEGRIND_LOOKUPS 20000 CACHE STRING "Number of lookups per Cachegrind test.")
+
+include(${CMAKE_SOURCE_DIR}/cmake/Fixtures.cmake)
+
+# Fixed fixtures, the seeds in Fixtures.cmake must never change or the baseline becomes meaningless.
+GEOIP_FIXTURES(cachegrind CACHEGRIND_FIXTURES)
+
+set(CACHEGRIND_RESULTS ${CMAKE_BINARY_DIR}/cachegrind)
+file(MAKE_DIRECTORY ${CACHEGRIND_RESULTS})
+
+add_executable(geoip_cachegrind ${CMAKE_SOURCE_DIR}/bench/geoip_cachegrind.c)
+target_link_libraries(geoip_cachegrind PRIVATE maxminddb_ext_static workload)
+
+# The functions the baseline has a line for, a test that compares against nothing
+# would gate nothing. Editing the baseline reconfigures the build.
+file(STRINGS ${CMAKE_SOURCE_DIR}/bench/cachegrind_baseline.txt CACHEGRIND_BASELINE REGEX "^[a-z_]+ ")
+set_property(DIRECTORY APPEND PROPERTY CMAKE_CONFIGURE_DEPENDS ${CMAKE_SOURCE_DIR}/bench/cachegrind_baseline.txt)
+
+function(CACHEGRIND_TEST FUNCTION NETWORKS)
+    string(TOUPPER ${FUNCTION} FUNCTION_UPPER)
+
+    set(CACHEGRIND_ARGS_${FUNCTION}
+        -DVALGRIND=${VALGRIND_FOUND}
+        -DDRIVER=$<TARGET_FILE:geoip_cachegrind>
+        -DFIXTURES=${CACHEGRIND_FIXTURES}
+        -DNETWORKS=${CACHEGRIND_FIXTURES}/${NETWORKS}
+        -DFUNCTION=${FUNCTION}
+        -DCOUNT=${CACHEGRIND_LOOKUPS}
+        -DRESULTS=${CACHEGRIND_RESULTS}
+    )
+    set(CACHEGRIND_ARGS_${FUNCTION} ${CACHEGRIND_ARGS_${FUNCTION}} PARENT_SCOPE)
+
+    list(FILTER CACHEGRIND_BASELINE INCLUDE REGEX "^${FUNCTION} ")
+    if(NOT CACHEGRIND_BASELINE)
+        set(CACHEGRIND_UNMEASURED ${CACHEGRIND_UNMEASURED} ${FUNCTION} PARENT_SCOPE)
+        return()
+    endif()
+
+    add_test(NAME CACHEGRIND_${FUNCTION_UPPER}_TEST
+        COMMAND ${CMAKE_COMMAND}
+            ${CACHEGRIND_ARGS_${FUNCTION}}
+            -DBASELINE=${CMAKE_SOURCE_DIR}/bench/cachegrind_baseline.txt
+            -DTHRESHOLD=${CACHEGRIND_THRESHOLD}
+            -DLL_THRESHOLD=${CACHEGRIND_LL_THRESHOLD}
+            -P ${CMAKE_SOURCE_DIR}/cmake/CachegrindCheck.cmake
+    )
+endfunction()
+
+CACHEGRIND_TEST(geoip_country city-networks.txt)
+CACHEGRIND_TEST(geoip_continent city-networks.txt)
+CACHEGRIND_TEST(geoip_city city-networks.txt)
+CACHEGRIND_TEST(geoip_state city-networks.txt)
+CACHEGRIND_TEST(geoip_timezone city-networks.txt)
+CACHEGRIND_TEST(geoip_zipcode city-networks.txt)
+CACHEGRIND_TEST(geoip_asn_owner asn-networks.txt)
+CACHEGRIND_TEST(geoip_asn_number asn-networks.txt)
+CACHEGRIND_TEST(geoip city-networks.txt)
+
+# Functions without a baseline line are not tested, `make cachegrind_baseline`
+# measures them into the results directory instead.
+set(CACHEGRIND_COMMANDS "")
+foreach(FUNCTION ${CACHEGRIND_UNMEASURED})
+    list(APPEND CACHEGRIND_COMMANDS
+        COMMAND ${CMAKE_COMMAND} ${CACHEGRIND_ARGS_${FUNCTION}} -P ${CMAKE_SOURCE_DIR}/cmake/CachegrindCheck.cmake
+    )
+endforeach()
+
+add_custom_target(cachegrind_baseline ${CACHEGRIND_COMMANDS} VERBATIM)
+add_dependencies(cachegrind_baseline geoip_cachegrind fixtures_cachegrind)
+
+if(CACHEGRIND_UNMEASURED)
+    string(REPLACE ";" ", " CACHEGRIND_UNMEASURED "${CACHEGRIND_UNMEASURED}")
+    message(STATUS "No Cachegrind baseline for ${CACHEGRIND_UNMEASURED}, measure them with the cachegrind_baseline target")
+endif()
@@ -0,0 +1,81 @@
+# Measure the instructions and LL misses per lookup of one function and compare
+# them against the committed baseline, run as a CTest script:
+#
+#   cmake -DVALGRIND=... -DDRIVER=... -DFIXTURES=... -DNETWORKS=... -DFUNCTION=...
+#         -DCOUNT=... -DBASELINE=... -DRESULTS=... -DTHRESHOLD=... -DLL_THRESHOLD=...
+#         -P CachegrindCheck.cmake
+#
+# The driver runs twice, once with and once without the lookups, so the setup
+# cost cancels out. The measurement is written to RESULTS/FUNCTION.txt in the
+# baseline format, ready to be copied into the baseline file. Without BASELINE
+# the script only records the measurement, which the cachegrind_baseline target
+# does for functions the baseline has no line for yet.
+
+function(CACHEGRIND_RUN LOOKUPS INSTRUCTIONS LL_MISSES)
+    execute_process(
+        COMMAND ${VALGRIND} --tool=cachegrind --cache-sim=yes --cachegrind-out-file=/dev/null
+            ${DRIVER} --dir ${FIXTURES} --networks ${NETWORKS} --function ${FUNCTION} --count ${COUNT} --lookups ${LOOKUPS}
+        RESULT_VARIABLE RC
+        OUTPUT_VARIABLE OUT
+        ERROR_VARIABLE ERR
+    )
+
+    if(NOT RC EQUAL 0)
+        message(FATAL_ERROR "Cachegrind run of ${FUNCTION} failed:\n${OUT}${ERR}")
+    endif()
+
+    string(REGEX MATCH "I +refs: +([0-9,]+)" MATCHED "${ERR}")
+    string(REPLACE "," "" I_REFS "${CMAKE_MATCH_1}")
+    string(REGEX MATCH "LL misses: +([0-9,]+)" MATCHED "${ERR}")
+    string(REPLACE "," "" LL "${CMAKE_MATCH_1}")
+
+    if(I_REFS STREQUAL "" OR LL STREQUAL "")
+        message(FATAL_ERROR "Unable to read the Cachegrind summary:\n${ERR}")
+    endif()
+
+    set(${INSTRUCTIONS} ${I_REFS} PARENT_SCOPE)
+    set(${LL_MISSES} ${LL} PARENT_SCOPE)
+endfunction()
+
+CACHEGRIND_RUN(0 SETUP_INSTRUCTIONS SETUP_LL)
+CACHEGRIND_RUN(1 TOTAL_INSTRUCTIONS TOTAL_LL)
+
+# Instructions per lookup, and LL misses per thousand lookups to keep some precision in integer math.
+math(EXPR INSTRUCTIONS "(${TOTAL_INSTRUCTIONS} - ${SETUP_INSTRUCTIONS}) / ${COUNT}")
+math(EXPR LL_MISSES "(${TOTAL_LL} - ${SETUP_LL}) * 1000 / ${COUNT}")
+if(LL_MISSES LESS 0)
+    set(LL_MISSES 0)
+endif()
+
+message("${FUNCTION}: ${INSTRUCTIONS} instructions per lookup, ${LL_MISSES} LL misses per 1000 lookups")
+file(WRITE ${RESULTS}/${FUNCTION}.txt "${FUNCTION} ${INSTRUCTIONS} ${LL_MISSES}\n")
+
+if(NOT DEFINED BASELINE)
+    return()
+endif()
+
+file(STRINGS ${BASELINE} BASELINE_LINE REGEX "^${FUNCTION} ")
+if(BASELINE_LINE STREQUAL "")
+    message(FATAL_ERROR "No baseline for ${FUNCTION} in ${BASELINE}, reconfigure the build")
+endif()
+
+string(REGEX MATCH "^[^ ]+ +([0-9]+) +([0-9]+)" MATCHED "${BASELINE_LINE}")
+set(BASE_INSTRUCTIONS ${CMAKE_MATCH_1})
+set(BASE_LL ${CMAKE_MATCH_2})
+
+# LL misses get one extra miss per thousand lookups of slack, small baselines would flap otherwise.
+math(EXPR MAX_INSTRUCTIONS "${BASE_INSTRUCTIONS} * (100 + ${THRESHOLD}) / 100")
+math(EXPR MAX_LL "${BASE_LL} * (100 + ${LL_THRESHOLD}) / 100 + 1")
+math(EXPR MIN_INSTRUCTIONS "${BASE_INSTRUCTIONS} * (100 - ${THRESHOLD}) / 100")
+
+if(INSTRUCTIONS GREATER MAX_INSTRUCTIONS)
+    message(FATAL_ERROR "${FUNCTION} regressed: ${INSTRUCTIONS} instructions per lookup, the baseline is ${BASE_INSTRUCTIONS} (+${THRESHOLD}% allowed)")
+endif()
+
+if(LL_MISSES GREATER MAX_LL)
+    message(FATAL_ERROR "${FUNCTION} regressed: ${LL_MISSES} LL misses per 1000 lookups, the baseline is ${BASE_LL} (+${LL_THRESHOLD}% allowed)")
+endif()
+
+if(INSTRUCTIONS LESS MIN_INSTRUCTIONS)
+    message("${FUNCTION} improved beyond the threshold, consider updating ${BASELINE}")
+endif()
@@ -0,0 +1,21 @@
+include_guard(GLOBAL)
+
+# Generate the synthetic GeoLite2-City.mmdb and GeoLite2-ASN.mmdb fixtures, along
+# with the networks they hold, into <build>/fixtures/NAME. Every consumer gets
+# its own directory, warm-start files saved next to the databases must not leak
+# from one test into another. The seeds
+# are fixed, so every directory holds identical databases.
+function(GEOIP_FIXTURES NAME OUTDIR)
+    set(DIR ${CMAKE_BINARY_DIR}/fixtures/${NAME})
+
+    add_custom_command(
+        OUTPUT ${DIR}/GeoLite2-City.mmdb ${DIR}/city-networks.txt ${DIR}/GeoLite2-ASN.mmdb ${DIR}/asn-networks.txt
+        COMMAND ${CMAKE_COMMAND} -E make_directory ${DIR}
+        COMMAND mmdb_gen --kind city --networks 50000 --seed 1 --list ${DIR}/city-networks.txt ${DIR}/GeoLite2-City.mmdb
+        COMMAND mmdb_gen --kind asn --networks 20000 --seed 2 --list ${DIR}/asn-networks.txt ${DIR}/GeoLite2-ASN.mmdb
+        DEPENDS mmdb_gen
+    )
+    add_custom_target(fixtures_${NAME} ALL DEPENDS ${DIR}/GeoLite2-City.mmdb ${DIR}/GeoLite2-ASN.mmdb)
+
+    set(${OUTDIR} ${DIR} PARENT_SCOPE)
+endfunction()
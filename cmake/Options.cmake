@@ -4,11 +4,23 @@ option(GIT_PULL_LIBMAXMINDDB "Automatically retrieve the libmaxminddb source cod
 # Create an option for enabling Valgrind testing.
 option(ENABLE_VALGRIND_TESTS "Perform Valgrind memory leak tests." ON)
 
+# Create an option for enabling Cachegrind instruction-count regression tests.
+option(ENABLE_CACHEGRIND_TESTS "Fail when instructions or LL misses per lookup regress against bench/cachegrind_baseline.txt." ON)
+
 # Create an option for enabling CPPCheck code formatting tests.
 option(ENABLE_CPPCHECK_TESTS "Perform CPPCheck code analysis." ON)
 
 # Create an option for enabling SQLite3 extension testing.
-option(ENABLE_SQLITE3_TESTS "Perform multiple SQLite3 queries on known public IP addresses." ON)
+option(ENABLE_SQLITE3_TESTS "Check the results of the SQL functions against synthetic fixture databases." ON)
+
+# Compile USDT static tracepoints into the lookup hot path.
+option(ENABLE_USDT_PROBES "Compile USDT probes that bpftrace/perf can attach to at runtime." OFF)
+
+# Build the synthetic MMDB writer used for benchmark and test fixtures.
+option(ENABLE_TOOLS "Build the mmdb_gen synthetic database generator." ON)
+
+# Build the geoip_bench microbenchmark executable.
+option(ENABLE_BENCHMARKS "Build the geoip_bench microbenchmark suite." OFF)
 
 # Enable Doxygen to generate documentation from the code.
 option(USE_DOXYGEN "Run Doxygen to generate documentation." OFF)
@@ -16,6 +28,7 @@ option(USE_DOXYGEN "Run Doxygen to generate documentation." OFF)
 # Disable tests and checks for release builds
 if(CMAKE_BUILD_TYPE STREQUAL "Release")
     set(ENABLE_VALGRIND_TESTS OFF)
+    set(ENABLE_CACHEGRIND_TESTS OFF)
     set(ENABLE_CPPCHECK_TESTS OFF)
     set(ENABLE_SQLITE3_TESTS OFF)
 endif()
@@ -64,9 +77,8 @@ if(ENABLE_CPPCHECK_TESTS)
     include(${CMAKE_SOURCE_DIR}/cmake/CPPCheck.cmake)
 endif()
 
-if(ENABLE_SQLITE3_TESTS)
-    # TODO: Incorporate testing method that runs multiple
-    #       SQLite queries retrieve and check the output.
+if(ENABLE_USDT_PROBES)
+    include(${CMAKE_SOURCE_DIR}/cmake/USDT.cmake)
 endif()
 
 if(USE_DOXYGEN)
@@ -0,0 +1,48 @@
+enable_testing()
+
+include(${CMAKE_SOURCE_DIR}/cmake/Fixtures.cmake)
+
+add_executable(geoip_sql_test ${CMAKE_SOURCE_DIR}/tests/geoip_sql_test.c)
+target_link_libraries(geoip_sql_test PRIVATE maxminddb_ext_static)
+
+# Run tests/NAME.sql against fixtures of its own, every row it returns is a check
+# that fails unless its last column is 1.
+function(SQLITE3_TEST NAME)
+    string(TOUPPER ${NAME} NAME_UPPER)
+
+    GEOIP_FIXTURES(sqlite3_${NAME} FIXTURES)
+    add_test(NAME SQLITE3_${NAME_UPPER}_TEST
+        COMMAND geoip_sql_test --dir ${FIXTURES} ${CMAKE_SOURCE_DIR}/tests/${NAME}.sql
+    )
+endfunction()
+
+SQLITE3_TEST(cidr)
+SQLITE3_TEST(predicates)
+SQLITE3_TEST(summary)
+SQLITE3_TEST(near)
+SQLITE3_TEST(pack)
+SQLITE3_TEST(policy)
+SQLITE3_TEST(walks)
+SQLITE3_TEST(registry)
+SQLITE3_TEST(reserved)
+SQLITE3_TEST(warm)
+SQLITE3_TEST(stats)
+SQLITE3_TEST(explain)
+
+# walks.sql compares the lookups of every search tree layout, on City databases
+# of every record size and on an IPv4-only one.
+set(WALKS_FIXTURES ${CMAKE_BINARY_DIR}/fixtures/sqlite3_walks)
+set(WALKS_DATABASES
+    ${WALKS_FIXTURES}/walk-24.mmdb ${WALKS_FIXTURES}/walk-28.mmdb
+    ${WALKS_FIXTURES}/walk-32.mmdb ${WALKS_FIXTURES}/walk-v4.mmdb
+)
+add_custom_command(
+    OUTPUT ${WALKS_DATABASES}
+    COMMAND ${CMAKE_COMMAND} -E make_directory ${WALKS_FIXTURES}
+    COMMAND mmdb_gen --networks 20000 --record-size 24 --seed 3 ${WALKS_FIXTURES}/walk-24.mmdb
+    COMMAND mmdb_gen --networks 20000 --record-size 28 --seed 4 ${WALKS_FIXTURES}/walk-28.mmdb
+    COMMAND mmdb_gen --networks 20000 --record-size 32 --seed 5 ${WALKS_FIXTURES}/walk-32.mmdb
+    COMMAND mmdb_gen --networks 20000 --ip-version 4 --seed 6 ${WALKS_FIXTURES}/walk-v4.mmdb
+    DEPENDS mmdb_gen
+)
+add_custom_target(fixtures_sqlite3_walks_layouts ALL DEPENDS ${WALKS_DATABASES})
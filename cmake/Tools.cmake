@@ -0,0 +1,26 @@
+# The synthetic MMDB writer, a library so the benchmarks and tests can
+# generate their own fixtures, and the mmdb_gen command line front end.
+add_library(mmdb_writer STATIC ${CMAKE_SOURCE_DIR}/tools/mmdb_writer.c)
+target_include_directories(mmdb_writer PUBLIC ${CMAKE_SOURCE_DIR}/tools)
+
+if(CMAKE_SYSTEM_NAME STREQUAL "Windows")
+    target_link_libraries(mmdb_writer PUBLIC ws2_32)
+endif()
+
+add_executable(mmdb_gen ${CMAKE_SOURCE_DIR}/tools/mmdb_gen.c)
+target_link_libraries(mmdb_gen PRIVATE mmdb_writer)
+
+# The lookup stream generator shared by the benchmarks, and its command line
+# front end that writes or replays streams.
+add_library(workload STATIC ${CMAKE_SOURCE_DIR}/tools/workload.c)
+target_include_directories(workload PUBLIC ${CMAKE_SOURCE_DIR}/tools PRIVATE ${CMAKE_SOURCE_DIR}/source)
+target_link_libraries(workload PUBLIC sqlite3)
+
+if(CMAKE_SYSTEM_NAME STREQUAL "Windows")
+    target_link_libraries(workload PUBLIC ws2_32)
+else()
+    target_link_libraries(workload PUBLIC m)
+endif()
+
+add_executable(geoip_workload ${CMAKE_SOURCE_DIR}/tools/geoip_workload.c)
+target_link_libraries(geoip_workload PRIVATE workload)
@@ -0,0 +1,10 @@
+include(CheckIncludeFile)
+check_include_file(sys/sdt.h HAVE_SYS_SDT_H)
+
+if(NOT HAVE_SYS_SDT_H)
+    message(FATAL_ERROR "sys/sdt.h is required for USDT probes (install systemtap-sdt-dev or systemtap-sdt-devel), you can disable the probes with -DENABLE_USDT_PROBES=OFF")
+endif()
+
+message("Compiling USDT probes into the lookup hot path")
+
+add_compile_definitions(GEOIP_USDT_PROBES)
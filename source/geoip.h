@@ -0,0 +1,134 @@
+#ifndef GEOIP_H
+#define GEOIP_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "maxminddb.h"
+
+#ifdef _WIN32
+#   define MSG_ERRGETADDRINFO "Error from getaddrinfo for %s - %ws"
+#   define HOMEENVNAME "HOMEPATH"
+#   define DLLFUNC __declspec(dllexport)
+#   define PATH_MAX 260
+#   include <Ws2tcpip.h>
+#   include <direct.h>
+#else
+#   define MSG_ERRGETADDRINFO "Error from getaddrinfo for %s - %s"
+#   define HOMEENVNAME "HOME"
+#   define DLLFUNC
+#   include <linux/limits.h>
+#   include <arpa/inet.h>
+#   include <unistd.h>
+#endif
+
+#include "geoip_cache.h"
+#include "geoip_class.h"
+#include "geoip_geo.h"
+#include "geoip_index.h"
+#include "geoip_ip.h"
+#include "geoip_json.h"
+#include "geoip_memo.h"
+#include "geoip_mmap.h"
+#include "geoip_pack.h"
+#include "geoip_records.h"
+#include "geoip_set.h"
+#include "geoip_stats.h"
+#include "geoip_summary.h"
+#include "geoip_tree.h"
+
+#define MSG_NOTINITIALIZED "sqlite-maxminddb is not initialized"
+#define MSG_ERRLIBMAXMIND  "Got an error from libmaxminddb: %s"
+#define MSG_UNKNOWNDB      "Unknown database, expected 'asn', 'city' or an alias given to geoip_open"
+#define GEOIP_DB_MAX       16 /**< The number of databases that can be registered at once, the two built-in ones included. */
+#define GEOIP_ALIAS_MAX    32 /**< The size of a database alias, including the terminating NUL. */
+#define GEOIP_PATH_MAX     16 /**< The number of components a "geoip_get" path may have. */
+#define GEOIP_JSON_SUBTYPE 'J' /**< The subtype SQLite's JSON functions use to recognize JSON text. */
+
+/**
+ * A parsed IP address.
+ * 
+ * IPv4 addresses are stored IPv4-mapped (::ffff:a.b.c.d) so both families share one 16 byte representation.
+ */
+typedef struct geoip_addr {
+    uint8_t bytes[16]; /**< The address in network byte order. */
+    int family;        /**< Either AF_INET or AF_INET6, the family the address was written in. */
+} geoip_addr;
+
+/**
+ * The life cycle of a geoip_db, databases are only opened once a function needs them.
+ */
+enum {
+    GEOIP_DB_CLOSED, /**< Not opened yet. */
+    GEOIP_DB_OPEN,   /**< Opened successfully, the handle and the cache are ready. */
+    GEOIP_DB_FAILED  /**< Opening failed, the MMDB_* error is kept in geoip_db.status. */
+};
+
+/**
+ * An MMDB file along with the state this extension keeps next to it.
+ */
+typedef struct geoip_db {
+    MMDB_s mmdb;                 /**< The libmaxminddb handle. */
+    const char *name;            /**< A short human-readable name used in diagnostics. */
+    const char *filename;        /**< The file name of a built-in MMDB file within the working directory of the first connection. */
+    char path[PATH_MAX];         /**< The location of the MMDB file on disk. */
+    char alias[GEOIP_ALIAS_MAX]; /**< The name SQL functions know the database by. */
+    uint32_t cache_slots;        /**< The number of lookup cache slots, 0 for GEOIP_CACHE_SLOTS. */
+    geoip_cache cache;           /**< The lookup cache sitting in front of the search tree. */
+    geoip_mmap map;              /**< How the mapping of the file is advised, locked and warmed up. */
+    geoip_tree tree;             /**< The blocked relayout of the search tree lookups walk instead of the file, when built. */
+    geoip_walker walk;           /**< The search tree walks matching the record size and layout, picked when the file is opened. */
+    atomic_bool reject_reserved; /**< Whether lookups of non-public addresses return not found without a walk. */
+    atomic_bool warm_start;      /**< Whether the lookup cache is written to its warm-start file when the last connection closes. */
+    _Atomic(geoip_index *) index[GEOIP_INDEX_FIELDS]; /**< The inverted indexes "geoip_networks_by" built, by GEOIP_INDEX_*. */
+    _Atomic(geoip_geo *) geo;    /**< The grid of record coordinates "geoip_networks_near" built. */
+    atomic_int state;            /**< A GEOIP_DB_* value. */
+    int status;                  /**< The MMDB_* result of opening the file, valid once state is no longer GEOIP_DB_CLOSED. */
+    struct geoip_db *next;       /**< The next database closed by "geoip_close" whose memory is not released yet. */
+} geoip_db;
+
+/**
+ * What the lookup functions return for input that is not an address they can look up.
+ */
+enum {
+    GEOIP_POLICY_STRICT,   /**< Raise an error describing the input, which aborts the statement. */
+    GEOIP_POLICY_NULL,     /**< Return NULL, like an address that is not in the database. */
+    GEOIP_POLICY_SENTINEL, /**< Return the sentinel text of the connection. */
+    GEOIP_POLICY_COUNT     /**< The number of policies. */
+};
+
+/**
+ * The state this extension keeps per SQLite connection, the user data of its lookup functions.
+ */
+typedef struct geoip_conn {
+    uint8_t policy[GEOIP_STAT_COUNT]; /**< The GEOIP_POLICY_* value of every function, indexed by GEOIP_STAT_*. */
+    char sentinel[64];                /**< The text returned under GEOIP_POLICY_SENTINEL. */
+    geoip_json_cache json;            /**< The records "geoip_json" serialized last. */
+} geoip_conn;
+
+extern bool initialized; /**< Whether the first connection has settled where the databases live. */
+extern geoip_db db_asn;  /**< The GeoLite2-ASN database. */
+extern geoip_db db_cnt;  /**< The GeoLite2-City database. */
+
+geoip_db *geoip_db_find(const char *name);
+geoip_db *geoip_db_at(int index);
+int geoip_db_acquire(geoip_db *db);
+void geoip_db_release(geoip_db *db);
+void geoip_registry_release(void);
+int geoip_registry_register(sqlite3 *db);
+int geoip_parse_address(const char *ipaddress, geoip_addr *addr);
+int geoip_lookup(geoip_db *db, const geoip_addr *addr, MMDB_lookup_result_s *result, int function);
+
+/**
+ * Walk the search tree of an opened database for an address, bypassing the lookup cache.
+ * 
+ * @param db        The opened database.
+ * @param addr      The parsed address.
+ * @param result    Receives the lookup result.
+ * @return          MMDB_SUCCESS or a libmaxminddb error code.
+ */
+static inline int geoip_tree_walk(const geoip_db *db, const geoip_addr *addr, MMDB_lookup_result_s *result) {
+    return (addr->family == AF_INET ? db->walk.ipv4 : db->walk.ipv6)(db, addr, result);
+}
+
+#endif /* GEOIP_H */
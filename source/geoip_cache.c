@@ -0,0 +1,396 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "geoip.h"
+
+#ifndef _WIN32
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#endif
+
+#define CACHE_VALID (1ULL << 40) /**< The slot holds a result. */
+#define CACHE_FOUND (1ULL << 41) /**< The cached lookup found an entry. */
+#define CACHE_IPV4  (1ULL << 42) /**< The cached address was written as IPv4. */
+
+/**
+ * Hash an address into a slot index.
+ * 
+ * @param hi    The first half of the address.
+ * @param lo    The second half of the address.
+ * @return      A well mixed 32-bit hash.
+ */
+static inline uint32_t cache_hash(uint64_t hi, uint64_t lo) {
+    uint64_t h = hi ^ (lo * 0x9E3779B97F4A7C15ULL);
+
+    h ^= h >> 29;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 32;
+    return (uint32_t)h;
+}
+
+/**
+ * Compare two warm-start entries by address and then by family.
+ * 
+ * @param a     The first geoip_warm_entry.
+ * @param b     The second geoip_warm_entry.
+ * @return      A negative, zero or positive value like memcmp.
+ */
+static int warm_compare(const void *a, const void *b) {
+    const geoip_warm_entry *x = a;
+    const geoip_warm_entry *y = b;
+    int cmp = memcmp(x->key, y->key, sizeof(x->key));
+
+    if (cmp != 0)
+        return cmp;
+
+    return (int)(x->flags & GEOIP_WARM_IPV4) - (int)(y->flags & GEOIP_WARM_IPV4);
+}
+
+/**
+ * Binary search the warm-start entries for an address.
+ * 
+ * @param cache The cache owning the warm-start mapping.
+ * @param probe An entry holding the address and family to look for.
+ * @return      The matching entry or NULL.
+ */
+static const geoip_warm_entry *warm_find(const geoip_cache *cache, const geoip_warm_entry *probe) {
+    if (cache->warm_entries == NULL)
+        return NULL;
+
+    return bsearch(probe, cache->warm_entries, cache->warm_count, sizeof(geoip_warm_entry), warm_compare);
+}
+
+/**
+ * Allocate the live table of a lookup cache.
+ * 
+ * @param cache The cache to set up.
+ * @param slots The number of slots, rounded up to a power of two.
+ * @return      0 on success, -1 if the table could not be allocated.
+ */
+int geoip_cache_init(geoip_cache *cache, uint32_t slots) {
+    uint32_t size = 1;
+
+    while (size < slots && size < (1U << 31))
+        size <<= 1;
+
+    memset(cache, 0, sizeof(*cache));
+    cache->slots = calloc(size, sizeof(geoip_cache_slot));
+    if (cache->slots == NULL)
+        return -1;
+
+    cache->mask = size - 1;
+    return 0;
+}
+
+/**
+ * Release the live table and unmap the warm-start file of a lookup cache.
+ * 
+ * @param cache The cache to tear down.
+ */
+void geoip_cache_free(geoip_cache *cache) {
+    free(cache->slots);
+
+    if (cache->warm_map != NULL) {
+    #ifdef _WIN32
+        free(cache->warm_map);
+    #else
+        munmap(cache->warm_map, cache->warm_size);
+    #endif
+    }
+
+    memset(cache, 0, sizeof(*cache));
+}
+
+/**
+ * Look an address up in the cache.
+ * 
+ * The live table is checked first, a miss there falls back to the warm-start file and promotes the entry it finds.
+ * The entry's mmdb pointer is left for the caller to fill in.
+ * 
+ * @param cache     The cache to search.
+ * @param addr      The address to look for.
+ * @param result    Receives the cached lookup result on a hit.
+ * @return          true on a hit.
+ */
+bool geoip_cache_get(geoip_cache *cache, const geoip_addr *addr, MMDB_lookup_result_s *result) {
+    uint64_t hi, lo;
+
+    if (cache->slots == NULL)
+        return false;
+
+    memcpy(&hi, addr->bytes, 8);
+    memcpy(&lo, addr->bytes + 8, 8);
+
+    const uint64_t family = addr->family == AF_INET ? CACHE_IPV4 : 0;
+    geoip_cache_slot *slot = &cache->slots[cache_hash(hi, lo) & cache->mask];
+    uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+    if ((seq & 1) == 0) {
+        uint64_t key_hi = atomic_load_explicit(&slot->key_hi, memory_order_relaxed);
+        uint64_t key_lo = atomic_load_explicit(&slot->key_lo, memory_order_relaxed);
+        uint64_t value = atomic_load_explicit(&slot->value, memory_order_relaxed);
+
+        atomic_thread_fence(memory_order_acquire);
+        if (seq == atomic_load_explicit(&slot->seq, memory_order_relaxed) &&
+            (value & CACHE_VALID) && (value & CACHE_IPV4) == family && key_hi == hi && key_lo == lo) {
+            result->found_entry = (value & CACHE_FOUND) != 0;
+            result->netmask = (uint16_t)((value >> 32) & 0xFF);
+            result->entry.offset = (uint32_t)value;
+            return true;
+        }
+    }
+
+    geoip_warm_entry probe;
+    memcpy(probe.key, addr->bytes, sizeof(probe.key));
+    probe.flags = family ? GEOIP_WARM_IPV4 : 0;
+
+    const geoip_warm_entry *warm = warm_find(cache, &probe);
+    if (warm == NULL)
+        return false;
+
+    result->found_entry = (warm->flags & GEOIP_WARM_FOUND) != 0;
+    result->netmask = warm->netmask;
+    result->entry.offset = warm->offset;
+    geoip_cache_put(cache, addr, result);
+    return true;
+}
+
+/**
+ * Store a lookup result in the cache.
+ * 
+ * Writers claim a slot by making its sequence counter odd, if another writer holds it the result is dropped.
+ * 
+ * @param cache     The cache to update.
+ * @param addr      The address that was looked up.
+ * @param result    The result of the search tree walk.
+ */
+void geoip_cache_put(geoip_cache *cache, const geoip_addr *addr, const MMDB_lookup_result_s *result) {
+    uint64_t hi, lo;
+
+    if (cache->slots == NULL)
+        return;
+
+    memcpy(&hi, addr->bytes, 8);
+    memcpy(&lo, addr->bytes + 8, 8);
+
+    geoip_cache_slot *slot = &cache->slots[cache_hash(hi, lo) & cache->mask];
+    uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+
+    if ((seq & 1) || !atomic_compare_exchange_strong_explicit(&slot->seq, &seq, seq + 1, memory_order_acquire, memory_order_relaxed))
+        return;
+
+    uint64_t value = CACHE_VALID | ((uint64_t)(result->netmask & 0xFF) << 32);
+    if (result->found_entry)
+        value |= CACHE_FOUND | result->entry.offset;
+    if (addr->family == AF_INET)
+        value |= CACHE_IPV4;
+
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&slot->key_hi, hi, memory_order_relaxed);
+    atomic_store_explicit(&slot->key_lo, lo, memory_order_relaxed);
+    atomic_store_explicit(&slot->value, value, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+}
+
+/**
+ * Map a warm-start file read-only and attach it to a cache.
+ * 
+ * The file is only attached if it was written for the same build of the MMDB file, nothing is read up front
+ * apart from the header so the pages are faulted in as lookups touch them.
+ * 
+ * @param cache The cache to attach the file to.
+ * @param path  The location of the warm-start file.
+ * @param mmdb  The opened MMDB file the cache belongs to.
+ * @return      The number of entries attached, or -1 if the file is missing, stale or malformed.
+ */
+int geoip_cache_load(geoip_cache *cache, const char *path, const MMDB_s *mmdb) {
+    void *map = NULL;
+    size_t size = 0;
+
+#ifdef _WIN32
+    FILE *fp = fopen(path, "rb");
+    if (fp == NULL)
+        return -1;
+
+    if (fseek(fp, 0, SEEK_END) == 0) {
+        long length = ftell(fp);
+
+        if (length > 0 && fseek(fp, 0, SEEK_SET) == 0 && (map = malloc((size_t)length)) != NULL) {
+            size = (size_t)length;
+            if (fread(map, 1, size, fp) != size) {
+                free(map);
+                map = NULL;
+            }
+        }
+    }
+
+    fclose(fp);
+    if (map == NULL)
+        return -1;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(geoip_warm_header)) {
+        close(fd);
+        return -1;
+    }
+
+    size = (size_t)st.st_size;
+    map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED)
+        return -1;
+
+    madvise(map, size, MADV_RANDOM);
+#endif
+
+    const geoip_warm_header *header = map;
+    const geoip_warm_entry *entries = (const geoip_warm_entry *)(header + 1);
+    bool valid = size >= sizeof(*header) &&
+        memcmp(header->magic, GEOIP_WARM_MAGIC, sizeof(header->magic)) == 0 &&
+        header->version == GEOIP_WARM_VERSION &&
+        header->build_epoch == mmdb->metadata.build_epoch &&
+        header->node_count == mmdb->metadata.node_count &&
+        size == sizeof(*header) + (size_t)header->count * sizeof(geoip_warm_entry);
+
+    if (!valid) {
+    #ifdef _WIN32
+        free(map);
+    #else
+        munmap(map, size);
+    #endif
+        return -1;
+    }
+
+    cache->warm_map = map;
+    cache->warm_size = size;
+    cache->warm_entries = entries;
+    cache->warm_count = header->count;
+    return (int)header->count;
+}
+
+/**
+ * Copy the hot set of a cache into the content of a warm-start file.
+ * 
+ * Every result in the live table is taken, topped up with entries of the attached warm-start file that were not
+ * touched since it was loaded, up to the size of the live table. The cache may be released once this returns, the
+ * snapshot is written out by geoip_cache_write().
+ * 
+ * @param cache     The cache to dump.
+ * @param mmdb      The opened MMDB file the cache belongs to.
+ * @param snapshot  Receives the header and the entries of the file.
+ * @return          0 on success, or -1 on failure.
+ */
+int geoip_cache_snapshot(const geoip_cache *cache, const MMDB_s *mmdb, geoip_warm_snapshot *snapshot) {
+    const uint32_t capacity = cache->mask + 1;
+    geoip_warm_entry *entries;
+    uint32_t count = 0;
+
+    if (cache->slots == NULL)
+        return -1;
+
+    entries = malloc((size_t)capacity * sizeof(geoip_warm_entry));
+    if (entries == NULL)
+        return -1;
+
+    for (uint32_t i = 0; i < capacity; i++) {
+        geoip_cache_slot *slot = &cache->slots[i];
+        uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+        if (seq & 1)
+            continue;
+
+        uint64_t hi = atomic_load_explicit(&slot->key_hi, memory_order_relaxed);
+        uint64_t lo = atomic_load_explicit(&slot->key_lo, memory_order_relaxed);
+        uint64_t value = atomic_load_explicit(&slot->value, memory_order_relaxed);
+
+        atomic_thread_fence(memory_order_acquire);
+        if (seq != atomic_load_explicit(&slot->seq, memory_order_relaxed) || !(value & CACHE_VALID))
+            continue;
+
+        geoip_warm_entry *entry = &entries[count++];
+        memset(entry, 0, sizeof(*entry));
+        memcpy(entry->key, &hi, 8);
+        memcpy(entry->key + 8, &lo, 8);
+        entry->offset = (uint32_t)value;
+        entry->netmask = (uint8_t)(value >> 32);
+        entry->flags = (uint8_t)(((value & CACHE_FOUND) ? GEOIP_WARM_FOUND : 0) | ((value & CACHE_IPV4) ? GEOIP_WARM_IPV4 : 0));
+    }
+
+    qsort(entries, count, sizeof(geoip_warm_entry), warm_compare);
+
+    const uint32_t live = count;
+    for (uint32_t i = 0; i < cache->warm_count && count < capacity; i++) {
+        if (bsearch(&cache->warm_entries[i], entries, live, sizeof(geoip_warm_entry), warm_compare) == NULL)
+            entries[count++] = cache->warm_entries[i];
+    }
+
+    if (count != live)
+        qsort(entries, count, sizeof(geoip_warm_entry), warm_compare);
+
+    geoip_warm_header *header = &snapshot->header;
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, GEOIP_WARM_MAGIC, sizeof(header->magic));
+    header->version = GEOIP_WARM_VERSION;
+    header->count = count;
+    header->build_epoch = mmdb->metadata.build_epoch;
+    header->node_count = mmdb->metadata.node_count;
+
+    snapshot->entries = entries;
+    return 0;
+}
+
+/**
+ * Write a snapshot of a cache to a warm-start file and release its entries.
+ * 
+ * The file is written next to its final location and renamed over it so a reader never sees a partial file. Callers
+ * must serialize writes of the same path.
+ * 
+ * @param snapshot  The snapshot geoip_cache_snapshot() took, its entries are freed whatever the outcome.
+ * @param path      The location of the warm-start file.
+ * @return          The number of entries written, or -1 on failure.
+ */
+int geoip_cache_write(geoip_warm_snapshot *snapshot, const char *path) {
+    const uint32_t count = snapshot->header.count;
+    geoip_warm_entry *entries = snapshot->entries;
+
+    snapshot->entries = NULL;
+
+    char tmppath[PATH_MAX];
+    if (snprintf(tmppath, sizeof(tmppath), "%s.tmp", path) >= (int)sizeof(tmppath)) {
+        free(entries);
+        return -1;
+    }
+
+    FILE *fp = fopen(tmppath, "wb");
+    if (fp == NULL) {
+        free(entries);
+        return -1;
+    }
+
+    bool written = fwrite(&snapshot->header, sizeof(snapshot->header), 1, fp) == 1 &&
+        fwrite(entries, sizeof(geoip_warm_entry), count, fp) == count;
+
+    free(entries);
+
+    if (fclose(fp) != 0 || !written) {
+        remove(tmppath);
+        return -1;
+    }
+
+#ifdef _WIN32
+    remove(path);
+#endif
+
+    if (rename(tmppath, path) != 0) {
+        remove(tmppath);
+        return -1;
+    }
+
+    return (int)count;
+}
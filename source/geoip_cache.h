@@ -0,0 +1,84 @@
+#ifndef GEOIP_CACHE_H
+#define GEOIP_CACHE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "maxminddb.h"
+
+#define GEOIP_CACHE_SLOTS   65536      /**< The default number of slots in a lookup cache, must be a power of two. */
+#define GEOIP_WARM_SUFFIX   ".warm"    /**< The suffix appended to the alias of a database to name its warm-start file. */
+#define GEOIP_WARM_MAGIC    "MMDBWARM" /**< The first eight bytes of every warm-start file. */
+#define GEOIP_WARM_VERSION  1          /**< The warm-start file format version, also used to detect a foreign byte order. */
+
+typedef struct geoip_addr geoip_addr;
+
+/**
+ * A single lookup cache slot.
+ * 
+ * Slots are guarded by a sequence counter so that readers never block and writers never wait on each other,
+ * a writer that finds a slot busy simply skips caching its result.
+ */
+typedef struct geoip_cache_slot {
+    _Atomic uint64_t seq;    /**< Odd while a writer is updating the slot. */
+    _Atomic uint64_t key_hi; /**< The first half of the address. */
+    _Atomic uint64_t key_lo; /**< The second half of the address. */
+    _Atomic uint64_t value;  /**< The data section offset, netmask and flags of the cached result. */
+} geoip_cache_slot;
+
+/**
+ * The on-disk header of a warm-start file, stored in native byte order.
+ */
+typedef struct geoip_warm_header {
+    char magic[8];        /**< Always GEOIP_WARM_MAGIC. */
+    uint32_t version;     /**< Always GEOIP_WARM_VERSION. */
+    uint32_t count;       /**< The number of entries following the header. */
+    uint64_t build_epoch; /**< The build epoch of the MMDB file the entries were taken from. */
+    uint32_t node_count;  /**< The search tree node count of the MMDB file, a second guard against a mismatched file. */
+    uint32_t reserved;    /**< Padding, always zero. */
+} geoip_warm_header;
+
+/**
+ * A single warm-start entry, entries are sorted by address and family so they can be binary searched in place.
+ */
+typedef struct geoip_warm_entry {
+    uint8_t key[16];  /**< The address in network byte order. */
+    uint32_t offset;  /**< The data section offset of the record. */
+    uint8_t netmask;  /**< The netmask reported by the lookup. */
+    uint8_t flags;    /**< GEOIP_WARM_FOUND and GEOIP_WARM_IPV4. */
+    uint8_t pad[2];   /**< Padding, always zero. */
+} geoip_warm_entry;
+
+#define GEOIP_WARM_FOUND 0x01 /**< The cached lookup found an entry. */
+#define GEOIP_WARM_IPV4  0x02 /**< The cached address was written as IPv4. */
+
+/**
+ * The content of a warm-start file, copied out of a cache so it can be written without holding on to the cache.
+ */
+typedef struct geoip_warm_snapshot {
+    geoip_warm_header header;  /**< The header of the file. */
+    geoip_warm_entry *entries; /**< The header.count entries of the file, allocated with malloc(). */
+} geoip_warm_snapshot;
+
+/**
+ * A fixed-size, direct-mapped cache of search tree results backed by an optional read-only warm-start file.
+ */
+typedef struct geoip_cache {
+    geoip_cache_slot *slots;              /**< The live cache table. */
+    uint32_t mask;                        /**< The number of slots minus one. */
+    const geoip_warm_entry *warm_entries; /**< The entries of the mapped warm-start file, NULL when none was loaded. */
+    uint32_t warm_count;                  /**< The number of entries in the warm-start file. */
+    void *warm_map;                       /**< The base of the warm-start file mapping. */
+    size_t warm_size;                     /**< The size of the warm-start file mapping. */
+} geoip_cache;
+
+int geoip_cache_init(geoip_cache *cache, uint32_t slots);
+void geoip_cache_free(geoip_cache *cache);
+bool geoip_cache_get(geoip_cache *cache, const geoip_addr *addr, MMDB_lookup_result_s *result);
+void geoip_cache_put(geoip_cache *cache, const geoip_addr *addr, const MMDB_lookup_result_s *result);
+int geoip_cache_load(geoip_cache *cache, const char *path, const MMDB_s *mmdb);
+int geoip_cache_snapshot(const geoip_cache *cache, const MMDB_s *mmdb, geoip_warm_snapshot *snapshot);
+int geoip_cache_write(geoip_warm_snapshot *snapshot, const char *path);
+
+#endif /* GEOIP_CACHE_H */
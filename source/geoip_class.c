@@ -0,0 +1,237 @@
+#include <stdint.h>
+#include "geoip.h"
+#include <sqlite3ext.h>
+SQLITE_EXTENSION_INIT3
+
+/**
+ * A special-purpose block, as a prefix of the 16 byte address form IPv4 addresses are mapped into.
+ */
+typedef struct class_prefix {
+    uint64_t hi;     /**< The first eight bytes of the prefix. */
+    uint64_t lo;     /**< The last eight bytes of the prefix. */
+    uint8_t length;  /**< The prefix length in bits, out of 128. */
+    uint8_t cls;     /**< The GEOIP_CLASS_* value of the block. */
+} class_prefix;
+
+/* IPv4 blocks live under ::ffff:0:0/96, 96 bits in front of their own prefix length. */
+#define CLASS_V4(a, b, c, d, length, cls) \
+    { 0, 0x0000FFFF00000000ULL | (uint64_t)(a) << 24 | (uint64_t)(b) << 16 | (uint64_t)(c) << 8 | (d), 96 + (length), cls }
+
+/**
+ * Every special-purpose block, the first match wins so 255.255.255.255 comes before 240.0.0.0/4.
+ */
+static const class_prefix class_prefixes[] = {
+    CLASS_V4(0, 0, 0, 0, 8, GEOIP_CLASS_THIS_NETWORK),
+    CLASS_V4(10, 0, 0, 0, 8, GEOIP_CLASS_PRIVATE),
+    CLASS_V4(100, 64, 0, 0, 10, GEOIP_CLASS_CGNAT),
+    CLASS_V4(127, 0, 0, 0, 8, GEOIP_CLASS_LOOPBACK),
+    CLASS_V4(169, 254, 0, 0, 16, GEOIP_CLASS_LINK_LOCAL),
+    CLASS_V4(172, 16, 0, 0, 12, GEOIP_CLASS_PRIVATE),
+    CLASS_V4(192, 0, 0, 0, 24, GEOIP_CLASS_RESERVED),
+    CLASS_V4(192, 0, 2, 0, 24, GEOIP_CLASS_DOCUMENTATION),
+    CLASS_V4(192, 168, 0, 0, 16, GEOIP_CLASS_PRIVATE),
+    CLASS_V4(198, 18, 0, 0, 15, GEOIP_CLASS_BENCHMARKING),
+    CLASS_V4(198, 51, 100, 0, 24, GEOIP_CLASS_DOCUMENTATION),
+    CLASS_V4(203, 0, 113, 0, 24, GEOIP_CLASS_DOCUMENTATION),
+    CLASS_V4(224, 0, 0, 0, 4, GEOIP_CLASS_MULTICAST),
+    CLASS_V4(255, 255, 255, 255, 32, GEOIP_CLASS_BROADCAST),
+    CLASS_V4(240, 0, 0, 0, 4, GEOIP_CLASS_RESERVED),
+    { 0, 0, 128, GEOIP_CLASS_UNSPECIFIED },
+    { 0, 1, 128, GEOIP_CLASS_LOOPBACK },
+    { 0x0100000000000000ULL, 0, 64, GEOIP_CLASS_RESERVED },
+    { 0x2001000200000000ULL, 0, 48, GEOIP_CLASS_BENCHMARKING },
+    { 0x20010DB800000000ULL, 0, 32, GEOIP_CLASS_DOCUMENTATION },
+    { 0xFC00000000000000ULL, 0, 7, GEOIP_CLASS_UNIQUE_LOCAL },
+    { 0xFE80000000000000ULL, 0, 10, GEOIP_CLASS_LINK_LOCAL },
+    { 0xFF00000000000000ULL, 0, 8, GEOIP_CLASS_MULTICAST }
+};
+
+static const char *const class_names[GEOIP_CLASS_COUNT] = {
+    [GEOIP_CLASS_PUBLIC]        = "public",
+    [GEOIP_CLASS_UNSPECIFIED]   = "unspecified",
+    [GEOIP_CLASS_THIS_NETWORK]  = "this-network",
+    [GEOIP_CLASS_LOOPBACK]      = "loopback",
+    [GEOIP_CLASS_PRIVATE]       = "private",
+    [GEOIP_CLASS_CGNAT]         = "cgnat",
+    [GEOIP_CLASS_LINK_LOCAL]    = "link-local",
+    [GEOIP_CLASS_UNIQUE_LOCAL]  = "unique-local",
+    [GEOIP_CLASS_DOCUMENTATION] = "documentation",
+    [GEOIP_CLASS_BENCHMARKING]  = "benchmarking",
+    [GEOIP_CLASS_MULTICAST]     = "multicast",
+    [GEOIP_CLASS_BROADCAST]     = "broadcast",
+    [GEOIP_CLASS_RESERVED]      = "reserved"
+};
+
+/**
+ * The mask selecting the leading bits of a 64-bit half of an address.
+ * 
+ * @param bits  The number of leading bits, anything outside 0 to 64 is clamped.
+ * @return      The mask.
+ */
+static inline uint64_t prefix_mask(int bits) {
+    if (bits <= 0)
+        return 0;
+
+    return bits >= 64 ? UINT64_MAX : ~(UINT64_MAX >> bits);
+}
+
+static inline uint64_t load_be64(const uint8_t *bytes) {
+    uint64_t value = 0;
+
+    for (int i = 0; i < 8; i++)
+        value = value << 8 | bytes[i];
+
+    return value;
+}
+
+/**
+ * Classify an address.
+ * 
+ * The address is compared against a fixed table of prefixes, so classifying takes the same couple of dozen mask and
+ * compare steps whatever the address. IPv4 addresses and IPv4-mapped IPv6 addresses are classified alike.
+ * 
+ * @param addr      The parsed address.
+ * @param length    Receives the length of the matching prefix out of 128 bits, 0 for public addresses. May be NULL.
+ * @return          A GEOIP_CLASS_* value.
+ */
+int geoip_class_of(const geoip_addr *addr, int *length) {
+    const uint64_t hi = load_be64(addr->bytes);
+    const uint64_t lo = load_be64(addr->bytes + 8);
+
+    for (size_t i = 0; i < sizeof(class_prefixes) / sizeof(class_prefixes[0]); i++) {
+        const class_prefix *prefix = &class_prefixes[i];
+
+        if ((hi & prefix_mask(prefix->length)) == prefix->hi && (lo & prefix_mask(prefix->length - 64)) == prefix->lo) {
+            if (length != NULL)
+                *length = prefix->length;
+
+            return prefix->cls;
+        }
+    }
+
+    if (length != NULL)
+        *length = 0;
+
+    return GEOIP_CLASS_PUBLIC;
+}
+
+/**
+ * Decide whether a lookup can be answered without walking the search tree.
+ * 
+ * Rejection is a setting of each database: on for the built-in GeoLite2 files, which never map such addresses, and
+ * off for the ones opened by "geoip_open" unless their options turn it on. IPv6 addresses in an IPv4 database are
+ * always walked, so they keep failing the way libmaxminddb fails them.
+ * 
+ * @param db        The opened database.
+ * @param addr      The parsed address.
+ * @param netmask   Receives the netmask the lookup reports, counted the way the walk would count it.
+ * @return          Whether the address is not public and the database rejects such addresses.
+ */
+bool geoip_class_reject(const geoip_db *db, const geoip_addr *addr, int *netmask) {
+    int length;
+
+    if (!atomic_load_explicit(&db->reject_reserved, memory_order_relaxed))
+        return false;
+
+    if (addr->family != AF_INET && db->mmdb.metadata.ip_version != 6)
+        return false;
+
+    if (geoip_class_of(addr, &length) == GEOIP_CLASS_PUBLIC)
+        return false;
+
+    *netmask = addr->family == AF_INET ? length - 96 + db->walk.ipv4_netmask : length;
+    return true;
+}
+
+/**
+ * The name of a class, as geoip_ip_class() returns it.
+ * 
+ * @param cls   A GEOIP_CLASS_* value.
+ * @return      The name.
+ */
+const char *geoip_class_name(int cls) {
+    return cls >= 0 && cls < GEOIP_CLASS_COUNT ? class_names[cls] : "unknown";
+}
+
+/**
+ * Classify an address.
+ * 
+ * This function handles the "geoip_ip_class" extension function. It returns 'public' or the name of the
+ * special-purpose block the address belongs to, without opening any database.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (should be 1).
+ * @param argv          The address.
+ */
+static void class_ip_class(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    (void)argc;  /* Unused parameter */
+    geoip_addr addr;
+
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL)
+        return;
+
+    int gai_error = geoip_value_address(argv[0], &addr);
+
+    if (gai_error != 0) {
+        char msg[4096];
+
+        snprintf(msg, sizeof(msg), MSG_ERRGETADDRINFO, geoip_value_text(argv[0]), gai_strerror(gai_error));
+        sqlite3_result_error(context, msg, -1);
+        return;
+    }
+
+    sqlite3_result_text(context, geoip_class_name(geoip_class_of(&addr, NULL)), -1, SQLITE_STATIC);
+}
+
+/**
+ * Report or change whether a database rejects non-public addresses before any tree walk.
+ * 
+ * This function handles the "geoip_reject_reserved" extension function. With an argument it enables (non-zero) or
+ * disables (zero) the rejection of the database named by the second argument, or of both built-in databases when
+ * there is none. It returns whether the database, 'city' by default, rejects such addresses afterwards.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (0 to 2).
+ * @param argv          Whether to reject non-public addresses and the database, when given.
+ */
+static void class_reject_reserved(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    geoip_db *db = argc == 2 ? geoip_db_find((const char *)sqlite3_value_text(argv[1])) : &db_cnt;
+
+    if (db == NULL) {
+        sqlite3_result_error(context, MSG_UNKNOWNDB, -1);
+        return;
+    }
+
+    if (argc >= 1 && sqlite3_value_type(argv[0]) != SQLITE_NULL) {
+        bool reject = sqlite3_value_int(argv[0]) != 0;
+
+        atomic_store_explicit(&db->reject_reserved, reject, memory_order_relaxed);
+        if (argc == 1)
+            atomic_store_explicit(&db_asn.reject_reserved, reject, memory_order_relaxed);
+    }
+
+    sqlite3_result_int(context, atomic_load_explicit(&db->reject_reserved, memory_order_relaxed));
+}
+
+/**
+ * Register the address classification functions.
+ * 
+ * Changing the rejection of a database affects every connection, so those forms are not usable from triggers or views.
+ * 
+ * @param db    The current SQLite3 database context.
+ * @return      An SQLite3 result code.
+ */
+int geoip_class_register(sqlite3 *db) {
+    int rc;
+
+    rc = sqlite3_create_function(db, "geoip_ip_class", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC | SQLITE_INNOCUOUS, 0, class_ip_class, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_reject_reserved", 0, SQLITE_UTF8, 0, class_reject_reserved, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_reject_reserved", 1, SQLITE_UTF8 | SQLITE_DIRECTONLY, 0, class_reject_reserved, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    return sqlite3_create_function(db, "geoip_reject_reserved", 2, SQLITE_UTF8 | SQLITE_DIRECTONLY, 0, class_reject_reserved, 0, 0);
+}
@@ -0,0 +1,36 @@
+#ifndef GEOIP_CLASS_H
+#define GEOIP_CLASS_H
+
+#include <stdbool.h>
+
+typedef struct sqlite3 sqlite3;
+typedef struct geoip_addr geoip_addr;
+typedef struct geoip_db geoip_db;
+
+/**
+ * The special-purpose address blocks an address can belong to, from the IANA IPv4 and IPv6 special-purpose address
+ * registries. MaxMind databases never contain any of them.
+ */
+enum {
+    GEOIP_CLASS_PUBLIC,          /**< None of the blocks below, the address may be in a database. */
+    GEOIP_CLASS_UNSPECIFIED,     /**< ::/128. */
+    GEOIP_CLASS_THIS_NETWORK,    /**< 0.0.0.0/8. */
+    GEOIP_CLASS_LOOPBACK,        /**< 127.0.0.0/8 and ::1/128. */
+    GEOIP_CLASS_PRIVATE,         /**< The RFC 1918 blocks 10.0.0.0/8, 172.16.0.0/12 and 192.168.0.0/16. */
+    GEOIP_CLASS_CGNAT,           /**< The RFC 6598 shared address space 100.64.0.0/10. */
+    GEOIP_CLASS_LINK_LOCAL,      /**< 169.254.0.0/16 and fe80::/10. */
+    GEOIP_CLASS_UNIQUE_LOCAL,    /**< The RFC 4193 block fc00::/7. */
+    GEOIP_CLASS_DOCUMENTATION,   /**< 192.0.2.0/24, 198.51.100.0/24, 203.0.113.0/24 and 2001:db8::/32. */
+    GEOIP_CLASS_BENCHMARKING,    /**< 198.18.0.0/15 and 2001:2::/48. */
+    GEOIP_CLASS_MULTICAST,       /**< 224.0.0.0/4 and ff00::/8. */
+    GEOIP_CLASS_BROADCAST,       /**< 255.255.255.255/32. */
+    GEOIP_CLASS_RESERVED,        /**< The other special-purpose blocks, 192.0.0.0/24, 240.0.0.0/4 and 100::/64. */
+    GEOIP_CLASS_COUNT            /**< The number of classes. */
+};
+
+int geoip_class_of(const geoip_addr *addr, int *length);
+bool geoip_class_reject(const geoip_db *db, const geoip_addr *addr, int *netmask);
+const char *geoip_class_name(int cls);
+int geoip_class_register(sqlite3 *db);
+
+#endif /* GEOIP_CLASS_H */
@@ -0,0 +1,679 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "geoip.h"
+#include <sqlite3ext.h>
+SQLITE_EXTENSION_INIT3
+
+#define GEO_MEMO_SLOTS   4096          /**< The initial number of record memo slots, a power of two. */
+#define GEO_EARTH_RADIUS 6371.0088     /**< The mean radius of the Earth in kilometres. */
+#define GEO_PI           3.14159265358979323846 /**< M_PI, which strict C does not define. */
+#define GEO_SLACK        1e-6          /**< Degrees added around the cells a query scans, against rounding. */
+
+/**
+ * The coordinates of a record.
+ */
+typedef struct geo_location {
+    double latitude;  /**< The latitude in degrees. */
+    double longitude; /**< The longitude in degrees. */
+    uint16_t radius;  /**< The accuracy radius in kilometres, 0 when the record has none. */
+} geo_location;
+
+/**
+ * The state of building the grid of one database.
+ */
+typedef struct geo_builder {
+    const MMDB_s *mmdb;          /**< The database being indexed. */
+    geoip_geo_network *networks; /**< The networks in the order the walk found them. */
+    uint32_t nnetworks;          /**< The number of networks. */
+    size_t net_capacity;         /**< The number of networks allocated. */
+    geo_location *locations;     /**< The coordinates of every record decoded so far that has them. */
+    uint32_t nlocations;         /**< The number of coordinates. */
+    size_t loc_capacity;         /**< The number of coordinates allocated. */
+    geoip_memo memo;             /**< The position of the coordinates of every record decoded so far, UINT32_MAX for none. */
+} geo_builder;
+
+/**
+ * The grid cell of a point.
+ * 
+ * @param latitude  The latitude in degrees, from -90 to 90.
+ * @param longitude The longitude in degrees, from -180 to 180, where 180 and -180 share a column.
+ * @return          The position of the cell in geoip_geo.cells.
+ */
+static uint32_t geo_cell(double latitude, double longitude) {
+    uint32_t row = (uint32_t)(latitude + 90);
+    uint32_t column = (uint32_t)(longitude + 180) % GEOIP_GEO_COLUMNS;
+
+    if (row >= GEOIP_GEO_ROWS)
+        row = GEOIP_GEO_ROWS - 1;
+
+    return row * GEOIP_GEO_COLUMNS + column;
+}
+
+/**
+ * Decode the coordinates of a record.
+ * 
+ * @param mmdb      The opened database.
+ * @param offset    The offset of the record in the data section.
+ * @param location  Receives the coordinates.
+ * @return          Whether the record has a valid latitude and longitude.
+ */
+static bool geo_decode(const MMDB_s *mmdb, uint32_t offset, geo_location *location) {
+    MMDB_entry_s entry = { .mmdb = mmdb, .offset = offset };
+    MMDB_entry_data_s latitude, longitude, radius;
+
+    if (MMDB_aget_value(&entry, &latitude, (const char *const[]){ "location", "latitude", NULL }) != MMDB_SUCCESS ||
+        !latitude.has_data || latitude.type != MMDB_DATA_TYPE_DOUBLE)
+        return false;
+
+    if (MMDB_aget_value(&entry, &longitude, (const char *const[]){ "location", "longitude", NULL }) != MMDB_SUCCESS ||
+        !longitude.has_data || longitude.type != MMDB_DATA_TYPE_DOUBLE)
+        return false;
+
+    /* Written so NaN fails too. */
+    if (!(latitude.double_value >= -90 && latitude.double_value <= 90) ||
+        !(longitude.double_value >= -180 && longitude.double_value <= 180))
+        return false;
+
+    location->latitude = latitude.double_value;
+    location->longitude = longitude.double_value;
+    location->radius = 0;
+
+    if (MMDB_aget_value(&entry, &radius, (const char *const[]){ "location", "accuracy_radius", NULL }) == MMDB_SUCCESS &&
+        radius.has_data && radius.type == MMDB_DATA_TYPE_UINT16)
+        location->radius = radius.uint16;
+
+    return true;
+}
+
+/**
+ * Find the coordinates of a record, decoding each record once for all the networks sharing it.
+ * 
+ * @param b         The builder.
+ * @param offset    The offset of the record in the data section.
+ * @param position  Receives the position of the coordinates, or UINT32_MAX when the record does not have them.
+ * @return          MMDB_SUCCESS or MMDB_OUT_OF_MEMORY_ERROR.
+ */
+static int geo_location_of(geo_builder *b, uint32_t offset, uint32_t *position) {
+    if (geoip_memo_get(&b->memo, offset, position))
+        return MMDB_SUCCESS;
+
+    geo_location location;
+
+    *position = UINT32_MAX;
+    if (geo_decode(b->mmdb, offset, &location)) {
+        int status = geoip_reserve((void **)&b->locations, &b->loc_capacity, b->nlocations, sizeof(geo_location));
+        if (status != MMDB_SUCCESS)
+            return status;
+
+        b->locations[b->nlocations] = location;
+        *position = b->nlocations++;
+    }
+
+    return geoip_memo_put(&b->memo, offset, *position);
+}
+
+/**
+ * Keep a network of the search tree whose record has coordinates.
+ * 
+ * @param arg       The geo_builder.
+ * @param prefix    The network address.
+ * @param length    The prefix length out of 128 bits.
+ * @param offset    The offset of the record of the network.
+ * @return          MMDB_SUCCESS or MMDB_OUT_OF_MEMORY_ERROR.
+ */
+static int geo_add_network(void *arg, const uint8_t *prefix, int length, uint32_t offset) {
+    geo_builder *b = arg;
+    uint32_t position;
+
+    int status = geo_location_of(b, offset, &position);
+    if (status != MMDB_SUCCESS || position == UINT32_MAX)
+        return status;
+
+    if (b->nnetworks == UINT32_MAX)
+        return MMDB_OUT_OF_MEMORY_ERROR;
+
+    status = geoip_reserve((void **)&b->networks, &b->net_capacity, b->nnetworks, sizeof(geoip_geo_network));
+    if (status != MMDB_SUCCESS)
+        return status;
+
+    const geo_location *location = &b->locations[position];
+    geoip_geo_network *network = &b->networks[b->nnetworks++];
+
+    network->latitude = location->latitude;
+    network->longitude = location->longitude;
+    memcpy(network->prefix, prefix, 16);
+    network->offset = offset;
+    network->radius = location->radius;
+    network->length = (uint8_t)length;
+    return MMDB_SUCCESS;
+}
+
+/**
+ * Bucket the networks by grid cell with a counting sort, keeping the order of the walk within every cell.
+ * 
+ * @param b         The builder, holding the networks.
+ * @param geo       The grid, with every cell count zero.
+ * @return          MMDB_SUCCESS or MMDB_OUT_OF_MEMORY_ERROR.
+ */
+static int geo_bucket(const geo_builder *b, geoip_geo *geo) {
+    geo->networks = sqlite3_malloc64(((uint64_t)b->nnetworks + 1) * sizeof(geoip_geo_network));
+    if (geo->networks == NULL)
+        return MMDB_OUT_OF_MEMORY_ERROR;
+
+    for (uint32_t i = 0; i < b->nnetworks; i++)
+        geo->cells[geo_cell(b->networks[i].latitude, b->networks[i].longitude) + 1]++;
+
+    for (uint32_t i = 1; i <= GEOIP_GEO_ROWS * GEOIP_GEO_COLUMNS; i++)
+        geo->cells[i] += geo->cells[i - 1];
+
+    /* cells[c] is used as the next free position of cell c, ending up at the start of cell c + 1. */
+    for (uint32_t i = 0; i < b->nnetworks; i++)
+        geo->networks[geo->cells[geo_cell(b->networks[i].latitude, b->networks[i].longitude)]++] = b->networks[i];
+
+    memmove(geo->cells + 1, geo->cells, GEOIP_GEO_ROWS * GEOIP_GEO_COLUMNS * sizeof(uint32_t));
+    geo->cells[0] = 0;
+    geo->nnetworks = b->nnetworks;
+    return MMDB_SUCCESS;
+}
+
+static void geo_free(geoip_geo *geo) {
+    if (geo == NULL)
+        return;
+
+    sqlite3_free(geo->networks);
+    sqlite3_free(geo);
+}
+
+/**
+ * Build the grid of a database.
+ * 
+ * One walk over the search tree visits the IPv4 networks, then the IPv6 networks that are not aliases of the IPv4
+ * part, so every address is covered by one network at most.
+ * 
+ * @param mmdb      The opened database.
+ * @param built     Receives the grid.
+ * @return          MMDB_SUCCESS or a libmaxminddb error code.
+ */
+static int geo_build(const MMDB_s *mmdb, geoip_geo **built) {
+    geo_builder b = { .mmdb = mmdb };
+    geoip_geo *geo = sqlite3_malloc(sizeof(geoip_geo));
+    int status = MMDB_OUT_OF_MEMORY_ERROR;
+
+    if (geo != NULL && geoip_memo_init(&b.memo, GEO_MEMO_SLOTS) == MMDB_SUCCESS) {
+        memset(geo, 0, sizeof(geoip_geo));
+
+        status = geoip_tree_networks(mmdb, GEOIP_NETWORKS_IPV4, geo_add_network, &b);
+        if (status == MMDB_SUCCESS)
+            status = geoip_tree_networks(mmdb, GEOIP_NETWORKS_IPV6, geo_add_network, &b);
+        if (status == MMDB_SUCCESS)
+            status = geo_bucket(&b, geo);
+    }
+
+    sqlite3_free(b.networks);
+    sqlite3_free(b.locations);
+    geoip_memo_free(&b.memo);
+
+    if (status != MMDB_SUCCESS) {
+        geo_free(geo);
+        return status;
+    }
+
+    *built = geo;
+    return MMDB_SUCCESS;
+}
+
+/**
+ * Get the grid of a database, building it the first time it is asked for.
+ * 
+ * Like the indexes of "geoip_networks_by", the grid belongs to the opened file and is built once under the
+ * SQLITE_MUTEX_STATIC_APP2 mutex, reading a built grid takes a single acquire load. A failed build is retried by the
+ * next call.
+ * 
+ * @param db        The opened database.
+ * @param geo       Receives the grid, valid as long as the database is.
+ * @return          MMDB_SUCCESS or a libmaxminddb error code.
+ */
+int geoip_geo_get(geoip_db *db, const geoip_geo **geo) {
+    geoip_geo *built = atomic_load_explicit(&db->geo, memory_order_acquire);
+    int status = MMDB_SUCCESS;
+
+    if (built == NULL) {
+        sqlite3_mutex *mutex = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP2);
+        sqlite3_mutex_enter(mutex);
+
+        built = atomic_load_explicit(&db->geo, memory_order_relaxed);
+        if (built == NULL) {
+            status = geo_build(&db->mmdb, &built);
+            if (status == MMDB_SUCCESS)
+                atomic_store_explicit(&db->geo, built, memory_order_release);
+        }
+
+        sqlite3_mutex_leave(mutex);
+    }
+
+    *geo = built;
+    return status;
+}
+
+/**
+ * The great-circle distance between two points, by the haversine formula on a spherical Earth.
+ * 
+ * @param lat1      The latitude of the first point in degrees.
+ * @param lon1      The longitude of the first point in degrees.
+ * @param lat2      The latitude of the second point in degrees.
+ * @param lon2      The longitude of the second point in degrees.
+ * @return          The distance in kilometres.
+ */
+double geoip_geo_distance(double lat1, double lon1, double lat2, double lon2) {
+    const double radians = GEO_PI / 180;
+    double dlat = sin((lat2 - lat1) * radians / 2);
+    double dlon = sin((lon2 - lon1) * radians / 2);
+    double a = dlat * dlat + cos(lat1 * radians) * cos(lat2 * radians) * dlon * dlon;
+
+    return 2 * GEO_EARTH_RADIUS * asin(a < 1 ? sqrt(a) : 1);
+}
+
+/**
+ * Release the grid of a database.
+ * 
+ * Must be called with the SQLITE_MUTEX_STATIC_APP1 mutex held, once no connection can be reading the grid.
+ * 
+ * @param db    The database.
+ */
+void geoip_geo_release(geoip_db *db) {
+    geo_free(atomic_exchange_explicit(&db->geo, NULL, memory_order_acq_rel));
+}
+
+/**
+ * The columns of the geoip_networks_near virtual table, in declaration order.
+ */
+enum {
+    NEAR_COLUMN_NETWORK,
+    NEAR_COLUMN_ID,
+    NEAR_COLUMN_LATITUDE,
+    NEAR_COLUMN_LONGITUDE,
+    NEAR_COLUMN_ACCURACY_RADIUS,
+    NEAR_COLUMN_DISTANCE,
+    NEAR_COLUMN_LAT,
+    NEAR_COLUMN_LON,
+    NEAR_COLUMN_KM,
+    NEAR_COLUMN_DB
+};
+
+#define NEAR_ARGS 1 /**< An idxNum bit, the hidden lat, lon and km columns are constrained. */
+#define NEAR_DB   2 /**< An idxNum bit, the hidden db column names the database. */
+
+/**
+ * A network within the distance, along with how far it is.
+ */
+typedef struct near_row {
+    const geoip_geo_network *network; /**< The network, owned by the grid. */
+    double distance;                  /**< The distance in kilometres. */
+} near_row;
+
+/**
+ * A cursor over the networks within a distance of a point, nearest first.
+ */
+typedef struct near_cursor {
+    sqlite3_vtab_cursor base; /**< The base class, must come first. */
+    geoip_db *db;             /**< The database the networks come from. */
+    double latitude;          /**< The latitude of the point. */
+    double longitude;         /**< The longitude of the point. */
+    double km;                /**< The distance. */
+    near_row *rows;           /**< The networks found. */
+    uint32_t count;           /**< The number of networks found. */
+    size_t capacity;          /**< The number of rows allocated. */
+    uint32_t row;             /**< The current network. */
+} near_cursor;
+
+static int near_connect(sqlite3 *db, void *pAux, int argc, const char *const *argv, sqlite3_vtab **ppVtab, char **pzErr) {
+    (void)pAux; (void)argc; (void)argv; (void)pzErr;  /* Unused parameters */
+
+    int rc = sqlite3_declare_vtab(db, "CREATE TABLE x(network TEXT, id INTEGER, latitude REAL, longitude REAL, "
+        "accuracy_radius INTEGER, distance REAL, lat HIDDEN, lon HIDDEN, km HIDDEN, db HIDDEN)");
+    if (rc != SQLITE_OK)
+        return rc;
+
+    sqlite3_vtab *vtab = sqlite3_malloc(sizeof(sqlite3_vtab));
+    if (vtab == NULL)
+        return SQLITE_NOMEM;
+
+    memset(vtab, 0, sizeof(*vtab));
+    *ppVtab = vtab;
+    return SQLITE_OK;
+}
+
+static int near_disconnect(sqlite3_vtab *pVtab) {
+    sqlite3_free(pVtab);
+    return SQLITE_OK;
+}
+
+/**
+ * Plan a lookup: equalities on lat, lon and km, and optionally db, are handed to the filter. Without them there is
+ * nothing to look up, which the filter reports.
+ */
+static int near_best_index(sqlite3_vtab *pVtab, sqlite3_index_info *pInfo) {
+    (void)pVtab;  /* Unused parameter */
+    int args[4] = { -1, -1, -1, -1 };
+
+    for (int i = 0; i < pInfo->nConstraint; i++) {
+        const struct sqlite3_index_constraint *constraint = &pInfo->aConstraint[i];
+
+        if (constraint->op != SQLITE_INDEX_CONSTRAINT_EQ || constraint->iColumn < NEAR_COLUMN_LAT)
+            continue;
+
+        if (!constraint->usable)
+            return SQLITE_CONSTRAINT;
+
+        args[constraint->iColumn - NEAR_COLUMN_LAT] = i;
+    }
+
+    pInfo->idxNum = 0;
+    if (args[0] < 0 || args[1] < 0 || args[2] < 0) {
+        pInfo->estimatedCost = 1e12;
+        return SQLITE_OK;
+    }
+
+    pInfo->idxNum = NEAR_ARGS | (args[3] >= 0 ? NEAR_DB : 0);
+    for (int i = 0; i < 4; i++) {
+        if (args[i] >= 0) {
+            pInfo->aConstraintUsage[args[i]].argvIndex = i + 1;
+            pInfo->aConstraintUsage[args[i]].omit = 1;
+        }
+    }
+
+    /* Rows come back nearest first. */
+    if (pInfo->nOrderBy == 1 && pInfo->aOrderBy[0].iColumn == NEAR_COLUMN_DISTANCE && !pInfo->aOrderBy[0].desc)
+        pInfo->orderByConsumed = 1;
+
+    pInfo->estimatedCost = 1000;
+    pInfo->estimatedRows = 1000;
+    return SQLITE_OK;
+}
+
+static int near_open(sqlite3_vtab *pVtab, sqlite3_vtab_cursor **ppCursor) {
+    (void)pVtab;  /* Unused parameter */
+
+    near_cursor *cursor = sqlite3_malloc(sizeof(near_cursor));
+    if (cursor == NULL)
+        return SQLITE_NOMEM;
+
+    memset(cursor, 0, sizeof(*cursor));
+    *ppCursor = &cursor->base;
+    return SQLITE_OK;
+}
+
+static int near_close(sqlite3_vtab_cursor *pCursor) {
+    near_cursor *cursor = (near_cursor *)pCursor;
+
+    sqlite3_free(cursor->rows);
+    sqlite3_free(cursor);
+    return SQLITE_OK;
+}
+
+/**
+ * Report an error through the virtual table.
+ * 
+ * @param cursor    The cursor the error happened on.
+ * @param msg       The error message, taken over.
+ * @return          SQLITE_ERROR.
+ */
+static int near_error(near_cursor *cursor, char *msg) {
+    sqlite3_vtab *vtab = cursor->base.pVtab;
+
+    sqlite3_free(vtab->zErrMsg);
+    vtab->zErrMsg = msg;
+    return SQLITE_ERROR;
+}
+
+static int near_compare_rows(const void *a, const void *b) {
+    const near_row *x = a, *y = b;
+
+    if (x->distance != y->distance)
+        return (x->distance > y->distance) - (x->distance < y->distance);
+
+    int c = memcmp(x->network->prefix, y->network->prefix, 16);
+    return c != 0 ? c : (x->network->length > y->network->length) - (x->network->length < y->network->length);
+}
+
+/**
+ * Keep the networks of one grid cell that are within the distance.
+ * 
+ * @param cursor    The cursor collecting the rows.
+ * @param geo       The grid.
+ * @param cell      The position of the cell in geoip_geo.cells.
+ * @return          SQLITE_OK or SQLITE_NOMEM.
+ */
+static int near_scan(near_cursor *cursor, const geoip_geo *geo, uint32_t cell) {
+    for (uint32_t i = geo->cells[cell]; i < geo->cells[cell + 1]; i++) {
+        const geoip_geo_network *network = &geo->networks[i];
+        double distance = geoip_geo_distance(cursor->latitude, cursor->longitude, network->latitude, network->longitude);
+
+        if (distance > cursor->km)
+            continue;
+
+        if (geoip_reserve((void **)&cursor->rows, &cursor->capacity, cursor->count, sizeof(near_row)) != MMDB_SUCCESS)
+            return SQLITE_NOMEM;
+
+        cursor->rows[cursor->count++] = (near_row){ .network = network, .distance = distance };
+    }
+
+    return SQLITE_OK;
+}
+
+/**
+ * Collect the networks within the distance of the point.
+ * 
+ * Only the cells overlapping the bounding box of the circle are scanned. The box spans every longitude when the circle
+ * reaches a pole, and wraps around the antimeridian otherwise.
+ * 
+ * @param cursor    The cursor, holding the point and the distance.
+ * @param geo       The grid.
+ * @return          SQLITE_OK or SQLITE_NOMEM.
+ */
+static int near_collect(near_cursor *cursor, const geoip_geo *geo) {
+    const double radians = GEO_PI / 180;
+    double angle = cursor->km / GEO_EARTH_RADIUS;
+    double dlat = angle / radians + GEO_SLACK;
+    double south = cursor->latitude - dlat, north = cursor->latitude + dlat;
+    int first_row = south <= -90 ? 0 : (int)(south + 90);
+    int last_row = north >= 90 ? GEOIP_GEO_ROWS - 1 : (int)(north + 90);
+    int first_column = 0, last_column = GEOIP_GEO_COLUMNS - 1;
+
+    if (angle < GEO_PI && south > -90 && north < 90) {
+        double spread = sin(angle) / cos(cursor->latitude * radians);
+
+        if (spread < 1) {
+            double dlon = asin(spread) / radians + GEO_SLACK;
+
+            first_column = (int)floor(cursor->longitude - dlon + 180);
+            last_column = (int)floor(cursor->longitude + dlon + 180);
+            if (last_column - first_column >= GEOIP_GEO_COLUMNS - 1) {
+                first_column = 0;
+                last_column = GEOIP_GEO_COLUMNS - 1;
+            }
+        }
+    }
+
+    if (last_row >= GEOIP_GEO_ROWS)
+        last_row = GEOIP_GEO_ROWS - 1;
+
+    for (int row = first_row; row <= last_row; row++) {
+        for (int column = first_column; column <= last_column; column++) {
+            uint32_t cell = (uint32_t)row * GEOIP_GEO_COLUMNS + (uint32_t)((column + GEOIP_GEO_COLUMNS) % GEOIP_GEO_COLUMNS);
+
+            int rc = near_scan(cursor, geo, cell);
+            if (rc != SQLITE_OK)
+                return rc;
+        }
+    }
+
+    if (cursor->count > 0)
+        qsort(cursor->rows, cursor->count, sizeof(near_row), near_compare_rows);
+
+    return SQLITE_OK;
+}
+
+/**
+ * Read a number argument.
+ * 
+ * @param value     The argument.
+ * @param number    Receives the number.
+ * @return          Whether the argument is an integer or a real.
+ */
+static bool near_number(sqlite3_value *value, double *number) {
+    int type = sqlite3_value_numeric_type(value);
+
+    if (type != SQLITE_INTEGER && type != SQLITE_FLOAT)
+        return false;
+
+    *number = sqlite3_value_double(value);
+    return true;
+}
+
+static int near_filter(sqlite3_vtab_cursor *pCursor, int idxNum, const char *idxStr, int argc, sqlite3_value **argv) {
+    (void)idxStr; (void)argc;  /* Unused parameters */
+    near_cursor *cursor = (near_cursor *)pCursor;
+
+    cursor->count = cursor->row = 0;
+
+    if (!initialized)
+        return near_error(cursor, sqlite3_mprintf(MSG_NOTINITIALIZED));
+
+    if (!(idxNum & NEAR_ARGS))
+        return near_error(cursor, sqlite3_mprintf("geoip_networks_near takes a latitude, a longitude and a distance in kilometres, as in geoip_networks_near(48.85, 2.35, 50)"));
+
+    geoip_db *db = idxNum & NEAR_DB ? geoip_db_find((const char *)sqlite3_value_text(argv[3])) : &db_cnt;
+    if (db == NULL)
+        return near_error(cursor, sqlite3_mprintf(MSG_UNKNOWNDB));
+
+    for (int i = 0; i < 3; i++) {
+        if (sqlite3_value_type(argv[i]) == SQLITE_NULL)
+            return SQLITE_OK;
+    }
+
+    if (!near_number(argv[0], &cursor->latitude) || cursor->latitude < -90 || cursor->latitude > 90)
+        return near_error(cursor, sqlite3_mprintf("Not a latitude between -90 and 90: %s", sqlite3_value_text(argv[0])));
+
+    if (!near_number(argv[1], &cursor->longitude) || cursor->longitude < -180 || cursor->longitude > 180)
+        return near_error(cursor, sqlite3_mprintf("Not a longitude between -180 and 180: %s", sqlite3_value_text(argv[1])));
+
+    if (!near_number(argv[2], &cursor->km) || cursor->km < 0)
+        return near_error(cursor, sqlite3_mprintf("Not a distance in kilometres: %s", sqlite3_value_text(argv[2])));
+
+    const geoip_geo *geo;
+    int status = geoip_db_acquire(db);
+    if (status == MMDB_SUCCESS)
+        status = geoip_geo_get(db, &geo);
+
+    if (status == MMDB_OUT_OF_MEMORY_ERROR)
+        return SQLITE_NOMEM;
+
+    if (status != MMDB_SUCCESS)
+        return near_error(cursor, sqlite3_mprintf(MSG_ERRLIBMAXMIND, MMDB_strerror(status)));
+
+    cursor->db = db;
+    return near_collect(cursor, geo);
+}
+
+static int near_next(sqlite3_vtab_cursor *pCursor) {
+    ((near_cursor *)pCursor)->row++;
+    return SQLITE_OK;
+}
+
+static int near_eof(sqlite3_vtab_cursor *pCursor) {
+    near_cursor *cursor = (near_cursor *)pCursor;
+
+    return cursor->row >= cursor->count;
+}
+
+static int near_column(sqlite3_vtab_cursor *pCursor, sqlite3_context *context, int column) {
+    near_cursor *cursor = (near_cursor *)pCursor;
+    const near_row *row = &cursor->rows[cursor->row];
+    const geoip_geo_network *network = row->network;
+
+    switch (column) {
+    case NEAR_COLUMN_NETWORK: {
+        /* IPv4 networks are written in dotted decimal with their prefix length out of 32 bits, like ip_in_cidr() reads them. */
+        geoip_addr addr = { .family = AF_INET6 };
+        char text[GEOIP_IP_TEXT];
+
+        memcpy(addr.bytes, network->prefix, 16);
+        if (geoip_format_address(&addr, text, sizeof(text)) < 0)
+            return SQLITE_ERROR;
+
+        int length = network->length;
+        if (strchr(text, ':') == NULL)
+            length -= 96;
+
+        char *cidr = sqlite3_mprintf("%s/%d", text, length);
+        if (cidr == NULL)
+            return SQLITE_NOMEM;
+
+        sqlite3_result_text(context, cidr, -1, sqlite3_free);
+        break;
+    }
+    case NEAR_COLUMN_ID:
+        sqlite3_result_int64(context, network->offset);
+        break;
+    case NEAR_COLUMN_LATITUDE:
+        sqlite3_result_double(context, network->latitude);
+        break;
+    case NEAR_COLUMN_LONGITUDE:
+        sqlite3_result_double(context, network->longitude);
+        break;
+    case NEAR_COLUMN_ACCURACY_RADIUS:
+        if (network->radius != 0)
+            sqlite3_result_int(context, network->radius);
+        break;
+    case NEAR_COLUMN_DISTANCE:
+        sqlite3_result_double(context, row->distance);
+        break;
+    case NEAR_COLUMN_LAT:
+        sqlite3_result_double(context, cursor->latitude);
+        break;
+    case NEAR_COLUMN_LON:
+        sqlite3_result_double(context, cursor->longitude);
+        break;
+    case NEAR_COLUMN_KM:
+        sqlite3_result_double(context, cursor->km);
+        break;
+    case NEAR_COLUMN_DB:
+        sqlite3_result_text(context, cursor->db->alias, -1, SQLITE_TRANSIENT);
+        break;
+    }
+
+    return SQLITE_OK;
+}
+
+static int near_rowid(sqlite3_vtab_cursor *pCursor, sqlite_int64 *pRowid) {
+    *pRowid = ((near_cursor *)pCursor)->row;
+    return SQLITE_OK;
+}
+
+static sqlite3_module near_module = {
+    .iVersion = 0,
+    .xCreate = NULL,             /* Eponymous-only, "CREATE VIRTUAL TABLE" is not supported */
+    .xConnect = near_connect,
+    .xBestIndex = near_best_index,
+    .xDisconnect = near_disconnect,
+    .xDestroy = near_disconnect,
+    .xOpen = near_open,
+    .xClose = near_close,
+    .xFilter = near_filter,
+    .xNext = near_next,
+    .xEof = near_eof,
+    .xColumn = near_column,
+    .xRowid = near_rowid
+};
+
+/**
+ * Register the geoip_networks_near table-valued function.
+ * 
+ * @param db    The current SQLite3 database context.
+ * @return      An SQLite3 result code.
+ */
+int geoip_geo_register(sqlite3 *db) {
+    return sqlite3_create_module(db, "geoip_networks_near", &near_module, 0);
+}
@@ -0,0 +1,38 @@
+#ifndef GEOIP_GEO_H
+#define GEOIP_GEO_H
+
+#include <stdint.h>
+
+typedef struct sqlite3 sqlite3;
+typedef struct geoip_db geoip_db;
+
+#define GEOIP_GEO_ROWS    180 /**< The number of grid rows, one degree of latitude each. */
+#define GEOIP_GEO_COLUMNS 360 /**< The number of grid columns, one degree of longitude each. */
+
+/**
+ * A network whose record has coordinates.
+ */
+typedef struct geoip_geo_network {
+    double latitude;       /**< The latitude of the record in degrees. */
+    double longitude;      /**< The longitude of the record in degrees. */
+    uint8_t prefix[16];    /**< The network address in the form geoip_addr holds it, the bits past length are zero. */
+    uint32_t offset;       /**< The offset of the record in the data section, the id "geoip_record_id" returns. */
+    uint16_t radius;       /**< The accuracy radius of the record in kilometres, 0 when the record has none. */
+    uint8_t length;        /**< The prefix length out of 128 bits. */
+} geoip_geo_network;
+
+/**
+ * The networks of one database bucketed by the one degree grid cell their coordinates fall in.
+ */
+typedef struct geoip_geo {
+    geoip_geo_network *networks;                           /**< The networks, grouped by cell in row-major order. */
+    uint32_t nnetworks;                                    /**< The number of networks. */
+    uint32_t cells[GEOIP_GEO_ROWS * GEOIP_GEO_COLUMNS + 1]; /**< The position of the first network of every cell, and the number of networks last. */
+} geoip_geo;
+
+int geoip_geo_get(geoip_db *db, const geoip_geo **geo);
+double geoip_geo_distance(double lat1, double lon1, double lat2, double lon2);
+void geoip_geo_release(geoip_db *db);
+int geoip_geo_register(sqlite3 *db);
+
+#endif /* GEOIP_GEO_H */
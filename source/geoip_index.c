@@ -0,0 +1,693 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "geoip.h"
+#include <sqlite3ext.h>
+SQLITE_EXTENSION_INIT3
+
+#define INDEX_MEMO_SLOTS 4096 /**< The initial number of record memo slots, a power of two. */
+#define INDEX_NAME_SLOTS 1024 /**< The initial number of value hash slots, a power of two. */
+
+/**
+ * The name and the MMDB lookup path of every indexed field, indexed by GEOIP_INDEX_*.
+ */
+static const struct {
+    const char *name;
+    const char *const *path;
+} index_fields[] = {
+    [GEOIP_INDEX_COUNTRY]   = { "country",   (const char *const[]){ "country", "iso_code", NULL } },
+    [GEOIP_INDEX_CONTINENT] = { "continent", (const char *const[]){ "continent", "code", NULL } },
+    [GEOIP_INDEX_ASN]       = { "asn",       (const char *const[]){ "autonomous_system_number", NULL } },
+    [GEOIP_INDEX_CITY]      = { "city",      (const char *const[]){ "city", "names", "en", NULL } }
+};
+
+/**
+ * The state of building the index of one field.
+ */
+typedef struct index_builder {
+    const MMDB_s *mmdb;     /**< The database being indexed. */
+    int field;              /**< The GEOIP_INDEX_* value of the field. */
+    geoip_index *index;     /**< The index being built. */
+    size_t pool_size;       /**< The number of bytes of the pool in use. */
+    size_t pool_capacity;   /**< The number of bytes allocated for the pool. */
+    size_t key_capacity;    /**< The number of values allocated. */
+    size_t net_capacity;    /**< The number of networks allocated. */
+    uint32_t *names;        /**< The position of every value plus one, by the hash of its text. */
+    uint32_t names_mask;    /**< The number of value hash slots minus one. */
+    geoip_memo memo;        /**< The position of the value of every record decoded so far, UINT32_MAX for none. */
+} index_builder;
+
+static uint32_t index_hash(const char *text, size_t length) {
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < length; i++)
+        hash = (hash ^ (unsigned char)text[i]) * 16777619u;
+
+    return hash;
+}
+
+/**
+ * Find the position of a value, adding it the first time it is seen.
+ * 
+ * @param b         The builder.
+ * @param text      The value, which does not have to be NUL terminated.
+ * @param length    The number of bytes in text.
+ * @param key       Receives the position of the value.
+ * @return          MMDB_SUCCESS or MMDB_OUT_OF_MEMORY_ERROR.
+ */
+static int index_intern(index_builder *b, const char *text, size_t length, uint32_t *key) {
+    geoip_index *index = b->index;
+    uint32_t slot = index_hash(text, length) & b->names_mask;
+
+    for (; b->names[slot] != 0; slot = (slot + 1) & b->names_mask) {
+        const geoip_index_key *known = &index->keys[b->names[slot] - 1];
+
+        if (known->length == length && memcmp(index->pool + known->text, text, length) == 0) {
+            *key = b->names[slot] - 1;
+            return MMDB_SUCCESS;
+        }
+    }
+
+    while (b->pool_size + length + 1 > b->pool_capacity) {
+        int status = geoip_reserve((void **)&index->pool, &b->pool_capacity, b->pool_capacity, 1);
+        if (status != MMDB_SUCCESS)
+            return status;
+    }
+
+    int status = geoip_reserve((void **)&index->keys, &b->key_capacity, index->nkeys, sizeof(geoip_index_key));
+    if (status != MMDB_SUCCESS)
+        return status;
+
+    memcpy(index->pool + b->pool_size, text, length);
+    index->pool[b->pool_size + length] = '\0';
+    index->keys[index->nkeys] = (geoip_index_key){ .text = (uint32_t)b->pool_size, .length = (uint32_t)length };
+    b->pool_size += length + 1;
+    b->names[slot] = ++index->nkeys;
+    *key = index->nkeys - 1;
+
+    /* Keep the hash at most half full. */
+    if (index->nkeys * 2 > b->names_mask) {
+        uint32_t mask = b->names_mask * 2 + 1;
+        uint32_t *names = sqlite3_malloc64(((uint64_t)mask + 1) * sizeof(uint32_t));
+
+        if (names == NULL)
+            return MMDB_OUT_OF_MEMORY_ERROR;
+
+        memset(names, 0, ((size_t)mask + 1) * sizeof(uint32_t));
+        for (uint32_t i = 0; i < index->nkeys; i++) {
+            const geoip_index_key *known = &index->keys[i];
+            uint32_t moved = index_hash(index->pool + known->text, known->length) & mask;
+
+            while (names[moved] != 0)
+                moved = (moved + 1) & mask;
+            names[moved] = i + 1;
+        }
+
+        sqlite3_free(b->names);
+        b->names = names;
+        b->names_mask = mask;
+    }
+
+    return MMDB_SUCCESS;
+}
+
+/**
+ * Look up a field by name.
+ * 
+ * @param name      'country', 'continent', 'asn' or 'city', compared case-insensitively.
+ * @return          The GEOIP_INDEX_* value, or -1 for an unknown name.
+ */
+int geoip_index_field(const char *name) {
+    for (int i = 0; name != NULL && i < GEOIP_INDEX_FIELDS; i++) {
+        if (sqlite3_stricmp(name, index_fields[i].name) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+/**
+ * The name of a field.
+ * 
+ * @param field     A GEOIP_INDEX_* value.
+ * @return          The name the field is looked up by.
+ */
+const char *geoip_index_name(int field) {
+    return index_fields[field].name;
+}
+
+/**
+ * Decode the value of a field from a record, as the index keeps it.
+ * 
+ * @param mmdb      The opened database.
+ * @param offset    The offset of the record in the data section.
+ * @param field     A GEOIP_INDEX_* value.
+ * @param number    A buffer of GEOIP_INDEX_NUMBER bytes autonomous system numbers are written to as text.
+ * @param text      Receives the value, within the data section or number and not NUL terminated.
+ * @return          The length of the value, 0 when the record does not have the field.
+ */
+size_t geoip_index_value(const MMDB_s *mmdb, uint32_t offset, int field, char *number, const char **text) {
+    MMDB_entry_s entry = { .mmdb = mmdb, .offset = offset };
+    MMDB_entry_data_s entry_data;
+
+    if (MMDB_aget_value(&entry, &entry_data, index_fields[field].path) != MMDB_SUCCESS || !entry_data.has_data)
+        return 0;
+
+    if (entry_data.type == MMDB_DATA_TYPE_UTF8_STRING && field != GEOIP_INDEX_ASN) {
+        *text = entry_data.utf8_string;
+        return entry_data.data_size;
+    }
+
+    if (entry_data.type == MMDB_DATA_TYPE_UINT32 && field == GEOIP_INDEX_ASN) {
+        *text = number;
+        return (size_t)snprintf(number, GEOIP_INDEX_NUMBER, "%u", entry_data.uint32);
+    }
+
+    return 0;
+}
+
+/**
+ * Find the value a record holds, decoding each record once for all the networks sharing it.
+ * 
+ * @param b         The builder.
+ * @param offset    The offset of the record in the data section.
+ * @param key       Receives the position of the value, or UINT32_MAX when the record does not have the field.
+ * @return          MMDB_SUCCESS or MMDB_OUT_OF_MEMORY_ERROR.
+ */
+static int index_key(index_builder *b, uint32_t offset, uint32_t *key) {
+    if (geoip_memo_get(&b->memo, offset, key))
+        return MMDB_SUCCESS;
+
+    char number[GEOIP_INDEX_NUMBER];
+    const char *text;
+    size_t length = geoip_index_value(b->mmdb, offset, b->field, number, &text);
+
+    *key = UINT32_MAX;
+    if (length > 0) {
+        int status = index_intern(b, text, length, key);
+        if (status != MMDB_SUCCESS)
+            return status;
+    }
+
+    return geoip_memo_put(&b->memo, offset, *key);
+}
+
+/**
+ * Add a network of the search tree to the group of the value its record holds.
+ * 
+ * @param arg       The index_builder.
+ * @param prefix    The network address.
+ * @param length    The prefix length out of 128 bits.
+ * @param offset    The offset of the record of the network.
+ * @return          MMDB_SUCCESS or MMDB_OUT_OF_MEMORY_ERROR.
+ */
+static int index_add_network(void *arg, const uint8_t *prefix, int length, uint32_t offset) {
+    index_builder *b = arg;
+    geoip_index *index = b->index;
+    uint32_t key;
+
+    int status = index_key(b, offset, &key);
+    if (status != MMDB_SUCCESS || key == UINT32_MAX)
+        return status;
+
+    if (index->nnetworks == UINT32_MAX)
+        return MMDB_OUT_OF_MEMORY_ERROR;
+
+    status = geoip_reserve((void **)&index->networks, &b->net_capacity, index->nnetworks, sizeof(geoip_index_network));
+    if (status != MMDB_SUCCESS)
+        return status;
+
+    geoip_index_network *network = &index->networks[index->nnetworks++];
+    memcpy(network->prefix, prefix, 16);
+    network->offset = offset;
+    network->key = key;
+    network->length = (uint8_t)length;
+
+    index->keys[key].count++;
+    return MMDB_SUCCESS;
+}
+
+/**
+ * A value along with its position while the values are put in order.
+ */
+typedef struct index_order {
+    const char *text; /**< The value. */
+    uint32_t key;     /**< Its position in the order the walk found it. */
+} index_order;
+
+static int index_compare_order(const void *a, const void *b) {
+    return strcmp(((const index_order *)a)->text, ((const index_order *)b)->text);
+}
+
+static int index_compare_networks(const void *a, const void *b) {
+    const geoip_index_network *x = a, *y = b;
+
+    if (x->key != y->key)
+        return (x->key > y->key) - (x->key < y->key);
+
+    int c = memcmp(x->prefix, y->prefix, 16);
+    return c != 0 ? c : (x->length > y->length) - (x->length < y->length);
+}
+
+/**
+ * Put the values in strcmp() order and group the networks by value.
+ * 
+ * @param index     The index, with the values in the order the walk found them.
+ * @return          MMDB_SUCCESS or MMDB_OUT_OF_MEMORY_ERROR.
+ */
+static int index_sort(geoip_index *index) {
+    index_order *order = sqlite3_malloc64(((uint64_t)index->nkeys + 1) * sizeof(index_order));
+    uint32_t *rank = sqlite3_malloc64(((uint64_t)index->nkeys + 1) * sizeof(uint32_t));
+    geoip_index_key *keys = sqlite3_malloc64(((uint64_t)index->nkeys + 1) * sizeof(geoip_index_key));
+
+    if (order == NULL || rank == NULL || keys == NULL) {
+        sqlite3_free(order);
+        sqlite3_free(rank);
+        sqlite3_free(keys);
+        return MMDB_OUT_OF_MEMORY_ERROR;
+    }
+
+    for (uint32_t i = 0; i < index->nkeys; i++)
+        order[i] = (index_order){ .text = index->pool + index->keys[i].text, .key = i };
+
+    qsort(order, index->nkeys, sizeof(index_order), index_compare_order);
+
+    uint32_t first = 0;
+    for (uint32_t i = 0; i < index->nkeys; i++) {
+        const geoip_index_key *key = &index->keys[order[i].key];
+
+        rank[order[i].key] = i;
+        keys[i] = (geoip_index_key){ .text = key->text, .length = key->length, .first = first, .count = key->count };
+        first += key->count;
+    }
+
+    for (uint32_t i = 0; i < index->nnetworks; i++)
+        index->networks[i].key = rank[index->networks[i].key];
+
+    qsort(index->networks, index->nnetworks, sizeof(geoip_index_network), index_compare_networks);
+
+    sqlite3_free(index->keys);
+    index->keys = keys;
+    sqlite3_free(order);
+    sqlite3_free(rank);
+    return MMDB_SUCCESS;
+}
+
+static void index_free(geoip_index *index) {
+    if (index == NULL)
+        return;
+
+    sqlite3_free(index->pool);
+    sqlite3_free(index->keys);
+    sqlite3_free(index->networks);
+    sqlite3_free(index);
+}
+
+/**
+ * Build the index of one field of a database.
+ * 
+ * One walk over the search tree visits the IPv4 networks, then the IPv6 networks that are not aliases of the IPv4
+ * part, so every address is covered by one network at most.
+ * 
+ * @param mmdb      The opened database.
+ * @param field     A GEOIP_INDEX_* value.
+ * @param built     Receives the index.
+ * @return          MMDB_SUCCESS or a libmaxminddb error code.
+ */
+static int index_build(const MMDB_s *mmdb, int field, geoip_index **built) {
+    index_builder b = { .mmdb = mmdb, .field = field, .names_mask = INDEX_NAME_SLOTS - 1 };
+    int status = MMDB_OUT_OF_MEMORY_ERROR;
+
+    b.index = sqlite3_malloc(sizeof(geoip_index));
+    b.names = sqlite3_malloc64(INDEX_NAME_SLOTS * sizeof(uint32_t));
+
+    if (b.index != NULL && b.names != NULL && geoip_memo_init(&b.memo, INDEX_MEMO_SLOTS) == MMDB_SUCCESS) {
+        memset(b.index, 0, sizeof(geoip_index));
+        memset(b.names, 0, INDEX_NAME_SLOTS * sizeof(uint32_t));
+
+        status = geoip_tree_networks(mmdb, GEOIP_NETWORKS_IPV4, index_add_network, &b);
+        if (status == MMDB_SUCCESS)
+            status = geoip_tree_networks(mmdb, GEOIP_NETWORKS_IPV6, index_add_network, &b);
+        if (status == MMDB_SUCCESS)
+            status = index_sort(b.index);
+    }
+
+    sqlite3_free(b.names);
+    geoip_memo_free(&b.memo);
+
+    if (status != MMDB_SUCCESS) {
+        index_free(b.index);
+        return status;
+    }
+
+    *built = b.index;
+    return MMDB_SUCCESS;
+}
+
+/**
+ * Get the index of one field of a database, building it the first time it is asked for.
+ * 
+ * An index belongs to the opened file and is released along with it, a file opened again under "geoip_open" gets new
+ * indexes. Builds are serialized on the SQLITE_MUTEX_STATIC_APP2 mutex so every index is built once, reading a built
+ * index takes a single acquire load. A failed build is retried by the next call.
+ * 
+ * @param db        The opened database.
+ * @param field     A GEOIP_INDEX_* value.
+ * @param index     Receives the index, valid as long as the database is.
+ * @return          MMDB_SUCCESS or a libmaxminddb error code.
+ */
+int geoip_index_get(geoip_db *db, int field, const geoip_index **index) {
+    geoip_index *built = atomic_load_explicit(&db->index[field], memory_order_acquire);
+    int status = MMDB_SUCCESS;
+
+    if (built == NULL) {
+        sqlite3_mutex *mutex = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP2);
+        sqlite3_mutex_enter(mutex);
+
+        built = atomic_load_explicit(&db->index[field], memory_order_relaxed);
+        if (built == NULL) {
+            status = index_build(&db->mmdb, field, &built);
+            if (status == MMDB_SUCCESS)
+                atomic_store_explicit(&db->index[field], built, memory_order_release);
+        }
+
+        sqlite3_mutex_leave(mutex);
+    }
+
+    *index = built;
+    return status;
+}
+
+/**
+ * Find a value in an index.
+ * 
+ * @param index     The index.
+ * @param value     The value, compared exactly.
+ * @return          The value and its networks, or NULL when no network has it.
+ */
+const geoip_index_key *geoip_index_find(const geoip_index *index, const char *value) {
+    uint32_t lo = 0, hi = index->nkeys;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int c = strcmp(index->pool + index->keys[mid].text, value);
+
+        if (c == 0)
+            return &index->keys[mid];
+
+        if (c < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return NULL;
+}
+
+/**
+ * Release every index of a database.
+ * 
+ * Must be called with the SQLITE_MUTEX_STATIC_APP1 mutex held, once no connection can be reading the indexes.
+ * 
+ * @param db    The database.
+ */
+void geoip_index_release(geoip_db *db) {
+    for (int i = 0; i < GEOIP_INDEX_FIELDS; i++)
+        index_free(atomic_exchange_explicit(&db->index[i], NULL, memory_order_acq_rel));
+}
+
+/**
+ * The columns of the geoip_networks_by virtual table, in declaration order.
+ */
+enum {
+    NETWORKS_COLUMN_NETWORK,
+    NETWORKS_COLUMN_ID,
+    NETWORKS_COLUMN_FIELD,
+    NETWORKS_COLUMN_VALUE,
+    NETWORKS_COLUMN_DB
+};
+
+#define NETWORKS_ARGS 1 /**< An idxNum bit, the hidden field and value columns are constrained. */
+#define NETWORKS_DB   2 /**< An idxNum bit, the hidden db column names the database. */
+
+/**
+ * A cursor over the networks of one value.
+ */
+typedef struct networks_cursor {
+    sqlite3_vtab_cursor base;             /**< The base class, must come first. */
+    geoip_db *db;                         /**< The database the networks come from. */
+    int field;                            /**< The GEOIP_INDEX_* value of the field. */
+    const char *value;                    /**< The value as the index keeps it, owned by the index. */
+    const geoip_index_network *networks;  /**< The networks of the value, owned by the index. */
+    uint32_t count;                       /**< The number of networks. */
+    uint32_t row;                         /**< The current network. */
+} networks_cursor;
+
+static int networks_connect(sqlite3 *db, void *pAux, int argc, const char *const *argv, sqlite3_vtab **ppVtab, char **pzErr) {
+    (void)pAux; (void)argc; (void)argv; (void)pzErr;  /* Unused parameters */
+
+    int rc = sqlite3_declare_vtab(db, "CREATE TABLE x(network TEXT, id INTEGER, field HIDDEN, value HIDDEN, db HIDDEN)");
+    if (rc != SQLITE_OK)
+        return rc;
+
+    sqlite3_vtab *vtab = sqlite3_malloc(sizeof(sqlite3_vtab));
+    if (vtab == NULL)
+        return SQLITE_NOMEM;
+
+    memset(vtab, 0, sizeof(*vtab));
+    *ppVtab = vtab;
+    return SQLITE_OK;
+}
+
+static int networks_disconnect(sqlite3_vtab *pVtab) {
+    sqlite3_free(pVtab);
+    return SQLITE_OK;
+}
+
+/**
+ * Plan a lookup: equalities on field and value, and optionally db, are handed to the filter. Without them there is
+ * nothing to look up, which the filter reports.
+ */
+static int networks_best_index(sqlite3_vtab *pVtab, sqlite3_index_info *pInfo) {
+    (void)pVtab;  /* Unused parameter */
+    int args[3] = { -1, -1, -1 };
+
+    for (int i = 0; i < pInfo->nConstraint; i++) {
+        const struct sqlite3_index_constraint *constraint = &pInfo->aConstraint[i];
+
+        if (constraint->op != SQLITE_INDEX_CONSTRAINT_EQ || constraint->iColumn < NETWORKS_COLUMN_FIELD)
+            continue;
+
+        if (!constraint->usable)
+            return SQLITE_CONSTRAINT;
+
+        args[constraint->iColumn - NETWORKS_COLUMN_FIELD] = i;
+    }
+
+    pInfo->idxNum = 0;
+    if (args[0] < 0 || args[1] < 0) {
+        pInfo->estimatedCost = 1e12;
+        return SQLITE_OK;
+    }
+
+    pInfo->idxNum = NETWORKS_ARGS | (args[2] >= 0 ? NETWORKS_DB : 0);
+    for (int i = 0; i < 3; i++) {
+        if (args[i] >= 0) {
+            pInfo->aConstraintUsage[args[i]].argvIndex = i + 1;
+            pInfo->aConstraintUsage[args[i]].omit = 1;
+        }
+    }
+
+    pInfo->estimatedCost = 100;
+    pInfo->estimatedRows = 1000;
+    return SQLITE_OK;
+}
+
+static int networks_open(sqlite3_vtab *pVtab, sqlite3_vtab_cursor **ppCursor) {
+    (void)pVtab;  /* Unused parameter */
+
+    networks_cursor *cursor = sqlite3_malloc(sizeof(networks_cursor));
+    if (cursor == NULL)
+        return SQLITE_NOMEM;
+
+    memset(cursor, 0, sizeof(*cursor));
+    *ppCursor = &cursor->base;
+    return SQLITE_OK;
+}
+
+static int networks_close(sqlite3_vtab_cursor *pCursor) {
+    sqlite3_free(pCursor);
+    return SQLITE_OK;
+}
+
+/**
+ * Report an error through the virtual table.
+ * 
+ * @param cursor    The cursor the error happened on.
+ * @param msg       The error message, taken over.
+ * @return          SQLITE_ERROR.
+ */
+static int networks_error(networks_cursor *cursor, char *msg) {
+    sqlite3_vtab *vtab = cursor->base.pVtab;
+
+    sqlite3_free(vtab->zErrMsg);
+    vtab->zErrMsg = msg;
+    return SQLITE_ERROR;
+}
+
+static int networks_filter(sqlite3_vtab_cursor *pCursor, int idxNum, const char *idxStr, int argc, sqlite3_value **argv) {
+    (void)idxStr; (void)argc;  /* Unused parameters */
+    networks_cursor *cursor = (networks_cursor *)pCursor;
+
+    cursor->networks = NULL;
+    cursor->count = cursor->row = 0;
+
+    if (!initialized)
+        return networks_error(cursor, sqlite3_mprintf(MSG_NOTINITIALIZED));
+
+    if (!(idxNum & NETWORKS_ARGS))
+        return networks_error(cursor, sqlite3_mprintf("geoip_networks_by takes a field and a value, as in geoip_networks_by('asn', 13335)"));
+
+    int field = geoip_index_field((const char *)sqlite3_value_text(argv[0]));
+    if (field < 0)
+        return networks_error(cursor, sqlite3_mprintf("Unknown field, expected 'country', 'continent', 'asn' or 'city'"));
+
+    geoip_db *db = idxNum & NETWORKS_DB ? geoip_db_find((const char *)sqlite3_value_text(argv[2])) :
+        field == GEOIP_INDEX_ASN ? &db_asn : &db_cnt;
+    if (db == NULL)
+        return networks_error(cursor, sqlite3_mprintf(MSG_UNKNOWNDB));
+
+    if (sqlite3_value_type(argv[1]) == SQLITE_NULL)
+        return SQLITE_OK;
+
+    /* Codes and numbers are written the way the index keeps them, city names are compared as given. */
+    char key[GEOIP_INDEX_NUMBER];
+    const char *value = key;
+
+    if (field == GEOIP_INDEX_CITY) {
+        value = (const char *)sqlite3_value_text(argv[1]);
+    } else if (field == GEOIP_INDEX_ASN) {
+        uint32_t number = geoip_set_key(GEOIP_SET_ASN, argv[1]);
+
+        if (number == 0)
+            return networks_error(cursor, sqlite3_mprintf("Not an autonomous system number: %s", sqlite3_value_text(argv[1])));
+
+        snprintf(key, sizeof(key), "%u", number);
+    } else {
+        uint32_t code = geoip_set_key(GEOIP_SET_COUNTRY, argv[1]);
+
+        if (code == 0)
+            return networks_error(cursor, sqlite3_mprintf("Not a two letter code: %s", sqlite3_value_text(argv[1])));
+
+        snprintf(key, sizeof(key), "%c%c", (char)(code >> 8), (char)(code & 0xFF));
+    }
+
+    if (value == NULL)
+        return SQLITE_NOMEM;
+
+    const geoip_index *index;
+    int status = geoip_db_acquire(db);
+    if (status == MMDB_SUCCESS)
+        status = geoip_index_get(db, field, &index);
+
+    if (status == MMDB_OUT_OF_MEMORY_ERROR)
+        return SQLITE_NOMEM;
+
+    if (status != MMDB_SUCCESS)
+        return networks_error(cursor, sqlite3_mprintf(MSG_ERRLIBMAXMIND, MMDB_strerror(status)));
+
+    const geoip_index_key *found = geoip_index_find(index, value);
+    if (found != NULL) {
+        cursor->db = db;
+        cursor->field = field;
+        cursor->value = index->pool + found->text;
+        cursor->networks = index->networks + found->first;
+        cursor->count = found->count;
+    }
+
+    return SQLITE_OK;
+}
+
+static int networks_next(sqlite3_vtab_cursor *pCursor) {
+    ((networks_cursor *)pCursor)->row++;
+    return SQLITE_OK;
+}
+
+static int networks_eof(sqlite3_vtab_cursor *pCursor) {
+    networks_cursor *cursor = (networks_cursor *)pCursor;
+
+    return cursor->row >= cursor->count;
+}
+
+static int networks_column(sqlite3_vtab_cursor *pCursor, sqlite3_context *context, int column) {
+    networks_cursor *cursor = (networks_cursor *)pCursor;
+    const geoip_index_network *network = &cursor->networks[cursor->row];
+
+    switch (column) {
+    case NETWORKS_COLUMN_NETWORK: {
+        /* IPv4 networks are written in dotted decimal with their prefix length out of 32 bits, like ip_in_cidr() reads them. */
+        geoip_addr addr = { .family = AF_INET6 };
+        char text[GEOIP_IP_TEXT];
+
+        memcpy(addr.bytes, network->prefix, 16);
+        if (geoip_format_address(&addr, text, sizeof(text)) < 0)
+            return SQLITE_ERROR;
+
+        int length = network->length;
+        if (strchr(text, ':') == NULL)
+            length -= 96;
+
+        char *cidr = sqlite3_mprintf("%s/%d", text, length);
+        if (cidr == NULL)
+            return SQLITE_NOMEM;
+
+        sqlite3_result_text(context, cidr, -1, sqlite3_free);
+        break;
+    }
+    case NETWORKS_COLUMN_ID:
+        sqlite3_result_int64(context, network->offset);
+        break;
+    case NETWORKS_COLUMN_FIELD:
+        sqlite3_result_text(context, index_fields[cursor->field].name, -1, SQLITE_STATIC);
+        break;
+    case NETWORKS_COLUMN_VALUE:
+        sqlite3_result_text(context, cursor->value, -1, SQLITE_TRANSIENT);
+        break;
+    case NETWORKS_COLUMN_DB:
+        sqlite3_result_text(context, cursor->db->alias, -1, SQLITE_TRANSIENT);
+        break;
+    }
+
+    return SQLITE_OK;
+}
+
+static int networks_rowid(sqlite3_vtab_cursor *pCursor, sqlite_int64 *pRowid) {
+    *pRowid = ((networks_cursor *)pCursor)->row;
+    return SQLITE_OK;
+}
+
+static sqlite3_module networks_module = {
+    .iVersion = 0,
+    .xCreate = NULL,             /* Eponymous-only, "CREATE VIRTUAL TABLE" is not supported */
+    .xConnect = networks_connect,
+    .xBestIndex = networks_best_index,
+    .xDisconnect = networks_disconnect,
+    .xDestroy = networks_disconnect,
+    .xOpen = networks_open,
+    .xClose = networks_close,
+    .xFilter = networks_filter,
+    .xNext = networks_next,
+    .xEof = networks_eof,
+    .xColumn = networks_column,
+    .xRowid = networks_rowid
+};
+
+/**
+ * Register the geoip_networks_by table-valued function.
+ * 
+ * @param db    The current SQLite3 database context.
+ * @return      An SQLite3 result code.
+ */
+int geoip_index_register(sqlite3 *db) {
+    return sqlite3_create_module(db, "geoip_networks_by", &networks_module, 0);
+}
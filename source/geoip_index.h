@@ -0,0 +1,63 @@
+#ifndef GEOIP_INDEX_H
+#define GEOIP_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "maxminddb.h"
+
+typedef struct sqlite3 sqlite3;
+typedef struct geoip_db geoip_db;
+
+#define GEOIP_INDEX_NUMBER 16 /**< The size of a buffer holding an autonomous system number as text, including the NUL. */
+
+/**
+ * The fields "geoip_networks_by" can look networks up by.
+ */
+enum {
+    GEOIP_INDEX_COUNTRY,   /**< "country.iso_code", two letter codes. */
+    GEOIP_INDEX_CONTINENT, /**< "continent.code", two letter codes. */
+    GEOIP_INDEX_ASN,       /**< "autonomous_system_number", kept as decimal text. */
+    GEOIP_INDEX_CITY,      /**< "city.names.en", the name "geoip_city" returns. */
+    GEOIP_INDEX_FIELDS     /**< The number of fields. */
+};
+
+/**
+ * A network whose record holds a value of the indexed field.
+ */
+typedef struct geoip_index_network {
+    uint8_t prefix[16]; /**< The network address in the form geoip_addr holds it, the bits past length are zero. */
+    uint32_t offset;    /**< The offset of the record in the data section, the id "geoip_record_id" returns. */
+    uint32_t key;       /**< The position of the value in geoip_index.keys. */
+    uint8_t length;     /**< The prefix length out of 128 bits. */
+} geoip_index_network;
+
+/**
+ * A value of the indexed field and the networks whose record holds it.
+ */
+typedef struct geoip_index_key {
+    uint32_t text;   /**< The offset of the value in geoip_index.pool. */
+    uint32_t length; /**< The length of the value, without its NUL. */
+    uint32_t first;  /**< The position of the first network of the value in geoip_index.networks. */
+    uint32_t count;  /**< The number of networks holding the value. */
+} geoip_index_key;
+
+/**
+ * The inverted index of one field of one database: every value the field takes, each with its networks.
+ */
+typedef struct geoip_index {
+    char *pool;                    /**< The values as NUL terminated text, one after another. */
+    geoip_index_key *keys;         /**< The values in strcmp() order. */
+    uint32_t nkeys;                /**< The number of values. */
+    geoip_index_network *networks; /**< The networks grouped by value, each group in ip_to_blob() order. */
+    uint32_t nnetworks;            /**< The number of networks. */
+} geoip_index;
+
+int geoip_index_field(const char *name);
+const char *geoip_index_name(int field);
+size_t geoip_index_value(const MMDB_s *mmdb, uint32_t offset, int field, char *number, const char **text);
+int geoip_index_get(geoip_db *db, int field, const geoip_index **index);
+const geoip_index_key *geoip_index_find(const geoip_index *index, const char *value);
+void geoip_index_release(geoip_db *db);
+int geoip_index_register(sqlite3 *db);
+
+#endif /* GEOIP_INDEX_H */
@@ -0,0 +1,355 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "geoip.h"
+#include <sqlite3ext.h>
+SQLITE_EXTENSION_INIT3
+
+/**
+ * The first twelve bytes of every IPv4-mapped IPv6 address, ::ffff:0:0/96.
+ */
+static const uint8_t ip_v4_prefix[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF };
+
+/**
+ * Read an address from a function argument.
+ * 
+ * Text goes through geoip_parse_address(). A 16 byte BLOB is taken as an address in network byte order, as
+ * ip_to_blob() returns it, and a 4 byte BLOB or an integer between 0 and 2^32 - 1 as an IPv4 address, as ip_to_int()
+ * returns it. None of them are parsed, so stored BLOBs and integers are the cheapest input a lookup can get.
+ * 
+ * @param value     The argument, not NULL.
+ * @param addr      Receives the address.
+ * @return          0 on success, otherwise a getaddrinfo error code.
+ */
+int geoip_value_address(sqlite3_value *value, geoip_addr *addr) {
+    switch (sqlite3_value_type(value)) {
+    case SQLITE_BLOB: {
+        const uint8_t *bytes = sqlite3_value_blob(value);
+        int length = sqlite3_value_bytes(value);
+
+        if (length == 16) {
+            memcpy(addr->bytes, bytes, 16);
+            addr->family = memcmp(bytes, ip_v4_prefix, sizeof(ip_v4_prefix)) == 0 ? AF_INET : AF_INET6;
+            return 0;
+        }
+
+        if (length == 4) {
+            memcpy(addr->bytes, ip_v4_prefix, sizeof(ip_v4_prefix));
+            memcpy(addr->bytes + 12, bytes, 4);
+            addr->family = AF_INET;
+            return 0;
+        }
+
+        return EAI_NONAME;
+    }
+    case SQLITE_INTEGER: {
+        sqlite3_int64 number = sqlite3_value_int64(value);
+
+        if (number < 0 || number > UINT32_MAX)
+            return EAI_NONAME;
+
+        memcpy(addr->bytes, ip_v4_prefix, sizeof(ip_v4_prefix));
+        for (int i = 0; i < 4; i++)
+            addr->bytes[12 + i] = (uint8_t)(number >> (24 - 8 * i));
+        addr->family = AF_INET;
+        return 0;
+    }
+    default: {
+        const char *text = (const char *)sqlite3_value_text(value);
+
+        /* Converting a number to text can run out of memory. */
+        return text != NULL ? geoip_parse_address(text, addr) : EAI_MEMORY;
+    }
+    }
+}
+
+/**
+ * Describe a function argument holding an address, for error messages.
+ * 
+ * @param value     The argument.
+ * @return          The text of the argument, or a placeholder when it is a BLOB or its text could not be made.
+ */
+const char *geoip_value_text(sqlite3_value *value) {
+    if (sqlite3_value_type(value) == SQLITE_BLOB)
+        return "(BLOB)";
+
+    const char *text = (const char *)sqlite3_value_text(value);
+    return text != NULL ? text : "(NULL)";
+}
+
+/**
+ * Write an address as text, IPv4-mapped addresses in dotted decimal.
+ * 
+ * @param addr      The address.
+ * @param text      Receives the text, GEOIP_IP_TEXT bytes are always enough.
+ * @param size      The size of text.
+ * @return          The length of the text, or -1 if it did not fit.
+ */
+int geoip_format_address(const geoip_addr *addr, char *text, size_t size) {
+    bool v4 = memcmp(addr->bytes, ip_v4_prefix, sizeof(ip_v4_prefix)) == 0;
+
+    if (inet_ntop(v4 ? AF_INET : AF_INET6, v4 ? addr->bytes + 12 : addr->bytes, text, size) == NULL)
+        return -1;
+
+    return (int)strlen(text);
+}
+
+/**
+ * Parse a network written as an address and a prefix length.
+ * 
+ * An IPv4 network is mapped into ::ffff:0:0/96 like IPv4 addresses are, its prefix length growing by 96. An address
+ * without a prefix length is a network of one address. Bits past the prefix are ignored.
+ * 
+ * @param cidr      The network, such as '192.0.2.0/24' or '2001:db8::/32'.
+ * @param addr      Receives the address.
+ * @param length    Receives the prefix length out of 128 bits.
+ * @return          0 on success, -1 when the text is not a network.
+ */
+int geoip_parse_cidr(const char *cidr, geoip_addr *addr, int *length) {
+    char text[GEOIP_IP_TEXT];
+    const char *slash = strchr(cidr, '/');
+    size_t size = slash != NULL ? (size_t)(slash - cidr) : strlen(cidr);
+
+    if (size >= sizeof(text))
+        return -1;
+
+    memcpy(text, cidr, size);
+    text[size] = '\0';
+
+    if (geoip_parse_address(text, addr) != 0)
+        return -1;
+
+    const int bits = addr->family == AF_INET ? 32 : 128;
+    if (slash == NULL) {
+        *length = 128;
+        return 0;
+    }
+
+    char *end;
+    long prefix = strtol(slash + 1, &end, 10);
+    if (slash[1] < '0' || slash[1] > '9' || *end != '\0' || prefix > bits)
+        return -1;
+
+    *length = (int)prefix + 128 - bits;
+    return 0;
+}
+
+/**
+ * Read the address argument of an encoding function.
+ * 
+ * @param context   The current SQLite3 function context structure/object.
+ * @param value     The argument.
+ * @param addr      Receives the address.
+ * @return          Whether there is an address, otherwise the argument was NULL or an error was raised.
+ */
+static bool ip_argument(sqlite3_context *context, sqlite3_value *value, geoip_addr *addr) {
+    if (sqlite3_value_type(value) == SQLITE_NULL)
+        return false;
+
+    int gai_error = geoip_value_address(value, addr);
+    if (gai_error == EAI_MEMORY) {
+        sqlite3_result_error_nomem(context);
+        return false;
+    }
+
+    if (gai_error != 0) {
+        char msg[4096];
+
+        snprintf(msg, sizeof(msg), MSG_ERRGETADDRINFO, geoip_value_text(value), gai_strerror(gai_error));
+        sqlite3_result_error(context, msg, -1);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Read the network argument of an encoding function.
+ * 
+ * @param context   The current SQLite3 function context structure/object.
+ * @param value     The argument.
+ * @param addr      Receives the address of the network.
+ * @param length    Receives the prefix length out of 128 bits.
+ * @return          Whether there is a network, otherwise the argument was NULL or an error was raised.
+ */
+static bool ip_cidr_argument(sqlite3_context *context, sqlite3_value *value, geoip_addr *addr, int *length) {
+    if (sqlite3_value_type(value) == SQLITE_NULL)
+        return false;
+
+    const char *cidr = (const char *)sqlite3_value_text(value);
+    if (cidr == NULL) {
+        sqlite3_result_error_nomem(context);
+        return false;
+    }
+
+    if (geoip_parse_cidr(cidr, addr, length) != 0) {
+        char *msg = sqlite3_mprintf("Not a network in CIDR notation: %s", cidr);
+
+        sqlite3_result_error(context, msg != NULL ? msg : "Not a network in CIDR notation", -1);
+        sqlite3_free(msg);
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Convert an address to a 16 byte BLOB.
+ * 
+ * This function handles the "ip_to_blob" extension function. IPv4 addresses are mapped into ::ffff:0:0/96, so the
+ * BLOBs of both families compare with memcmp() in address order and an index on them serves range scans.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (should be 1).
+ * @param argv          The address.
+ */
+static void ip_to_blob(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    (void)argc;  /* Unused parameter */
+    geoip_addr addr;
+
+    if (ip_argument(context, argv[0], &addr))
+        sqlite3_result_blob(context, addr.bytes, sizeof(addr.bytes), SQLITE_TRANSIENT);
+}
+
+/**
+ * Convert a BLOB from "ip_to_blob" back to text.
+ * 
+ * This function handles the "blob_to_ip" extension function. IPv4-mapped addresses are written in dotted decimal.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (should be 1).
+ * @param argv          The BLOB.
+ */
+static void ip_blob_to_ip(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    (void)argc;  /* Unused parameter */
+    char text[GEOIP_IP_TEXT];
+    geoip_addr addr;
+
+    if (sqlite3_value_type(argv[0]) != SQLITE_NULL && sqlite3_value_type(argv[0]) != SQLITE_BLOB) {
+        sqlite3_result_error(context, "blob_to_ip expects a BLOB returned by ip_to_blob", -1);
+        return;
+    }
+
+    if (!ip_argument(context, argv[0], &addr))
+        return;
+
+    int length = geoip_format_address(&addr, text, sizeof(text));
+    sqlite3_result_text(context, text, length, SQLITE_TRANSIENT);
+}
+
+/**
+ * Convert an IPv4 address to an integer.
+ * 
+ * This function handles the "ip_to_int" extension function and returns the address as an integer between 0 and
+ * 2^32 - 1, which sorts in address order. IPv6 addresses do not fit and raise an error.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (should be 1).
+ * @param argv          The address.
+ */
+static void ip_to_int(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    (void)argc;  /* Unused parameter */
+    geoip_addr addr;
+
+    if (!ip_argument(context, argv[0], &addr))
+        return;
+
+    if (addr.family != AF_INET) {
+        sqlite3_result_error(context, "Only IPv4 addresses fit an integer, use ip_to_blob for IPv6", -1);
+        return;
+    }
+
+    const uint8_t *v4 = addr.bytes + 12;
+    sqlite3_result_int64(context, (sqlite3_int64)((uint32_t)v4[0] << 24 | (uint32_t)v4[1] << 16 | (uint32_t)v4[2] << 8 | v4[3]));
+}
+
+/**
+ * Mask the address of a network down to its first or up to its last address.
+ * 
+ * @param addr      The address, changed in place.
+ * @param length    The prefix length out of 128 bits.
+ * @param last      Whether to set the host bits rather than clear them.
+ */
+static void ip_mask(geoip_addr *addr, int length, bool last) {
+    for (int i = 0; i < 16; i++) {
+        int bits = length - 8 * i;
+        uint8_t host = bits >= 8 ? 0 : bits <= 0 ? 0xFF : (uint8_t)(0xFF >> bits);
+
+        addr->bytes[i] = last ? addr->bytes[i] | host : addr->bytes[i] & ~host;
+    }
+}
+
+/**
+ * Check whether an address belongs to a network.
+ * 
+ * This function handles the "ip_in_cidr" extension function and returns 1 or 0. IPv4 addresses and networks compare in
+ * their IPv4-mapped form, so '10.1.2.3' is in '::ffff:10.0.0.0/104'.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (should be 2).
+ * @param argv          The address and the network.
+ */
+static void ip_in_cidr(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    (void)argc;  /* Unused parameter */
+    geoip_addr addr, network;
+    int length;
+
+    if (!ip_argument(context, argv[0], &addr) || !ip_cidr_argument(context, argv[1], &network, &length))
+        return;
+
+    ip_mask(&addr, length, false);
+    ip_mask(&network, length, false);
+    sqlite3_result_int(context, memcmp(addr.bytes, network.bytes, sizeof(addr.bytes)) == 0);
+}
+
+/**
+ * Return the first or last address of a network as a BLOB.
+ * 
+ * This function handles the "cidr_start" and "cidr_end" extension functions, the user data telling which. The BLOBs
+ * compare like those of "ip_to_blob", so 'ip BETWEEN cidr_start(net) AND cidr_end(net)' is an index range scan.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (should be 1).
+ * @param argv          The network.
+ */
+static void ip_cidr_bound(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    (void)argc;  /* Unused parameter */
+    geoip_addr network;
+    int length;
+
+    if (!ip_cidr_argument(context, argv[0], &network, &length))
+        return;
+
+    ip_mask(&network, length, sqlite3_user_data(context) != NULL);
+    sqlite3_result_blob(context, network.bytes, sizeof(network.bytes), SQLITE_TRANSIENT);
+}
+
+/**
+ * Register the address encoding functions.
+ * 
+ * They never open a database, so they are deterministic and usable anywhere, including in indexes.
+ * 
+ * @param db    The current SQLite3 database context.
+ * @return      An SQLite3 result code.
+ */
+int geoip_ip_register(sqlite3 *db) {
+    const int flags = SQLITE_UTF8 | SQLITE_DETERMINISTIC | SQLITE_INNOCUOUS;
+    int rc;
+
+    rc = sqlite3_create_function(db, "ip_to_blob", 1, flags, 0, ip_to_blob, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "blob_to_ip", 1, flags, 0, ip_blob_to_ip, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "ip_to_int", 1, flags, 0, ip_to_int, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "ip_in_cidr", 2, flags, 0, ip_in_cidr, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "cidr_start", 1, flags, 0, ip_cidr_bound, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    return sqlite3_create_function(db, "cidr_end", 1, flags, (void *)1, ip_cidr_bound, 0, 0);
+}
@@ -0,0 +1,18 @@
+#ifndef GEOIP_IP_H
+#define GEOIP_IP_H
+
+#include <stddef.h>
+
+typedef struct sqlite3 sqlite3;
+typedef struct sqlite3_value sqlite3_value;
+typedef struct geoip_addr geoip_addr;
+
+#define GEOIP_IP_TEXT 46 /**< The size of the longest address geoip_format_address() writes, including the terminating NUL. */
+
+int geoip_value_address(sqlite3_value *value, geoip_addr *addr);
+const char *geoip_value_text(sqlite3_value *value);
+int geoip_parse_cidr(const char *cidr, geoip_addr *addr, int *length);
+int geoip_format_address(const geoip_addr *addr, char *text, size_t size);
+int geoip_ip_register(sqlite3 *db);
+
+#endif /* GEOIP_IP_H */
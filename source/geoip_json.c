@@ -0,0 +1,304 @@
+#include <math.h>
+#include <string.h>
+#include "geoip.h"
+#include <sqlite3ext.h>
+SQLITE_EXTENSION_INIT3
+
+/**
+ * The state of one record being serialized straight from the data section.
+ */
+typedef struct json_decoder {
+    const uint8_t *data; /**< The data section. */
+    uint32_t size;       /**< The size of the data section. */
+    sqlite3_str *str;    /**< The JSON text being built. */
+} json_decoder;
+
+/**
+ * Append a JSON string literal.
+ * 
+ * @param str       The string being built.
+ * @param value     The characters to quote, which do not have to be NUL terminated.
+ * @param length    The number of bytes in value.
+ */
+void geoip_json_append_string(sqlite3_str *str, const char *value, size_t length) {
+    sqlite3_str_appendchar(str, 1, '"');
+
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)value[i];
+
+        if (c == '"' || c == '\\')
+            sqlite3_str_appendf(str, "\\%c", c);
+        else if (c < 0x20)
+            sqlite3_str_appendf(str, "\\u%04x", c);
+        else
+            sqlite3_str_appendchar(str, 1, (char)c);
+    }
+
+    sqlite3_str_appendchar(str, 1, '"');
+}
+
+/**
+ * Read a big-endian unsigned integer of up to eight bytes.
+ * 
+ * @param bytes     The first byte.
+ * @param size      The number of bytes.
+ * @return          The value.
+ */
+static uint64_t json_uint(const uint8_t *bytes, uint32_t size) {
+    uint64_t value = 0;
+
+    for (uint32_t i = 0; i < size; i++)
+        value = value << 8 | bytes[i];
+
+    return value;
+}
+
+/**
+ * Append a run of bytes as a string of hexadecimal digits.
+ * 
+ * @param str       The JSON text being built.
+ * @param prefix    Text put in front of the digits inside the quotes.
+ * @param bytes     The bytes.
+ * @param size      The number of bytes.
+ */
+static void json_append_hex(sqlite3_str *str, const char *prefix, const uint8_t *bytes, uint32_t size) {
+    sqlite3_str_appendf(str, "\"%s", prefix);
+    for (uint32_t i = 0; i < size; i++)
+        sqlite3_str_appendf(str, "%02x", bytes[i]);
+    sqlite3_str_appendchar(str, 1, '"');
+}
+
+/**
+ * Serialize one value of the data section and everything it contains.
+ * 
+ * This follows the MaxMind DB data section format without building libmaxminddb's entry data list: pointers are
+ * followed in place and every value is written out as soon as it is decoded, so serializing a record allocates
+ * nothing beyond the growing JSON text.
+ * 
+ * @param d         The decoder.
+ * @param offset    The offset of the value, advanced past it.
+ * @param depth     The number of maps and arrays the value is nested in.
+ * @param key       Whether the value is a map key, which has to be a string.
+ * @return          MMDB_SUCCESS, or MMDB_INVALID_DATA_ERROR when the data section is corrupt.
+ */
+static int json_decode(json_decoder *d, uint32_t *offset, int depth, bool key) {
+    uint32_t pos = *offset;
+
+    if (depth > GEOIP_JSON_MAX_DEPTH || pos >= d->size)
+        return MMDB_INVALID_DATA_ERROR;
+
+    uint8_t ctrl = d->data[pos++];
+    int type = ctrl >> 5;
+
+    if (type == MMDB_DATA_TYPE_POINTER) {
+        uint32_t length = ((ctrl >> 3) & 3) + 1;
+        static const uint32_t bias[] = { 0, 0, 2048, 526336, 0 };
+
+        if (length > d->size - pos)
+            return MMDB_INVALID_DATA_ERROR;
+
+        uint32_t target = (uint32_t)json_uint(d->data + pos, length);
+        if (length < 4)
+            target = (target | (uint32_t)(ctrl & 7) << (8 * length)) + bias[length];
+
+        /* A pointer may not point at another pointer, which also rules out pointer cycles. */
+        if (target >= d->size || d->data[target] >> 5 == MMDB_DATA_TYPE_POINTER)
+            return MMDB_INVALID_DATA_ERROR;
+
+        *offset = pos + length;
+        return json_decode(d, &target, depth, key);
+    }
+
+    if (type == MMDB_DATA_TYPE_EXTENDED) {
+        if (pos >= d->size)
+            return MMDB_INVALID_DATA_ERROR;
+
+        type = 7 + d->data[pos++];
+    }
+
+    uint32_t size = ctrl & 0x1F;
+    if (size >= 29) {
+        uint32_t length = size - 28;
+        static const uint32_t base[] = { 0, 29, 285, 65821 };
+
+        if (length > d->size - pos)
+            return MMDB_INVALID_DATA_ERROR;
+
+        size = base[length] + (uint32_t)json_uint(d->data + pos, length);
+        pos += length;
+    }
+
+    if (key && type != MMDB_DATA_TYPE_UTF8_STRING)
+        return MMDB_INVALID_DATA_ERROR;
+
+    /* Maps, arrays and booleans use the size for something else, every other type is followed by size bytes. */
+    if (type != MMDB_DATA_TYPE_MAP && type != MMDB_DATA_TYPE_ARRAY && type != MMDB_DATA_TYPE_BOOLEAN && size > d->size - pos)
+        return MMDB_INVALID_DATA_ERROR;
+
+    const uint8_t *bytes = d->data + pos;
+
+    switch (type) {
+    case MMDB_DATA_TYPE_UTF8_STRING:
+        geoip_json_append_string(d->str, (const char *)bytes, size);
+        break;
+    case MMDB_DATA_TYPE_DOUBLE:
+    case MMDB_DATA_TYPE_FLOAT: {
+        double value;
+
+        if (type == MMDB_DATA_TYPE_DOUBLE && size == 8) {
+            uint64_t bits = json_uint(bytes, 8);
+            memcpy(&value, &bits, sizeof(value));
+        } else if (type == MMDB_DATA_TYPE_FLOAT && size == 4) {
+            uint32_t bits = (uint32_t)json_uint(bytes, 4);
+            float single;
+
+            memcpy(&single, &bits, sizeof(single));
+            value = single;
+        } else {
+            return MMDB_INVALID_DATA_ERROR;
+        }
+
+        if (isfinite(value))
+            sqlite3_str_appendf(d->str, type == MMDB_DATA_TYPE_DOUBLE ? "%!.17g" : "%!.9g", value);
+        else
+            sqlite3_str_appendall(d->str, "null");
+        break;
+    }
+    case MMDB_DATA_TYPE_BYTES:
+        json_append_hex(d->str, "", bytes, size);
+        break;
+    case MMDB_DATA_TYPE_UINT16:
+    case MMDB_DATA_TYPE_UINT32:
+    case MMDB_DATA_TYPE_UINT64:
+        if (size > (type == MMDB_DATA_TYPE_UINT16 ? 2u : type == MMDB_DATA_TYPE_UINT32 ? 4u : 8u))
+            return MMDB_INVALID_DATA_ERROR;
+
+        sqlite3_str_appendf(d->str, "%llu", (unsigned long long)json_uint(bytes, size));
+        break;
+    case MMDB_DATA_TYPE_INT32:
+        if (size > 4)
+            return MMDB_INVALID_DATA_ERROR;
+
+        sqlite3_str_appendf(d->str, "%d", (int32_t)(uint32_t)json_uint(bytes, size));
+        break;
+    case MMDB_DATA_TYPE_UINT128:
+        /* Too wide for a JSON number any consumer reads back exactly. */
+        if (size > 16)
+            return MMDB_INVALID_DATA_ERROR;
+
+        json_append_hex(d->str, "0x", bytes, size);
+        break;
+    case MMDB_DATA_TYPE_BOOLEAN:
+        if (size > 1)
+            return MMDB_INVALID_DATA_ERROR;
+
+        sqlite3_str_appendall(d->str, size ? "true" : "false");
+        size = 0;
+        break;
+    case MMDB_DATA_TYPE_MAP:
+    case MMDB_DATA_TYPE_ARRAY: {
+        bool map = type == MMDB_DATA_TYPE_MAP;
+
+        sqlite3_str_appendchar(d->str, 1, map ? '{' : '[');
+        for (uint32_t i = 0; i < size; i++) {
+            int status;
+
+            if (i > 0)
+                sqlite3_str_appendchar(d->str, 1, ',');
+
+            if (map) {
+                status = json_decode(d, &pos, depth + 1, true);
+                if (status != MMDB_SUCCESS)
+                    return status;
+
+                sqlite3_str_appendchar(d->str, 1, ':');
+            }
+
+            status = json_decode(d, &pos, depth + 1, false);
+            if (status != MMDB_SUCCESS)
+                return status;
+        }
+        sqlite3_str_appendchar(d->str, 1, map ? '}' : ']');
+
+        *offset = pos;
+        return MMDB_SUCCESS;
+    }
+    default:
+        /* Containers and end markers never appear in a record. */
+        return MMDB_INVALID_DATA_ERROR;
+    }
+
+    *offset = pos + size;
+    return MMDB_SUCCESS;
+}
+
+/**
+ * Append a record of a database as JSON.
+ * 
+ * @param str       The JSON text being built.
+ * @param mmdb      The opened database.
+ * @param offset    The offset of the record in the data section, as found in MMDB_entry_s.offset.
+ * @return          MMDB_SUCCESS, or MMDB_INVALID_DATA_ERROR when the record is corrupt.
+ */
+int geoip_json_append_record(sqlite3_str *str, const MMDB_s *mmdb, uint32_t offset) {
+    json_decoder d = { .data = mmdb->data_section, .size = mmdb->data_section_size, .str = str };
+
+    return json_decode(&d, &offset, 0, false);
+}
+
+/**
+ * Find the JSON text of a record, serializing it on a cache miss.
+ * 
+ * @param cache     The cache of the calling connection.
+ * @param mmdb      The opened database.
+ * @param offset    The offset of the record in the data section.
+ * @param json      Receives the JSON text, owned by the cache and valid until the next call.
+ * @param length    Receives the length of the JSON text.
+ * @return          MMDB_SUCCESS, MMDB_INVALID_DATA_ERROR when the record is corrupt or MMDB_OUT_OF_MEMORY_ERROR.
+ */
+int geoip_json_record(geoip_json_cache *cache, const MMDB_s *mmdb, uint32_t offset, const char **json, int *length) {
+    uint32_t hash = (offset ^ (uint32_t)((uintptr_t)mmdb >> 4)) * 0x9E3779B1u;
+    geoip_json_entry *entry = &cache->entries[(hash >> 16) & (GEOIP_JSON_CACHE_SLOTS - 1)];
+
+    if (entry->mmdb == mmdb && entry->offset == offset) {
+        cache->hits++;
+        *json = entry->json;
+        *length = entry->length;
+        return MMDB_SUCCESS;
+    }
+
+    cache->misses++;
+
+    sqlite3_str *str = sqlite3_str_new(NULL);
+    int status = geoip_json_append_record(str, mmdb, offset);
+
+    if (status == MMDB_SUCCESS && sqlite3_str_errcode(str) != SQLITE_OK)
+        status = MMDB_OUT_OF_MEMORY_ERROR;
+
+    int text_length = sqlite3_str_length(str);
+    char *text = sqlite3_str_finish(str);
+
+    if (status != MMDB_SUCCESS) {
+        sqlite3_free(text);
+        return status;
+    }
+
+    sqlite3_free(entry->json);
+    *entry = (geoip_json_entry){ .mmdb = mmdb, .offset = offset, .length = text_length, .json = text };
+
+    *json = text;
+    *length = text_length;
+    return MMDB_SUCCESS;
+}
+
+/**
+ * Free every record held by a cache.
+ * 
+ * @param cache     The cache to empty.
+ */
+void geoip_json_cache_clear(geoip_json_cache *cache) {
+    for (int i = 0; i < GEOIP_JSON_CACHE_SLOTS; i++)
+        sqlite3_free(cache->entries[i].json);
+
+    memset(cache, 0, sizeof(*cache));
+}
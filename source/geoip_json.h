@@ -0,0 +1,41 @@
+#ifndef GEOIP_JSON_H
+#define GEOIP_JSON_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "maxminddb.h"
+
+typedef struct sqlite3_str sqlite3_str;
+
+#define GEOIP_JSON_CACHE_SLOTS 256 /**< The number of records whose JSON a connection keeps, a power of two. */
+#define GEOIP_JSON_MAX_DEPTH   32  /**< How deep maps and arrays may nest before a record is considered corrupt. */
+
+/**
+ * The JSON text of one record.
+ */
+typedef struct geoip_json_entry {
+    const MMDB_s *mmdb; /**< The database the record belongs to, NULL for an empty slot. */
+    uint32_t offset;    /**< The offset of the record in the data section. */
+    int length;         /**< The length of json in bytes. */
+    char *json;         /**< The JSON text, allocated with sqlite3_malloc(). */
+} geoip_json_entry;
+
+/**
+ * A direct-mapped cache of serialized records.
+ * 
+ * Many networks share a record, a City database holds a few hundred thousand records for millions of networks, so
+ * keying on the record offset rather than the address lets every network of a city reuse one serialization. The cache
+ * belongs to a connection and is never shared between threads.
+ */
+typedef struct geoip_json_cache {
+    geoip_json_entry entries[GEOIP_JSON_CACHE_SLOTS]; /**< The cached records, indexed by a hash of the offset. */
+    uint64_t hits;                                    /**< The number of records served from the cache. */
+    uint64_t misses;                                  /**< The number of records serialized. */
+} geoip_json_cache;
+
+void geoip_json_append_string(sqlite3_str *str, const char *value, size_t length);
+int geoip_json_append_record(sqlite3_str *str, const MMDB_s *mmdb, uint32_t offset);
+int geoip_json_record(geoip_json_cache *cache, const MMDB_s *mmdb, uint32_t offset, const char **json, int *length);
+void geoip_json_cache_clear(geoip_json_cache *cache);
+
+#endif /* GEOIP_JSON_H */
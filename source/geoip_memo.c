@@ -0,0 +1,123 @@
+#include <string.h>
+#include "geoip.h"
+#include <sqlite3ext.h>
+SQLITE_EXTENSION_INIT3
+
+#define MEMO_TAG(offset)  (((uint64_t)(offset) + 1) << 32)     /**< The upper half of the slot of a record. */
+#define MEMO_HASH(offset) ((uint32_t)(offset) * 0x9E3779B1u) /**< Spreads the offsets of neighbouring records. */
+
+/**
+ * Make room for one more element of an array growing by doubling.
+ * 
+ * @param array     The array, updated when it moves.
+ * @param capacity  The number of elements allocated, updated when it grows.
+ * @param used      The number of elements in use.
+ * @param size      The size of an element.
+ * @return          MMDB_SUCCESS or MMDB_OUT_OF_MEMORY_ERROR.
+ */
+int geoip_reserve(void **array, size_t *capacity, size_t used, size_t size) {
+    if (used < *capacity)
+        return MMDB_SUCCESS;
+
+    size_t grown = *capacity ? *capacity * 2 : 256;
+    void *moved = sqlite3_realloc64(*array, grown * size);
+
+    if (moved == NULL)
+        return MMDB_OUT_OF_MEMORY_ERROR;
+
+    *array = moved;
+    *capacity = grown;
+    return MMDB_SUCCESS;
+}
+
+/**
+ * Allocate an empty memo.
+ * 
+ * @param memo      The memo.
+ * @param slots     The initial number of slots, a power of two.
+ * @return          MMDB_SUCCESS or MMDB_OUT_OF_MEMORY_ERROR.
+ */
+int geoip_memo_init(geoip_memo *memo, uint32_t slots) {
+    memo->slots = sqlite3_malloc64((uint64_t)slots * sizeof(uint64_t));
+    memo->mask = slots - 1;
+    memo->used = 0;
+
+    if (memo->slots == NULL)
+        return MMDB_OUT_OF_MEMORY_ERROR;
+
+    memset(memo->slots, 0, (size_t)slots * sizeof(uint64_t));
+    return MMDB_SUCCESS;
+}
+
+/**
+ * Release the slots of a memo.
+ * 
+ * @param memo      The memo, which may never have been allocated.
+ */
+void geoip_memo_free(geoip_memo *memo) {
+    sqlite3_free(memo->slots);
+    memo->slots = NULL;
+}
+
+/**
+ * Find the value kept for a record.
+ * 
+ * @param memo      The memo.
+ * @param offset    The offset of the record in the data section.
+ * @param value     Receives the value.
+ * @return          Whether a value was kept for the record.
+ */
+bool geoip_memo_get(const geoip_memo *memo, uint32_t offset, uint32_t *value) {
+    const uint64_t tag = MEMO_TAG(offset);
+
+    for (uint32_t slot = MEMO_HASH(offset) & memo->mask; memo->slots[slot] != 0; slot = (slot + 1) & memo->mask) {
+        if ((memo->slots[slot] & ~(uint64_t)UINT32_MAX) == tag) {
+            *value = (uint32_t)memo->slots[slot];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Keep the value of a record geoip_memo_get() did not find.
+ * 
+ * @param memo      The memo.
+ * @param offset    The offset of the record in the data section.
+ * @param value     The value.
+ * @return          MMDB_SUCCESS or MMDB_OUT_OF_MEMORY_ERROR, the value is kept either way.
+ */
+int geoip_memo_put(geoip_memo *memo, uint32_t offset, uint32_t value) {
+    uint32_t slot = MEMO_HASH(offset) & memo->mask;
+
+    while (memo->slots[slot] != 0)
+        slot = (slot + 1) & memo->mask;
+    memo->slots[slot] = MEMO_TAG(offset) | value;
+
+    /* Keep the memo at most half full. */
+    if (++memo->used * 2 > memo->mask) {
+        uint32_t mask = memo->mask * 2 + 1;
+        uint64_t *slots = sqlite3_malloc64(((uint64_t)mask + 1) * sizeof(uint64_t));
+
+        if (slots == NULL)
+            return MMDB_OUT_OF_MEMORY_ERROR;
+
+        memset(slots, 0, ((size_t)mask + 1) * sizeof(uint64_t));
+        for (uint32_t i = 0; i <= memo->mask; i++) {
+            if (memo->slots[i] == 0)
+                continue;
+
+            uint32_t moved = MEMO_HASH((memo->slots[i] >> 32) - 1) & mask;
+            while (slots[moved] != 0)
+                moved = (moved + 1) & mask;
+            slots[moved] = memo->slots[i];
+        }
+
+        sqlite3_free(memo->slots);
+        memo->slots = slots;
+        memo->mask = mask;
+    }
+
+    return MMDB_SUCCESS;
+}
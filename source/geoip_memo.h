@@ -0,0 +1,26 @@
+#ifndef GEOIP_MEMO_H
+#define GEOIP_MEMO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * A 32-bit value per record, by the offset of the record in the data section.
+ * 
+ * The walks over the networks of a search tree keep one so every record is decoded once for all the networks sharing
+ * it. Slots are found by open addressing and the table is kept at most half full.
+ */
+typedef struct geoip_memo {
+    uint64_t *slots; /**< The offset + 1 shifted left 32 bits plus the value of every record, or 0 for an empty slot. */
+    uint32_t mask;   /**< The number of slots minus one. */
+    uint32_t used;   /**< The number of slots in use. */
+} geoip_memo;
+
+int geoip_reserve(void **array, size_t *capacity, size_t used, size_t size);
+int geoip_memo_init(geoip_memo *memo, uint32_t slots);
+void geoip_memo_free(geoip_memo *memo);
+bool geoip_memo_get(const geoip_memo *memo, uint32_t offset, uint32_t *value);
+int geoip_memo_put(geoip_memo *memo, uint32_t offset, uint32_t value);
+
+#endif /* GEOIP_MEMO_H */
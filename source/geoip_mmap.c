@@ -0,0 +1,838 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "geoip.h"
+#include <sqlite3ext.h>
+SQLITE_EXTENSION_INIT3
+
+#ifdef _WIN32
+#   include <windows.h>
+#else
+#   include <sys/mman.h>
+#   include <unistd.h>
+#endif
+
+#define WARMUP_STOP_CHECK 256 /**< The number of pages the warmup thread touches between checks of its stop flag. */
+
+static const char *const advice_names[GEOIP_ADVICE_COUNT] = {
+    [GEOIP_ADVICE_NORMAL]     = "normal",
+    [GEOIP_ADVICE_RANDOM]     = "random",
+    [GEOIP_ADVICE_SEQUENTIAL] = "sequential",
+    [GEOIP_ADVICE_WILLNEED]   = "willneed",
+    [GEOIP_ADVICE_HUGEPAGE]   = "hugepage"
+};
+
+static const char *const open_mode_names[GEOIP_OPEN_MODE_COUNT] = {
+    [GEOIP_OPEN_MMAP]      = "mmap",
+    [GEOIP_OPEN_COPY_TREE] = "tree",
+    [GEOIP_OPEN_COPY_ALL]  = "all",
+    [GEOIP_OPEN_BLOCKED]   = "blocked"
+};
+
+const char *const geoip_pages_names[] = {
+    [GEOIP_PAGES_NORMAL]  = "normal",
+    [GEOIP_PAGES_THP]     = "thp",
+    [GEOIP_PAGES_HUGETLB] = "hugetlb"
+};
+
+static const char *const warmup_names[] = {
+    [GEOIP_WARMUP_IDLE]    = "idle",
+    [GEOIP_WARMUP_RUNNING] = "running",
+    [GEOIP_WARMUP_DONE]    = "done"
+};
+
+/**
+ * The size of the search tree, which starts at the beginning of the file.
+ * 
+ * @param mmdb  The opened MMDB file.
+ * @return      The size of the search tree in bytes.
+ */
+size_t geoip_mmap_tree_size(const MMDB_s *mmdb) {
+    return (size_t)mmdb->metadata.node_count * mmdb->metadata.record_size / 4;
+}
+
+static size_t page_size(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+/**
+ * The file mapping of an opened database, which lookups may no longer read when they were pointed at a copy.
+ * 
+ * @param db    The opened database.
+ * @return      The start of the mapping libmaxminddb set up.
+ */
+static const uint8_t *map_file(const geoip_db *db) {
+    return db->map.copy != NULL ? db->map.file_content : db->mmdb.file_content;
+}
+
+/**
+ * The search tree lookups of an opened database walk.
+ * 
+ * @param db    The opened database.
+ * @param size  Receives the size of the tree in bytes.
+ * @return      The relayout when the database has one, otherwise the tree at the start of the copy or the mapping.
+ */
+static const uint8_t *map_tree(const geoip_db *db, size_t *size) {
+    if (db->tree.nodes != NULL) {
+        *size = (size_t)db->tree.node_count * 2 * sizeof(uint32_t);
+        return (const uint8_t *)db->tree.nodes;
+    }
+
+    *size = geoip_mmap_tree_size(&db->mmdb);
+    return db->mmdb.file_content;
+}
+
+/**
+ * Allocate memory for a copy or a relayout, backed by huge pages where possible.
+ * 
+ * Explicit huge pages are tried first, they only exist when the administrator reserved a pool of them. Otherwise the
+ * allocation is aligned to a huge page boundary and the kernel is asked to back it with transparent huge pages, which
+ * it does when THP is enabled in "always" or "madvise" mode.
+ * 
+ * @param size      The number of bytes needed, rounded up to a whole number of huge pages.
+ * @param pages     Receives the GEOIP_PAGES_* value describing the memory.
+ * @return          The memory, aligned to at least 64 bytes, or NULL on failure.
+ */
+uint8_t *geoip_mmap_alloc(size_t size, int *pages) {
+#ifdef _WIN32
+    *pages = GEOIP_PAGES_NORMAL;
+    return VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+    void *memory;
+
+#ifdef MAP_HUGETLB
+    memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (memory != MAP_FAILED) {
+        *pages = GEOIP_PAGES_HUGETLB;
+        return memory;
+    }
+#endif
+
+    /* Over-allocate by one huge page and trim both ends so the copy starts on a huge page boundary. */
+    memory = mmap(NULL, size + GEOIP_HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+        return NULL;
+
+    uint8_t *start = memory;
+    uint8_t *aligned = (uint8_t *)(((uintptr_t)start + GEOIP_HUGE_PAGE - 1) & ~(uintptr_t)(GEOIP_HUGE_PAGE - 1));
+
+    if (aligned > start)
+        munmap(start, (size_t)(aligned - start));
+
+    if (start + GEOIP_HUGE_PAGE > aligned)
+        munmap(aligned + size, (size_t)(start + GEOIP_HUGE_PAGE - aligned));
+
+    *pages = GEOIP_PAGES_NORMAL;
+#ifdef MADV_HUGEPAGE
+    if (madvise(aligned, size, MADV_HUGEPAGE) == 0)
+        *pages = GEOIP_PAGES_THP;
+#endif
+
+    return aligned;
+#endif
+}
+
+void geoip_mmap_free(uint8_t *memory, size_t size) {
+#ifdef _WIN32
+    (void)size;  /* Unused parameter */
+    VirtualFree(memory, 0, MEM_RELEASE);
+#else
+    munmap(memory, size);
+#endif
+}
+
+/**
+ * Make memory from geoip_mmap_alloc() read-only once it has been filled in.
+ * 
+ * @param memory    The allocation.
+ * @param size      The size that was allocated.
+ */
+void geoip_mmap_protect(uint8_t *memory, size_t size) {
+#ifdef _WIN32
+    DWORD protect;
+    VirtualProtect(memory, size, PAGE_READONLY, &protect);
+#else
+    mprotect(memory, size, PROT_READ);
+#endif
+}
+
+/**
+ * Copy a freshly opened database into huge-page-backed memory and point lookups at the copy.
+ * 
+ * Depending on the open mode either the search tree or the whole file is copied. libmaxminddb reads the search tree
+ * through file_content and records through data_section, so redirecting those pointers is all it takes. The original
+ * pointers are saved and put back by geoip_mmap_release(), MMDB_close() must never see the copy.
+ * 
+ * @param map   The mapping state of the database, its open_mode decides what is copied.
+ * @param mmdb  The database, opened but not used by any lookup yet.
+ * @return      0 on success or when nothing has to be copied, -1 when the memory could not be allocated.
+ */
+int geoip_mmap_copy(geoip_mmap *map, MMDB_s *mmdb) {
+    if (map->open_mode != GEOIP_OPEN_COPY_TREE && map->open_mode != GEOIP_OPEN_COPY_ALL)
+        return 0;
+
+    const size_t bytes = map->open_mode == GEOIP_OPEN_COPY_ALL ? (size_t)mmdb->file_size : geoip_mmap_tree_size(mmdb);
+    const size_t size = (bytes + GEOIP_HUGE_PAGE - 1) / GEOIP_HUGE_PAGE * GEOIP_HUGE_PAGE;
+    int pages;
+
+    uint8_t *copy = geoip_mmap_alloc(size, &pages);
+    if (copy == NULL)
+        return -1;
+
+    memcpy(copy, mmdb->file_content, bytes);
+    geoip_mmap_protect(copy, size);
+
+    map->copy = copy;
+    map->copy_size = size;
+    map->copy_pages = pages;
+    map->file_content = mmdb->file_content;
+    map->data_section = mmdb->data_section;
+    map->metadata_section = mmdb->metadata_section;
+
+    mmdb->file_content = copy;
+    if (map->open_mode == GEOIP_OPEN_COPY_ALL) {
+        mmdb->data_section = copy + (map->data_section - map->file_content);
+        mmdb->metadata_section = copy + (map->metadata_section - map->file_content);
+    }
+
+    return 0;
+}
+
+/**
+ * Point a database back at its file mapping and free the copy, before MMDB_close().
+ * 
+ * @param map   The mapping state of the database.
+ * @param mmdb  The database, no lookup may be using it anymore.
+ */
+void geoip_mmap_release(geoip_mmap *map, MMDB_s *mmdb) {
+    if (map->copy == NULL)
+        return;
+
+    mmdb->file_content = map->file_content;
+    mmdb->data_section = map->data_section;
+    mmdb->metadata_section = map->metadata_section;
+    geoip_mmap_free(map->copy, map->copy_size);
+
+    map->copy = NULL;
+    map->copy_size = 0;
+}
+
+/**
+ * Touch every page of the search tree once so later lookups do not fault.
+ * 
+ * The tree lookups walk is warmed up: the relayout in the 'blocked' mode, the copy when the database was opened with
+ * one, and the file mapping otherwise. A copy or a relayout is already resident, since it was just written. The kernel
+ * is first asked to read the tree in asynchronously, so the loop mostly finds the pages already there.
+ * 
+ * @param db    The database to warm up.
+ */
+static void warmup_run(geoip_db *db) {
+    size_t size;
+    const volatile uint8_t *tree = map_tree(db, &size);
+    const size_t step = page_size();
+    uint8_t sink = 0;
+
+#ifndef _WIN32
+    madvise((void *)(uintptr_t)tree, size, MADV_WILLNEED);
+#endif
+
+    for (size_t offset = 0, pages = 0; offset < size; offset += step, pages++) {
+        if (pages % WARMUP_STOP_CHECK == 0 && atomic_load_explicit(&db->map.stop, memory_order_relaxed))
+            break;
+
+        sink ^= tree[offset];
+        atomic_store_explicit(&db->map.warmed, offset + step < size ? offset + step : size, memory_order_relaxed);
+    }
+
+    (void)sink;
+    atomic_store_explicit(&db->map.warmup, GEOIP_WARMUP_DONE, memory_order_release);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI warmup_thread(void *arg) {
+    warmup_run(arg);
+    return 0;
+}
+#else
+static void *warmup_thread(void *arg) {
+    warmup_run(arg);
+    return NULL;
+}
+#endif
+
+static void warmup_join(geoip_mmap *map) {
+    if (!map->started)
+        return;
+
+#ifdef _WIN32
+    WaitForSingleObject(map->thread, INFINITE);
+    CloseHandle(map->thread);
+#else
+    pthread_join(map->thread, NULL);
+#endif
+    map->started = false;
+}
+
+/**
+ * Start warming up a database in the background, unless a warmup is already running.
+ * 
+ * Must be called with the SQLITE_MUTEX_STATIC_APP1 mutex held.
+ * 
+ * @param db    The opened database.
+ * @return      0 on success, -1 when the thread could not be started.
+ */
+static int warmup_start(geoip_db *db) {
+    if (atomic_load_explicit(&db->map.warmup, memory_order_acquire) == GEOIP_WARMUP_RUNNING)
+        return 0;
+
+    warmup_join(&db->map);
+    atomic_store_explicit(&db->map.stop, false, memory_order_relaxed);
+    atomic_store_explicit(&db->map.warmed, 0, memory_order_relaxed);
+    atomic_store_explicit(&db->map.warmup, GEOIP_WARMUP_RUNNING, memory_order_release);
+
+#ifdef _WIN32
+    db->map.thread = CreateThread(NULL, 0, warmup_thread, db, 0, NULL);
+    db->map.started = db->map.thread != NULL;
+#else
+    db->map.started = pthread_create(&db->map.thread, NULL, warmup_thread, db) == 0;
+#endif
+
+    if (!db->map.started) {
+        atomic_store_explicit(&db->map.warmup, GEOIP_WARMUP_IDLE, memory_order_release);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Stop a running warmup and wait for its thread.
+ * 
+ * Must be called with the SQLITE_MUTEX_STATIC_APP1 mutex held.
+ * 
+ * @param map   The mapping state of the database.
+ */
+void geoip_mmap_stop(geoip_mmap *map) {
+    atomic_store_explicit(&map->stop, true, memory_order_relaxed);
+    warmup_join(map);
+}
+
+/**
+ * Apply an madvise() policy to the whole mapping of a database.
+ * 
+ * @param db        The opened database.
+ * @param advice    A GEOIP_ADVICE_* value.
+ * @return          0 on success, -1 with errno set on failure.
+ */
+static int map_advise(geoip_db *db, int advice) {
+#ifdef _WIN32
+    (void)db; (void)advice;  /* Unused parameters */
+    errno = ENOSYS;
+    return -1;
+#else
+    int flag;
+
+    switch (advice) {
+    case GEOIP_ADVICE_RANDOM:
+        flag = MADV_RANDOM;
+        break;
+    case GEOIP_ADVICE_SEQUENTIAL:
+        flag = MADV_SEQUENTIAL;
+        break;
+    case GEOIP_ADVICE_WILLNEED:
+        flag = MADV_WILLNEED;
+        break;
+    case GEOIP_ADVICE_HUGEPAGE:
+    #ifdef MADV_HUGEPAGE
+        flag = MADV_HUGEPAGE;
+        break;
+    #else
+        errno = ENOTSUP;
+        return -1;
+    #endif
+    default:
+        flag = MADV_NORMAL;
+        break;
+    }
+
+    if (madvise((void *)(uintptr_t)map_file(db), (size_t)db->mmdb.file_size, flag) != 0)
+        return -1;
+
+    db->map.advice = advice;
+    return 0;
+#endif
+}
+
+/**
+ * Lock the search tree of a database in memory, or unlock it.
+ * 
+ * The tree lookups walk is locked: the relayout in the 'blocked' mode, the copy when the database was opened with one
+ * and the file mapping otherwise.
+ * 
+ * @param db    The opened database.
+ * @param lock  Whether to lock or unlock the tree.
+ * @return      0 on success, -1 with errno set on failure.
+ */
+static int map_lock(geoip_db *db, bool lock) {
+    const size_t page = page_size();
+    size_t bytes;
+    void *tree = (void *)(uintptr_t)map_tree(db, &bytes);
+    const size_t size = (bytes + page - 1) / page * page;
+
+    if (lock == (db->map.locked != 0))
+        return 0;
+
+#ifdef _WIN32
+    if (!(lock ? VirtualLock(tree, size) : VirtualUnlock(tree, size))) {
+        errno = EPERM;
+        return -1;
+    }
+#else
+    if ((lock ? mlock(tree, size) : munlock(tree, size)) != 0)
+        return -1;
+#endif
+
+    db->map.locked = lock ? size : 0;
+    return 0;
+}
+
+/**
+ * Apply one of the engine options "geoip_open" accepts to a database that is not opened yet.
+ * 
+ * The options handled here are mode (an open mode), madvise (a policy), mlock and warmup (0 or 1).
+ * 
+ * @param map       The mapping state of the database.
+ * @param key       The option name.
+ * @param value     The option value.
+ * @return          1 when the option was applied, 0 when it is not a mapping option, -1 when its value is invalid.
+ */
+int geoip_mmap_option(geoip_mmap *map, const char *key, const char *value) {
+    if (sqlite3_stricmp(key, "mode") == 0) {
+        for (int i = 0; i < GEOIP_OPEN_MODE_COUNT; i++) {
+            if (sqlite3_stricmp(value, open_mode_names[i]) == 0) {
+                map->open_mode = i;
+                return 1;
+            }
+        }
+
+        return -1;
+    }
+
+    if (sqlite3_stricmp(key, "madvise") == 0) {
+        for (int i = 0; i < GEOIP_ADVICE_COUNT; i++) {
+            if (sqlite3_stricmp(value, advice_names[i]) == 0) {
+                map->open_advice = i;
+                return 1;
+            }
+        }
+
+        return -1;
+    }
+
+    if (sqlite3_stricmp(key, "mlock") == 0 || sqlite3_stricmp(key, "warmup") == 0) {
+        if (strcmp(value, "0") != 0 && strcmp(value, "1") != 0)
+            return -1;
+
+        *(sqlite3_stricmp(key, "mlock") == 0 ? &map->open_lock : &map->open_warmup) = value[0] == '1';
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Apply the options given to "geoip_open" once the database is opened.
+ * 
+ * Like the functions doing the same later on, these only affect performance, so a failure is reported as a warning.
+ * Must be called with the SQLITE_MUTEX_STATIC_APP1 mutex held.
+ * 
+ * @param db    The database that was just opened.
+ */
+void geoip_mmap_opened(geoip_db *db) {
+    if (db->map.open_advice != GEOIP_ADVICE_NORMAL && map_advise(db, db->map.open_advice) != 0)
+        fprintf(stderr, "Warning: unable to advise the %s MMDB: %s\n", db->name, strerror(errno));
+
+    if (db->map.open_lock && map_lock(db, true) != 0)
+        fprintf(stderr, "Warning: unable to lock the %s MMDB: %s\n", db->name, strerror(errno));
+
+    if (db->map.open_warmup && warmup_start(db) != 0)
+        fprintf(stderr, "Warning: unable to start warming up the %s MMDB\n", db->name);
+}
+
+/**
+ * Describe how much of a database is resident in memory.
+ * 
+ * Must be called with the SQLITE_MUTEX_STATIC_APP1 mutex held.
+ * 
+ * @param str   The JSON document being built.
+ * @param db    The database to describe, which is not opened if it was not already.
+ */
+static void residency_append(sqlite3_str *str, geoip_db *db) {
+    sqlite3_str_appendf(str, "{\"database\":");
+    geoip_json_append_string(str, db->name, strlen(db->name));
+    sqlite3_str_appendf(str, ",\"alias\":");
+    geoip_json_append_string(str, db->alias, strlen(db->alias));
+
+    if (atomic_load_explicit(&db->state, memory_order_acquire) != GEOIP_DB_OPEN) {
+        sqlite3_str_appendf(str, ",\"open\":false,\"open_mode\":\"%s\"}", open_mode_names[db->map.open_mode]);
+        return;
+    }
+
+    const size_t page = page_size();
+    const size_t file_size = (size_t)db->mmdb.file_size;
+    const size_t tree_size = geoip_mmap_tree_size(&db->mmdb);
+
+    sqlite3_str_appendf(str, ",\"open\":true,\"page_size\":%llu,\"file_bytes\":%llu,\"tree_bytes\":%llu",
+        (unsigned long long)page, (unsigned long long)file_size, (unsigned long long)tree_size);
+
+#ifdef _WIN32
+    sqlite3_str_appendf(str, ",\"error\":\"%s\"", "mincore() is not available on Windows");
+#else
+    const size_t pages = (file_size + page - 1) / page;
+    const size_t tree_pages = (tree_size + page - 1) / page;
+    size_t tree_resident = 0, data_resident = 0;
+    unsigned char *vec = malloc(pages > 0 ? pages : 1);
+
+    if (vec == NULL || mincore((void *)(uintptr_t)map_file(db), file_size, (void *)vec) != 0) {
+        const char *error = vec == NULL ? "out of memory" : strerror(errno);
+
+        sqlite3_str_appendf(str, ",\"error\":");
+        geoip_json_append_string(str, error, strlen(error));
+    } else {
+        for (size_t i = 0; i < pages; i++) {
+            if ((vec[i] & 1) == 0)
+                continue;
+
+            if (i < tree_pages)
+                tree_resident++;
+            else
+                data_resident++;
+        }
+
+        sqlite3_str_appendf(str, ",\"tree_pages\":%llu,\"tree_resident\":%llu,\"data_pages\":%llu,\"data_resident\":%llu,\"resident_bytes\":%llu",
+            (unsigned long long)tree_pages, (unsigned long long)tree_resident,
+            (unsigned long long)(pages - tree_pages), (unsigned long long)data_resident,
+            (unsigned long long)((tree_resident + data_resident) * page));
+    }
+
+    free(vec);
+#endif
+
+    sqlite3_str_appendf(str, ",\"open_mode\":\"%s\"", open_mode_names[db->map.open_mode]);
+    if (db->map.copy != NULL) {
+        sqlite3_str_appendf(str, ",\"copy_bytes\":%llu,\"copy_pages\":\"%s\"",
+            (unsigned long long)db->map.copy_size, geoip_pages_names[db->map.copy_pages]);
+    }
+
+    if (db->tree.nodes != NULL) {
+        sqlite3_str_appendf(str, ",\"blocked_bytes\":%llu,\"blocked_pages\":\"%s\",\"blocked_fill\":%.3f",
+            (unsigned long long)db->tree.size, geoip_pages_names[db->tree.pages], (double)db->tree.used / db->tree.node_count);
+    }
+
+    sqlite3_str_appendf(str, ",\"advice\":\"%s\",\"locked_bytes\":%llu,\"warmup\":\"%s\",\"warmed_bytes\":%llu}",
+        advice_names[db->map.advice], (unsigned long long)db->map.locked,
+        warmup_names[atomic_load_explicit(&db->map.warmup, memory_order_acquire)],
+        (unsigned long long)atomic_load_explicit(&db->map.warmed, memory_order_relaxed));
+}
+
+/**
+ * Resolve the database argument of a function and make sure the database is open.
+ * 
+ * @param context   The current SQLite3 function context structure/object.
+ * @param value     The argument naming the database.
+ * @return          The opened database, or NULL after an error has been set on the context.
+ */
+static geoip_db *mmap_database(sqlite3_context *context, sqlite3_value *value) {
+    if (!initialized) {
+        sqlite3_result_error(context, MSG_NOTINITIALIZED, -1);
+        return NULL;
+    }
+
+    geoip_db *db = geoip_db_find((const char *)sqlite3_value_text(value));
+    if (db == NULL) {
+        sqlite3_result_error(context, MSG_UNKNOWNDB, -1);
+        return NULL;
+    }
+
+    int status = geoip_db_acquire(db);
+    if (status != MMDB_SUCCESS) {
+        char msg[256];
+
+        snprintf(msg, sizeof(msg), MSG_ERRLIBMAXMIND, MMDB_strerror(status));
+        sqlite3_result_error(context, msg, -1);
+        return NULL;
+    }
+
+    return db;
+}
+
+static void mmap_error(sqlite3_context *context, const char *what, geoip_db *db) {
+    char msg[256];
+
+    snprintf(msg, sizeof(msg), "Unable to %s the %s MMDB: %s", what, db->name, strerror(errno));
+    sqlite3_result_error(context, msg, -1);
+}
+
+/**
+ * Prefault the search tree of a database in a background thread.
+ * 
+ * This function handles the "geoip_warmup" extension function. It returns right away with the number of search tree
+ * bytes being warmed up, the progress is reported by "geoip_residency". Calling it while a warmup is running does not
+ * start another one.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (should be 1).
+ * @param argv          The database, 'asn', 'city' or an alias.
+ */
+static void mmap_warmup(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    (void)argc;  /* Unused parameter */
+
+    geoip_db *db = mmap_database(context, argv[0]);
+    if (db == NULL)
+        return;
+
+    sqlite3_mutex *mutex = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP1);
+    sqlite3_mutex_enter(mutex);
+    int rc = warmup_start(db);
+    sqlite3_mutex_leave(mutex);
+
+    if (rc != 0) {
+        sqlite3_result_error(context, "Unable to start the warmup thread", -1);
+        return;
+    }
+
+    sqlite3_result_int64(context, (sqlite3_int64)geoip_mmap_tree_size(&db->mmdb));
+}
+
+/**
+ * Apply an madvise() policy to the mapping of a database.
+ * 
+ * This function handles the "geoip_madvise" extension function and returns the number of bytes advised. The policy is
+ * one of 'normal', 'random', 'sequential', 'willneed' or 'hugepage'. Huge pages for file mappings need a kernel built
+ * with CONFIG_READ_ONLY_THP_FOR_FS, other kernels report an error.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (should be 2).
+ * @param argv          The database and the policy.
+ */
+static void mmap_madvise(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    (void)argc;  /* Unused parameter */
+    const char *name = (const char *)sqlite3_value_text(argv[1]);
+    int advice = GEOIP_ADVICE_COUNT;
+
+    for (int i = 0; name != NULL && i < GEOIP_ADVICE_COUNT; i++) {
+        if (sqlite3_stricmp(name, advice_names[i]) == 0)
+            advice = i;
+    }
+
+    if (advice == GEOIP_ADVICE_COUNT) {
+        sqlite3_result_error(context, "Unknown policy, expected 'normal', 'random', 'sequential', 'willneed' or 'hugepage'", -1);
+        return;
+    }
+
+    geoip_db *db = mmap_database(context, argv[0]);
+    if (db == NULL)
+        return;
+
+    sqlite3_mutex *mutex = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP1);
+    sqlite3_mutex_enter(mutex);
+    int rc = map_advise(db, advice);
+    sqlite3_mutex_leave(mutex);
+
+    if (rc != 0) {
+        mmap_error(context, "advise", db);
+        return;
+    }
+
+    sqlite3_result_int64(context, (sqlite3_int64)db->mmdb.file_size);
+}
+
+/**
+ * Lock the search tree of a database in memory, or unlock it again.
+ * 
+ * This function handles the "geoip_mlock" extension function and returns the number of bytes locked, 0 after unlocking.
+ * Locking is subject to RLIMIT_MEMLOCK.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (should be 2).
+ * @param argv          The database and whether to lock (non-zero) or unlock (zero) it.
+ */
+static void mmap_mlock(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    (void)argc;  /* Unused parameter */
+
+    geoip_db *db = mmap_database(context, argv[0]);
+    if (db == NULL)
+        return;
+
+    sqlite3_mutex *mutex = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP1);
+    sqlite3_mutex_enter(mutex);
+    int rc = map_lock(db, sqlite3_value_int(argv[1]) != 0);
+    size_t locked = db->map.locked;
+    sqlite3_mutex_leave(mutex);
+
+    if (rc != 0) {
+        mmap_error(context, "lock", db);
+        return;
+    }
+
+    sqlite3_result_int64(context, (sqlite3_int64)locked);
+}
+
+/**
+ * Choose how a database is opened.
+ * 
+ * This function handles the "geoip_open_mode" extension function. The mode is 'mmap' to read the file mapping, 'tree'
+ * to copy the search tree into huge-page-backed memory, 'all' to copy the whole file, or 'blocked' to relay the search
+ * tree out in cache-line-sized blocks. Lookups never switch between layouts, so the mode has to be chosen before the
+ * first function needing the database is called.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (should be 2).
+ * @param argv          The database and the mode.
+ */
+static void mmap_open_mode(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    (void)argc;  /* Unused parameter */
+    const char *name = (const char *)sqlite3_value_text(argv[1]);
+    int mode = GEOIP_OPEN_MODE_COUNT;
+
+    if (!initialized) {
+        sqlite3_result_error(context, MSG_NOTINITIALIZED, -1);
+        return;
+    }
+
+    for (int i = 0; name != NULL && i < GEOIP_OPEN_MODE_COUNT; i++) {
+        if (sqlite3_stricmp(name, open_mode_names[i]) == 0)
+            mode = i;
+    }
+
+    if (mode == GEOIP_OPEN_MODE_COUNT) {
+        sqlite3_result_error(context, "Unknown open mode, expected 'mmap', 'tree', 'all' or 'blocked'", -1);
+        return;
+    }
+
+    geoip_db *db = geoip_db_find((const char *)sqlite3_value_text(argv[0]));
+    if (db == NULL) {
+        sqlite3_result_error(context, MSG_UNKNOWNDB, -1);
+        return;
+    }
+
+    sqlite3_mutex *mutex = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP1);
+    sqlite3_mutex_enter(mutex);
+
+    bool closed = atomic_load_explicit(&db->state, memory_order_acquire) == GEOIP_DB_CLOSED;
+    if (closed)
+        db->map.open_mode = mode;
+
+    sqlite3_mutex_leave(mutex);
+
+    if (!closed && db->map.open_mode != mode) {
+        char msg[256];
+
+        snprintf(msg, sizeof(msg), "The %s MMDB is already open, its open mode must be chosen before its first use", db->name);
+        sqlite3_result_error(context, msg, -1);
+        return;
+    }
+
+    sqlite3_result_int(context, 1);
+}
+
+/**
+ * Report how much of the databases is resident in memory.
+ * 
+ * This function handles the "geoip_residency" extension function. Called with a database it returns a JSON object
+ * with the resident pages of its search tree and data section, as reported by mincore(), along with the madvise()
+ * policy, the locked bytes and the warmup progress. Called without arguments it returns an array covering every
+ * registered database. Databases that were not opened yet are reported as such and are not opened.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (0 or 1).
+ * @param argv          The database, 'asn', 'city' or an alias, when given.
+ */
+static void mmap_residency(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    geoip_db *db = NULL;
+
+    if (!initialized) {
+        sqlite3_result_error(context, MSG_NOTINITIALIZED, -1);
+        return;
+    }
+
+    if (argc == 1 && (db = geoip_db_find((const char *)sqlite3_value_text(argv[0]))) == NULL) {
+        sqlite3_result_error(context, MSG_UNKNOWNDB, -1);
+        return;
+    }
+
+    sqlite3_str *str = sqlite3_str_new(sqlite3_context_db_handle(context));
+    sqlite3_mutex *mutex = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP1);
+    sqlite3_mutex_enter(mutex);
+
+    if (db != NULL) {
+        residency_append(str, db);
+    } else {
+        bool first = true;
+
+        sqlite3_str_appendchar(str, 1, '[');
+        for (int i = 0; i < GEOIP_DB_MAX; i++) {
+            geoip_db *entry = geoip_db_at(i);
+
+            if (entry == NULL)
+                continue;
+
+            if (!first)
+                sqlite3_str_appendchar(str, 1, ',');
+
+            residency_append(str, entry);
+            first = false;
+        }
+        sqlite3_str_appendchar(str, 1, ']');
+    }
+
+    sqlite3_mutex_leave(mutex);
+
+    if (sqlite3_str_errcode(str) != SQLITE_OK) {
+        sqlite3_free(sqlite3_str_finish(str));
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+
+    int length = sqlite3_str_length(str);
+    sqlite3_result_text(context, sqlite3_str_finish(str), length, sqlite3_free);
+    sqlite3_result_subtype(context, GEOIP_JSON_SUBTYPE);
+}
+
+/**
+ * Register the mapping management functions.
+ * 
+ * Everything but "geoip_residency" changes process-wide state, so those functions are not usable from triggers or views.
+ * 
+ * @param db    The current SQLite3 database context.
+ * @return      An SQLite3 result code.
+ */
+int geoip_mmap_register(sqlite3 *db) {
+    int rc;
+
+    rc = sqlite3_create_function(db, "geoip_warmup", 1, SQLITE_UTF8 | SQLITE_DIRECTONLY, 0, mmap_warmup, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_madvise", 2, SQLITE_UTF8 | SQLITE_DIRECTONLY, 0, mmap_madvise, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_mlock", 2, SQLITE_UTF8 | SQLITE_DIRECTONLY, 0, mmap_mlock, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_open_mode", 2, SQLITE_UTF8 | SQLITE_DIRECTONLY, 0, mmap_open_mode, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_residency", 0, SQLITE_UTF8 | SQLITE_RESULT_SUBTYPE, 0, mmap_residency, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    return sqlite3_create_function(db, "geoip_residency", 1, SQLITE_UTF8 | SQLITE_RESULT_SUBTYPE, 0, mmap_residency, 0, 0);
+}
@@ -0,0 +1,100 @@
+#ifndef GEOIP_MMAP_H
+#define GEOIP_MMAP_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "maxminddb.h"
+
+#ifndef _WIN32
+#   include <pthread.h>
+#endif
+
+#define GEOIP_HUGE_PAGE (2 * 1024 * 1024) /**< The huge page size copies are aligned and sized to. */
+
+typedef struct sqlite3 sqlite3;
+typedef struct geoip_db geoip_db;
+
+/**
+ * The madvise() policies that can be applied to a database mapping.
+ */
+enum {
+    GEOIP_ADVICE_NORMAL,         /**< The kernel default, moderate readahead. */
+    GEOIP_ADVICE_RANDOM,         /**< No readahead, every fault reads a single page. */
+    GEOIP_ADVICE_SEQUENTIAL,     /**< Aggressive readahead. */
+    GEOIP_ADVICE_WILLNEED,       /**< Start reading the whole file in asynchronously. */
+    GEOIP_ADVICE_HUGEPAGE,       /**< Back the mapping with transparent huge pages where the kernel supports it for files. */
+    GEOIP_ADVICE_COUNT           /**< The number of policies. */
+};
+
+/**
+ * How a database is opened, chosen before its first use.
+ */
+enum {
+    GEOIP_OPEN_MMAP,             /**< Lookups read the file mapping libmaxminddb set up. */
+    GEOIP_OPEN_COPY_TREE,        /**< The search tree is copied into huge-page-backed memory, the data section stays mapped. */
+    GEOIP_OPEN_COPY_ALL,         /**< The whole file is copied into huge-page-backed memory. */
+    GEOIP_OPEN_BLOCKED,          /**< The search tree is relaid out in cache-line-sized blocks, see geoip_tree.h. */
+    GEOIP_OPEN_MODE_COUNT        /**< The number of open modes. */
+};
+
+/**
+ * The pages backing an in-memory copy.
+ */
+enum {
+    GEOIP_PAGES_NORMAL,          /**< Regular pages, huge pages were not available. */
+    GEOIP_PAGES_THP,             /**< Anonymous memory the kernel was asked to back with transparent huge pages. */
+    GEOIP_PAGES_HUGETLB          /**< Explicit huge pages from the hugetlbfs pool. */
+};
+
+/**
+ * The state of the background warmup of a database.
+ */
+enum {
+    GEOIP_WARMUP_IDLE,           /**< No warmup was started. */
+    GEOIP_WARMUP_RUNNING,        /**< The warmup thread is touching the search tree. */
+    GEOIP_WARMUP_DONE            /**< The warmup thread finished or was stopped. */
+};
+
+/**
+ * How the mapping of a database is managed, all fields except the atomics are guarded by the SQLITE_MUTEX_STATIC_APP1 mutex.
+ */
+typedef struct geoip_mmap {
+    int advice;                      /**< The GEOIP_ADVICE_* policy last applied to the mapping. */
+    int open_mode;                   /**< The GEOIP_OPEN_* mode the database is, or will be, opened with. */
+    uint8_t *copy;                   /**< The in-memory copy lookups read instead of the mapping, NULL when there is none. */
+    size_t copy_size;                /**< The size of the allocation holding the copy. */
+    int copy_pages;                  /**< The GEOIP_PAGES_* value describing the memory behind the copy. */
+    const uint8_t *file_content;     /**< The file mapping libmaxminddb set up, saved while its pointers lead to the copy. */
+    const uint8_t *data_section;     /**< The data section within the file mapping, saved along with file_content. */
+    const uint8_t *metadata_section; /**< The metadata section within the file mapping, saved along with file_content. */
+    size_t locked;                   /**< The number of search tree bytes locked in memory, 0 when not locked. */
+    atomic_int warmup;               /**< A GEOIP_WARMUP_* value. */
+    atomic_bool stop;                /**< Asks the warmup thread to stop early. */
+    _Atomic size_t warmed;           /**< The number of search tree bytes the warmup thread has touched so far. */
+    bool started;                    /**< Whether the warmup thread has been started and not joined yet. */
+    int open_advice;                 /**< The GEOIP_ADVICE_* policy applied as soon as the database is opened. */
+    bool open_lock;                  /**< Whether the search tree is locked in memory as soon as the database is opened. */
+    bool open_warmup;                /**< Whether a warmup is started as soon as the database is opened. */
+#ifdef _WIN32
+    void *thread;                    /**< The handle of the warmup thread. */
+#else
+    pthread_t thread;                /**< The warmup thread. */
+#endif
+} geoip_mmap;
+
+extern const char *const geoip_pages_names[]; /**< The names of the GEOIP_PAGES_* values. */
+
+size_t geoip_mmap_tree_size(const MMDB_s *mmdb);
+uint8_t *geoip_mmap_alloc(size_t size, int *pages);
+void geoip_mmap_free(uint8_t *memory, size_t size);
+void geoip_mmap_protect(uint8_t *memory, size_t size);
+int geoip_mmap_copy(geoip_mmap *map, MMDB_s *mmdb);
+void geoip_mmap_release(geoip_mmap *map, MMDB_s *mmdb);
+void geoip_mmap_stop(geoip_mmap *map);
+int geoip_mmap_option(geoip_mmap *map, const char *key, const char *value);
+void geoip_mmap_opened(geoip_db *db);
+int geoip_mmap_register(sqlite3 *db);
+
+#endif /* GEOIP_MMAP_H */
@@ -0,0 +1,272 @@
+#include <string.h>
+#include "geoip.h"
+#include <sqlite3ext.h>
+SQLITE_EXTENSION_INIT3
+
+/**
+ * The continent codes MaxMind uses, a fingerprint stores the position of the code in this list plus one.
+ */
+static const char pack_continents[][3] = { "AF", "AN", "AS", "EU", "NA", "OC", "SA" };
+
+#define PACK_CONTINENTS (int)(sizeof(pack_continents) / sizeof(pack_continents[0]))
+
+static inline void pack_be16(uint8_t *bytes, uint32_t value) {
+    bytes[0] = (uint8_t)(value >> 8);
+    bytes[1] = (uint8_t)value;
+}
+
+static inline void pack_be32(uint8_t *bytes, uint32_t value) {
+    bytes[0] = (uint8_t)(value >> 24);
+    bytes[1] = (uint8_t)(value >> 16);
+    bytes[2] = (uint8_t)(value >> 8);
+    bytes[3] = (uint8_t)value;
+}
+
+static inline uint32_t unpack_be16(const uint8_t *bytes) {
+    return (uint32_t)bytes[0] << 8 | bytes[1];
+}
+
+static inline uint32_t unpack_be32(const uint8_t *bytes) {
+    return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 8 | bytes[3];
+}
+
+/**
+ * Read a field of a record holding an unsigned integer.
+ * 
+ * @param entry     The record.
+ * @param path      The path of the field.
+ * @return          The value, or 0 when the record has no such field.
+ */
+static uint32_t pack_uint(MMDB_entry_s *entry, const char *const *path) {
+    MMDB_entry_data_s entry_data;
+
+    if (MMDB_aget_value(entry, &entry_data, path) != MMDB_SUCCESS || !entry_data.has_data)
+        return 0;
+
+    switch (entry_data.type) {
+    case MMDB_DATA_TYPE_UINT16:
+        return entry_data.uint16;
+    case MMDB_DATA_TYPE_UINT32:
+        return entry_data.uint32;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * Read a field of a record holding a two letter code.
+ * 
+ * @param entry     The record.
+ * @param path      The path of the field.
+ * @param code      Receives the two letters, or two NULs when the record has no such field.
+ */
+static void pack_code(MMDB_entry_s *entry, const char *const *path, char code[2]) {
+    MMDB_entry_data_s entry_data;
+
+    code[0] = code[1] = '\0';
+    if (MMDB_aget_value(entry, &entry_data, path) != MMDB_SUCCESS || !entry_data.has_data ||
+        entry_data.type != MMDB_DATA_TYPE_UTF8_STRING || entry_data.data_size != 2)
+        return;
+
+    memcpy(code, entry_data.utf8_string, 2);
+}
+
+/**
+ * The build day of a database as stored in a fingerprint.
+ * 
+ * @param mmdb      The opened database.
+ * @return          The days between 1970-01-01 and the build, clamped to 16 bits.
+ */
+static uint32_t pack_epoch(const MMDB_s *mmdb) {
+    uint64_t days = mmdb->metadata.build_epoch / 86400;
+
+    return days > UINT16_MAX ? UINT16_MAX : (uint32_t)days;
+}
+
+/**
+ * Pack what the built-in databases know about an address into a fingerprint.
+ * 
+ * @param blob      Receives GEOIP_PACK_SIZE bytes.
+ * @param asn_mmdb  The opened ASN database.
+ * @param asn       The result of looking the address up in the ASN database.
+ * @param city_mmdb The opened City database.
+ * @param city      The result of looking the address up in the City database.
+ */
+void geoip_pack_encode(uint8_t *blob, const MMDB_s *asn_mmdb, MMDB_lookup_result_s *asn, const MMDB_s *city_mmdb, MMDB_lookup_result_s *city) {
+    memset(blob, 0, GEOIP_PACK_SIZE);
+    blob[GEOIP_PACK_AT_VERSION] = GEOIP_PACK_VERSION;
+
+    if (asn->found_entry)
+        pack_be32(blob + GEOIP_PACK_AT_ASN, pack_uint(&asn->entry, (const char *const[]){ "autonomous_system_number", NULL }));
+
+    if (city->found_entry) {
+        char code[2];
+
+        pack_code(&city->entry, (const char *const[]){ "continent", "code", NULL }, code);
+        for (int i = 0; i < PACK_CONTINENTS; i++) {
+            if (memcmp(code, pack_continents[i], 2) == 0)
+                blob[GEOIP_PACK_AT_CONTINENT] = (uint8_t)(i + 1);
+        }
+
+        pack_code(&city->entry, (const char *const[]){ "country", "iso_code", NULL }, code);
+        memcpy(blob + GEOIP_PACK_AT_COUNTRY, code, 2);
+
+        pack_be32(blob + GEOIP_PACK_AT_CITY, pack_uint(&city->entry, (const char *const[]){ "city", "geoname_id", NULL }));
+        pack_be32(blob + GEOIP_PACK_AT_SUBDIVISION, pack_uint(&city->entry, (const char *const[]){ "subdivisions", "0", "geoname_id", NULL }));
+    }
+
+    pack_be16(blob + GEOIP_PACK_AT_CITY_EPOCH, pack_epoch(city_mmdb));
+    pack_be16(blob + GEOIP_PACK_AT_ASN_EPOCH, pack_epoch(asn_mmdb));
+}
+
+/**
+ * Read the fingerprint argument of an unpack function.
+ * 
+ * @param context   The current SQLite3 function context structure/object.
+ * @param value     The argument.
+ * @return          The fingerprint, or NULL when the argument is NULL or an error was raised because it is no fingerprint.
+ */
+static const uint8_t *unpack_blob(sqlite3_context *context, sqlite3_value *value) {
+    if (sqlite3_value_type(value) == SQLITE_NULL)
+        return NULL;
+
+    const uint8_t *blob = sqlite3_value_blob(value);
+    if (sqlite3_value_type(value) != SQLITE_BLOB || sqlite3_value_bytes(value) != GEOIP_PACK_SIZE ||
+        blob[GEOIP_PACK_AT_VERSION] != GEOIP_PACK_VERSION) {
+        sqlite3_result_error(context, "Not a fingerprint returned by geoip_pack", -1);
+        return NULL;
+    }
+
+    return blob;
+}
+
+/**
+ * Return the continent code of a fingerprint.
+ * 
+ * This function handles the "geoip_unpack_continent" extension function and returns a code such as 'EU', or NULL.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (should be 1).
+ * @param argv          The fingerprint.
+ */
+static void unpack_continent(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    (void)argc;  /* Unused parameter */
+    const uint8_t *blob = unpack_blob(context, argv[0]);
+
+    if (blob == NULL || blob[GEOIP_PACK_AT_CONTINENT] == 0 || blob[GEOIP_PACK_AT_CONTINENT] > PACK_CONTINENTS)
+        return;
+
+    sqlite3_result_text(context, pack_continents[blob[GEOIP_PACK_AT_CONTINENT] - 1], 2, SQLITE_STATIC);
+}
+
+/**
+ * Return the country code of a fingerprint.
+ * 
+ * This function handles the "geoip_unpack_country" extension function and returns an ISO 3166-1 code such as 'FR', or
+ * NULL.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (should be 1).
+ * @param argv          The fingerprint.
+ */
+static void unpack_country(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    (void)argc;  /* Unused parameter */
+    const uint8_t *blob = unpack_blob(context, argv[0]);
+
+    if (blob == NULL || unpack_be16(blob + GEOIP_PACK_AT_COUNTRY) == 0)
+        return;
+
+    sqlite3_result_text(context, (const char *)blob + GEOIP_PACK_AT_COUNTRY, 2, SQLITE_TRANSIENT);
+}
+
+/**
+ * Return an integer field of a fingerprint.
+ * 
+ * This function handles the "geoip_unpack_country_id", "geoip_unpack_asn", "geoip_unpack_city_id" and
+ * "geoip_unpack_subdivision_id" extension functions, the user data being the GEOIP_PACK_AT_* offset of the field.
+ * The country id is the country code read as a 16-bit integer, which groups like the code without comparing text.
+ * Zero, a field the databases did not have, is returned as NULL.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (should be 1).
+ * @param argv          The fingerprint.
+ */
+static void unpack_uint(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    (void)argc;  /* Unused parameter */
+    const int at = (int)(intptr_t)sqlite3_user_data(context);
+    const uint8_t *blob = unpack_blob(context, argv[0]);
+
+    if (blob == NULL)
+        return;
+
+    uint32_t value = at == GEOIP_PACK_AT_COUNTRY ? unpack_be16(blob + at) : unpack_be32(blob + at);
+    if (value != 0)
+        sqlite3_result_int64(context, value);
+}
+
+/**
+ * Return when a database behind a fingerprint was built.
+ * 
+ * This function handles the "geoip_unpack_epoch" extension function. It returns the Unix time of the day the City
+ * database, or the database named by the second argument ('asn' or 'city'), was built.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (1 or 2).
+ * @param argv          The fingerprint and optionally the name of the database.
+ */
+static void unpack_epoch(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    int at = GEOIP_PACK_AT_CITY_EPOCH;
+
+    if (argc == 2) {
+        const char *name = (const char *)sqlite3_value_text(argv[1]);
+
+        if (name != NULL && sqlite3_stricmp(name, "asn") == 0) {
+            at = GEOIP_PACK_AT_ASN_EPOCH;
+        } else if (name == NULL || sqlite3_stricmp(name, "city") != 0) {
+            sqlite3_result_error(context, "Unknown database, expected 'asn' or 'city'", -1);
+            return;
+        }
+    }
+
+    const uint8_t *blob = unpack_blob(context, argv[0]);
+    if (blob != NULL)
+        sqlite3_result_int64(context, (sqlite3_int64)unpack_be16(blob + at) * 86400);
+}
+
+/**
+ * Register the fingerprint unpack functions.
+ * 
+ * They only read their argument, never a database, so they are deterministic and usable anywhere.
+ * 
+ * @param db    The current SQLite3 database context.
+ * @return      An SQLite3 result code.
+ */
+int geoip_pack_register(sqlite3 *db) {
+    const int flags = SQLITE_UTF8 | SQLITE_DETERMINISTIC | SQLITE_INNOCUOUS;
+    static const struct {
+        const char *name;
+        int at;
+    } fields[] = {
+        { "geoip_unpack_country_id", GEOIP_PACK_AT_COUNTRY },
+        { "geoip_unpack_asn", GEOIP_PACK_AT_ASN },
+        { "geoip_unpack_city_id", GEOIP_PACK_AT_CITY },
+        { "geoip_unpack_subdivision_id", GEOIP_PACK_AT_SUBDIVISION }
+    };
+    int rc;
+
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        rc = sqlite3_create_function(db, fields[i].name, 1, flags, (void *)(intptr_t)fields[i].at, unpack_uint, 0, 0);
+        if (rc != SQLITE_OK) return rc;
+    }
+
+    rc = sqlite3_create_function(db, "geoip_unpack_continent", 1, flags, 0, unpack_continent, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_unpack_country", 1, flags, 0, unpack_country, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_unpack_epoch", 1, flags, 0, unpack_epoch, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    return sqlite3_create_function(db, "geoip_unpack_epoch", 2, flags, 0, unpack_epoch, 0, 0);
+}
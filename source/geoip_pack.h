@@ -0,0 +1,30 @@
+#ifndef GEOIP_PACK_H
+#define GEOIP_PACK_H
+
+#include <stdint.h>
+#include "maxminddb.h"
+
+typedef struct sqlite3 sqlite3;
+
+#define GEOIP_PACK_SIZE    20 /**< The size of a packed fingerprint in bytes. */
+#define GEOIP_PACK_VERSION 1  /**< The layout version stored in the first byte of a fingerprint. */
+
+/**
+ * The layout of a packed fingerprint, every field big-endian so fingerprints sort by version, continent and country.
+ * A field the databases do not have for the address is zero.
+ */
+enum {
+    GEOIP_PACK_AT_VERSION     = 0,  /**< 1 byte, GEOIP_PACK_VERSION. */
+    GEOIP_PACK_AT_CONTINENT   = 1,  /**< 1 byte, the position of the continent code in the list AF AN AS EU NA OC SA, from 1. */
+    GEOIP_PACK_AT_COUNTRY     = 2,  /**< 2 bytes, the two ASCII letters of the ISO 3166-1 country code. */
+    GEOIP_PACK_AT_ASN         = 4,  /**< 4 bytes, the autonomous system number. */
+    GEOIP_PACK_AT_CITY        = 8,  /**< 4 bytes, the GeoNames id of the city. */
+    GEOIP_PACK_AT_SUBDIVISION = 12, /**< 4 bytes, the GeoNames id of the first subdivision. */
+    GEOIP_PACK_AT_CITY_EPOCH  = 16, /**< 2 bytes, the day the City database was built, counted from 1970-01-01. */
+    GEOIP_PACK_AT_ASN_EPOCH   = 18  /**< 2 bytes, the day the ASN database was built, counted from 1970-01-01. */
+};
+
+void geoip_pack_encode(uint8_t *blob, const MMDB_s *asn_mmdb, MMDB_lookup_result_s *asn, const MMDB_s *city_mmdb, MMDB_lookup_result_s *city);
+int geoip_pack_register(sqlite3 *db);
+
+#endif /* GEOIP_PACK_H */
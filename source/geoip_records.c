@@ -0,0 +1,328 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "geoip.h"
+#include <sqlite3ext.h>
+SQLITE_EXTENSION_INIT3
+
+/**
+ * The columns of the geoip_records virtual table, in declaration order.
+ */
+enum {
+    RECORDS_COLUMN_ID,
+    RECORDS_COLUMN_CONTINENT,
+    RECORDS_COLUMN_COUNTRY,
+    RECORDS_COLUMN_STATE,
+    RECORDS_COLUMN_CITY,
+    RECORDS_COLUMN_ZIPCODE,
+    RECORDS_COLUMN_TIMEZONE,
+    RECORDS_COLUMN_ASN_NUMBER,
+    RECORDS_COLUMN_ASN_OWNER,
+    RECORDS_COLUMN_JSON,
+    RECORDS_COLUMN_DB
+};
+
+#define RECORDS_ID 1 /**< An idxNum bit, the id column is constrained to a single value. */
+#define RECORDS_DB 2 /**< An idxNum bit, the hidden db column names the database. */
+
+/**
+ * The MMDB lookup path of every decoded column, the same fields the lookup functions of the same names return.
+ */
+static const char *const *const records_paths[] = {
+    [RECORDS_COLUMN_CONTINENT]  = (const char *const[]){ "continent", "names", "en", NULL },
+    [RECORDS_COLUMN_COUNTRY]    = (const char *const[]){ "country", "names", "en", NULL },
+    [RECORDS_COLUMN_STATE]      = (const char *const[]){ "subdivisions", "0", "names", "en", NULL },
+    [RECORDS_COLUMN_CITY]       = (const char *const[]){ "city", "names", "en", NULL },
+    [RECORDS_COLUMN_ZIPCODE]    = (const char *const[]){ "postal", "code", NULL },
+    [RECORDS_COLUMN_TIMEZONE]   = (const char *const[]){ "location", "time_zone", NULL },
+    [RECORDS_COLUMN_ASN_NUMBER] = (const char *const[]){ "autonomous_system_number", NULL },
+    [RECORDS_COLUMN_ASN_OWNER]  = (const char *const[]){ "autonomous_system_organization", NULL }
+};
+
+/**
+ * The virtual table, which remembers the connection whose JSON cache the json column goes through.
+ */
+typedef struct records_vtab {
+    sqlite3_vtab base;   /**< The base class, must come first. */
+    geoip_conn *conn;    /**< The state of the connection the table belongs to. */
+} records_vtab;
+
+/**
+ * A cursor over the records of one database.
+ */
+typedef struct records_cursor {
+    sqlite3_vtab_cursor base; /**< The base class, must come first. */
+    geoip_db *db;             /**< The database being listed. */
+    uint32_t *records;        /**< The data section offsets of every record, from geoip_tree_records(), or NULL. */
+    const uint8_t *listed;    /**< The data section records was listed from, kept between filters of a join. */
+    uint32_t nrecords;        /**< The number of records in records. */
+    uint32_t count;           /**< The position in records past the last record listed. */
+    uint32_t row;             /**< The position in records of the current record. */
+} records_cursor;
+
+static int records_connect(sqlite3 *db, void *pAux, int argc, const char *const *argv, sqlite3_vtab **ppVtab, char **pzErr) {
+    (void)argc; (void)argv; (void)pzErr;  /* Unused parameters */
+
+    int rc = sqlite3_declare_vtab(db,
+        "CREATE TABLE x(id INTEGER, continent TEXT, country TEXT, state TEXT, city TEXT, zipcode TEXT, timezone TEXT, "
+        "asn_number INTEGER, asn_owner TEXT, json TEXT, db HIDDEN)");
+    if (rc != SQLITE_OK)
+        return rc;
+
+    records_vtab *vtab = sqlite3_malloc(sizeof(records_vtab));
+    if (vtab == NULL)
+        return SQLITE_NOMEM;
+
+    memset(vtab, 0, sizeof(*vtab));
+    vtab->conn = pAux;
+    *ppVtab = &vtab->base;
+    return SQLITE_OK;
+}
+
+static int records_disconnect(sqlite3_vtab *pVtab) {
+    sqlite3_free(pVtab);
+    return SQLITE_OK;
+}
+
+/**
+ * Plan a scan: an equality on id fetches one record, an equality on db picks the database, anything else lists every
+ * record of the database in id order.
+ */
+static int records_best_index(sqlite3_vtab *pVtab, sqlite3_index_info *pInfo) {
+    (void)pVtab;  /* Unused parameter */
+    int id = -1, db = -1;
+
+    for (int i = 0; i < pInfo->nConstraint; i++) {
+        const struct sqlite3_index_constraint *constraint = &pInfo->aConstraint[i];
+
+        if (constraint->op != SQLITE_INDEX_CONSTRAINT_EQ)
+            continue;
+
+        if (constraint->iColumn == RECORDS_COLUMN_DB) {
+            if (!constraint->usable)
+                return SQLITE_CONSTRAINT;
+
+            db = i;
+        } else if ((constraint->iColumn == RECORDS_COLUMN_ID || constraint->iColumn == -1) && constraint->usable) {
+            id = i;
+        }
+    }
+
+    int argvIndex = 0;
+    pInfo->idxNum = 0;
+
+    if (id >= 0) {
+        pInfo->aConstraintUsage[id].argvIndex = ++argvIndex;
+        pInfo->aConstraintUsage[id].omit = 1;
+        pInfo->idxNum |= RECORDS_ID;
+        pInfo->idxFlags = SQLITE_INDEX_SCAN_UNIQUE;
+        pInfo->estimatedCost = 10;
+        pInfo->estimatedRows = 1;
+    } else {
+        pInfo->estimatedCost = 1000000;
+        pInfo->estimatedRows = 500000;
+    }
+
+    if (db >= 0) {
+        pInfo->aConstraintUsage[db].argvIndex = ++argvIndex;
+        pInfo->aConstraintUsage[db].omit = 1;
+        pInfo->idxNum |= RECORDS_DB;
+    }
+
+    /* Records are listed by ascending offset. */
+    if (pInfo->nOrderBy == 1 && pInfo->aOrderBy[0].iColumn == RECORDS_COLUMN_ID && !pInfo->aOrderBy[0].desc)
+        pInfo->orderByConsumed = 1;
+
+    return SQLITE_OK;
+}
+
+static int records_open(sqlite3_vtab *pVtab, sqlite3_vtab_cursor **ppCursor) {
+    (void)pVtab;  /* Unused parameter */
+
+    records_cursor *cursor = sqlite3_malloc(sizeof(records_cursor));
+    if (cursor == NULL)
+        return SQLITE_NOMEM;
+
+    memset(cursor, 0, sizeof(*cursor));
+    *ppCursor = &cursor->base;
+    return SQLITE_OK;
+}
+
+static int records_close(sqlite3_vtab_cursor *pCursor) {
+    records_cursor *cursor = (records_cursor *)pCursor;
+
+    free(cursor->records);
+    sqlite3_free(cursor);
+    return SQLITE_OK;
+}
+
+/**
+ * Report an error through the virtual table.
+ * 
+ * @param cursor    The cursor the error happened on.
+ * @param msg       The error message.
+ * @return          SQLITE_ERROR.
+ */
+static int records_error(records_cursor *cursor, const char *msg) {
+    sqlite3_vtab *vtab = cursor->base.pVtab;
+
+    sqlite3_free(vtab->zErrMsg);
+    vtab->zErrMsg = sqlite3_mprintf("%s", msg);
+    return SQLITE_ERROR;
+}
+
+static int records_compare(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static int records_filter(sqlite3_vtab_cursor *pCursor, int idxNum, const char *idxStr, int argc, sqlite3_value **argv) {
+    (void)idxStr; (void)argc;  /* Unused parameters */
+    records_cursor *cursor = (records_cursor *)pCursor;
+    int arg = 0;
+
+    cursor->count = cursor->row = 0;
+
+    if (!initialized)
+        return records_error(cursor, MSG_NOTINITIALIZED);
+
+    sqlite3_value *id = idxNum & RECORDS_ID ? argv[arg++] : NULL;
+    cursor->db = idxNum & RECORDS_DB ? geoip_db_find((const char *)sqlite3_value_text(argv[arg])) : &db_cnt;
+    if (cursor->db == NULL)
+        return records_error(cursor, MSG_UNKNOWNDB);
+
+    int status = geoip_db_acquire(cursor->db);
+    if (status != MMDB_SUCCESS) {
+        char msg[256];
+
+        snprintf(msg, sizeof(msg), MSG_ERRLIBMAXMIND, MMDB_strerror(status));
+        return records_error(cursor, msg);
+    }
+
+    /*
+     * The list of records outlives the filter, a join looking records up by id reads the tree once rather than for every
+     * row. It is listed again when the cursor moves to another database or the file was reopened.
+     */
+    if (cursor->records == NULL || cursor->listed != cursor->db->mmdb.data_section) {
+        free(cursor->records);
+        cursor->records = geoip_tree_records(&cursor->db->mmdb, &cursor->nrecords);
+        cursor->listed = cursor->records != NULL ? cursor->db->mmdb.data_section : NULL;
+        if (cursor->records == NULL && cursor->db->mmdb.data_section_size > 0 && cursor->db->mmdb.metadata.node_count > 0) {
+            /* geoip_tree_records() cannot tell an empty database from a failed allocation, a database has records. */
+            return SQLITE_NOMEM;
+        }
+    }
+
+    if (id != NULL) {
+        /* Only an offset the search tree points at is a record, a map nested in one or anything else matches nothing. */
+        sqlite3_int64 offset = sqlite3_value_int64(id);
+
+        if (sqlite3_value_numeric_type(id) != SQLITE_INTEGER || offset < 0 || offset >= cursor->db->mmdb.data_section_size)
+            return SQLITE_OK;
+
+        uint32_t key = (uint32_t)offset;
+        const uint32_t *record = bsearch(&key, cursor->records, cursor->nrecords, sizeof(uint32_t), records_compare);
+        if (record != NULL) {
+            cursor->row = (uint32_t)(record - cursor->records);
+            cursor->count = cursor->row + 1;
+        }
+
+        return SQLITE_OK;
+    }
+
+    cursor->count = cursor->nrecords;
+    return SQLITE_OK;
+}
+
+static int records_next(sqlite3_vtab_cursor *pCursor) {
+    ((records_cursor *)pCursor)->row++;
+    return SQLITE_OK;
+}
+
+static int records_eof(sqlite3_vtab_cursor *pCursor) {
+    records_cursor *cursor = (records_cursor *)pCursor;
+
+    return cursor->row >= cursor->count;
+}
+
+static inline uint32_t records_offset(const records_cursor *cursor) {
+    return cursor->records[cursor->row];
+}
+
+static int records_column(sqlite3_vtab_cursor *pCursor, sqlite3_context *context, int column) {
+    records_cursor *cursor = (records_cursor *)pCursor;
+    MMDB_entry_s entry = { .mmdb = &cursor->db->mmdb, .offset = records_offset(cursor) };
+
+    switch (column) {
+    case RECORDS_COLUMN_ID:
+        sqlite3_result_int64(context, entry.offset);
+        break;
+    case RECORDS_COLUMN_DB:
+        sqlite3_result_text(context, cursor->db->alias, -1, SQLITE_TRANSIENT);
+        break;
+    case RECORDS_COLUMN_JSON: {
+        const records_vtab *vtab = (const records_vtab *)cursor->base.pVtab;
+        const char *json;
+        int length;
+        int status = geoip_json_record(&vtab->conn->json, entry.mmdb, entry.offset, &json, &length);
+
+        if (status == MMDB_OUT_OF_MEMORY_ERROR)
+            return SQLITE_NOMEM;
+
+        if (status != MMDB_SUCCESS)
+            return records_error(cursor, MMDB_strerror(status));
+
+        sqlite3_result_text(context, json, length, SQLITE_TRANSIENT);
+        sqlite3_result_subtype(context, GEOIP_JSON_SUBTYPE);
+        break;
+    }
+    default: {
+        /* A field the record does not have, or of an unexpected type, is NULL. */
+        MMDB_entry_data_s entry_data;
+
+        if (MMDB_aget_value(&entry, &entry_data, records_paths[column]) != MMDB_SUCCESS || !entry_data.has_data)
+            break;
+
+        if (entry_data.type == MMDB_DATA_TYPE_UTF8_STRING)
+            sqlite3_result_text(context, entry_data.utf8_string, entry_data.data_size, SQLITE_TRANSIENT);
+        else if (entry_data.type == MMDB_DATA_TYPE_UINT32)
+            sqlite3_result_int64(context, entry_data.uint32);
+        break;
+    }
+    }
+
+    return SQLITE_OK;
+}
+
+static int records_rowid(sqlite3_vtab_cursor *pCursor, sqlite_int64 *pRowid) {
+    *pRowid = records_offset((records_cursor *)pCursor);
+    return SQLITE_OK;
+}
+
+static sqlite3_module records_module = {
+    .iVersion = 0,
+    .xCreate = NULL,             /* Eponymous-only, "CREATE VIRTUAL TABLE" is not supported */
+    .xConnect = records_connect,
+    .xBestIndex = records_best_index,
+    .xDisconnect = records_disconnect,
+    .xDestroy = records_disconnect,
+    .xOpen = records_open,
+    .xClose = records_close,
+    .xFilter = records_filter,
+    .xNext = records_next,
+    .xEof = records_eof,
+    .xColumn = records_column,
+    .xRowid = records_rowid
+};
+
+/**
+ * Register the geoip_records virtual table.
+ * 
+ * @param db    The current SQLite3 database context.
+ * @param conn  The state of the connection, whose JSON cache the json column shares with "geoip_json".
+ * @return      An SQLite3 result code.
+ */
+int geoip_records_register(sqlite3 *db, geoip_conn *conn) {
+    return sqlite3_create_module(db, "geoip_records", &records_module, conn);
+}
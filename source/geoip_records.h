@@ -0,0 +1,9 @@
+#ifndef GEOIP_RECORDS_H
+#define GEOIP_RECORDS_H
+
+typedef struct sqlite3 sqlite3;
+typedef struct geoip_conn geoip_conn;
+
+int geoip_records_register(sqlite3 *db, geoip_conn *conn);
+
+#endif /* GEOIP_RECORDS_H */
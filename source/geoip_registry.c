@@ -0,0 +1,339 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "geoip.h"
+#include <sqlite3ext.h>
+SQLITE_EXTENSION_INIT3
+
+/**
+ * Every database SQL functions can name, written under the SQLITE_MUTEX_STATIC_APP1 mutex and read without it.
+ */
+static _Atomic(geoip_db *) registry[GEOIP_DB_MAX] = { &db_asn, &db_cnt };
+
+static geoip_db *retired; /**< The databases closed by "geoip_close", guarded by the SQLITE_MUTEX_STATIC_APP1 mutex. */
+
+/**
+ * Find a database by the alias SQL functions know it by.
+ * 
+ * @param name      The alias, 'asn' and 'city' for the built-in databases, compared case-insensitively.
+ * @return          The database, or NULL for an unknown alias.
+ */
+geoip_db *geoip_db_find(const char *name) {
+    if (name == NULL)
+        return NULL;
+
+    for (int i = 0; i < GEOIP_DB_MAX; i++) {
+        geoip_db *db = atomic_load_explicit(&registry[i], memory_order_acquire);
+
+        if (db != NULL && sqlite3_stricmp(name, db->alias) == 0)
+            return db;
+    }
+
+    return NULL;
+}
+
+/**
+ * Get a registered database by its slot in the registry, to walk over all of them.
+ * 
+ * @param index     A slot between 0 and GEOIP_DB_MAX - 1.
+ * @return          The database in the slot, or NULL for an empty slot.
+ */
+geoip_db *geoip_db_at(int index) {
+    if (index < 0 || index >= GEOIP_DB_MAX)
+        return NULL;
+
+    return atomic_load_explicit(&registry[index], memory_order_acquire);
+}
+
+/**
+ * Apply the engine options of "geoip_open" to a database that is not opened yet.
+ * 
+ * Options are key=value pairs separated by commas or spaces: cache (the number of lookup cache slots),
+ * reject_reserved (0 or 1, whether lookups of non-public addresses skip the walk), warm_start (0 or 1, whether the
+ * lookup cache is saved when the last connection closes), mode, madvise, mlock and warmup, the last four as accepted
+ * by geoip_mmap_option().
+ * 
+ * @param db        The database.
+ * @param options   The option text.
+ * @param msg       Receives an error message.
+ * @param size      The size of msg.
+ * @return          0 on success, -1 with msg set for a malformed or unknown option.
+ */
+static int registry_options(geoip_db *db, const char *options, char *msg, size_t size) {
+    const char *p = options;
+
+    while (*p != '\0') {
+        char key[32], value[32];
+        size_t length;
+
+        p += strspn(p, ", ");
+        if (*p == '\0')
+            break;
+
+        length = strcspn(p, "=, ");
+        if (length == 0 || length >= sizeof(key) || p[length] != '=') {
+            snprintf(msg, size, "Malformed option near '%.32s', expected key=value", p);
+            return -1;
+        }
+
+        memcpy(key, p, length);
+        key[length] = '\0';
+        p += length + 1;
+
+        length = strcspn(p, ", ");
+        if (length >= sizeof(value)) {
+            snprintf(msg, size, "The value of option '%s' is too long", key);
+            return -1;
+        }
+
+        memcpy(value, p, length);
+        value[length] = '\0';
+        p += length;
+
+        int rc = geoip_mmap_option(&db->map, key, value);
+        if (rc == 0 && sqlite3_stricmp(key, "cache") == 0) {
+            char *end;
+            unsigned long slots = strtoul(value, &end, 10);
+
+            rc = value[0] != '\0' && *end == '\0' && slots > 0 && slots <= (1UL << 31) ? 1 : -1;
+            if (rc > 0)
+                db->cache_slots = (uint32_t)slots;
+        } else if (rc == 0 && sqlite3_stricmp(key, "reject_reserved") == 0) {
+            rc = strcmp(value, "0") == 0 || strcmp(value, "1") == 0 ? 1 : -1;
+            if (rc > 0)
+                atomic_store_explicit(&db->reject_reserved, value[0] == '1', memory_order_relaxed);
+        } else if (rc == 0 && sqlite3_stricmp(key, "warm_start") == 0) {
+            rc = strcmp(value, "0") == 0 || strcmp(value, "1") == 0 ? 1 : -1;
+            if (rc > 0)
+                atomic_store_explicit(&db->warm_start, value[0] == '1', memory_order_relaxed);
+        }
+
+        if (rc == 0) {
+            snprintf(msg, size, "Unknown option '%s', expected cache, reject_reserved, warm_start, mode, madvise, mlock or "
+                "warmup", key);
+            return -1;
+        }
+
+        if (rc < 0) {
+            snprintf(msg, size, "Invalid value '%s' for option '%s'", value, key);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Release a database that was never published or has been retired.
+ * 
+ * @param db        The database.
+ */
+static void registry_free(geoip_db *db) {
+    sqlite3_mutex *mutex = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP1);
+
+    sqlite3_mutex_enter(mutex);
+    geoip_db_release(db);
+    sqlite3_mutex_leave(mutex);
+
+    sqlite3_free(db);
+}
+
+/**
+ * Open an MMDB file of any type under an alias.
+ * 
+ * This function handles the "geoip_open" extension function. The file is opened right away with the given engine
+ * options so a missing or corrupt file is reported here, then the alias is registered for the whole process. It
+ * returns 1, or 0 when the alias already names the same file, which lets every connection run the same setup.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (2 or 3).
+ * @param argv          The alias, the path of the file and optionally the engine options.
+ */
+static void registry_open(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    const char *alias = (const char *)sqlite3_value_text(argv[0]);
+    const char *path = (const char *)sqlite3_value_text(argv[1]);
+    char msg[PATH_MAX + 128];
+
+    if (!initialized) {
+        sqlite3_result_error(context, MSG_NOTINITIALIZED, -1);
+        return;
+    }
+
+    if (alias == NULL || alias[0] == '\0' || strlen(alias) >= GEOIP_ALIAS_MAX || path == NULL) {
+        sqlite3_result_error(context, "The alias must be 1 to 31 characters long and the path not NULL", -1);
+        return;
+    }
+
+    geoip_db *db = sqlite3_malloc(sizeof(geoip_db));
+    if (db == NULL) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+
+    memset(db, 0, sizeof(*db));
+    strcpy(db->alias, alias);
+    db->name = db->alias;
+
+    #ifdef _WIN32
+        bool resolved = _fullpath(db->path, path, sizeof(db->path)) != NULL;
+    #else
+        bool resolved = realpath(path, db->path) != NULL;
+    #endif
+
+    if (!resolved) {
+        snprintf(msg, sizeof(msg), "Unable to open %s: %s", path, strerror(errno));
+        sqlite3_result_error(context, msg, -1);
+        sqlite3_free(db);
+        return;
+    }
+
+    if (argc == 3 && sqlite3_value_type(argv[2]) != SQLITE_NULL &&
+        registry_options(db, (const char *)sqlite3_value_text(argv[2]), msg, sizeof(msg)) != 0) {
+        sqlite3_result_error(context, msg, -1);
+        sqlite3_free(db);
+        return;
+    }
+
+    geoip_db *existing = geoip_db_find(alias);
+    if (existing != NULL) {
+        bool same = strcmp(existing->path, db->path) == 0;
+
+        sqlite3_free(db);
+        if (same) {
+            sqlite3_result_int(context, 0);
+            return;
+        }
+
+        snprintf(msg, sizeof(msg), "The alias %s is already taken by %s", alias, existing->path);
+        sqlite3_result_error(context, msg, -1);
+        return;
+    }
+
+    int status = geoip_db_acquire(db);
+    if (status != MMDB_SUCCESS) {
+        snprintf(msg, sizeof(msg), MSG_ERRLIBMAXMIND, MMDB_strerror(status));
+        sqlite3_result_error(context, msg, -1);
+        registry_free(db);
+        return;
+    }
+
+    /* Another connection may have registered the alias while the file was being opened. */
+    sqlite3_mutex *mutex = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP1);
+    int slot = -1;
+
+    sqlite3_mutex_enter(mutex);
+    existing = geoip_db_find(alias);
+    for (int i = 0; existing == NULL && slot < 0 && i < GEOIP_DB_MAX; i++) {
+        if (atomic_load_explicit(&registry[i], memory_order_relaxed) == NULL)
+            slot = i;
+    }
+
+    if (slot >= 0)
+        atomic_store_explicit(&registry[slot], db, memory_order_release);
+    sqlite3_mutex_leave(mutex);
+
+    if (slot < 0) {
+        bool same = existing != NULL && strcmp(existing->path, db->path) == 0;
+
+        registry_free(db);
+        if (same) {
+            sqlite3_result_int(context, 0);
+            return;
+        }
+
+        sqlite3_result_error(context, existing != NULL ? "The alias was taken while the file was being opened" :
+            "Too many databases are open, close one with geoip_close first", -1);
+        return;
+    }
+
+    sqlite3_result_int(context, 1);
+}
+
+/**
+ * Unregister a database opened by "geoip_open".
+ * 
+ * This function handles the "geoip_close" extension function and returns 1, or 0 when the alias is unknown. Lookups
+ * running in other connections may still be reading the database, so its memory is only released once the last
+ * connection using the extension closes. The built-in databases cannot be closed.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (should be 1).
+ * @param argv          The alias.
+ */
+static void registry_close(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    (void)argc;  /* Unused parameter */
+    const char *alias = (const char *)sqlite3_value_text(argv[0]);
+    int closed = 0;
+
+    if (!initialized) {
+        sqlite3_result_error(context, MSG_NOTINITIALIZED, -1);
+        return;
+    }
+
+    sqlite3_mutex *mutex = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP1);
+    sqlite3_mutex_enter(mutex);
+
+    for (int i = 0; alias != NULL && i < GEOIP_DB_MAX; i++) {
+        geoip_db *db = atomic_load_explicit(&registry[i], memory_order_relaxed);
+
+        if (db == NULL || sqlite3_stricmp(alias, db->alias) != 0)
+            continue;
+
+        if (db == &db_asn || db == &db_cnt) {
+            closed = -1;
+            break;
+        }
+
+        atomic_store_explicit(&registry[i], NULL, memory_order_release);
+        geoip_mmap_stop(&db->map);
+        db->next = retired;
+        retired = db;
+        closed = 1;
+        break;
+    }
+
+    sqlite3_mutex_leave(mutex);
+
+    if (closed < 0) {
+        sqlite3_result_error(context, "The built-in databases cannot be closed", -1);
+        return;
+    }
+
+    sqlite3_result_int(context, closed);
+}
+
+/**
+ * Release the databases closed by "geoip_close".
+ * 
+ * Must be called with the SQLITE_MUTEX_STATIC_APP1 mutex held, once no connection can be looking anything up.
+ */
+void geoip_registry_release(void) {
+    while (retired != NULL) {
+        geoip_db *db = retired;
+
+        retired = db->next;
+        geoip_db_release(db);
+        sqlite3_free(db);
+    }
+}
+
+/**
+ * Register the database registry functions.
+ * 
+ * Both change process-wide state, so they are not usable from triggers or views.
+ * 
+ * @param db    The current SQLite3 database context.
+ * @return      An SQLite3 result code.
+ */
+int geoip_registry_register(sqlite3 *db) {
+    int rc;
+
+    rc = sqlite3_create_function(db, "geoip_open", 2, SQLITE_UTF8 | SQLITE_DIRECTONLY, 0, registry_open, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_open", 3, SQLITE_UTF8 | SQLITE_DIRECTONLY, 0, registry_open, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    return sqlite3_create_function(db, "geoip_close", 1, SQLITE_UTF8 | SQLITE_DIRECTONLY, 0, registry_close, 0, 0);
+}
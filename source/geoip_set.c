@@ -0,0 +1,362 @@
+#include <stdlib.h>
+#include <string.h>
+#include "geoip.h"
+#include <sqlite3ext.h>
+SQLITE_EXTENSION_INIT3
+
+#define SET_MEMO_SLOTS 4096 /**< The initial number of memo slots, a power of two. */
+
+/**
+ * The path of the field every kind of set compares, indexed by GEOIP_SET_*.
+ */
+static const char *const *const set_paths[] = {
+    [GEOIP_SET_COUNTRY]   = (const char *const[]){ "country", "iso_code", NULL },
+    [GEOIP_SET_ASN]       = (const char *const[]){ "autonomous_system_number", NULL },
+    [GEOIP_SET_CONTINENT] = (const char *const[]){ "continent", "code", NULL }
+};
+
+/**
+ * The key of a two letter code, or 0 when the text is not one.
+ * 
+ * @param text      The code.
+ * @param length    The length of the code in bytes.
+ * @return          Both letters upper-cased, big-endian.
+ */
+static uint32_t set_code(const char *text, int length) {
+    if (text == NULL || length != 2)
+        return 0;
+
+    unsigned char a = (unsigned char)text[0], b = (unsigned char)text[1];
+    if (a >= 'a' && a <= 'z')
+        a -= 'a' - 'A';
+    if (b >= 'a' && b <= 'z')
+        b -= 'a' - 'A';
+
+    return (uint32_t)a << 8 | b;
+}
+
+static int set_compare_keys(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * Parse a value the field of a kind of set is compared with.
+ * 
+ * Codes are compared case-insensitively. Autonomous system numbers may be written as integers or as text such as
+ * 'AS13335'.
+ * 
+ * @param kind      A GEOIP_SET_* value.
+ * @param value     The value, not NULL.
+ * @return          The key, codes as their two letters upper-cased and big-endian, or 0 when the value is malformed.
+ */
+uint32_t geoip_set_key(int kind, sqlite3_value *value) {
+    const char *text = (const char *)sqlite3_value_text(value);
+
+    if (kind != GEOIP_SET_ASN)
+        return set_code(text, sqlite3_value_bytes(value));
+
+    char *end = NULL;
+    if (text != NULL && (text[0] == 'A' || text[0] == 'a') && (text[1] == 'S' || text[1] == 's'))
+        text += 2;
+
+    unsigned long long number = text != NULL && text[0] >= '0' && text[0] <= '9' ? strtoull(text, &end, 10) : 0;
+    return end != NULL && *end == '\0' && number <= UINT32_MAX ? (uint32_t)number : 0;
+}
+
+/**
+ * Compile the constant arguments of a predicate function.
+ * 
+ * Values are parsed by geoip_set_key(), NULL arguments are skipped.
+ * 
+ * @param kind      A GEOIP_SET_* value.
+ * @param argc      The number of values.
+ * @param argv      The values.
+ * @param errmsg    Receives an error message allocated with sqlite3_malloc() when a value is malformed.
+ * @return          The set, to be released with geoip_set_free(), or NULL with errmsg set or left NULL when out of memory.
+ */
+geoip_set *geoip_set_new(int kind, int argc, sqlite3_value **argv, char **errmsg) {
+    geoip_set *set = sqlite3_malloc(sizeof(geoip_set));
+
+    *errmsg = NULL;
+    if (set == NULL)
+        return NULL;
+
+    memset(set, 0, sizeof(*set));
+    set->kind = kind;
+    set->db = kind == GEOIP_SET_ASN ? &db_asn : &db_cnt;
+    set->keys = sqlite3_malloc64((argc + 1) * sizeof(uint32_t));
+    set->args = sqlite3_malloc64((argc + 1) * sizeof(sqlite3_value *));
+    if (set->keys == NULL || set->args == NULL) {
+        geoip_set_free(set);
+        return NULL;
+    }
+
+    for (int i = 0; i < argc; i++) {
+        if ((set->args[set->nargs] = sqlite3_value_dup(argv[i])) == NULL) {
+            geoip_set_free(set);
+            return NULL;
+        }
+        set->nargs++;
+
+        if (sqlite3_value_type(argv[i]) == SQLITE_NULL)
+            continue;
+
+        uint32_t key = geoip_set_key(kind, argv[i]);
+        if (key == 0) {
+            *errmsg = sqlite3_mprintf(kind == GEOIP_SET_ASN ? "Not an autonomous system number: %s" : "Not a two letter code: %s",
+                sqlite3_value_text(argv[i]));
+            geoip_set_free(set);
+            return NULL;
+        }
+
+        set->keys[set->nkeys++] = key;
+    }
+
+    qsort(set->keys, set->nkeys, sizeof(uint32_t), set_compare_keys);
+    return set;
+}
+
+/**
+ * Check whether a set was compiled from the given arguments.
+ * 
+ * SQLite only keeps a set between rows while its arguments are constant, but it cannot tell whether the arguments
+ * after the first one are, so every row compares them all.
+ * 
+ * @param set       The set.
+ * @param argc      The number of arguments.
+ * @param argv      The arguments.
+ * @return          Whether the arguments are the ones the set was compiled from.
+ */
+bool geoip_set_same(const geoip_set *set, int argc, sqlite3_value **argv) {
+    if (argc != set->nargs)
+        return false;
+
+    for (int i = 0; i < argc; i++) {
+        int type = sqlite3_value_type(argv[i]);
+
+        if (type != sqlite3_value_type(set->args[i]))
+            return false;
+
+        if (type == SQLITE_INTEGER) {
+            if (sqlite3_value_int64(argv[i]) != sqlite3_value_int64(set->args[i]))
+                return false;
+        } else if (type != SQLITE_NULL) {
+            int length = sqlite3_value_bytes(argv[i]);
+
+            if (length != sqlite3_value_bytes(set->args[i]) ||
+                memcmp(sqlite3_value_blob(argv[i]), sqlite3_value_blob(set->args[i]), length) != 0)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Decode the field of a record and look its value up among the wanted values.
+ * 
+ * @param set       The set.
+ * @param offset    The offset of the record in the data section.
+ * @return          Whether the record holds one of the wanted values.
+ */
+static bool set_record_matches(const geoip_set *set, uint32_t offset) {
+    MMDB_entry_s entry = { .mmdb = &set->db->mmdb, .offset = offset };
+    MMDB_entry_data_s entry_data;
+    uint32_t key = 0;
+
+    if (MMDB_aget_value(&entry, &entry_data, set_paths[set->kind]) == MMDB_SUCCESS && entry_data.has_data) {
+        if (entry_data.type == MMDB_DATA_TYPE_UTF8_STRING)
+            key = set_code(entry_data.utf8_string, (int)entry_data.data_size);
+        else if (entry_data.type == MMDB_DATA_TYPE_UINT32 && set->kind == GEOIP_SET_ASN)
+            key = entry_data.uint32;
+    }
+
+    return key != 0 && bsearch(&key, set->keys, set->nkeys, sizeof(uint32_t), set_compare_keys) != NULL;
+}
+
+/**
+ * Decide whether a record holds one of the wanted values, remembering the answer for the networks sharing the record.
+ * 
+ * @param set       The set.
+ * @param offset    The offset of the record in the data section.
+ * @param match     Receives the answer.
+ * @return          MMDB_SUCCESS or MMDB_OUT_OF_MEMORY_ERROR.
+ */
+static int set_match(geoip_set *set, uint32_t offset, bool *match) {
+    uint32_t known;
+
+    if (geoip_memo_get(&set->memo, offset, &known)) {
+        *match = known != 0;
+        return MMDB_SUCCESS;
+    }
+
+    *match = set_record_matches(set, offset);
+    return geoip_memo_put(&set->memo, offset, *match);
+}
+
+/**
+ * The state of building the ranges of one address family.
+ */
+typedef struct set_builder {
+    geoip_set *set;         /**< The set being built. */
+    geoip_set_part *part;   /**< The part being built. */
+} set_builder;
+
+/**
+ * Add a network of the search tree to the ranges when its record matches.
+ * 
+ * Networks come in address order, so the ranges stay sorted, and a network adjacent to the range before it extends it.
+ * 
+ * @param arg       The set_builder.
+ * @param prefix    The network address.
+ * @param length    The prefix length out of 128 bits.
+ * @param offset    The offset of the record of the network.
+ * @return          MMDB_SUCCESS or MMDB_OUT_OF_MEMORY_ERROR.
+ */
+static int set_add_network(void *arg, const uint8_t *prefix, int length, uint32_t offset) {
+    set_builder *builder = arg;
+    geoip_set_part *part = builder->part;
+    bool match;
+
+    int status = set_match(builder->set, offset, &match);
+    if (status != MMDB_SUCCESS || !match)
+        return status;
+
+    geoip_set_range range;
+    memcpy(range.first, prefix, 16);
+    memcpy(range.last, prefix, 16);
+    for (int i = 0; i < 16; i++) {
+        int bits = length - 8 * i;
+
+        if (bits < 8)
+            range.last[i] |= bits <= 0 ? 0xFF : (uint8_t)(0xFF >> bits);
+    }
+
+    if (part->count > 0) {
+        /* The range before is adjacent when its last address plus one is the first address of this one. */
+        uint8_t next[16];
+        geoip_set_range *previous = &part->ranges[part->count - 1];
+        int i = 15;
+
+        memcpy(next, previous->last, 16);
+        while (i >= 0 && ++next[i] == 0)
+            i--;
+
+        if (i >= 0 && memcmp(next, range.first, 16) == 0) {
+            memcpy(previous->last, range.last, 16);
+            return MMDB_SUCCESS;
+        }
+    }
+
+    status = geoip_reserve((void **)&part->ranges, &part->capacity, part->count, sizeof(geoip_set_range));
+    if (status != MMDB_SUCCESS)
+        return status;
+
+    part->ranges[part->count++] = range;
+    return MMDB_SUCCESS;
+}
+
+/**
+ * Test whether an address is in a set.
+ * 
+ * The first address of a family walks every network of the database once, decoding each record once, and keeps the
+ * matching networks as sorted ranges. Every address after that costs one binary search over the ranges.
+ * 
+ * @param set       The set.
+ * @param addr      The parsed address.
+ * @param member    Receives whether the record of the address holds one of the wanted values.
+ * @return          MMDB_SUCCESS or a libmaxminddb error code.
+ */
+int geoip_set_contains(geoip_set *set, const geoip_addr *addr, bool *member) {
+    int status = geoip_db_acquire(set->db);
+    int netmask;
+
+    *member = false;
+    if (status != MMDB_SUCCESS)
+        return status;
+
+    if (addr->family != AF_INET && set->db->mmdb.metadata.ip_version != 6)
+        return MMDB_IPV6_LOOKUP_IN_IPV4_DATABASE_ERROR;
+
+    /* Lookups answer these as not found without a walk, so the set has to as well. */
+    if (geoip_class_reject(set->db, addr, &netmask))
+        return MMDB_SUCCESS;
+
+    geoip_set_part *part = &set->parts[addr->family == AF_INET ? 0 : 1];
+    if (!part->built) {
+        set_builder builder = { .set = set, .part = part };
+
+        if (set->memo.slots == NULL && geoip_memo_init(&set->memo, SET_MEMO_SLOTS) != MMDB_SUCCESS)
+            return MMDB_OUT_OF_MEMORY_ERROR;
+
+        part->status = geoip_tree_networks(&set->db->mmdb,
+            addr->family == AF_INET ? GEOIP_NETWORKS_IPV4 : GEOIP_NETWORKS_ALL, set_add_network, &builder);
+        part->built = true;
+    }
+
+    if (part->status != MMDB_SUCCESS)
+        return part->status;
+
+    /* Find the last range starting at or before the address. */
+    size_t lo = 0, hi = part->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (memcmp(part->ranges[mid].first, addr->bytes, 16) <= 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    *member = lo > 0 && memcmp(addr->bytes, part->ranges[lo - 1].last, 16) <= 0;
+    return MMDB_SUCCESS;
+}
+
+/**
+ * Test whether an address is in a set with a single lookup, without building the ranges.
+ * 
+ * This is what values that change from row to row get: building the ranges walks the whole search tree, which only
+ * pays off when the same set answers many rows.
+ * 
+ * @param set       The set.
+ * @param addr      The parsed address.
+ * @param function  The GEOIP_STAT_* value of the calling extension function, whose lookup counters are updated.
+ * @param member    Receives whether the record of the address holds one of the wanted values.
+ * @return          MMDB_SUCCESS or a libmaxminddb error code.
+ */
+int geoip_set_lookup(geoip_set *set, const geoip_addr *addr, int function, bool *member) {
+    MMDB_lookup_result_s result = {0};
+
+    *member = false;
+    int status = geoip_lookup(set->db, addr, &result, function);
+    if (status != MMDB_SUCCESS || !result.found_entry)
+        return status;
+
+    *member = set_record_matches(set, result.entry.offset);
+    return MMDB_SUCCESS;
+}
+
+/**
+ * Release a set, usable as an SQLite auxiliary data destructor.
+ * 
+ * @param set       The set.
+ */
+void geoip_set_free(void *set) {
+    geoip_set *s = set;
+
+    if (s == NULL)
+        return;
+
+    for (int i = 0; i < s->nargs; i++)
+        sqlite3_value_free(s->args[i]);
+
+    for (int i = 0; i < 2; i++)
+        sqlite3_free(s->parts[i].ranges);
+
+    sqlite3_free(s->args);
+    sqlite3_free(s->keys);
+    geoip_memo_free(&s->memo);
+    sqlite3_free(s);
+}
@@ -0,0 +1,62 @@
+#ifndef GEOIP_SET_H
+#define GEOIP_SET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "geoip_memo.h"
+
+typedef struct sqlite3_value sqlite3_value;
+typedef struct geoip_addr geoip_addr;
+typedef struct geoip_db geoip_db;
+
+/**
+ * The fields the predicate functions compare, each one names the database and the field of its records.
+ */
+enum {
+    GEOIP_SET_COUNTRY,   /**< "country.iso_code" of the City database, two letter codes. */
+    GEOIP_SET_ASN,       /**< "autonomous_system_number" of the ASN database, integers. */
+    GEOIP_SET_CONTINENT  /**< "continent.code" of the City database, two letter codes. */
+};
+
+/**
+ * A run of consecutive addresses whose records all match, both ends included.
+ */
+typedef struct geoip_set_range {
+    uint8_t first[16]; /**< The first address, in the form geoip_addr holds it. */
+    uint8_t last[16];  /**< The last address. */
+} geoip_set_range;
+
+/**
+ * The matching ranges of one address family, built the first time an address of the family is tested.
+ */
+typedef struct geoip_set_part {
+    geoip_set_range *ranges; /**< The ranges in address order, none of them adjacent. */
+    size_t count;            /**< The number of ranges. */
+    size_t capacity;         /**< The number of ranges allocated. */
+    int status;              /**< The MMDB_* result of building the ranges, valid once built. */
+    bool built;              /**< Whether the ranges were built. */
+} geoip_set_part;
+
+/**
+ * The compiled arguments of a predicate function: the addresses whose record holds one of the wanted values.
+ */
+typedef struct geoip_set {
+    int kind;                   /**< A GEOIP_SET_* value. */
+    geoip_db *db;               /**< The database the records come from. */
+    uint32_t *keys;             /**< The wanted values in ascending order, codes as their two letters big-endian. */
+    int nkeys;                  /**< The number of wanted values. */
+    sqlite3_value **args;       /**< Copies of the arguments the set was compiled from. */
+    int nargs;                  /**< The number of arguments. */
+    geoip_set_part parts[2];    /**< The ranges of IPv4 addresses, then of IPv6 addresses. */
+    geoip_memo memo;            /**< Whether a record matches, 1 or 0 by record offset, allocated with the first ranges. */
+} geoip_set;
+
+uint32_t geoip_set_key(int kind, sqlite3_value *value);
+geoip_set *geoip_set_new(int kind, int argc, sqlite3_value **argv, char **errmsg);
+bool geoip_set_same(const geoip_set *set, int argc, sqlite3_value **argv);
+int geoip_set_contains(geoip_set *set, const geoip_addr *addr, bool *member);
+int geoip_set_lookup(geoip_set *set, const geoip_addr *addr, int function, bool *member);
+void geoip_set_free(void *set);
+
+#endif /* GEOIP_SET_H */
@@ -0,0 +1,444 @@
+#include <stdlib.h>
+#include <string.h>
+#include "geoip.h"
+#include "geoip_stats.h"
+#include <sqlite3ext.h>
+SQLITE_EXTENSION_INIT3
+
+#ifdef _WIN32
+#   include <windows.h>
+#else
+#   include <pthread.h>
+#   include <time.h>
+#endif
+
+/**
+ * The counters of every function as seen by one thread.
+ * 
+ * Blocks are pushed onto a global list the first time a thread records a call and are never unlinked, when the thread
+ * exits the block is released for adoption by the next new thread so its counts keep contributing to the totals. The
+ * list is freed when the extension is unloaded.
+ */
+typedef struct geoip_stats_block {
+    geoip_stats_counters functions[GEOIP_STAT_COUNT]; /**< The counters of every function. */
+    struct geoip_stats_block *next;                   /**< The next block in the global list. */
+    atomic_bool in_use;                               /**< Whether a live thread owns the block. */
+} geoip_stats_block;
+
+static const char *const stats_names[GEOIP_STAT_COUNT] = {
+    "geoip_asn_number",
+    "geoip_asn_owner",
+    "geoip_timezone",
+    "geoip_zipcode",
+    "geoip_continent",
+    "geoip_country",
+    "geoip_state",
+    "geoip_city",
+    "geoip",
+    "geoip_explain",
+    "geoip_json",
+    "geoip_get",
+    "geoip_record_id",
+    "geoip_pack",
+    "geoip_in_country",
+    "geoip_in_asn",
+    "geoip_in_continent",
+    "geoip_latitude",
+    "geoip_longitude",
+    "geoip_accuracy_radius"
+};
+
+static _Atomic(geoip_stats_block *) stats_blocks; /**< Every block ever handed out. */
+/** A shared block used when a thread block cannot be allocated, its counters are added to atomically. */
+static geoip_stats_block stats_fallback = { .functions = { [0 ... GEOIP_STAT_COUNT - 1] = { .shared = true } } };
+static _Thread_local geoip_stats_block *stats_local_block;
+
+#ifdef _WIN32
+static DWORD stats_key = FLS_OUT_OF_INDEXES;
+static INIT_ONCE stats_once = INIT_ONCE_STATIC_INIT;
+
+static void WINAPI stats_release(void *block) {
+    if (block != NULL)
+        atomic_store_explicit(&((geoip_stats_block *)block)->in_use, false, memory_order_release);
+}
+
+static BOOL CALLBACK stats_key_create(PINIT_ONCE once, void *param, void **context) {
+    (void)once; (void)param; (void)context;  /* Unused parameters */
+    stats_key = FlsAlloc(stats_release);
+    return TRUE;
+}
+#else
+static pthread_key_t stats_key;
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+static bool stats_key_valid;
+
+static void stats_release(void *block) {
+    atomic_store_explicit(&((geoip_stats_block *)block)->in_use, false, memory_order_release);
+}
+
+static void stats_key_create(void) {
+    stats_key_valid = pthread_key_create(&stats_key, stats_release) == 0;
+}
+#endif
+
+#ifndef SQLITE_CORE
+/**
+ * Forget the thread exit destructor and free every block when the extension is unloaded.
+ * 
+ * The destructor lives in the extension, a thread exiting after SQLite unloaded it would otherwise call into code that
+ * is no longer mapped. No connection uses the extension any more at this point, and the thread local pointers to the
+ * blocks go away along with the extension. Builds with SQLITE_CORE are never unloaded.
+ */
+__attribute__((destructor)) static void stats_unload(void) {
+#ifdef _WIN32
+    /* FlsFree() runs the destructor for the value of every thread first. */
+    if (stats_key != FLS_OUT_OF_INDEXES)
+        FlsFree(stats_key);
+#else
+    if (stats_key_valid)
+        pthread_key_delete(stats_key);
+#endif
+
+    geoip_stats_block *block = atomic_exchange_explicit(&stats_blocks, NULL, memory_order_acq_rel);
+    while (block != NULL) {
+        geoip_stats_block *next = block->next;
+
+        free(block);
+        block = next;
+    }
+}
+#endif
+
+/**
+ * Find or allocate the statistics block of the calling thread.
+ * 
+ * @return  The block of the calling thread, or the shared fallback block if none could be allocated.
+ */
+static geoip_stats_block *stats_attach(void) {
+    geoip_stats_block *block;
+
+    for (block = atomic_load_explicit(&stats_blocks, memory_order_acquire); block != NULL; block = block->next) {
+        bool expected = false;
+
+        if (atomic_compare_exchange_strong(&block->in_use, &expected, true))
+            break;
+    }
+
+    if (block == NULL) {
+        block = calloc(1, sizeof(*block));
+        if (block == NULL)
+            return &stats_fallback;
+
+        atomic_init(&block->in_use, true);
+        block->next = atomic_load_explicit(&stats_blocks, memory_order_relaxed);
+        while (!atomic_compare_exchange_weak_explicit(&stats_blocks, &block->next, block, memory_order_release, memory_order_relaxed));
+    }
+
+#ifdef _WIN32
+    InitOnceExecuteOnce(&stats_once, stats_key_create, NULL, NULL);
+    if (stats_key != FLS_OUT_OF_INDEXES)
+        FlsSetValue(stats_key, block);
+#else
+    pthread_once(&stats_once, stats_key_create);
+    if (stats_key_valid)
+        pthread_setspecific(stats_key, block);
+#endif
+
+    return block;
+}
+
+/**
+ * Read a monotonic clock.
+ * 
+ * @return  The current time in nanoseconds from an arbitrary starting point.
+ */
+uint64_t geoip_stats_now(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/**
+ * Retrieve the counters of a function for the calling thread.
+ * 
+ * @param function  A GEOIP_STAT_* value.
+ * @return          The counters, never NULL.
+ */
+geoip_stats_counters *geoip_stats_local(int function) {
+    if (stats_local_block == NULL)
+        stats_local_block = stats_attach();
+
+    return &stats_local_block->functions[function];
+}
+
+/**
+ * Record the end of a function call.
+ * 
+ * @param stats     The counters returned by geoip_stats_local().
+ * @param start     The time returned by geoip_stats_now() when the call started.
+ * @param outcome   A GEOIP_OUTCOME_* value.
+ */
+void geoip_stats_end(geoip_stats_counters *stats, uint64_t start, int outcome) {
+    uint64_t elapsed = geoip_stats_now() - start;
+    int bucket = elapsed == 0 ? 0 : 64 - __builtin_clzll(elapsed);
+
+    geoip_stats_add(stats, &stats->calls, 1);
+    geoip_stats_add(stats, &stats->latency[bucket], 1);
+
+    if (outcome == GEOIP_OUTCOME_NOT_FOUND)
+        geoip_stats_add(stats, &stats->not_found, 1);
+    else if (outcome == GEOIP_OUTCOME_ERROR)
+        geoip_stats_add(stats, &stats->errors, 1);
+    else if (outcome == GEOIP_OUTCOME_INVALID)
+        geoip_stats_add(stats, &stats->invalid, 1);
+}
+
+/**
+ * Find a function keeping statistics by its SQL name.
+ * 
+ * @param name  The name of the function, like "geoip_country".
+ * @return      The GEOIP_STAT_* value of the function, or -1 when no such function keeps statistics.
+ */
+int geoip_stats_find(const char *name) {
+    for (int i = 0; i < GEOIP_STAT_COUNT; i++) {
+        if (sqlite3_stricmp(name, stats_names[i]) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+#define STATS_LATENCY 7                                  /**< The index of the first latency bucket in a total. */
+#define STATS_VALUES (STATS_LATENCY + GEOIP_STATS_BUCKETS) /**< The number of values summed up per function. */
+
+/**
+ * Add the counters of one thread to a running total.
+ * 
+ * @param total     The total to add to.
+ * @param counters  The counters of one thread.
+ */
+static void stats_merge(uint64_t *total, const geoip_stats_counters *counters) {
+    total[0] += atomic_load_explicit(&counters->calls, memory_order_relaxed);
+    total[1] += atomic_load_explicit(&counters->not_found, memory_order_relaxed);
+    total[2] += atomic_load_explicit(&counters->errors, memory_order_relaxed);
+    total[3] += atomic_load_explicit(&counters->cache_hits, memory_order_relaxed);
+    total[4] += atomic_load_explicit(&counters->cache_misses, memory_order_relaxed);
+    total[5] += atomic_load_explicit(&counters->reserved, memory_order_relaxed);
+    total[6] += atomic_load_explicit(&counters->invalid, memory_order_relaxed);
+
+    for (int i = 0; i < GEOIP_STATS_BUCKETS; i++)
+        total[STATS_LATENCY + i] += atomic_load_explicit(&counters->latency[i], memory_order_relaxed);
+}
+
+/**
+ * Estimate a latency percentile from a log2 histogram.
+ * 
+ * @param histogram The latency buckets.
+ * @param calls     The total number of calls in the histogram.
+ * @param quantile  The quantile to estimate, between 0 and 1.
+ * @return          The upper bound in nanoseconds of the bucket holding the quantile, or 0 without calls.
+ */
+static uint64_t stats_percentile(const uint64_t *histogram, uint64_t calls, double quantile) {
+    uint64_t rank = (uint64_t)((double)calls * quantile);
+    uint64_t seen = 0;
+
+    if (calls == 0)
+        return 0;
+
+    for (int i = 0; i < GEOIP_STATS_BUCKETS; i++) {
+        seen += histogram[i];
+        if (seen > rank)
+            return i == 0 ? 0 : (i >= 64 ? UINT64_MAX : (1ULL << i));
+    }
+
+    return UINT64_MAX;
+}
+
+/* Columns of the geoip_stats virtual table */
+enum {
+    STATS_COLUMN_FUNCTION,
+    STATS_COLUMN_CALLS,
+    STATS_COLUMN_NOT_FOUND,
+    STATS_COLUMN_ERRORS,
+    STATS_COLUMN_CACHE_HITS,
+    STATS_COLUMN_CACHE_MISSES,
+    STATS_COLUMN_RESERVED,
+    STATS_COLUMN_INVALID,
+    STATS_COLUMN_P50_NS,
+    STATS_COLUMN_P99_NS,
+    STATS_COLUMN_P999_NS,
+    STATS_COLUMN_HISTOGRAM
+};
+
+
+/**
+ * A cursor over a snapshot of the statistics.
+ */
+typedef struct stats_cursor {
+    sqlite3_vtab_cursor base;                            /**< The base class, must come first. */
+    int row;                                             /**< The current function. */
+    uint64_t totals[GEOIP_STAT_COUNT][STATS_VALUES];     /**< The summed up counters of every function. */
+} stats_cursor;
+
+static int stats_connect(sqlite3 *db, void *pAux, int argc, const char *const *argv, sqlite3_vtab **ppVtab, char **pzErr) {
+    (void)pAux; (void)argc; (void)argv; (void)pzErr;  /* Unused parameters */
+
+    int rc = sqlite3_declare_vtab(db,
+        "CREATE TABLE x(function TEXT, calls INTEGER, not_found INTEGER, errors INTEGER, cache_hits INTEGER, "
+        "cache_misses INTEGER, reserved INTEGER, invalid INTEGER, p50_ns INTEGER, p99_ns INTEGER, p999_ns INTEGER, "
+        "histogram TEXT)");
+    if (rc != SQLITE_OK)
+        return rc;
+
+    *ppVtab = sqlite3_malloc(sizeof(sqlite3_vtab));
+    if (*ppVtab == NULL)
+        return SQLITE_NOMEM;
+
+    memset(*ppVtab, 0, sizeof(sqlite3_vtab));
+    return SQLITE_OK;
+}
+
+static int stats_disconnect(sqlite3_vtab *pVtab) {
+    sqlite3_free(pVtab);
+    return SQLITE_OK;
+}
+
+static int stats_best_index(sqlite3_vtab *pVtab, sqlite3_index_info *pInfo) {
+    (void)pVtab;  /* Unused parameter */
+
+    pInfo->estimatedCost = GEOIP_STAT_COUNT;
+    pInfo->estimatedRows = GEOIP_STAT_COUNT;
+    return SQLITE_OK;
+}
+
+static int stats_open(sqlite3_vtab *pVtab, sqlite3_vtab_cursor **ppCursor) {
+    (void)pVtab;  /* Unused parameter */
+
+    stats_cursor *cursor = sqlite3_malloc(sizeof(stats_cursor));
+    if (cursor == NULL)
+        return SQLITE_NOMEM;
+
+    memset(cursor, 0, sizeof(*cursor));
+    *ppCursor = &cursor->base;
+    return SQLITE_OK;
+}
+
+static int stats_close(sqlite3_vtab_cursor *pCursor) {
+    sqlite3_free(pCursor);
+    return SQLITE_OK;
+}
+
+static int stats_filter(sqlite3_vtab_cursor *pCursor, int idxNum, const char *idxStr, int argc, sqlite3_value **argv) {
+    (void)idxNum; (void)idxStr; (void)argc; (void)argv;  /* Unused parameters */
+    stats_cursor *cursor = (stats_cursor *)pCursor;
+
+    memset(cursor->totals, 0, sizeof(cursor->totals));
+
+    for (int i = 0; i < GEOIP_STAT_COUNT; i++)
+        stats_merge(cursor->totals[i], &stats_fallback.functions[i]);
+
+    for (geoip_stats_block *block = atomic_load_explicit(&stats_blocks, memory_order_acquire); block != NULL; block = block->next) {
+        for (int i = 0; i < GEOIP_STAT_COUNT; i++)
+            stats_merge(cursor->totals[i], &block->functions[i]);
+    }
+
+    cursor->row = 0;
+    return SQLITE_OK;
+}
+
+static int stats_next(sqlite3_vtab_cursor *pCursor) {
+    ((stats_cursor *)pCursor)->row++;
+    return SQLITE_OK;
+}
+
+static int stats_eof(sqlite3_vtab_cursor *pCursor) {
+    return ((stats_cursor *)pCursor)->row >= GEOIP_STAT_COUNT;
+}
+
+static int stats_column(sqlite3_vtab_cursor *pCursor, sqlite3_context *context, int column) {
+    stats_cursor *cursor = (stats_cursor *)pCursor;
+    const uint64_t *totals = cursor->totals[cursor->row];
+
+    switch (column) {
+    case STATS_COLUMN_FUNCTION:
+        sqlite3_result_text(context, stats_names[cursor->row], -1, SQLITE_STATIC);
+        break;
+    case STATS_COLUMN_P50_NS:
+        sqlite3_result_int64(context, (sqlite3_int64)stats_percentile(totals + STATS_LATENCY, totals[0], 0.5));
+        break;
+    case STATS_COLUMN_P99_NS:
+        sqlite3_result_int64(context, (sqlite3_int64)stats_percentile(totals + STATS_LATENCY, totals[0], 0.99));
+        break;
+    case STATS_COLUMN_P999_NS:
+        sqlite3_result_int64(context, (sqlite3_int64)stats_percentile(totals + STATS_LATENCY, totals[0], 0.999));
+        break;
+    case STATS_COLUMN_HISTOGRAM: {
+        /* A JSON object mapping the upper bound of every non-empty bucket to its count. */
+        sqlite3_str *str = sqlite3_str_new(NULL);
+        bool first = true;
+
+        sqlite3_str_appendchar(str, 1, '{');
+        for (int i = 0; i < GEOIP_STATS_BUCKETS; i++) {
+            if (totals[STATS_LATENCY + i] == 0)
+                continue;
+
+            sqlite3_str_appendf(str, "%s\"%llu\":%llu", first ? "" : ",",
+                i == 0 ? 0ULL : (i >= 64 ? (unsigned long long)UINT64_MAX : 1ULL << i), (unsigned long long)totals[STATS_LATENCY + i]);
+            first = false;
+        }
+        sqlite3_str_appendchar(str, 1, '}');
+
+        int length = sqlite3_str_length(str);
+        sqlite3_result_text(context, sqlite3_str_finish(str), length, sqlite3_free);
+        break;
+    }
+    default:
+        sqlite3_result_int64(context, (sqlite3_int64)totals[column - STATS_COLUMN_CALLS]);
+        break;
+    }
+
+    return SQLITE_OK;
+}
+
+static int stats_rowid(sqlite3_vtab_cursor *pCursor, sqlite_int64 *pRowid) {
+    *pRowid = ((stats_cursor *)pCursor)->row;
+    return SQLITE_OK;
+}
+
+static sqlite3_module stats_module = {
+    .iVersion = 0,
+    .xCreate = NULL,             /* Eponymous-only, "CREATE VIRTUAL TABLE" is not supported */
+    .xConnect = stats_connect,
+    .xBestIndex = stats_best_index,
+    .xDisconnect = stats_disconnect,
+    .xDestroy = stats_disconnect,
+    .xOpen = stats_open,
+    .xClose = stats_close,
+    .xFilter = stats_filter,
+    .xNext = stats_next,
+    .xEof = stats_eof,
+    .xColumn = stats_column,
+    .xRowid = stats_rowid
+};
+
+/**
+ * Register the geoip_stats virtual table.
+ * 
+ * @param db    The current SQLite3 database context.
+ * @return      An SQLite3 result code.
+ */
+int geoip_stats_register(sqlite3 *db) {
+    return sqlite3_create_module(db, "geoip_stats", &stats_module, NULL);
+}
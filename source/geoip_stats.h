@@ -0,0 +1,88 @@
+#ifndef GEOIP_STATS_H
+#define GEOIP_STATS_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct sqlite3 sqlite3;
+
+#define GEOIP_STATS_BUCKETS 65 /**< The number of latency buckets, bucket n counts calls that took less than 2^n nanoseconds. */
+
+/**
+ * The extension functions that keep statistics, each one is a row of the geoip_stats virtual table.
+ */
+enum {
+    GEOIP_STAT_ASN_NUMBER,       /**< Statistics of the "geoip_asn_number" function */
+    GEOIP_STAT_ASN_OWNER,        /**< Statistics of the "geoip_asn_owner" function */
+    GEOIP_STAT_TIMEZONE,         /**< Statistics of the "geoip_timezone" function */
+    GEOIP_STAT_ZIPCODE,          /**< Statistics of the "geoip_zipcode" function */
+    GEOIP_STAT_CONTINENT,        /**< Statistics of the "geoip_continent" function */
+    GEOIP_STAT_COUNTRY,          /**< Statistics of the "geoip_country" function */
+    GEOIP_STAT_STATE,            /**< Statistics of the "geoip_state" function */
+    GEOIP_STAT_CITY,             /**< Statistics of the "geoip_city" function */
+    GEOIP_STAT_GEOIP,            /**< Statistics of the "geoip" function */
+    GEOIP_STAT_EXPLAIN,          /**< Statistics of the "geoip_explain" function */
+    GEOIP_STAT_JSON,             /**< Statistics of the "geoip_json" function */
+    GEOIP_STAT_GET,              /**< Statistics of the "geoip_get" function */
+    GEOIP_STAT_RECORD_ID,        /**< Statistics of the "geoip_record_id" function */
+    GEOIP_STAT_PACK,             /**< Statistics of the "geoip_pack" function */
+    GEOIP_STAT_IN_COUNTRY,       /**< Statistics of the "geoip_in_country" function */
+    GEOIP_STAT_IN_ASN,           /**< Statistics of the "geoip_in_asn" function */
+    GEOIP_STAT_IN_CONTINENT,     /**< Statistics of the "geoip_in_continent" function */
+    GEOIP_STAT_LATITUDE,         /**< Statistics of the "geoip_latitude" function */
+    GEOIP_STAT_LONGITUDE,        /**< Statistics of the "geoip_longitude" function */
+    GEOIP_STAT_ACCURACY_RADIUS,  /**< Statistics of the "geoip_accuracy_radius" function */
+    GEOIP_STAT_COUNT             /**< The number of functions keeping statistics */
+};
+
+/**
+ * The outcome of a single extension function call.
+ */
+enum {
+    GEOIP_OUTCOME_FOUND,         /**< A value was returned */
+    GEOIP_OUTCOME_NOT_FOUND,     /**< The address or the requested field is not in the database */
+    GEOIP_OUTCOME_ERROR,         /**< An error was raised */
+    GEOIP_OUTCOME_INVALID        /**< The input was not an address and the error policy answered without an error */
+};
+
+/**
+ * The counters of one function as seen by one thread.
+ * 
+ * Only the owning thread ever writes its counters, readers merely sum them up, so updates are plain loads and stores.
+ * The shared fallback block handed out when a thread block cannot be allocated is the exception, it is marked shared
+ * and added to atomically.
+ */
+typedef struct geoip_stats_counters {
+    _Atomic uint64_t calls;                         /**< The number of calls. */
+    _Atomic uint64_t not_found;                     /**< The number of calls returning GEOIP_OUTCOME_NOT_FOUND. */
+    _Atomic uint64_t errors;                        /**< The number of calls returning GEOIP_OUTCOME_ERROR. */
+    _Atomic uint64_t cache_hits;                    /**< The number of lookups answered by the lookup cache. */
+    _Atomic uint64_t cache_misses;                  /**< The number of lookups that had to walk the search tree. */
+    _Atomic uint64_t reserved;                      /**< The number of lookups of non-public addresses answered without a walk. */
+    _Atomic uint64_t invalid;                       /**< The number of calls returning GEOIP_OUTCOME_INVALID. */
+    _Atomic uint64_t latency[GEOIP_STATS_BUCKETS];  /**< A log2 histogram of call latencies in nanoseconds. */
+    bool shared;                                    /**< Whether several threads write the counters, set once before any of them. */
+} geoip_stats_counters;
+
+/**
+ * Increment a counter of the calling thread.
+ * 
+ * @param stats     The counters returned by geoip_stats_local().
+ * @param counter   The counter to increment, one of stats.
+ * @param n         The amount to add.
+ */
+static inline void geoip_stats_add(const geoip_stats_counters *stats, _Atomic uint64_t *counter, uint64_t n) {
+    if (stats->shared)
+        atomic_fetch_add_explicit(counter, n, memory_order_relaxed);
+    else
+        atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+uint64_t geoip_stats_now(void);
+geoip_stats_counters *geoip_stats_local(int function);
+int geoip_stats_find(const char *name);
+void geoip_stats_end(geoip_stats_counters *stats, uint64_t start, int outcome);
+int geoip_stats_register(sqlite3 *db);
+
+#endif /* GEOIP_STATS_H */
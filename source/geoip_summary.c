@@ -0,0 +1,490 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "geoip.h"
+#include <sqlite3ext.h>
+SQLITE_EXTENSION_INIT3
+
+#define SUMMARY_SLOTS 1024 /**< The initial number of record memo slots, a power of two. */
+
+/**
+ * The addresses one record covers within the summarized prefix.
+ */
+typedef struct summary_record {
+    uint32_t offset;    /**< The offset of the record in the data section. */
+    uint32_t text;      /**< The offset of its value in the pool, or UINT32_MAX when it has none. */
+    uint64_t networks;  /**< The number of networks leading to the record. */
+    uint64_t high;      /**< The upper half of the number of addresses. */
+    uint64_t low;       /**< The lower half of the number of addresses. */
+} summary_record;
+
+/**
+ * The state of a walk, which sums up the networks of every record.
+ */
+typedef struct summary_walker {
+    summary_record *records; /**< The records in the order the walk met them. */
+    size_t count;            /**< The number of records. */
+    size_t capacity;         /**< The number of records allocated. */
+    geoip_memo memo;         /**< The position of every record, by offset. */
+} summary_walker;
+
+/**
+ * A row of the summary: a value of the field and everything under the prefix having it.
+ */
+typedef struct summary_row {
+    const char *value;  /**< The value, NULL for records that do not have the field. */
+    uint64_t networks;  /**< The number of networks. */
+    uint64_t records;   /**< The number of distinct records. */
+    uint64_t high;      /**< The upper half of the number of addresses. */
+    uint64_t low;       /**< The lower half of the number of addresses. */
+} summary_row;
+
+/**
+ * The columns of the geoip_cidr_summary virtual table, in declaration order.
+ */
+enum {
+    SUMMARY_COLUMN_VALUE,
+    SUMMARY_COLUMN_ADDRESSES,
+    SUMMARY_COLUMN_SHARE,
+    SUMMARY_COLUMN_NETWORKS,
+    SUMMARY_COLUMN_RECORDS,
+    SUMMARY_COLUMN_CIDR,
+    SUMMARY_COLUMN_FIELD,
+    SUMMARY_COLUMN_DB
+};
+
+#define SUMMARY_CIDR  1 /**< An idxNum bit, the hidden cidr column is constrained. */
+#define SUMMARY_FIELD 2 /**< An idxNum bit, the hidden field column picks the field. */
+#define SUMMARY_DB    4 /**< An idxNum bit, the hidden db column names the database. */
+
+/**
+ * A cursor over the summary of one prefix.
+ */
+typedef struct summary_cursor {
+    sqlite3_vtab_cursor base; /**< The base class, must come first. */
+    geoip_db *db;             /**< The database summarized. */
+    int field;                /**< The GEOIP_INDEX_* value of the field. */
+    double size;              /**< The number of addresses in the prefix. */
+    char *cidr;               /**< The prefix as given. */
+    char *pool;               /**< The values as NUL terminated text, one after another. */
+    summary_row *rows;        /**< The rows, by descending number of addresses. */
+    size_t count;             /**< The number of rows. */
+    size_t row;               /**< The current row. */
+} summary_cursor;
+
+/**
+ * Add to a 128-bit count, saturating instead of wrapping around.
+ * 
+ * @param high      The upper half of the count.
+ * @param low       The lower half of the count.
+ * @param add_high  The upper half of the amount.
+ * @param add_low   The lower half of the amount.
+ */
+static void summary_count(uint64_t *high, uint64_t *low, uint64_t add_high, uint64_t add_low) {
+    uint64_t sum = *low + add_low;
+    uint64_t carry = sum < add_low;
+
+    if (*high > UINT64_MAX - add_high || *high + add_high > UINT64_MAX - carry) {
+        *high = *low = UINT64_MAX;
+        return;
+    }
+
+    *high += add_high + carry;
+    *low = sum;
+}
+
+/**
+ * Count a network of the subtree towards its record.
+ * 
+ * @param arg       The summary_walker.
+ * @param prefix    The network address.
+ * @param length    The prefix length out of 128 bits.
+ * @param offset    The offset of the record of the network.
+ * @return          MMDB_SUCCESS or MMDB_OUT_OF_MEMORY_ERROR.
+ */
+static int summary_add(void *arg, const uint8_t *prefix, int length, uint32_t offset) {
+    (void)prefix;  /* Unused parameter */
+    summary_walker *w = arg;
+    uint32_t position;
+
+    if (!geoip_memo_get(&w->memo, offset, &position)) {
+        int status = geoip_reserve((void **)&w->records, &w->capacity, w->count, sizeof(summary_record));
+        if (status != MMDB_SUCCESS)
+            return status;
+
+        position = (uint32_t)w->count;
+        w->records[w->count++] = (summary_record){ .offset = offset, .text = UINT32_MAX };
+        status = geoip_memo_put(&w->memo, offset, position);
+        if (status != MMDB_SUCCESS)
+            return status;
+    }
+
+    summary_record *record = &w->records[position];
+    int span = 128 - length;
+
+    record->networks++;
+    if (span >= 128)
+        summary_count(&record->high, &record->low, UINT64_MAX, UINT64_MAX);
+    else if (span >= 64)
+        summary_count(&record->high, &record->low, 1ULL << (span - 64), 0);
+    else
+        summary_count(&record->high, &record->low, 0, 1ULL << span);
+
+    return MMDB_SUCCESS;
+}
+
+/**
+ * Convert a 128-bit count to floating point.
+ * 
+ * @param high      The upper half of the count.
+ * @param low       The lower half of the count.
+ * @return          The count, rounded.
+ */
+static double summary_double(uint64_t high, uint64_t low) {
+    return (double)high * 18446744073709551616.0 + (double)low;
+}
+
+static int summary_compare_values(const void *a, const void *b) {
+    const char *x = ((const summary_row *)a)->value, *y = ((const summary_row *)b)->value;
+
+    if (x == NULL || y == NULL)
+        return (x != NULL) - (y != NULL);
+
+    return strcmp(x, y);
+}
+
+static int summary_compare_rows(const void *a, const void *b) {
+    const summary_row *x = a, *y = b;
+
+    if (x->high != y->high)
+        return x->high < y->high ? 1 : -1;
+
+    if (x->low != y->low)
+        return x->low < y->low ? 1 : -1;
+
+    return summary_compare_values(a, b);
+}
+
+/**
+ * Decode the field of every record the walk met, once each, and merge the records sharing a value into rows.
+ * 
+ * @param cursor    The cursor receiving the rows.
+ * @param w         The finished walk.
+ * @return          MMDB_SUCCESS, or MMDB_OUT_OF_MEMORY_ERROR.
+ */
+static int summary_rows(summary_cursor *cursor, summary_walker *w) {
+    size_t size = 0, capacity = 256;
+
+    cursor->pool = sqlite3_malloc64(capacity);
+    cursor->rows = sqlite3_malloc64((w->count + 1) * sizeof(summary_row));
+    if (cursor->pool == NULL || cursor->rows == NULL)
+        return MMDB_OUT_OF_MEMORY_ERROR;
+
+    for (size_t i = 0; i < w->count; i++) {
+        char number[GEOIP_INDEX_NUMBER];
+        const char *text;
+        size_t length = geoip_index_value(&cursor->db->mmdb, w->records[i].offset, cursor->field, number, &text);
+
+        if (length == 0)
+            continue;
+
+        if (size + length + 1 > UINT32_MAX)
+            return MMDB_OUT_OF_MEMORY_ERROR;
+
+        while (size + length + 1 > capacity) {
+            char *pool = sqlite3_realloc64(cursor->pool, capacity * 2);
+
+            if (pool == NULL)
+                return MMDB_OUT_OF_MEMORY_ERROR;
+
+            cursor->pool = pool;
+            capacity *= 2;
+        }
+
+        memcpy(cursor->pool + size, text, length);
+        cursor->pool[size + length] = '\0';
+        w->records[i].text = (uint32_t)size;
+        size += length + 1;
+    }
+
+    /* The pool does not move any more, so rows can point into it. */
+    for (size_t i = 0; i < w->count; i++) {
+        const summary_record *record = &w->records[i];
+
+        cursor->rows[i] = (summary_row){
+            .value = record->text != UINT32_MAX ? cursor->pool + record->text : NULL,
+            .networks = record->networks,
+            .records = 1,
+            .high = record->high,
+            .low = record->low
+        };
+    }
+
+    qsort(cursor->rows, w->count, sizeof(summary_row), summary_compare_values);
+
+    for (size_t i = 0; i < w->count; i++) {
+        summary_row *last = cursor->count > 0 ? &cursor->rows[cursor->count - 1] : NULL;
+
+        if (last == NULL || summary_compare_values(last, &cursor->rows[i]) != 0) {
+            cursor->rows[cursor->count++] = cursor->rows[i];
+            continue;
+        }
+
+        last->networks += cursor->rows[i].networks;
+        last->records++;
+        summary_count(&last->high, &last->low, cursor->rows[i].high, cursor->rows[i].low);
+    }
+
+    qsort(cursor->rows, cursor->count, sizeof(summary_row), summary_compare_rows);
+    return MMDB_SUCCESS;
+}
+
+static int summary_connect(sqlite3 *db, void *pAux, int argc, const char *const *argv, sqlite3_vtab **ppVtab, char **pzErr) {
+    (void)pAux; (void)argc; (void)argv; (void)pzErr;  /* Unused parameters */
+
+    int rc = sqlite3_declare_vtab(db,
+        "CREATE TABLE x(value TEXT, addresses INTEGER, share REAL, networks INTEGER, records INTEGER, "
+        "cidr HIDDEN, field HIDDEN, db HIDDEN)");
+    if (rc != SQLITE_OK)
+        return rc;
+
+    sqlite3_vtab *vtab = sqlite3_malloc(sizeof(sqlite3_vtab));
+    if (vtab == NULL)
+        return SQLITE_NOMEM;
+
+    memset(vtab, 0, sizeof(*vtab));
+    *ppVtab = vtab;
+    return SQLITE_OK;
+}
+
+static int summary_disconnect(sqlite3_vtab *pVtab) {
+    sqlite3_free(pVtab);
+    return SQLITE_OK;
+}
+
+/**
+ * Plan a summary: equalities on cidr, and optionally field and db, are handed to the filter. Without a prefix there is
+ * nothing to summarize, which the filter reports.
+ */
+static int summary_best_index(sqlite3_vtab *pVtab, sqlite3_index_info *pInfo) {
+    (void)pVtab;  /* Unused parameter */
+    int args[3] = { -1, -1, -1 };
+
+    for (int i = 0; i < pInfo->nConstraint; i++) {
+        const struct sqlite3_index_constraint *constraint = &pInfo->aConstraint[i];
+
+        if (constraint->op != SQLITE_INDEX_CONSTRAINT_EQ || constraint->iColumn < SUMMARY_COLUMN_CIDR)
+            continue;
+
+        if (!constraint->usable)
+            return SQLITE_CONSTRAINT;
+
+        args[constraint->iColumn - SUMMARY_COLUMN_CIDR] = i;
+    }
+
+    int argvIndex = 0;
+    pInfo->idxNum = 0;
+
+    for (int i = 0; i < 3; i++) {
+        if (args[i] >= 0) {
+            pInfo->aConstraintUsage[args[i]].argvIndex = ++argvIndex;
+            pInfo->aConstraintUsage[args[i]].omit = 1;
+            pInfo->idxNum |= 1 << i;
+        }
+    }
+
+    pInfo->estimatedCost = pInfo->idxNum & SUMMARY_CIDR ? 10000 : 1e12;
+    pInfo->estimatedRows = 100;
+    return SQLITE_OK;
+}
+
+static int summary_open(sqlite3_vtab *pVtab, sqlite3_vtab_cursor **ppCursor) {
+    (void)pVtab;  /* Unused parameter */
+
+    summary_cursor *cursor = sqlite3_malloc(sizeof(summary_cursor));
+    if (cursor == NULL)
+        return SQLITE_NOMEM;
+
+    memset(cursor, 0, sizeof(*cursor));
+    *ppCursor = &cursor->base;
+    return SQLITE_OK;
+}
+
+static void summary_reset(summary_cursor *cursor) {
+    sqlite3_free(cursor->cidr);
+    sqlite3_free(cursor->pool);
+    sqlite3_free(cursor->rows);
+    cursor->cidr = cursor->pool = NULL;
+    cursor->rows = NULL;
+    cursor->count = cursor->row = 0;
+}
+
+static int summary_close(sqlite3_vtab_cursor *pCursor) {
+    summary_reset((summary_cursor *)pCursor);
+    sqlite3_free(pCursor);
+    return SQLITE_OK;
+}
+
+/**
+ * Report an error through the virtual table.
+ * 
+ * @param cursor    The cursor the error happened on.
+ * @param msg       The error message, taken over.
+ * @return          SQLITE_ERROR.
+ */
+static int summary_error(summary_cursor *cursor, char *msg) {
+    sqlite3_vtab *vtab = cursor->base.pVtab;
+
+    sqlite3_free(vtab->zErrMsg);
+    vtab->zErrMsg = msg;
+    return SQLITE_ERROR;
+}
+
+static int summary_filter(sqlite3_vtab_cursor *pCursor, int idxNum, const char *idxStr, int argc, sqlite3_value **argv) {
+    (void)idxStr; (void)argc;  /* Unused parameters */
+    summary_cursor *cursor = (summary_cursor *)pCursor;
+    int arg = 1;
+
+    summary_reset(cursor);
+
+    if (!initialized)
+        return summary_error(cursor, sqlite3_mprintf(MSG_NOTINITIALIZED));
+
+    if (!(idxNum & SUMMARY_CIDR))
+        return summary_error(cursor, sqlite3_mprintf("geoip_cidr_summary takes a network, as in geoip_cidr_summary('203.0.113.0/24', 'asn')"));
+
+    cursor->field = idxNum & SUMMARY_FIELD ? geoip_index_field((const char *)sqlite3_value_text(argv[arg++])) : GEOIP_INDEX_COUNTRY;
+    if (cursor->field < 0)
+        return summary_error(cursor, sqlite3_mprintf("Unknown field, expected 'country', 'continent', 'asn' or 'city'"));
+
+    cursor->db = idxNum & SUMMARY_DB ? geoip_db_find((const char *)sqlite3_value_text(argv[arg])) :
+        cursor->field == GEOIP_INDEX_ASN ? &db_asn : &db_cnt;
+    if (cursor->db == NULL)
+        return summary_error(cursor, sqlite3_mprintf(MSG_UNKNOWNDB));
+
+    const char *cidr = (const char *)sqlite3_value_text(argv[0]);
+    geoip_addr addr;
+    int length;
+
+    if (cidr == NULL)
+        return SQLITE_OK;
+
+    if (geoip_parse_cidr(cidr, &addr, &length) != 0)
+        return summary_error(cursor, sqlite3_mprintf("Not a network: %s", cidr));
+
+    cursor->cidr = sqlite3_mprintf("%s", cidr);
+    if (cursor->cidr == NULL)
+        return SQLITE_NOMEM;
+
+    cursor->size = 1;
+    for (int i = length; i < 128; i++)
+        cursor->size *= 2;
+
+    summary_walker w = { 0 };
+    int status = geoip_db_acquire(cursor->db);
+
+    if (status == MMDB_SUCCESS)
+        status = geoip_memo_init(&w.memo, SUMMARY_SLOTS);
+
+    if (status == MMDB_SUCCESS)
+        status = geoip_tree_subtree(&cursor->db->mmdb, addr.bytes, length, summary_add, &w);
+
+    if (status == MMDB_SUCCESS)
+        status = summary_rows(cursor, &w);
+
+    sqlite3_free(w.records);
+    geoip_memo_free(&w.memo);
+
+    if (status == MMDB_OUT_OF_MEMORY_ERROR) {
+        summary_reset(cursor);
+        return SQLITE_NOMEM;
+    }
+
+    if (status != MMDB_SUCCESS) {
+        summary_reset(cursor);
+        return summary_error(cursor, sqlite3_mprintf(MSG_ERRLIBMAXMIND, MMDB_strerror(status)));
+    }
+
+    return SQLITE_OK;
+}
+
+static int summary_next(sqlite3_vtab_cursor *pCursor) {
+    ((summary_cursor *)pCursor)->row++;
+    return SQLITE_OK;
+}
+
+static int summary_eof(sqlite3_vtab_cursor *pCursor) {
+    summary_cursor *cursor = (summary_cursor *)pCursor;
+
+    return cursor->row >= cursor->count;
+}
+
+static int summary_column(sqlite3_vtab_cursor *pCursor, sqlite3_context *context, int column) {
+    summary_cursor *cursor = (summary_cursor *)pCursor;
+    const summary_row *row = &cursor->rows[cursor->row];
+
+    switch (column) {
+    case SUMMARY_COLUMN_VALUE:
+        if (row->value != NULL)
+            sqlite3_result_text(context, row->value, -1, SQLITE_TRANSIENT);
+        break;
+    case SUMMARY_COLUMN_ADDRESSES:
+        /* IPv6 counts outgrow 64 bits quickly, those are returned as REAL. */
+        if (row->high == 0 && row->low <= INT64_MAX)
+            sqlite3_result_int64(context, (sqlite3_int64)row->low);
+        else
+            sqlite3_result_double(context, summary_double(row->high, row->low));
+        break;
+    case SUMMARY_COLUMN_SHARE:
+        sqlite3_result_double(context, summary_double(row->high, row->low) / cursor->size);
+        break;
+    case SUMMARY_COLUMN_NETWORKS:
+        sqlite3_result_int64(context, (sqlite3_int64)row->networks);
+        break;
+    case SUMMARY_COLUMN_RECORDS:
+        sqlite3_result_int64(context, (sqlite3_int64)row->records);
+        break;
+    case SUMMARY_COLUMN_CIDR:
+        sqlite3_result_text(context, cursor->cidr, -1, SQLITE_TRANSIENT);
+        break;
+    case SUMMARY_COLUMN_FIELD:
+        sqlite3_result_text(context, geoip_index_name(cursor->field), -1, SQLITE_STATIC);
+        break;
+    case SUMMARY_COLUMN_DB:
+        sqlite3_result_text(context, cursor->db->alias, -1, SQLITE_TRANSIENT);
+        break;
+    }
+
+    return SQLITE_OK;
+}
+
+static int summary_rowid(sqlite3_vtab_cursor *pCursor, sqlite_int64 *pRowid) {
+    *pRowid = (sqlite_int64)((summary_cursor *)pCursor)->row;
+    return SQLITE_OK;
+}
+
+static sqlite3_module summary_module = {
+    .iVersion = 0,
+    .xCreate = NULL,             /* Eponymous-only, "CREATE VIRTUAL TABLE" is not supported */
+    .xConnect = summary_connect,
+    .xBestIndex = summary_best_index,
+    .xDisconnect = summary_disconnect,
+    .xDestroy = summary_disconnect,
+    .xOpen = summary_open,
+    .xClose = summary_close,
+    .xFilter = summary_filter,
+    .xNext = summary_next,
+    .xEof = summary_eof,
+    .xColumn = summary_column,
+    .xRowid = summary_rowid
+};
+
+/**
+ * Register the geoip_cidr_summary table-valued function.
+ * 
+ * @param db    The current SQLite3 database context.
+ * @return      An SQLite3 result code.
+ */
+int geoip_summary_register(sqlite3 *db) {
+    return sqlite3_create_module(db, "geoip_cidr_summary", &summary_module, 0);
+}
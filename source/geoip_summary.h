@@ -0,0 +1,8 @@
+#ifndef GEOIP_SUMMARY_H
+#define GEOIP_SUMMARY_H
+
+typedef struct sqlite3 sqlite3;
+
+int geoip_summary_register(sqlite3 *db);
+
+#endif /* GEOIP_SUMMARY_H */
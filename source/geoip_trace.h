@@ -0,0 +1,43 @@
+#ifndef GEOIP_TRACE_H
+#define GEOIP_TRACE_H
+
+/**
+ * USDT static tracepoints.
+ * 
+ * When the extension is configured with -DENABLE_USDT_PROBES=ON every probe compiles to a single nop plus an ELF note
+ * that bpftrace, perf or SystemTap can attach to in a running process, otherwise the probes compile to nothing.
+ * All probes live in the "sqlite_maxminddb" provider:
+ * 
+ * | Probe           | Arguments                                             |
+ * |-----------------|-------------------------------------------------------|
+ * | lookup__start   | function id, address family                           |
+ * | lookup__end     | function id, address family, tree depth, found        |
+ * | cache__hit      | function id, address family, tree depth               |
+ * | cache__miss     | function id, address family                           |
+ * | decode__start   | function id, data section offset                      |
+ * | decode__end     | function id, data section offset, libmaxminddb status |
+ * | db__reload      | database name, libmaxminddb status                    |
+ * 
+ * The function id is a GEOIP_STAT_* value, or -1 for internal lookups, and the tree depth is the number of search tree
+ * nodes visited for the address.
+ */
+#ifdef GEOIP_USDT_PROBES
+#   include <sys/sdt.h>
+#   define GEOIP_TRACE_LOOKUP_START(function, family)              DTRACE_PROBE2(sqlite_maxminddb, lookup__start, function, family)
+#   define GEOIP_TRACE_LOOKUP_END(function, family, depth, found)  DTRACE_PROBE4(sqlite_maxminddb, lookup__end, function, family, depth, found)
+#   define GEOIP_TRACE_CACHE_HIT(function, family, depth)          DTRACE_PROBE3(sqlite_maxminddb, cache__hit, function, family, depth)
+#   define GEOIP_TRACE_CACHE_MISS(function, family)                DTRACE_PROBE2(sqlite_maxminddb, cache__miss, function, family)
+#   define GEOIP_TRACE_DECODE_START(function, offset)              DTRACE_PROBE2(sqlite_maxminddb, decode__start, function, offset)
+#   define GEOIP_TRACE_DECODE_END(function, offset, status)        DTRACE_PROBE3(sqlite_maxminddb, decode__end, function, offset, status)
+#   define GEOIP_TRACE_DB_RELOAD(name, status)                     DTRACE_PROBE2(sqlite_maxminddb, db__reload, name, status)
+#else
+#   define GEOIP_TRACE_LOOKUP_START(function, family)              do {} while (0)
+#   define GEOIP_TRACE_LOOKUP_END(function, family, depth, found)  do {} while (0)
+#   define GEOIP_TRACE_CACHE_HIT(function, family, depth)          do {} while (0)
+#   define GEOIP_TRACE_CACHE_MISS(function, family)                do {} while (0)
+#   define GEOIP_TRACE_DECODE_START(function, offset)              do {} while (0)
+#   define GEOIP_TRACE_DECODE_END(function, offset, status)        do {} while (0)
+#   define GEOIP_TRACE_DB_RELOAD(name, status)                     do {} while (0)
+#endif
+
+#endif /* GEOIP_TRACE_H */
@@ -0,0 +1,678 @@
+#include <stdlib.h>
+#include <string.h>
+#include "geoip.h"
+
+#define TREE_UNASSIGNED UINT32_MAX       /**< A node that has no slot in the layout yet. */
+#define TREE_QUEUED     (UINT32_MAX - 1) /**< A node waiting to start a block of its own. */
+#define TREE_LINE       64               /**< The cache line size the layouts are compared in. */
+
+static inline uint32_t record24(const uint8_t *node, int right) {
+    const uint8_t *p = node + 3 * right;
+    return (uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2];
+}
+
+/* The middle byte holds the top four bits of both records, reading four bytes from either end covers it. */
+static inline uint32_t record28(const uint8_t *node, int right) {
+    const uint8_t *p = node + 3 * right;
+    uint32_t bytes = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+
+    return right ? bytes & 0x0FFFFFFF : (bytes >> 8) | (bytes & 0xF0) << 20;
+}
+
+static inline uint32_t record32(const uint8_t *node, int right) {
+    const uint8_t *p = node + 4 * right;
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+/**
+ * Read a record of the original search tree.
+ * 
+ * @param node          The start of the node.
+ * @param record_size   The record size of the database in bits, 24, 28 or 32.
+ * @param right         Whether to read the right record instead of the left one.
+ * @return              The record value.
+ */
+static inline uint32_t read_record(const uint8_t *node, int record_size, int right) {
+    switch (record_size) {
+    case 24:
+        return record24(node, right);
+    case 28:
+        return record28(node, right);
+    default:
+        return record32(node, right);
+    }
+}
+
+/**
+ * Assign every node of the original tree a slot, block by block.
+ * 
+ * A block is filled breadth first from its root until it holds GEOIP_TREE_BLOCK nodes or the subtree runs out, the
+ * children left over start blocks of their own. Blocks are placed in the order their roots were found, so the top of
+ * the tree stays together. MMDB trees are not strictly trees, IPv6 databases alias ::ffff:0:0/96 to the IPv4 subtree,
+ * so a node reached a second time keeps the slot it was given first.
+ * 
+ * @param mmdb      The opened database.
+ * @param slots     Receives the slot of every node, indexed by node number.
+ * @param queue     Scratch space for node_count block roots.
+ * @return          The number of blocks.
+ */
+static uint32_t tree_assign(const MMDB_s *mmdb, uint32_t *slots, uint32_t *queue) {
+    const uint32_t count = mmdb->metadata.node_count;
+    const int record_size = mmdb->metadata.record_size;
+    const size_t node_bytes = (size_t)record_size / 4;
+    uint32_t head = 0, tail = 0, scan = 0, blocks = 0;
+
+    for (uint32_t i = 0; i < count; i++)
+        slots[i] = TREE_UNASSIGNED;
+
+    queue[tail++] = 0;
+    slots[0] = TREE_QUEUED;
+
+    for (;;) {
+        uint32_t candidates[2 * GEOIP_TREE_BLOCK + 1];
+        uint32_t root, used = 0, next = 0, found = 0;
+
+        if (head < tail) {
+            root = queue[head++];
+        } else {
+            /* Nodes the root does not lead to are never visited by a lookup, but still get a slot. */
+            while (scan < count && slots[scan] != TREE_UNASSIGNED)
+                scan++;
+
+            if (scan == count)
+                break;
+
+            root = scan;
+        }
+
+        if (slots[root] < TREE_QUEUED)
+            continue;
+
+        candidates[found++] = root;
+        while (next < found && used < GEOIP_TREE_BLOCK) {
+            uint32_t node = candidates[next++];
+
+            if (slots[node] < TREE_QUEUED)
+                continue;
+
+            slots[node] = blocks * GEOIP_TREE_BLOCK + used++;
+            for (int right = 0; right < 2; right++) {
+                uint32_t record = read_record(mmdb->file_content + node * node_bytes, record_size, right);
+
+                if (record < count && slots[record] >= TREE_QUEUED)
+                    candidates[found++] = record;
+            }
+        }
+
+        for (; next < found; next++) {
+            if (slots[candidates[next]] == TREE_UNASSIGNED) {
+                slots[candidates[next]] = TREE_QUEUED;
+                queue[tail++] = candidates[next];
+            }
+        }
+
+        blocks++;
+    }
+
+    return blocks;
+}
+
+/**
+ * Check a relayout against the original tree.
+ * 
+ * Both trees are walked side by side from their roots, independently of how the slots were assigned. Every record has
+ * to lead to the same data section offset, and every node reached through several paths has to be reached at the same
+ * slot through all of them, which makes every lookup end on the same record in both trees.
+ * 
+ * @param tree      The relayout, filled in.
+ * @param mmdb      The opened database.
+ * @param pairs     Scratch space for node_count slots.
+ * @param stack     Scratch space for node_count node numbers.
+ * @return          0 when the trees match, -1 otherwise.
+ */
+static int tree_verify(const geoip_tree *tree, const MMDB_s *mmdb, uint32_t *pairs, uint32_t *stack) {
+    const uint32_t count = mmdb->metadata.node_count;
+    const int record_size = mmdb->metadata.record_size;
+    const size_t node_bytes = (size_t)record_size / 4;
+    uint32_t depth = 0;
+
+    for (uint32_t i = 0; i < count; i++)
+        pairs[i] = TREE_UNASSIGNED;
+
+    pairs[0] = 0;
+    stack[depth++] = 0;
+
+    while (depth > 0) {
+        uint32_t node = stack[--depth];
+
+        for (int right = 0; right < 2; right++) {
+            uint32_t record = read_record(mmdb->file_content + node * node_bytes, record_size, right);
+            uint32_t value = tree->nodes[2 * (size_t)pairs[node] + right];
+
+            if (record >= count) {
+                if (value != record - count + tree->node_count)
+                    return -1;
+
+                continue;
+            }
+
+            if (value >= tree->node_count)
+                return -1;
+
+            if (pairs[record] == TREE_UNASSIGNED) {
+                pairs[record] = value;
+                stack[depth++] = record;
+            } else if (pairs[record] != value) {
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Relay the search tree of a database out in cache-line-sized blocks.
+ * 
+ * The layout lives in memory of its own, backed by huge pages where possible, and is checked against the original
+ * tree before it is used. Databases whose layout would not fit 32-bit records are left alone.
+ * 
+ * @param tree      Receives the relayout.
+ * @param mmdb      The opened database.
+ * @return          0 on success, -1 when the relayout could not be built or did not match the original tree.
+ */
+int geoip_tree_build(geoip_tree *tree, const MMDB_s *mmdb) {
+    const uint32_t count = mmdb->metadata.node_count;
+    const int record_size = mmdb->metadata.record_size;
+    const size_t node_bytes = (size_t)record_size / 4;
+    int rc = -1;
+
+    memset(tree, 0, sizeof(*tree));
+    if (count == 0 || (record_size != 24 && record_size != 28 && record_size != 32))
+        return -1;
+
+    uint32_t *slots = malloc(count * sizeof(uint32_t));
+    uint32_t *scratch = malloc(2 * (size_t)count * sizeof(uint32_t));
+    if (slots == NULL || scratch == NULL)
+        goto cleanup;
+
+    const uint64_t slot_count = (uint64_t)tree_assign(mmdb, slots, scratch) * GEOIP_TREE_BLOCK;
+    if (slot_count + mmdb->data_section_size + GEOIP_TREE_SEPARATOR > UINT32_MAX)
+        goto cleanup;
+
+    const size_t bytes = (size_t)slot_count * 2 * sizeof(uint32_t);
+    tree->size = (bytes + GEOIP_HUGE_PAGE - 1) / GEOIP_HUGE_PAGE * GEOIP_HUGE_PAGE;
+    tree->nodes = (uint32_t *)geoip_mmap_alloc(tree->size, &tree->pages);
+    if (tree->nodes == NULL)
+        goto cleanup;
+
+    tree->node_count = (uint32_t)slot_count;
+    tree->used = count;
+
+    /* Padding slots read as not found, no record leads to them. */
+    for (size_t i = 0; i < 2 * (size_t)slot_count; i++)
+        tree->nodes[i] = tree->node_count;
+
+    for (uint32_t node = 0; node < count; node++) {
+        for (int right = 0; right < 2; right++) {
+            uint32_t record = read_record(mmdb->file_content + node * node_bytes, record_size, right);
+
+            tree->nodes[2 * (size_t)slots[node] + right] = record < count ? slots[record] : record - count + tree->node_count;
+        }
+    }
+
+    if (tree_verify(tree, mmdb, scratch, scratch + count) != 0)
+        goto cleanup;
+
+    /* The same walk down ::/96 libmaxminddb does when opening the file. */
+    if (mmdb->metadata.ip_version == 6) {
+        uint32_t value = 0;
+        uint16_t netmask = 0;
+
+        for (; netmask < 96 && value < tree->node_count; netmask++)
+            value = tree->nodes[2 * (size_t)value];
+
+        tree->ipv4_start = value;
+        tree->ipv4_netmask = netmask;
+    }
+
+    geoip_mmap_protect((uint8_t *)tree->nodes, tree->size);
+    rc = 0;
+
+cleanup:
+    if (rc != 0)
+        geoip_tree_free(tree);
+
+    free(slots);
+    free(scratch);
+    return rc;
+}
+
+/**
+ * Free a relayout.
+ * 
+ * @param tree      The relayout, no lookup may be using it anymore.
+ */
+void geoip_tree_free(geoip_tree *tree) {
+    if (tree->nodes != NULL)
+        geoip_mmap_free((uint8_t *)tree->nodes, tree->size);
+
+    memset(tree, 0, sizeof(*tree));
+}
+
+/**
+ * List the records a database holds.
+ * 
+ * Every node of the original tree is read once and the data section offsets its records point at are marked in a
+ * bitmap, so the records come out sorted and each one once however many networks share it.
+ * 
+ * @param mmdb      The opened database.
+ * @param count     Receives the number of records.
+ * @return          The data section offsets of the records in ascending order, to be released with free(), or NULL
+ *                  when out of memory or the database holds no record.
+ */
+uint32_t *geoip_tree_records(const MMDB_s *mmdb, uint32_t *count) {
+    const uint32_t nodes = mmdb->metadata.node_count;
+    const int record_size = mmdb->metadata.record_size;
+    const size_t node_bytes = (size_t)record_size / 4;
+    const uint32_t base = nodes + GEOIP_TREE_SEPARATOR;
+    const uint32_t size = mmdb->data_section_size;
+    uint32_t *records = NULL;
+    uint32_t found = 0;
+
+    *count = 0;
+    uint64_t *marks = calloc((size_t)size / 64 + 1, sizeof(uint64_t));
+    if (marks == NULL)
+        return NULL;
+
+    for (uint32_t node = 0; node < nodes; node++) {
+        for (int right = 0; right < 2; right++) {
+            uint32_t record = read_record(mmdb->file_content + node * node_bytes, record_size, right);
+
+            /* Values between the tree and the data section mean not found, values past it are corrupt. */
+            if (record < base || record - base >= size)
+                continue;
+
+            uint64_t bit = 1ULL << ((record - base) & 63);
+            uint64_t *word = &marks[(record - base) / 64];
+
+            found += (*word & bit) == 0;
+            *word |= bit;
+        }
+    }
+
+    if (found > 0 && (records = malloc(found * sizeof(uint32_t))) != NULL) {
+        uint32_t n = 0;
+
+        for (size_t i = 0; i <= (size_t)size / 64; i++) {
+            for (uint64_t word = marks[i]; word != 0; word &= word - 1)
+                records[n++] = (uint32_t)(i * 64) + (uint32_t)__builtin_ctzll(word);
+        }
+
+        *count = found;
+    }
+
+    free(marks);
+    return records;
+}
+
+/**
+ * Report every network below a node of the original tree, in address order.
+ * 
+ * @param mmdb      The opened database.
+ * @param value     The record value leading to the node, or to a leaf.
+ * @param prefix    The address bits leading to the value, the bits past length are zero.
+ * @param length    The number of bits leading to the value.
+ * @param skip      A node whose subtrees are left out, or UINT32_MAX.
+ * @param fn        Called for every network leading to the data section.
+ * @param arg       Passed to fn.
+ * @return          MMDB_SUCCESS, MMDB_CORRUPT_SEARCH_TREE_ERROR or the first non-zero result of fn.
+ */
+static int tree_networks(const MMDB_s *mmdb, uint32_t value, uint8_t *prefix, int length, uint32_t skip, geoip_network_fn fn, void *arg) {
+    const uint32_t nodes = mmdb->metadata.node_count;
+
+    if (value == nodes || value == skip)
+        return MMDB_SUCCESS;
+
+    if (value > nodes) {
+        if (value - nodes - GEOIP_TREE_SEPARATOR >= mmdb->data_section_size || value - nodes < GEOIP_TREE_SEPARATOR)
+            return MMDB_CORRUPT_SEARCH_TREE_ERROR;
+
+        return fn(arg, prefix, length, value - nodes - GEOIP_TREE_SEPARATOR);
+    }
+
+    if (length >= 128)
+        return MMDB_CORRUPT_SEARCH_TREE_ERROR;
+
+    const int record_size = mmdb->metadata.record_size;
+    const uint8_t *node = mmdb->file_content + value * ((size_t)record_size / 4);
+    const uint8_t bit = (uint8_t)(0x80 >> (length & 7));
+
+    int status = tree_networks(mmdb, read_record(node, record_size, 0), prefix, length + 1, skip, fn, arg);
+    if (status != MMDB_SUCCESS)
+        return status;
+
+    prefix[length / 8] |= bit;
+    status = tree_networks(mmdb, read_record(node, record_size, 1), prefix, length + 1, skip, fn, arg);
+    prefix[length / 8] &= (uint8_t)~bit;
+    return status;
+}
+
+/**
+ * Report every network of a database that leads to a record, in address order.
+ * 
+ * Networks are reported as 128-bit prefixes. Walking the IPv4 part of an IPv6 database starts below ::/96 where
+ * libmaxminddb starts IPv4 lookups, and reports the IPv4 networks under ::ffff:0:0/96 like geoip_addr holds IPv4
+ * addresses. Walking all of an IPv6 database also walks the subtrees it aliases to the IPv4 part, like ::ffff:0:0/96,
+ * walking its IPv6 part leaves them out so every record is reported once per network it really covers.
+ * 
+ * @param mmdb      The opened database.
+ * @param scope     A GEOIP_NETWORKS_* value.
+ * @param fn        Called with the prefix, its length out of 128 bits and the offset of the record in the data section.
+ * @param arg       Passed to fn.
+ * @return          MMDB_SUCCESS, MMDB_CORRUPT_SEARCH_TREE_ERROR or the first non-zero result of fn.
+ */
+int geoip_tree_networks(const MMDB_s *mmdb, int scope, geoip_network_fn fn, void *arg) {
+    const int record_size = mmdb->metadata.record_size;
+    uint8_t prefix[16] = {0};
+    uint32_t value = 0, skip = UINT32_MAX;
+    int length = 0;
+
+    if (record_size != 24 && record_size != 28 && record_size != 32)
+        return MMDB_UNKNOWN_DATABASE_FORMAT_ERROR;
+
+    if (mmdb->metadata.ip_version != 6) {
+        if (scope != GEOIP_NETWORKS_IPV4)
+            return MMDB_SUCCESS;
+
+        prefix[10] = prefix[11] = 0xFF;
+        length = 96;
+    } else if (scope != GEOIP_NETWORKS_ALL) {
+        uint32_t start = 0;
+
+        for (int bit = 0; bit < 96 && start < mmdb->metadata.node_count; bit++)
+            start = read_record(mmdb->file_content + start * ((size_t)record_size / 4), record_size, 0);
+
+        if (scope == GEOIP_NETWORKS_IPV6) {
+            /* Only a node can be aliased, a leaf above ::/96 is a network of its own. */
+            skip = start < mmdb->metadata.node_count ? start : UINT32_MAX;
+        } else {
+            /* A leaf above ::/96 covers the whole IPv4 space. */
+            value = start;
+            prefix[10] = prefix[11] = 0xFF;
+            length = 96;
+        }
+    }
+
+    return tree_networks(mmdb, value, prefix, length, skip, fn, arg);
+}
+
+/**
+ * Report every network within a prefix that leads to a record, in address order.
+ * 
+ * The walk descends along the prefix first and only visits the subtree below it, a network wider than the prefix is
+ * reported as the prefix itself. An IPv4 prefix, given under ::ffff:0:0/96 like geoip_addr holds IPv4 addresses, is
+ * looked up in the IPv4 part of the tree the way lookups find IPv4 addresses.
+ * 
+ * @param mmdb      The opened database.
+ * @param prefix    The 16 bytes of the prefix, bits past length are ignored.
+ * @param length    The prefix length out of 128 bits.
+ * @param fn        Called with every network, its length out of 128 bits and the offset of its record.
+ * @param arg       Passed to fn.
+ * @return          MMDB_SUCCESS, MMDB_IPV6_LOOKUP_IN_IPV4_DATABASE_ERROR, MMDB_CORRUPT_SEARCH_TREE_ERROR or the first
+ *                  non-zero result of fn.
+ */
+int geoip_tree_subtree(const MMDB_s *mmdb, const uint8_t *prefix, int length, geoip_network_fn fn, void *arg) {
+    static const uint8_t ipv4_mapped[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF };
+    const int record_size = mmdb->metadata.record_size;
+    const uint32_t nodes = mmdb->metadata.node_count;
+    const bool ipv4 = length >= 96 && memcmp(prefix, ipv4_mapped, sizeof(ipv4_mapped)) == 0;
+    uint8_t bits[16] = {0};
+    uint32_t value = 0;
+    int depth = 0;
+
+    if (record_size != 24 && record_size != 28 && record_size != 32)
+        return MMDB_UNKNOWN_DATABASE_FORMAT_ERROR;
+
+    for (int i = 0; i < 16; i++) {
+        int kept = length - 8 * i;
+
+        bits[i] = kept >= 8 ? prefix[i] : kept > 0 ? prefix[i] & (uint8_t)(0xFF << (8 - kept)) : 0;
+    }
+
+    if (ipv4) {
+        /* IPv4 lookups start below ::/96, an IPv4 database holds nothing but that part. */
+        for (; mmdb->metadata.ip_version == 6 && depth < 96 && value < nodes; depth++)
+            value = read_record(mmdb->file_content + value * ((size_t)record_size / 4), record_size, 0);
+
+        depth = 96;
+    } else if (mmdb->metadata.ip_version != 6) {
+        return MMDB_IPV6_LOOKUP_IN_IPV4_DATABASE_ERROR;
+    }
+
+    for (; depth < length && value < nodes; depth++) {
+        int bit = (bits[depth >> 3] >> (7 - (depth & 7))) & 1;
+
+        value = read_record(mmdb->file_content + value * ((size_t)record_size / 4), record_size, bit);
+    }
+
+    /* A leaf reached early covers the whole prefix, a node is the root of its subtree. */
+    return tree_networks(mmdb, value, bits, length, UINT32_MAX, fn, arg);
+}
+
+/**
+ * Turn the record value a walk ended on into a lookup result.
+ * 
+ * @param mmdb      The opened database the entry refers to.
+ * @param value     The record value past the tree the walk ended on.
+ * @param node_count The number of nodes or slots of the tree that was walked.
+ * @param netmask   The number of address bits the walk consumed.
+ * @param result    Receives the lookup result.
+ * @return          MMDB_SUCCESS or MMDB_CORRUPT_SEARCH_TREE_ERROR.
+ */
+static inline int walk_result(const MMDB_s *mmdb, uint32_t value, uint32_t node_count, int netmask, MMDB_lookup_result_s *result) {
+    *result = (MMDB_lookup_result_s){ .netmask = (uint16_t)netmask, .entry = { .mmdb = mmdb } };
+
+    if (value == node_count)
+        return MMDB_SUCCESS;
+
+    /* Also catches walks that ran out of address bits while still inside the tree. */
+    if (value - node_count >= mmdb->data_section_size)
+        return MMDB_CORRUPT_SEARCH_TREE_ERROR;
+
+    result->found_entry = true;
+    result->entry.offset = value - node_count - GEOIP_TREE_SEPARATOR;
+    return MMDB_SUCCESS;
+}
+
+static inline int address_bit(const uint8_t *bytes, int bit) {
+    return (bytes[bit >> 3] >> (7 - (bit & 7))) & 1;
+}
+
+static inline uint32_t record_blocked(const uint32_t *nodes, uint32_t value, int right) {
+    return nodes[2 * (size_t)value + right];
+}
+
+static inline uint32_t record_file24(const uint8_t *tree, uint32_t value, int right) {
+    return record24(tree + (size_t)value * 6, right);
+}
+
+static inline uint32_t record_file28(const uint8_t *tree, uint32_t value, int right) {
+    return record28(tree + (size_t)value * 7, right);
+}
+
+static inline uint32_t record_file32(const uint8_t *tree, uint32_t value, int right) {
+    return record32(tree + (size_t)value * 8, right);
+}
+
+/**
+ * Generate the walks of one tree layout.
+ * 
+ * Every layout gets an IPv4 walk starting at the IPv4 start node and testing 32 bits, and an IPv6 walk starting at the
+ * root and testing 128 bits. The record reader is inlined, so the loops carry no branch on the record size, the layout
+ * or the address family, and the results match MMDB_lookup_sockaddr() down to the netmask.
+ * 
+ * @param name      The suffix of the generated functions.
+ * @param type      The element type of the tree.
+ * @param nodes     The expression giving the tree from db.
+ * @param count     The expression giving the number of nodes or slots of the tree from db.
+ * @param record    The function reading a record, given the tree, a node and the side.
+ */
+#define GEOIP_WALKS(name, type, nodes, count, record)                                                                  \
+    static int walk_ipv4_##name(const geoip_db *db, const geoip_addr *addr, MMDB_lookup_result_s *result) {           \
+        const type *tree = nodes;                                                                                     \
+        const uint32_t node_count = count;                                                                            \
+        uint32_t value = db->walk.ipv4_start;                                                                         \
+        int bit = 0;                                                                                                  \
+                                                                                                                      \
+        for (; bit < 32 && value < node_count; bit++)                                                                 \
+            value = record(tree, value, address_bit(addr->bytes + 12, bit));                                          \
+                                                                                                                      \
+        return walk_result(&db->mmdb, value, node_count, db->walk.ipv4_netmask + bit, result);                        \
+    }                                                                                                                 \
+                                                                                                                      \
+    static int walk_ipv6_##name(const geoip_db *db, const geoip_addr *addr, MMDB_lookup_result_s *result) {           \
+        const type *tree = nodes;                                                                                     \
+        const uint32_t node_count = count;                                                                            \
+        uint32_t value = 0;                                                                                           \
+        int bit = 0;                                                                                                  \
+                                                                                                                      \
+        for (; bit < 128 && value < node_count; bit++)                                                                \
+            value = record(tree, value, address_bit(addr->bytes, bit));                                               \
+                                                                                                                      \
+        return walk_result(&db->mmdb, value, node_count, bit, result);                                                \
+    }
+
+GEOIP_WALKS(file24, uint8_t, db->mmdb.file_content, db->mmdb.metadata.node_count, record_file24)
+GEOIP_WALKS(file28, uint8_t, db->mmdb.file_content, db->mmdb.metadata.node_count, record_file28)
+GEOIP_WALKS(file32, uint8_t, db->mmdb.file_content, db->mmdb.metadata.node_count, record_file32)
+GEOIP_WALKS(blocked, uint32_t, db->tree.nodes, db->tree.node_count, record_blocked)
+
+/* IPv4 databases have no room for IPv6 addresses, not even IPv4-mapped ones. */
+static int walk_ipv6_none(const geoip_db *db, const geoip_addr *addr, MMDB_lookup_result_s *result) {
+    (void)addr;  /* Unused parameter */
+    *result = (MMDB_lookup_result_s){ .entry = { .mmdb = &db->mmdb } };
+    return MMDB_IPV6_LOOKUP_IN_IPV4_DATABASE_ERROR;
+}
+
+/**
+ * Pick the walks of an opened database, once its layout is settled.
+ * 
+ * The file walks read the tree through file_content, so they follow the database into an in-memory copy. The IPv4
+ * start node is found the same way libmaxminddb finds it, by following ::/96 down from the root.
+ * 
+ * @param db    The opened database, its relayout already built when it has one.
+ */
+void geoip_tree_select(geoip_db *db) {
+    const MMDB_s *mmdb = &db->mmdb;
+    const int record_size = mmdb->metadata.record_size;
+    geoip_walker *walk = &db->walk;
+
+    if (db->tree.nodes != NULL) {
+        *walk = (geoip_walker){ walk_ipv4_blocked, walk_ipv6_blocked, "blocked", db->tree.ipv4_start, db->tree.ipv4_netmask };
+    } else {
+        switch (record_size) {
+        case 24:
+            *walk = (geoip_walker){ walk_ipv4_file24, walk_ipv6_file24, "file24", 0, 0 };
+            break;
+        case 28:
+            *walk = (geoip_walker){ walk_ipv4_file28, walk_ipv6_file28, "file28", 0, 0 };
+            break;
+        default:
+            /* MMDB_open() refuses record sizes other than 24, 28 and 32. */
+            *walk = (geoip_walker){ walk_ipv4_file32, walk_ipv6_file32, "file32", 0, 0 };
+            break;
+        }
+
+        if (mmdb->metadata.ip_version == 6) {
+            for (; walk->ipv4_netmask < 96 && walk->ipv4_start < mmdb->metadata.node_count; walk->ipv4_netmask++)
+                walk->ipv4_start = read_record(mmdb->file_content + (size_t)walk->ipv4_start * record_size / 4, record_size, 0);
+        }
+    }
+
+    if (mmdb->metadata.ip_version == 4) {
+        walk->ipv6 = walk_ipv6_none;
+        walk->ipv4_start = 0;
+        walk->ipv4_netmask = 0;
+    }
+}
+
+/**
+ * Where a walk for an address starts.
+ * 
+ * IPv4 addresses are stored IPv4-mapped, their bits start at bit 96 of the address. IPv4 databases only hold those
+ * bits, and IPv6 databases are entered at their IPv4 start node for IPv4 addresses, like MMDB_lookup_sockaddr() does.
+ * 
+ * @param ipv6          Whether the database is an IPv6 database.
+ * @param addr          The parsed address.
+ * @param ipv4_start    The node IPv4 lookups start from in an IPv6 database.
+ * @param ipv4_netmask  The number of bits leading up to ipv4_start.
+ * @param value         Receives the node to start from.
+ * @param bit           Receives the first bit of the address to test.
+ * @return              0, or -1 for an IPv6 address in an IPv4 database.
+ */
+static inline int walk_start(bool ipv6, const geoip_addr *addr, uint32_t ipv4_start, uint16_t ipv4_netmask, uint32_t *value, int *bit) {
+    *value = 0;
+    *bit = 0;
+
+    if (!ipv6) {
+        if (addr->family != AF_INET)
+            return -1;
+
+        *bit = 96;
+        return 0;
+    }
+
+    if (addr->family == AF_INET) {
+        *value = ipv4_start;
+        *bit = ipv4_netmask;
+    }
+
+    return 0;
+}
+
+/**
+ * Count the cache lines a lookup touches in the original tree and in the relayout.
+ * 
+ * Used by the benchmark to show what the relayout saves, a node of the original tree straddling two cache lines counts
+ * for both.
+ * 
+ * @param tree          The relayout of the database.
+ * @param mmdb          The opened database, its file_content must be the original tree.
+ * @param addr          The parsed address.
+ * @param mmdb_lines    Receives the cache lines touched in the original tree.
+ * @return              The cache lines touched in the relayout, or -1 for an IPv6 address in an IPv4 database.
+ */
+int geoip_tree_lines(const geoip_tree *tree, const MMDB_s *mmdb, const geoip_addr *addr, int *mmdb_lines) {
+    const bool ipv6 = mmdb->metadata.ip_version == 6;
+    const size_t node_bytes = (size_t)mmdb->metadata.record_size / 4;
+    uintptr_t last = UINTPTR_MAX;
+    uint32_t value;
+    int bit, lines = 0;
+
+    *mmdb_lines = 0;
+    if (walk_start(ipv6, addr, mmdb->ipv4_start_node.node_value, mmdb->ipv4_start_node.netmask, &value, &bit) < 0)
+        return -1;
+
+    for (; bit < 128 && value < mmdb->metadata.node_count; bit++) {
+        const uint8_t *node = mmdb->file_content + value * node_bytes;
+        uintptr_t first = (uintptr_t)node / TREE_LINE, end = ((uintptr_t)node + node_bytes - 1) / TREE_LINE;
+
+        *mmdb_lines += (int)(end - first) + (first != last);
+        last = end;
+        value = read_record(node, mmdb->metadata.record_size, address_bit(addr->bytes, bit));
+    }
+
+    last = UINTPTR_MAX;
+    walk_start(ipv6, addr, tree->ipv4_start, tree->ipv4_netmask, &value, &bit);
+
+    for (; bit < 128 && value < tree->node_count; bit++) {
+        uintptr_t line = (uintptr_t)&tree->nodes[2 * (size_t)value] / TREE_LINE;
+
+        lines += line != last;
+        last = line;
+        value = record_blocked(tree->nodes, value, address_bit(addr->bytes, bit));
+    }
+
+    return lines;
+}
@@ -0,0 +1,82 @@
+#ifndef GEOIP_TREE_H
+#define GEOIP_TREE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "maxminddb.h"
+
+#define GEOIP_TREE_BLOCK     8  /**< The nodes per block, two 32-bit records each fill one 64 byte cache line. */
+#define GEOIP_TREE_SEPARATOR 16 /**< The bytes between the search tree and the data section that record values count in. */
+
+typedef struct geoip_addr geoip_addr;
+typedef struct geoip_db geoip_db;
+
+/**
+ * A search tree walk, specialised for one tree layout and one address family.
+ * 
+ * @param db        The opened database.
+ * @param addr      The parsed address, of the family the walk was picked for.
+ * @param result    Receives the lookup result, the same MMDB_lookup_sockaddr() returns.
+ * @return          MMDB_SUCCESS or a libmaxminddb error code.
+ */
+typedef int (*geoip_walk_fn)(const geoip_db *db, const geoip_addr *addr, MMDB_lookup_result_s *result);
+
+/**
+ * A network of the search tree, as geoip_tree_networks() reports it.
+ * 
+ * @param arg       The argument given to geoip_tree_networks().
+ * @param prefix    The 16 bytes of the network address, the bits past length are zero.
+ * @param length    The prefix length out of 128 bits.
+ * @param offset    The offset of the record of the network in the data section.
+ * @return          0 to go on, anything else stops the walk and is returned by geoip_tree_networks().
+ */
+typedef int (*geoip_network_fn)(void *arg, const uint8_t *prefix, int length, uint32_t offset);
+
+/**
+ * The part of the address space geoip_tree_networks() walks.
+ */
+enum {
+    GEOIP_NETWORKS_IPV4, /**< The IPv4 networks, reported under ::ffff:0:0/96. */
+    GEOIP_NETWORKS_ALL,  /**< Every IPv6 network, the ones aliased to the IPv4 part included. */
+    GEOIP_NETWORKS_IPV6  /**< The IPv6 networks that are not the IPv4 part or aliases of it. */
+};
+
+/**
+ * The walks picked for a database when it is opened.
+ */
+typedef struct geoip_walker {
+    geoip_walk_fn ipv4;    /**< Walks IPv4 addresses, starting at ipv4_start. */
+    geoip_walk_fn ipv6;    /**< Walks IPv6 addresses, starting at the root. */
+    const char *name;      /**< The layout the walks were generated for, for diagnostics. */
+    uint32_t ipv4_start;   /**< The node or slot IPv4 walks start from, the root in an IPv4 database. */
+    uint16_t ipv4_netmask; /**< The number of bits leading up to ipv4_start. */
+} geoip_walker;
+
+/**
+ * The search tree of a database relaid out in cache-line-sized blocks.
+ * 
+ * Every block holds a subtree of up to GEOIP_TREE_BLOCK nodes filled breadth first, so a walk touches one cache line
+ * for every three levels or more instead of one for almost every level. Nodes are addressed by their slot in the
+ * layout, record values at or above node_count point past the tree exactly like MMDB record values point past the
+ * original tree: node_count means not found, and node_count + GEOIP_TREE_SEPARATOR + offset an entry at that offset of
+ * the data section.
+ */
+typedef struct geoip_tree {
+    uint32_t *nodes;       /**< The left and right record of every slot, NULL when the database has no relayout. */
+    size_t size;           /**< The size of the allocation holding the nodes. */
+    int pages;             /**< The GEOIP_PAGES_* value describing the memory behind the nodes. */
+    uint32_t node_count;   /**< The number of slots, including the unused ones padding partly filled blocks. */
+    uint32_t used;         /**< The number of slots holding a node of the original tree. */
+    uint32_t ipv4_start;   /**< The slot IPv4 lookups start from in an IPv6 database. */
+    uint16_t ipv4_netmask; /**< The number of bits leading up to ipv4_start. */
+} geoip_tree;
+
+int geoip_tree_build(geoip_tree *tree, const MMDB_s *mmdb);
+void geoip_tree_free(geoip_tree *tree);
+void geoip_tree_select(geoip_db *db);
+uint32_t *geoip_tree_records(const MMDB_s *mmdb, uint32_t *count);
+int geoip_tree_networks(const MMDB_s *mmdb, int scope, geoip_network_fn fn, void *arg);
+int geoip_tree_subtree(const MMDB_s *mmdb, const uint8_t *prefix, int length, geoip_network_fn fn, void *arg);
+int geoip_tree_lines(const geoip_tree *tree, const MMDB_s *mmdb, const geoip_addr *addr, int *mmdb_lines);
+
+#endif /* GEOIP_TREE_H */
@@ -1,25 +1,12 @@
+#include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
-#include "maxminddb.h"
+#include "geoip.h"
+#include "geoip_stats.h"
+#include "geoip_trace.h"
 #include <sqlite3ext.h>
 
-#ifdef _WIN32
-#   define MSG_ERRGETADDRINFO "Error from getaddrinfo for %s - %ws"
-#   define HOMEENVNAME "HOMEPATH"
-#   define DLLFUNC __declspec(dllexport)
-#   define PATH_MAX 260
-#   include <Ws2tcpip.h>
-#   include <direct.h>
-#else
-#   define MSG_ERRGETADDRINFO "Error from getaddrinfo for %s - %s"
-#   define HOMEENVNAME "HOME"
-#   define DLLFUNC
-#   include <linux/limits.h>
-#   include <arpa/inet.h>
-#   include <unistd.h>
-#endif
-
 enum {
     GEOIP_FUNCTION_COUNTRY,          /**< enum value for determining if the selected function is "geoip_country" */
     GEOIP_FUNCTION_CONTINENT,        /**< enum value for determining if the selected function is "geoip_continent" */
@@ -28,16 +15,52 @@ enum {
     GEOIP_FUNCTION_TIMEZONE,         /**< enum value for determining if the selected function is "geoip_timezone" */
     GEOIP_FUNCTION_ZIPCODE,          /**< enum value for determining if the selected function is "geoip_zipcode" */
     GEOIP_FUNCTION_ASN_ORGANIZATION, /**< enum value for determining if the selected function is "geoip_asn_owner" */
-    GEOIP_FUNCTION_ASN_NUMBER        /**< enum value for determining if the selected function is "geoip_asn_number" */
+    GEOIP_FUNCTION_ASN_NUMBER,       /**< enum value for determining if the selected function is "geoip_asn_number" */
+    GEOIP_FUNCTION_LATITUDE,         /**< enum value for determining if the selected function is "geoip_latitude" */
+    GEOIP_FUNCTION_LONGITUDE,        /**< enum value for determining if the selected function is "geoip_longitude" */
+    GEOIP_FUNCTION_ACCURACY_RADIUS   /**< enum value for determining if the selected function is "geoip_accuracy_radius" */
+};
+
+/**
+ * The MMDB lookup path of every field, indexed by the GEOIP_FUNCTION_* enum.
+ */
+static const char *const *const lookup_paths[] = {
+    [GEOIP_FUNCTION_COUNTRY]          = (const char *const[]){ "country", "names", "en", NULL },
+    [GEOIP_FUNCTION_CONTINENT]        = (const char *const[]){ "continent", "names", "en", NULL },
+    [GEOIP_FUNCTION_CITY]             = (const char *const[]){ "city", "names", "en", NULL },
+    [GEOIP_FUNCTION_STATE]            = (const char *const[]){ "subdivisions", "0", "names", "en", NULL },
+    [GEOIP_FUNCTION_TIMEZONE]         = (const char *const[]){ "location", "time_zone", NULL },
+    [GEOIP_FUNCTION_ZIPCODE]          = (const char *const[]){ "postal", "code", NULL },
+    [GEOIP_FUNCTION_ASN_ORGANIZATION] = (const char *const[]){ "autonomous_system_organization", NULL },
+    [GEOIP_FUNCTION_ASN_NUMBER]       = (const char *const[]){ "autonomous_system_number", NULL },
+    [GEOIP_FUNCTION_LATITUDE]         = (const char *const[]){ "location", "latitude", NULL },
+    [GEOIP_FUNCTION_LONGITUDE]        = (const char *const[]){ "location", "longitude", NULL },
+    [GEOIP_FUNCTION_ACCURACY_RADIUS]  = (const char *const[]){ "location", "accuracy_radius", NULL }
+};
+
+/**
+ * The name of every field as reported by "geoip_explain", indexed by the GEOIP_FUNCTION_* enum.
+ */
+static const char *const lookup_names[] = {
+    [GEOIP_FUNCTION_COUNTRY]          = "country",
+    [GEOIP_FUNCTION_CONTINENT]        = "continent",
+    [GEOIP_FUNCTION_CITY]             = "city",
+    [GEOIP_FUNCTION_STATE]            = "state",
+    [GEOIP_FUNCTION_TIMEZONE]         = "timezone",
+    [GEOIP_FUNCTION_ZIPCODE]          = "zipcode",
+    [GEOIP_FUNCTION_ASN_ORGANIZATION] = "asn_owner",
+    [GEOIP_FUNCTION_ASN_NUMBER]       = "asn_number",
+    [GEOIP_FUNCTION_LATITUDE]         = "latitude",
+    [GEOIP_FUNCTION_LONGITUDE]        = "longitude",
+    [GEOIP_FUNCTION_ACCURACY_RADIUS]  = "accuracy_radius"
 };
 
-#define MSG_NOTINITIALIZED "sqlite-maxminddb is not initialized"
-#define MSG_ERRLIBMAXMIND  "Got an error from libmaxminddb: %s"
 SQLITE_EXTENSION_INIT1
 
 bool initialized = false; /**< A global variable that is being used to determine if the SQLite3 extension is ready to be used or not. */
-MMDB_s mmdb_asn;          /**< A global variable that will be used to store and reference the contents of the GeoLite2-ASN MMDB file. */
-MMDB_s mmdb_cnt;          /**< A global variable that will be used to store and reference the contents of the GeoLite2-City MMDB file. */
+geoip_db db_asn = { .name = "GeoLitev2 ASN", .filename = "GeoLite2-ASN.mmdb", .alias = "asn", .reject_reserved = true };    /**< A global variable that will be used to store and reference the contents of the GeoLite2-ASN MMDB file. */
+geoip_db db_cnt = { .name = "GeoLitev2 City", .filename = "GeoLite2-City.mmdb", .alias = "city", .reject_reserved = true }; /**< A global variable that will be used to store and reference the contents of the GeoLite2-City MMDB file. */
+static int connections;   /**< The number of SQLite3 connections the extension is currently loaded into, guarded by the SQLITE_MUTEX_STATIC_APP1 mutex. */
 
 /**
  * Convert an enum value to a string value.
@@ -87,6 +110,185 @@ static const char *MMDB_get_typestr(const uint32_t type) {
     return "unknown";
 }
 
+/**
+ * Parse the shorthand IPv4 forms inet_aton() accepts and inet_pton() does not.
+ * 
+ * An address is one to four parts separated by dots, each one decimal, octal with a leading 0 or hexadecimal with a
+ * leading 0x. The last part fills the bytes left over, so 127.1 is 127.0.0.1 and 3232235777 is 192.168.1.1.
+ * 
+ * @param text      The text to parse.
+ * @param bytes     Receives the address in network byte order.
+ * @return          Whether the text is such an address.
+ */
+static bool parse_ipv4_shorthand(const char *text, uint8_t bytes[4]) {
+    uint32_t parts[4];
+    int nparts = 0;
+    const char *p = text;
+
+    for (;;) {
+        int base = 10;
+        uint64_t value = 0;
+
+        if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+            base = 16;
+            p += 2;
+        } else if (p[0] == '0') {
+            base = 8;
+        }
+
+        const char *digits = p;
+        for (;; p++) {
+            int digit;
+
+            if (*p >= '0' && *p <= '9')
+                digit = *p - '0';
+            else if (base == 16 && *p >= 'a' && *p <= 'f')
+                digit = *p - 'a' + 10;
+            else if (base == 16 && *p >= 'A' && *p <= 'F')
+                digit = *p - 'A' + 10;
+            else
+                break;
+
+            if (digit >= base || (value = value * base + digit) > UINT32_MAX)
+                return false;
+        }
+
+        if (p == digits)
+            return false;
+
+        parts[nparts++] = (uint32_t)value;
+        if (*p == '\0')
+            break;
+
+        if (*p != '.' || nparts == 4)
+            return false;
+        p++;
+    }
+
+    /* Every part but the last is one byte, the last one holds the remaining 5 - nparts bytes. */
+    uint32_t address = 0;
+    for (int i = 0; i < nparts - 1; i++) {
+        if (parts[i] > 0xFF)
+            return false;
+
+        address |= parts[i] << (24 - 8 * i);
+    }
+
+    if (nparts > 1 && parts[nparts - 1] >> (8 * (5 - nparts)) != 0)
+        return false;
+
+    address |= parts[nparts - 1];
+    for (int i = 0; i < 4; i++)
+        bytes[i] = (uint8_t)(address >> (24 - 8 * i));
+    return true;
+}
+
+/**
+ * Parse a textual IP address.
+ * 
+ * Only numeric IPv4 and IPv6 addresses are accepted, like the AI_NUMERICHOST lookups of libmaxminddb accept them. Text
+ * inet_pton() rejects is tried again as one of the IPv4 shorthands inet_aton() knows, such as 127.1 or 3232235777, so
+ * these keep working. IPv6 zone indices such as fe80::1%eth0 are not accepted.
+ * 
+ * @param ipaddress     A pointer to a location in memory that stores a string of characters that represent the IP address.
+ * @param addr          Receives the parsed address.
+ * @return              0 on success, otherwise a getaddrinfo error code.
+ */
+int geoip_parse_address(const char *ipaddress, geoip_addr *addr) {
+    struct in_addr in4;
+
+    if (ipaddress == NULL)
+        return EAI_NONAME;
+
+    if (inet_pton(AF_INET, ipaddress, &in4) == 1 || parse_ipv4_shorthand(ipaddress, (uint8_t *)&in4)) {
+        memset(addr->bytes, 0, 10);
+        addr->bytes[10] = 0xFF;
+        addr->bytes[11] = 0xFF;
+        memcpy(addr->bytes + 12, &in4, 4);
+        addr->family = AF_INET;
+        return 0;
+    }
+
+    if (inet_pton(AF_INET6, ipaddress, addr->bytes) == 1) {
+        addr->family = AF_INET6;
+        return 0;
+    }
+
+    return EAI_NONAME;
+}
+
+/**
+ * Count the search tree nodes a lookup visited.
+ * 
+ * IPv4 lookups in an IPv6 database start at the cached IPv4 start node, the nodes leading up to it are not visited.
+ * 
+ * @param db            The database that was searched.
+ * @param addr          The parsed address.
+ * @param result        The lookup result.
+ * @return              The number of nodes visited.
+ */
+static inline int lookup_depth(const geoip_db *db, const geoip_addr *addr, const MMDB_lookup_result_s *result) {
+    if (addr->family == AF_INET && db->mmdb.metadata.ip_version == 6)
+        return result->netmask - db->walk.ipv4_netmask;
+
+    return result->netmask;
+}
+
+/**
+ * Find the record of an address in a database.
+ * 
+ * The database is opened on first use. Addresses in special-purpose blocks no database covers are answered as not found
+ * right away, then the lookup cache is consulted and the search tree is only walked on a miss.
+ * 
+ * @param db            The database to search.
+ * @param addr          The parsed address.
+ * @param result        Receives the lookup result.
+ * @param function      The GEOIP_STAT_* value of the calling function, cache hits and misses are counted there, or -1.
+ * @return              MMDB_SUCCESS or a libmaxminddb error code.
+ */
+int geoip_lookup(geoip_db *db, const geoip_addr *addr, MMDB_lookup_result_s *result, int function) {
+    geoip_stats_counters *stats = function >= 0 ? geoip_stats_local(function) : NULL;
+    int mmdb_error = geoip_db_acquire(db);
+
+    if (mmdb_error != MMDB_SUCCESS)
+        return mmdb_error;
+
+    GEOIP_TRACE_LOOKUP_START(function, addr->family);
+
+    int netmask;
+    if (geoip_class_reject(db, addr, &netmask)) {
+        *result = (MMDB_lookup_result_s){ .found_entry = false, .netmask = (uint16_t)netmask, .entry.mmdb = &db->mmdb };
+        if (stats != NULL)
+            geoip_stats_add(stats, &stats->reserved, 1);
+
+        GEOIP_TRACE_LOOKUP_END(function, addr->family, 0, false);
+        return MMDB_SUCCESS;
+    }
+
+    if (geoip_cache_get(&db->cache, addr, result) && (!result->found_entry || result->entry.offset < db->mmdb.data_section_size)) {
+        result->entry.mmdb = &db->mmdb;
+        if (stats != NULL)
+            geoip_stats_add(stats, &stats->cache_hits, 1);
+
+        GEOIP_TRACE_CACHE_HIT(function, addr->family, lookup_depth(db, addr, result));
+        GEOIP_TRACE_LOOKUP_END(function, addr->family, lookup_depth(db, addr, result), result->found_entry);
+        return MMDB_SUCCESS;
+    }
+
+    if (stats != NULL)
+        geoip_stats_add(stats, &stats->cache_misses, 1);
+
+    GEOIP_TRACE_CACHE_MISS(function, addr->family);
+
+    mmdb_error = geoip_tree_walk(db, addr, result);
+
+    if (mmdb_error == MMDB_SUCCESS)
+        geoip_cache_put(&db->cache, addr, result);
+
+    GEOIP_TRACE_LOOKUP_END(function, addr->family, lookup_depth(db, addr, result), result->found_entry);
+    return mmdb_error;
+}
+
 /**
  * Determine if errors occurred during runtime.
  * 
@@ -117,6 +319,39 @@ static bool check_lookup(sqlite3_context *context, const char *ipaddress, const
     return false;
 }
 
+/**
+ * Answer a call whose lookup failed, according to the error policy of the calling function.
+ * 
+ * Input that is not an address, or an IPv6 address given to an IPv4 database, is answered without formatting anything
+ * unless the policy is strict. Any other failure is an error whatever the policy.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param ipaddress     The text passed to the function.
+ * @param gai_error     The result of parsing the address.
+ * @param mmdb_error    The result of the lookup.
+ * @param function      The GEOIP_STAT_* value of the calling extension function.
+ * @return              A GEOIP_OUTCOME_* value describing the result.
+ */
+static int lookup_failed(sqlite3_context *context, const char *ipaddress, int gai_error, int mmdb_error, int function) {
+    const geoip_conn *conn = sqlite3_user_data(context);
+    bool invalid = gai_error != 0 || mmdb_error == MMDB_IPV6_LOOKUP_IN_IPV4_DATABASE_ERROR;
+
+    if (gai_error == EAI_MEMORY) {
+        sqlite3_result_error_nomem(context);
+        return GEOIP_OUTCOME_ERROR;
+    }
+
+    if (invalid && conn->policy[function] != GEOIP_POLICY_STRICT) {
+        if (conn->policy[function] == GEOIP_POLICY_SENTINEL)
+            sqlite3_result_text(context, conn->sentinel, -1, SQLITE_TRANSIENT);
+
+        return GEOIP_OUTCOME_INVALID;
+    }
+
+    check_lookup(context, ipaddress, gai_error, mmdb_error);
+    return GEOIP_OUTCOME_ERROR;
+}
+
 /**
  * Retrieve data from all extension functions.
  * 
@@ -140,7 +375,7 @@ static char *get_data(sqlite3_context *context, int status, char *zOut, MMDB_ent
     if (entry_data.type == MMDB_DATA_TYPE_BYTES || entry_data.type == MMDB_DATA_TYPE_UTF8_STRING)
         snprintf(zOut, entry_data.data_size + 1, "%s", (const char *)entry_data.bytes);
     else if (entry_data.type == MMDB_DATA_TYPE_UINT32)
-        snprintf(zOut, entry_data.data_size + 1, "%u", entry_data.uint32);
+        sprintf(zOut, "%u", entry_data.uint32);
     else
         return "NULL";
 
@@ -151,38 +386,66 @@ static char *get_data(sqlite3_context *context, int status, char *zOut, MMDB_ent
  * Send the results of the MMDB query to SQLite
  * 
  * This function handles the bulk of this extension's functionality by reflecting the MMDB query results to the SQLite query.
+ * Strings are handed to SQLite as they are stored in the data section, 32-bit numbers as text, coordinates as reals and
+ * accuracy radii as integers. A record lacking the field, or holding it with a type that cannot be returned, raises an
+ * error under the strict policy and returns NULL otherwise.
  * 
  * @param context       The current SQLite3 function context structure/object.
  * @param status        The MMDB error status which should be 0.
- * @param zOut          The string containing the IP address passed by the "geoip" function.
- * @param entry_data    An MMDB structure that stores field information for the queried data.   
+ * @param entry_data    An MMDB structure that stores field information for the queried data.
+ * @param function      The GEOIP_STAT_* value of the calling extension function.
+ * @return              A GEOIP_OUTCOME_* value describing the result.
  */
-static void send_data(sqlite3_context *context, int status, char *zOut, MMDB_entry_data_s entry_data) {
-    assert(zOut != NULL);
+static int send_data(sqlite3_context *context, int status, MMDB_entry_data_s entry_data, int function) {
+    const geoip_conn *conn = sqlite3_user_data(context);
+    bool strict = conn->policy[function] == GEOIP_POLICY_STRICT;
     char errmsg[PATH_MAX];
 
+    if (status == MMDB_LOOKUP_PATH_DOES_NOT_MATCH_DATA_ERROR && !strict)
+        return GEOIP_OUTCOME_NOT_FOUND;
+
     if (status != MMDB_SUCCESS) {
-        sprintf(errmsg, " %d: %s", status, MMDB_strerror(status));
+        snprintf(errmsg, sizeof(errmsg), " %d: %s", status, MMDB_strerror(status));
         sqlite3_result_error(context, errmsg, -1);
-        return;
+        return GEOIP_OUTCOME_ERROR;
     }
 
     if (!entry_data.has_data) {
-        sprintf(errmsg, "No data to retrieve");
-        sqlite3_result_error(context, errmsg, -1);
-        return;
+        if (strict)
+            sqlite3_result_error(context, "No data to retrieve", -1);
+
+        return GEOIP_OUTCOME_NOT_FOUND;
     }
 
-    if (entry_data.type == MMDB_DATA_TYPE_BYTES || entry_data.type == MMDB_DATA_TYPE_UTF8_STRING)
-        snprintf(zOut, entry_data.data_size + 1, "%s", (const char *)entry_data.bytes);
-    else if (entry_data.type == MMDB_DATA_TYPE_UINT32)
-        snprintf(zOut, entry_data.data_size + 1, "%u", entry_data.uint32);
-    else {
-        sprintf(errmsg, "Data type is: %s", MMDB_get_typestr(entry_data.type));
-        sqlite3_result_error(context, errmsg, -1);
+    if (entry_data.type == MMDB_DATA_TYPE_BYTES || entry_data.type == MMDB_DATA_TYPE_UTF8_STRING) {
+        sqlite3_result_text(context, (const char *)entry_data.bytes, entry_data.data_size, SQLITE_TRANSIENT);
+        return GEOIP_OUTCOME_FOUND;
+    }
+
+    if (entry_data.type == MMDB_DATA_TYPE_UINT32) {
+        char number[16];
+        int length = snprintf(number, sizeof(number), "%u", entry_data.uint32);
+
+        sqlite3_result_text(context, number, length, SQLITE_TRANSIENT);
+        return GEOIP_OUTCOME_FOUND;
+    }
+
+    if (entry_data.type == MMDB_DATA_TYPE_DOUBLE) {
+        sqlite3_result_double(context, entry_data.double_value);
+        return GEOIP_OUTCOME_FOUND;
+    }
+
+    if (entry_data.type == MMDB_DATA_TYPE_UINT16) {
+        sqlite3_result_int(context, entry_data.uint16);
+        return GEOIP_OUTCOME_FOUND;
     }
 
-    sqlite3_result_text(context, (char *)zOut, strlen(zOut), SQLITE_TRANSIENT);
+    if (!strict)
+        return GEOIP_OUTCOME_NOT_FOUND;
+
+    snprintf(errmsg, sizeof(errmsg), "Data type is: %s", MMDB_get_typestr(entry_data.type));
+    sqlite3_result_error(context, errmsg, -1);
+    return GEOIP_OUTCOME_ERROR;
 }
 
 /**
@@ -191,75 +454,38 @@ static void send_data(sqlite3_context *context, int status, char *zOut, MMDB_ent
  * This function performs the MMDB queries and sets up the extension to return the results of the query to SQLite.
  * 
  * @param context       The current SQLite3 function context structure/object.
- * @param ipaddress     A pointer to a location in memory that stores a string of characters that represent the IP address.
- * @param mmdb          A reference to the correct MMDB file that stores the table members for ASNs versus Cities.
+ * @param value         The address argument, as text, a BLOB from "ip_to_blob" or an integer from "ip_to_int".
+ * @param db            A reference to the correct MMDB file that stores the table members for ASNs versus Cities.
  * @param functype      An enum that represents which of the extension functions is being called to build the correct MMDB query.
+ * @param function      The GEOIP_STAT_* value of the calling extension function.
+ * @return              A GEOIP_OUTCOME_* value describing the result.
  * 
  * @todo Rename this function since it used to have variadic arguments instead of the enum "functype".
  */
-static void lookup_vargs(sqlite3_context *context, const char *ipaddress, const MMDB_s *mmdb, int functype) {
-    assert(functype >= 0 && functype <= 7);
+static int lookup_vargs(sqlite3_context *context, sqlite3_value *value, geoip_db *db, int functype, int function) {
+    assert(functype >= 0 && functype <= GEOIP_FUNCTION_ACCURACY_RADIUS);
 
-    int gai_error, mmdb_error;
-    MMDB_lookup_result_s result = MMDB_lookup_string(mmdb, ipaddress, &gai_error, &mmdb_error);
-    if (check_lookup(context, ipaddress, gai_error, mmdb_error)) {
-        char errmsg[PATH_MAX];
+    const char *ipaddress = geoip_value_text(value);
+    geoip_addr addr;
+    MMDB_lookup_result_s result = {0};
+    int gai_error = geoip_value_address(value, &addr);
 
-        if (gai_error) {
-            sprintf(errmsg, " (%d): %s", gai_error, gai_strerror(gai_error));
-            sqlite3_result_error(context, errmsg, -1);
-            return;
-        }
+    if (gai_error != 0)
+        return lookup_failed(context, ipaddress, gai_error, MMDB_SUCCESS, function);
 
-        sprintf(errmsg, " (%d): %s", mmdb_error, MMDB_strerror(mmdb_error));
-        sqlite3_result_error(context, errmsg, -1);
-        return;
-    }
+    int mmdb_error = geoip_lookup(db, &addr, &result, function);
+    if (mmdb_error != MMDB_SUCCESS)
+        return lookup_failed(context, ipaddress, 0, mmdb_error, function);
 
-    char zOut[4096];
-    zOut[0] = '\0';
+    if (!result.found_entry)
+        return GEOIP_OUTCOME_NOT_FOUND;
 
-    if (result.found_entry) {
-        MMDB_entry_data_s entry_data;
-        int status = 0;
+    MMDB_entry_data_s entry_data;
 
-        switch (functype) {
-        case GEOIP_FUNCTION_COUNTRY:
-            status = MMDB_get_value(&result.entry, &entry_data, "country", "names", "en", NULL);
-            send_data(context, status, zOut, entry_data);
-            break;
-        case GEOIP_FUNCTION_CONTINENT:
-            status = MMDB_get_value(&result.entry, &entry_data, "continent", "names", "en", NULL);
-            send_data(context, status, zOut, entry_data);
-            break;
-        case GEOIP_FUNCTION_CITY:
-            status = MMDB_get_value(&result.entry, &entry_data, "city", "names", "en", NULL);
-            send_data(context, status, zOut, entry_data);
-            break;
-        case GEOIP_FUNCTION_STATE:
-            status = MMDB_get_value(&result.entry, &entry_data, "subdivisions", "0", "names", "en", NULL);
-            send_data(context, status, zOut, entry_data);
-            break;
-        case GEOIP_FUNCTION_TIMEZONE:
-            status = MMDB_get_value(&result.entry, &entry_data, "location", "time_zone", NULL);
-            send_data(context, status, zOut, entry_data);
-            break;
-        case GEOIP_FUNCTION_ZIPCODE:
-            status = MMDB_get_value(&result.entry, &entry_data, "postal", "code", NULL);
-            send_data(context, status, zOut, entry_data);
-            break;
-        case GEOIP_FUNCTION_ASN_ORGANIZATION:
-            status = MMDB_get_value(&result.entry, &entry_data, "autonomous_system_organization", NULL);
-            send_data(context, status, zOut, entry_data);
-            break;
-        case GEOIP_FUNCTION_ASN_NUMBER:
-            status = MMDB_get_value(&result.entry, &entry_data, "autonomous_system_number", NULL);
-            send_data(context, status, zOut, entry_data);
-            break;
-        default:
-            break;
-        };
-    }
+    GEOIP_TRACE_DECODE_START(function, result.entry.offset);
+    int status = MMDB_aget_value(&result.entry, &entry_data, lookup_paths[functype]);
+    GEOIP_TRACE_DECODE_END(function, result.entry.offset, status);
+    return send_data(context, status, entry_data, function);
 }
 
 /**
@@ -268,40 +494,26 @@ static void lookup_vargs(sqlite3_context *context, const char *ipaddress, const
  * This function will simply run queries on both MMDB databases to be passed along to the "get_data" function.
  * 
  * @param context       The current SQLite3 function context structure/object.
- * @param ipaddress     A pointer to a location in memory that stores a string of characters that represent the IP address.
+ * @param value         The address argument, as text, a BLOB from "ip_to_blob" or an integer from "ip_to_int".
+ * @return              A GEOIP_OUTCOME_* value describing the result.
  */
-static void lookup_all(sqlite3_context *context, const char *ipaddress) {
-    int gai_error, mmdb_error;
-
-    MMDB_lookup_result_s result_asn = MMDB_lookup_string(&mmdb_asn, ipaddress, &gai_error, &mmdb_error);
-    if (check_lookup(context, ipaddress, gai_error, mmdb_error)) {
-        char errmsg[PATH_MAX];
+static int lookup_all(sqlite3_context *context, sqlite3_value *value) {
+    const char *ipaddress = geoip_value_text(value);
+    geoip_addr addr;
+    MMDB_lookup_result_s result_asn = {0};
+    MMDB_lookup_result_s result_cnt = {0};
+    int gai_error = geoip_value_address(value, &addr);
 
-        if (gai_error) {
-            sprintf(errmsg, " (%d): %s", gai_error, gai_strerror(gai_error));
-            sqlite3_result_error(context, errmsg, -1);
-            return;
-        }
-
-        sprintf(errmsg, " (%d): %s", mmdb_error, MMDB_strerror(mmdb_error));
-        sqlite3_result_error(context, errmsg, -1);
-        return;
-    }
+    if (gai_error != 0)
+        return lookup_failed(context, ipaddress, gai_error, MMDB_SUCCESS, GEOIP_STAT_GEOIP);
 
-    MMDB_lookup_result_s result_cnt = MMDB_lookup_string(&mmdb_cnt, ipaddress, &gai_error, &mmdb_error);
-    if (check_lookup(context, ipaddress, gai_error, mmdb_error)) {
-        char errmsg[PATH_MAX];
-
-        if (gai_error) {
-            sprintf(errmsg, " (%d): %s", gai_error, gai_strerror(gai_error));
-            sqlite3_result_error(context, errmsg, -1);
-            return;
-        }
+    int mmdb_error = geoip_lookup(&db_asn, &addr, &result_asn, GEOIP_STAT_GEOIP);
+    if (mmdb_error != MMDB_SUCCESS)
+        return lookup_failed(context, ipaddress, 0, mmdb_error, GEOIP_STAT_GEOIP);
 
-        sprintf(errmsg, " (%d): %s", mmdb_error, MMDB_strerror(mmdb_error));
-        sqlite3_result_error(context, errmsg, -1);
-        return;
-    }
+    mmdb_error = geoip_lookup(&db_cnt, &addr, &result_cnt, GEOIP_STAT_GEOIP);
+    if (mmdb_error != MMDB_SUCCESS)
+        return lookup_failed(context, ipaddress, 0, mmdb_error, GEOIP_STAT_GEOIP);
 
     char zOut[4096];
     zOut[0] = '\0';
@@ -312,6 +524,8 @@ static void lookup_all(sqlite3_context *context, const char *ipaddress) {
     MMDB_entry_data_s entry_data;
 
     if (result_asn.found_entry) {
+        GEOIP_TRACE_DECODE_START(GEOIP_STAT_GEOIP, result_asn.entry.offset);
+
         MMDB_get_value(&result_asn.entry, &entry_data, "autonomous_system_organization", NULL);
         strcat(zData, get_data(context, 0, zOut, entry_data));
         strcat(zData, " | ");
@@ -319,11 +533,14 @@ static void lookup_all(sqlite3_context *context, const char *ipaddress) {
         MMDB_get_value(&result_asn.entry, &entry_data, "autonomous_system_number", NULL);
         strcat(zData, get_data(context, 0, zOut, entry_data));
         strcat(zData, " | ");
+        GEOIP_TRACE_DECODE_END(GEOIP_STAT_GEOIP, result_asn.entry.offset, MMDB_SUCCESS);
     } else {
         strcat(zData, "NULL | NULL | ");
     }
 
     if (result_cnt.found_entry) {
+        GEOIP_TRACE_DECODE_START(GEOIP_STAT_GEOIP, result_cnt.entry.offset);
+
         MMDB_get_value(&result_cnt.entry, &entry_data, "continent", "names", "en", NULL);
         strcat(zData, get_data(context, 0, zOut, entry_data));
         strcat(zData, " | ");
@@ -346,9 +563,13 @@ static void lookup_all(sqlite3_context *context, const char *ipaddress) {
 
         MMDB_get_value(&result_cnt.entry, &entry_data, "location", "time_zone", NULL);
         strcat(zData, get_data(context, 0, zOut, entry_data));
+        GEOIP_TRACE_DECODE_END(GEOIP_STAT_GEOIP, result_cnt.entry.offset, MMDB_SUCCESS);
 
         sqlite3_result_text(context, (char *)zData, strlen(zData), SQLITE_TRANSIENT);
+        return GEOIP_OUTCOME_FOUND;
     }
+
+    return GEOIP_OUTCOME_NOT_FOUND;
 }
 
 /**
@@ -362,18 +583,21 @@ static void lookup_all(sqlite3_context *context, const char *ipaddress) {
  */
 static void lookup_country(sqlite3_context *context, int argc, sqlite3_value **argv) { 
     assert(argc == 1);
-    const char *zIn;
+    geoip_stats_counters *stats = geoip_stats_local(GEOIP_STAT_COUNTRY);
+    uint64_t start = geoip_stats_now();
 
     if (!initialized) {
         sqlite3_result_error(context, MSG_NOTINITIALIZED, -1);
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_ERROR);
         return;
     }
 
-    if (sqlite3_value_type(argv[0]) == SQLITE_NULL)
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_NOT_FOUND);
         return;
-    
-    zIn = (const char *)sqlite3_value_text(argv[0]);
-    lookup_vargs(context, zIn, &mmdb_cnt, GEOIP_FUNCTION_COUNTRY);          
+    }
+
+    geoip_stats_end(stats, start, lookup_vargs(context, argv[0], &db_cnt, GEOIP_FUNCTION_COUNTRY, GEOIP_STAT_COUNTRY));
 }
 
 /**
@@ -387,18 +611,21 @@ static void lookup_country(sqlite3_context *context, int argc, sqlite3_value **a
  */
 static void lookup_continent(sqlite3_context *context, int argc, sqlite3_value **argv) {
     assert(argc == 1);
-    const char *zIn;
+    geoip_stats_counters *stats = geoip_stats_local(GEOIP_STAT_CONTINENT);
+    uint64_t start = geoip_stats_now();
 
     if (!initialized) {
         sqlite3_result_error(context, MSG_NOTINITIALIZED, -1);
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_ERROR);
         return;
     }
 
-    if (sqlite3_value_type(argv[0]) == SQLITE_NULL)
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_NOT_FOUND);
         return;
-    
-    zIn = (const char *)sqlite3_value_text(argv[0]);
-    lookup_vargs(context, zIn, &mmdb_cnt, GEOIP_FUNCTION_CONTINENT);
+    }
+
+    geoip_stats_end(stats, start, lookup_vargs(context, argv[0], &db_cnt, GEOIP_FUNCTION_CONTINENT, GEOIP_STAT_CONTINENT));
 }
 
 /**
@@ -412,18 +639,21 @@ static void lookup_continent(sqlite3_context *context, int argc, sqlite3_value *
  */
 static void lookup_city(sqlite3_context *context, int argc, sqlite3_value **argv) { 
     assert(argc == 1);
-    const char *zIn;
+    geoip_stats_counters *stats = geoip_stats_local(GEOIP_STAT_CITY);
+    uint64_t start = geoip_stats_now();
 
     if (!initialized) {
         sqlite3_result_error(context, MSG_NOTINITIALIZED, -1);
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_ERROR);
         return;
     }
 
-    if (sqlite3_value_type(argv[0]) == SQLITE_NULL)
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_NOT_FOUND);
         return;
-    
-    zIn = (const char *)sqlite3_value_text(argv[0]);
-    lookup_vargs(context, zIn, &mmdb_cnt, GEOIP_FUNCTION_CITY);
+    }
+
+    geoip_stats_end(stats, start, lookup_vargs(context, argv[0], &db_cnt, GEOIP_FUNCTION_CITY, GEOIP_STAT_CITY));
 }
 
 /**
@@ -437,18 +667,21 @@ static void lookup_city(sqlite3_context *context, int argc, sqlite3_value **argv
  */
 static void lookup_state(sqlite3_context *context, int argc, sqlite3_value **argv) { 
     assert(argc == 1);
-    const char *zIn;
+    geoip_stats_counters *stats = geoip_stats_local(GEOIP_STAT_STATE);
+    uint64_t start = geoip_stats_now();
 
     if (!initialized) {
         sqlite3_result_error(context, MSG_NOTINITIALIZED, -1);
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_ERROR);
         return;
     }
 
-    if (sqlite3_value_type(argv[0]) == SQLITE_NULL)
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_NOT_FOUND);
         return;
-    
-    zIn = (const char *)sqlite3_value_text(argv[0]);
-    lookup_vargs(context, zIn, &mmdb_cnt, GEOIP_FUNCTION_STATE);
+    }
+
+    geoip_stats_end(stats, start, lookup_vargs(context, argv[0], &db_cnt, GEOIP_FUNCTION_STATE, GEOIP_STAT_STATE));
 }
 
 /**
@@ -462,18 +695,21 @@ static void lookup_state(sqlite3_context *context, int argc, sqlite3_value **arg
  */
 static void lookup_tz(sqlite3_context *context, int argc, sqlite3_value **argv) { 
     assert(argc == 1);
-    const char *zIn;
+    geoip_stats_counters *stats = geoip_stats_local(GEOIP_STAT_TIMEZONE);
+    uint64_t start = geoip_stats_now();
 
     if (!initialized) {
         sqlite3_result_error(context, MSG_NOTINITIALIZED, -1);
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_ERROR);
         return;
     }
 
-    if (sqlite3_value_type(argv[0]) == SQLITE_NULL)
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_NOT_FOUND);
         return;
-    
-    zIn = (const char *)sqlite3_value_text(argv[0]);
-    lookup_vargs(context, zIn, &mmdb_cnt, GEOIP_FUNCTION_TIMEZONE);
+    }
+
+    geoip_stats_end(stats, start, lookup_vargs(context, argv[0], &db_cnt, GEOIP_FUNCTION_TIMEZONE, GEOIP_STAT_TIMEZONE));
 }
 
 /**
@@ -487,18 +723,21 @@ static void lookup_tz(sqlite3_context *context, int argc, sqlite3_value **argv)
  */
 static void lookup_zip(sqlite3_context *context, int argc, sqlite3_value **argv) {
     assert(argc == 1);
-    const char *zIn;
+    geoip_stats_counters *stats = geoip_stats_local(GEOIP_STAT_ZIPCODE);
+    uint64_t start = geoip_stats_now();
 
     if (!initialized) {
         sqlite3_result_error(context, MSG_NOTINITIALIZED, -1);
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_ERROR);
         return;
     }
 
-    if (sqlite3_value_type(argv[0]) == SQLITE_NULL)
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_NOT_FOUND);
         return;
-    
-    zIn = (const char *)sqlite3_value_text(argv[0]);
-    lookup_vargs(context, zIn, &mmdb_cnt, GEOIP_FUNCTION_ZIPCODE);
+    }
+
+    geoip_stats_end(stats, start, lookup_vargs(context, argv[0], &db_cnt, GEOIP_FUNCTION_ZIPCODE, GEOIP_STAT_ZIPCODE));
 }
 
 /**
@@ -512,18 +751,21 @@ static void lookup_zip(sqlite3_context *context, int argc, sqlite3_value **argv)
  */
 static void lookup_org(sqlite3_context *context, int argc, sqlite3_value **argv) { 
     assert(argc == 1);
-    const char *zIn;
+    geoip_stats_counters *stats = geoip_stats_local(GEOIP_STAT_ASN_OWNER);
+    uint64_t start = geoip_stats_now();
 
     if (!initialized) {
         sqlite3_result_error(context, MSG_NOTINITIALIZED, -1);
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_ERROR);
         return;
     }
 
-    if (sqlite3_value_type(argv[0]) == SQLITE_NULL)
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_NOT_FOUND);
         return;
-    
-    zIn = (const char *)sqlite3_value_text(argv[0]);
-    lookup_vargs(context, zIn, &mmdb_asn, GEOIP_FUNCTION_ASN_ORGANIZATION); 
+    }
+
+    geoip_stats_end(stats, start, lookup_vargs(context, argv[0], &db_asn, GEOIP_FUNCTION_ASN_ORGANIZATION, GEOIP_STAT_ASN_OWNER));
 }
 
 /**
@@ -537,18 +779,21 @@ static void lookup_org(sqlite3_context *context, int argc, sqlite3_value **argv)
  */
 static void lookup_asn(sqlite3_context *context, int argc, sqlite3_value **argv) { 
     assert(argc == 1);
-    const char *zIn;
+    geoip_stats_counters *stats = geoip_stats_local(GEOIP_STAT_ASN_NUMBER);
+    uint64_t start = geoip_stats_now();
 
     if (!initialized) {
         sqlite3_result_error(context, MSG_NOTINITIALIZED, -1);
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_ERROR);
         return;
     }
 
-    if (sqlite3_value_type(argv[0]) == SQLITE_NULL)
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_NOT_FOUND);
         return;
-    
-    zIn = (const char *)sqlite3_value_text(argv[0]);
-    lookup_vargs(context, zIn, &mmdb_asn, GEOIP_FUNCTION_ASN_NUMBER);
+    }
+
+    geoip_stats_end(stats, start, lookup_vargs(context, argv[0], &db_asn, GEOIP_FUNCTION_ASN_NUMBER, GEOIP_STAT_ASN_NUMBER));
 }
 
 /**
@@ -562,96 +807,1289 @@ static void lookup_asn(sqlite3_context *context, int argc, sqlite3_value **argv)
  */
 static void lookup_geoip(sqlite3_context *context, int argc, sqlite3_value **argv) {
     assert(argc == 1);
-    const char *zIn;
+    geoip_stats_counters *stats = geoip_stats_local(GEOIP_STAT_GEOIP);
+    uint64_t start = geoip_stats_now();
 
     if (!initialized) {
         sqlite3_result_error(context, MSG_NOTINITIALIZED, -1);
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_ERROR);
         return;
     }
 
-    if (sqlite3_value_type(argv[0]) == SQLITE_NULL)
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_NOT_FOUND);
         return;
-    
-    zIn = (const char *)sqlite3_value_text(argv[0]);
-    lookup_all(context, zIn);
+    }
+
+    geoip_stats_end(stats, start, lookup_all(context, argv[0]));
 }
 
 /**
- * The SQLite3 hooking function.
+ * Pack what both MMDB databases know about an address into a fixed-size fingerprint.
  * 
- * This function serves as the entrypoint for all SQLite3 extensions.
+ * This function handles the "geoip_pack" extension function. The GEOIP_PACK_SIZE byte BLOB holds the continent,
+ * country, ASN, city and subdivision of the address as integers, along with the build day of both databases, and the
+ * "geoip_unpack_*" functions read it back without any database. An address neither database knows returns NULL.
  * 
- * @param db        The current SQLite3 database context.
- * @param pzErrMsg  A useless function in this context, normally used to store extension startup error messages.
- * @param pApi      Used to set up the necessary SQLite3 API functions within the scope of this extension.
- * @return          An error code that SQLite will use to determine what went wrong (should be 0).
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (should be 1).
+ * @param argv          The address.
  */
-DLLFUNC int sqlite3_maxminddbext_init(sqlite3 *db, char **pzErrMsg, const sqlite3_api_routines *pApi) {
-    int rc = SQLITE_OK;
+static void lookup_pack(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    (void)argc;  /* Unused parameter */
+    geoip_stats_counters *stats = geoip_stats_local(GEOIP_STAT_PACK);
+    uint64_t start = geoip_stats_now();
 
-    SQLITE_EXTENSION_INIT2(pApi);
-    (void)pzErrMsg;  /* Unused parameter */
+    if (!initialized) {
+        sqlite3_result_error(context, MSG_NOTINITIALIZED, -1);
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_ERROR);
+        return;
+    }
 
-    rc = sqlite3_create_function(db, "geoip_asn_number", 1, SQLITE_UTF8, 0, lookup_asn, 0, 0);
-    if (rc != SQLITE_OK) return rc;
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_NOT_FOUND);
+        return;
+    }
 
-    rc = sqlite3_create_function(db, "geoip_asn_owner", 1, SQLITE_UTF8, 0, lookup_org, 0, 0);
-    if (rc != SQLITE_OK) return rc;
+    const char *zIn = geoip_value_text(argv[0]);
+    MMDB_lookup_result_s result_asn = {0};
+    MMDB_lookup_result_s result_cnt = {0};
+    geoip_addr addr;
+    int gai_error = geoip_value_address(argv[0], &addr);
+    int mmdb_error = MMDB_SUCCESS;
 
-    rc = sqlite3_create_function(db, "geoip_timezone", 1, SQLITE_UTF8, 0, lookup_tz, 0, 0);
-    if (rc != SQLITE_OK) return rc;
+    if (gai_error == 0)
+        mmdb_error = geoip_lookup(&db_asn, &addr, &result_asn, GEOIP_STAT_PACK);
+    if (gai_error == 0 && mmdb_error == MMDB_SUCCESS)
+        mmdb_error = geoip_lookup(&db_cnt, &addr, &result_cnt, GEOIP_STAT_PACK);
 
-    rc = sqlite3_create_function(db, "geoip_zipcode", 1, SQLITE_UTF8, 0, lookup_zip, 0, 0);
-    if (rc != SQLITE_OK) return rc;
+    if (gai_error != 0 || mmdb_error != MMDB_SUCCESS) {
+        geoip_stats_end(stats, start, lookup_failed(context, zIn, gai_error, mmdb_error, GEOIP_STAT_PACK));
+        return;
+    }
 
-    rc = sqlite3_create_function(db, "geoip_continent", 1, SQLITE_UTF8, 0, lookup_continent, 0, 0);
-    if (rc != SQLITE_OK) return rc;
+    if (!result_asn.found_entry && !result_cnt.found_entry) {
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_NOT_FOUND);
+        return;
+    }
 
-    rc = sqlite3_create_function(db, "geoip_country", 1, SQLITE_UTF8, 0, lookup_country, 0, 0);
-    if (rc != SQLITE_OK) return rc;
+    uint8_t blob[GEOIP_PACK_SIZE];
 
-    rc = sqlite3_create_function(db, "geoip_state", 1, SQLITE_UTF8, 0, lookup_state, 0, 0);
-    if (rc != SQLITE_OK) return rc;
+    GEOIP_TRACE_DECODE_START(GEOIP_STAT_PACK, result_cnt.entry.offset);
+    geoip_pack_encode(blob, &db_asn.mmdb, &result_asn, &db_cnt.mmdb, &result_cnt);
+    GEOIP_TRACE_DECODE_END(GEOIP_STAT_PACK, result_cnt.entry.offset, MMDB_SUCCESS);
 
-    rc = sqlite3_create_function(db, "geoip_city", 1, SQLITE_UTF8, 0, lookup_city, 0, 0);
-    if (rc != SQLITE_OK) return rc;
+    sqlite3_result_blob(context, blob, sizeof(blob), SQLITE_TRANSIENT);
+    geoip_stats_end(stats, start, GEOIP_OUTCOME_FOUND);
+}
 
-    rc = sqlite3_create_function(db, "geoip", 1, SQLITE_UTF8, 0, lookup_geoip, 0, 0);
-    if (rc != SQLITE_OK) return rc;
+/**
+ * Test whether the record of an address holds one of the values given as arguments.
+ * 
+ * The values are compiled into a geoip_set kept as auxiliary data of the statement. A row whose values are the ones
+ * the previous row used tests the address against the matching address ranges, built by one walk over the whole
+ * search tree the first time, so as long as the values are constants every row costs a binary search and no record is
+ * decoded. Values seen for the first time, which is every row when they change from row to row, are answered by a
+ * single lookup and a comparison instead, so the walk is never paid for a set used once.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (2 or more).
+ * @param argv          The address followed by the wanted values.
+ * @param kind          The GEOIP_SET_* value naming the compared field.
+ * @param function      The GEOIP_STAT_* value of the calling extension function.
+ * @return              A GEOIP_OUTCOME_* value describing the result.
+ */
+static int lookup_in(sqlite3_context *context, int argc, sqlite3_value **argv, int kind, int function) {
+    if (!initialized) {
+        sqlite3_result_error(context, MSG_NOTINITIALIZED, -1);
+        return GEOIP_OUTCOME_ERROR;
+    }
 
-    char HOME[PATH_MAX];
+    if (argc < 2) {
+        sqlite3_result_error(context, "Expected an address and at least one value to compare with", -1);
+        return GEOIP_OUTCOME_ERROR;
+    }
 
-    #ifdef _WIN32
-        if (_getcwd(HOME, sizeof(HOME)) == NULL) {
-            perror("_getcwd() error");
-            return rc;
+    geoip_set *set = sqlite3_get_auxdata(context, 1);
+    bool reused = set != NULL && geoip_set_same(set, argc - 1, argv + 1);
+    if (!reused) {
+        char *errmsg;
+
+        set = geoip_set_new(kind, argc - 1, argv + 1, &errmsg);
+        if (set == NULL) {
+            if (errmsg != NULL)
+                sqlite3_result_error(context, errmsg, -1);
+            else
+                sqlite3_result_error_nomem(context);
+
+            sqlite3_free(errmsg);
+            return GEOIP_OUTCOME_ERROR;
         }
-    #else
-        if (getcwd(HOME, PATH_MAX) == NULL) {
-            perror("getcwd() error");
-            return rc;
+
+        sqlite3_set_auxdata(context, 1, set, geoip_set_free);
+        if ((set = sqlite3_get_auxdata(context, 1)) == NULL) {
+            sqlite3_result_error_nomem(context);
+            return GEOIP_OUTCOME_ERROR;
         }
-    #endif
+    }
 
-    char GEOLITE2_ASN[PATH_MAX];
-    char GEOLITE2_CTY[PATH_MAX];
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL)
+        return GEOIP_OUTCOME_NOT_FOUND;
 
-    sprintf(GEOLITE2_ASN, "%s/GeoLite2-ASN.mmdb", HOME);
-    sprintf(GEOLITE2_CTY, "%s/GeoLite2-City.mmdb", HOME);
+    geoip_addr addr;
+    bool member;
+    int gai_error = geoip_value_address(argv[0], &addr);
+    int mmdb_error = MMDB_SUCCESS;
 
-    int status_asn = MMDB_open(GEOLITE2_ASN, MMDB_MODE_MMAP, &mmdb_asn);
-    int status_cnt = MMDB_open(GEOLITE2_CTY, MMDB_MODE_MMAP, &mmdb_cnt);
+    if (gai_error == 0)
+        mmdb_error = reused ? geoip_set_contains(set, &addr, &member) : geoip_set_lookup(set, &addr, function, &member);
 
-    if (status_asn != MMDB_SUCCESS)
-        fprintf(stderr, "Error (%d): %s on GeoLitev2 ASN MMDB\n", status_asn, MMDB_strerror(status_asn));
-    
-    if (status_cnt != MMDB_SUCCESS)
-        fprintf(stderr, "Error (%d): %s on GeoLitev2 City MMDB\n", status_cnt, MMDB_strerror(status_cnt));
+    if (gai_error != 0 || mmdb_error != MMDB_SUCCESS)
+        return lookup_failed(context, geoip_value_text(argv[0]), gai_error, mmdb_error, function);
 
-    if (status_asn != MMDB_SUCCESS || status_cnt != MMDB_SUCCESS) {} else {
-        initialized = true;
-        rc = SQLITE_OK;
-    }
+    sqlite3_result_int(context, member);
+    return member ? GEOIP_OUTCOME_FOUND : GEOIP_OUTCOME_NOT_FOUND;
+}
+
+/**
+ * Test an address against the GeoLite2-City MMDB database.
+ * 
+ * This function handles the "geoip_in_country" extension function. It returns 1 when the address is in one of the
+ * countries given by ISO 3166-1 code, as in geoip_in_country(ip, 'US', 'CA'), and 0 otherwise.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (2 or more).
+ * @param argv          The address followed by the values to compare with.
+ */
+static void lookup_in_country(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    geoip_stats_counters *stats = geoip_stats_local(GEOIP_STAT_IN_COUNTRY);
+    uint64_t start = geoip_stats_now();
+
+    geoip_stats_end(stats, start, lookup_in(context, argc, argv, GEOIP_SET_COUNTRY, GEOIP_STAT_IN_COUNTRY));
+}
+
+/**
+ * Test an address against the GeoLite2-ASN MMDB database.
+ * 
+ * This function handles the "geoip_in_asn" extension function. It returns 1 when the address belongs to one of the
+ * autonomous systems given, as in geoip_in_asn(ip, 13335, 'AS15169'), and 0 otherwise.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (2 or more).
+ * @param argv          The address followed by the values to compare with.
+ */
+static void lookup_in_asn(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    geoip_stats_counters *stats = geoip_stats_local(GEOIP_STAT_IN_ASN);
+    uint64_t start = geoip_stats_now();
+
+    geoip_stats_end(stats, start, lookup_in(context, argc, argv, GEOIP_SET_ASN, GEOIP_STAT_IN_ASN));
+}
+
+/**
+ * Test an address against the GeoLite2-City MMDB database.
+ * 
+ * This function handles the "geoip_in_continent" extension function. It returns 1 when the address is on one of the
+ * continents given by code, as in geoip_in_continent(ip, 'EU'), and 0 otherwise.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (2 or more).
+ * @param argv          The address followed by the values to compare with.
+ */
+static void lookup_in_continent(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    geoip_stats_counters *stats = geoip_stats_local(GEOIP_STAT_IN_CONTINENT);
+    uint64_t start = geoip_stats_now();
+
+    geoip_stats_end(stats, start, lookup_in(context, argc, argv, GEOIP_SET_CONTINENT, GEOIP_STAT_IN_CONTINENT));
+}
+
+/**
+ * Return the full record of an address as JSON.
+ * 
+ * This function handles the "geoip_json" extension function. The record is looked up in the City database, or in the
+ * database named by the second argument ('asn', 'city' or an alias), and serialized straight from the data section with every
+ * field it holds. The JSON of recently returned records is kept per connection, keyed by record, so addresses sharing
+ * a record are only serialized once.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (1 or 2).
+ * @param argv          The address and optionally the name of the database.
+ */
+static void lookup_json(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    geoip_stats_counters *stats = geoip_stats_local(GEOIP_STAT_JSON);
+    geoip_conn *conn = sqlite3_user_data(context);
+    uint64_t start = geoip_stats_now();
+    geoip_db *db = &db_cnt;
+
+    if (!initialized) {
+        sqlite3_result_error(context, MSG_NOTINITIALIZED, -1);
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_ERROR);
+        return;
+    }
+
+    if (argc == 2 && (db = geoip_db_find((const char *)sqlite3_value_text(argv[1]))) == NULL) {
+        sqlite3_result_error(context, MSG_UNKNOWNDB, -1);
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_ERROR);
+        return;
+    }
+
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_NOT_FOUND);
+        return;
+    }
+
+    const char *zIn = geoip_value_text(argv[0]);
+    MMDB_lookup_result_s result = {0};
+    geoip_addr addr;
+    int gai_error = geoip_value_address(argv[0], &addr);
+    int mmdb_error = gai_error == 0 ? geoip_lookup(db, &addr, &result, GEOIP_STAT_JSON) : MMDB_SUCCESS;
+
+    if (gai_error != 0 || mmdb_error != MMDB_SUCCESS) {
+        geoip_stats_end(stats, start, lookup_failed(context, zIn, gai_error, mmdb_error, GEOIP_STAT_JSON));
+        return;
+    }
+
+    if (!result.found_entry) {
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_NOT_FOUND);
+        return;
+    }
+
+    const char *json;
+    int length;
+
+    GEOIP_TRACE_DECODE_START(GEOIP_STAT_JSON, result.entry.offset);
+    int status = geoip_json_record(&conn->json, &db->mmdb, result.entry.offset, &json, &length);
+    GEOIP_TRACE_DECODE_END(GEOIP_STAT_JSON, result.entry.offset, status);
+
+    if (status != MMDB_SUCCESS) {
+        check_lookup(context, zIn, 0, status);
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_ERROR);
+        return;
+    }
+
+    sqlite3_result_text(context, json, length, SQLITE_TRANSIENT);
+    sqlite3_result_subtype(context, GEOIP_JSON_SUBTYPE);
+    geoip_stats_end(stats, start, GEOIP_OUTCOME_FOUND);
+}
+
+/**
+ * Return the id of the record an address maps to.
+ * 
+ * This function handles the "geoip_record_id" extension function. The id is the offset of the record in the data
+ * section of the City database, or of the database named by the second argument, so it is stable for a given build of
+ * the database and every network sharing a record shares its id. The geoip_records virtual table decodes the record
+ * behind an id.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (1 or 2).
+ * @param argv          The address and optionally the name of the database.
+ */
+static void lookup_record_id(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    geoip_stats_counters *stats = geoip_stats_local(GEOIP_STAT_RECORD_ID);
+    uint64_t start = geoip_stats_now();
+    geoip_db *db = &db_cnt;
+
+    if (!initialized) {
+        sqlite3_result_error(context, MSG_NOTINITIALIZED, -1);
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_ERROR);
+        return;
+    }
+
+    if (argc == 2 && (db = geoip_db_find((const char *)sqlite3_value_text(argv[1]))) == NULL) {
+        sqlite3_result_error(context, MSG_UNKNOWNDB, -1);
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_ERROR);
+        return;
+    }
+
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_NOT_FOUND);
+        return;
+    }
+
+    const char *zIn = geoip_value_text(argv[0]);
+    MMDB_lookup_result_s result = {0};
+    geoip_addr addr;
+    int gai_error = geoip_value_address(argv[0], &addr);
+    int mmdb_error = gai_error == 0 ? geoip_lookup(db, &addr, &result, GEOIP_STAT_RECORD_ID) : MMDB_SUCCESS;
+
+    if (gai_error != 0 || mmdb_error != MMDB_SUCCESS) {
+        geoip_stats_end(stats, start, lookup_failed(context, zIn, gai_error, mmdb_error, GEOIP_STAT_RECORD_ID));
+        return;
+    }
+
+    if (!result.found_entry) {
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_NOT_FOUND);
+        return;
+    }
+
+    sqlite3_result_int64(context, result.entry.offset);
+    geoip_stats_end(stats, start, GEOIP_OUTCOME_FOUND);
+}
+
+/**
+ * Look up one part of the location of an address.
+ * 
+ * The record is looked up in the City database, or in the database named by the second argument ('asn', 'city' or an
+ * alias), and the field is returned with its own type instead of as text.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (1 or 2).
+ * @param argv          The address and optionally the name of the database.
+ * @param functype      GEOIP_FUNCTION_LATITUDE, GEOIP_FUNCTION_LONGITUDE or GEOIP_FUNCTION_ACCURACY_RADIUS.
+ * @param function      The GEOIP_STAT_* value of the calling extension function.
+ * @return              A GEOIP_OUTCOME_* value describing the result.
+ */
+static int lookup_location(sqlite3_context *context, int argc, sqlite3_value **argv, int functype, int function) {
+    geoip_db *db = &db_cnt;
+
+    if (!initialized) {
+        sqlite3_result_error(context, MSG_NOTINITIALIZED, -1);
+        return GEOIP_OUTCOME_ERROR;
+    }
+
+    if (argc == 2 && (db = geoip_db_find((const char *)sqlite3_value_text(argv[1]))) == NULL) {
+        sqlite3_result_error(context, MSG_UNKNOWNDB, -1);
+        return GEOIP_OUTCOME_ERROR;
+    }
+
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL)
+        return GEOIP_OUTCOME_NOT_FOUND;
+
+    return lookup_vargs(context, argv[0], db, functype, function);
+}
+
+/**
+ * Return the latitude of an address.
+ * 
+ * This function handles the "geoip_latitude" extension function, the latitude of the record in degrees as a REAL.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (1 or 2).
+ * @param argv          The address and optionally the name of the database.
+ */
+static void lookup_latitude(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    geoip_stats_counters *stats = geoip_stats_local(GEOIP_STAT_LATITUDE);
+    uint64_t start = geoip_stats_now();
+
+    geoip_stats_end(stats, start, lookup_location(context, argc, argv, GEOIP_FUNCTION_LATITUDE, GEOIP_STAT_LATITUDE));
+}
+
+/**
+ * Return the longitude of an address.
+ * 
+ * This function handles the "geoip_longitude" extension function, the longitude of the record in degrees as a REAL.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (1 or 2).
+ * @param argv          The address and optionally the name of the database.
+ */
+static void lookup_longitude(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    geoip_stats_counters *stats = geoip_stats_local(GEOIP_STAT_LONGITUDE);
+    uint64_t start = geoip_stats_now();
+
+    geoip_stats_end(stats, start, lookup_location(context, argc, argv, GEOIP_FUNCTION_LONGITUDE, GEOIP_STAT_LONGITUDE));
+}
+
+/**
+ * Return how precise the location of an address is.
+ * 
+ * This function handles the "geoip_accuracy_radius" extension function, the radius in kilometres around the
+ * coordinates of the record the address is likely to be in, as an INTEGER.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (1 or 2).
+ * @param argv          The address and optionally the name of the database.
+ */
+static void lookup_accuracy_radius(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    geoip_stats_counters *stats = geoip_stats_local(GEOIP_STAT_ACCURACY_RADIUS);
+    uint64_t start = geoip_stats_now();
+
+    geoip_stats_end(stats, start, lookup_location(context, argc, argv, GEOIP_FUNCTION_ACCURACY_RADIUS, GEOIP_STAT_ACCURACY_RADIUS));
+}
+
+/**
+ * Return one field of the record of an address in any registered database.
+ * 
+ * This function handles the "geoip_get" extension function. The path walks maps by key and arrays by index, separated
+ * by dots as in 'subdivisions.0.iso_code'. Strings come back as text, numbers as integers or reals, booleans as 0 or
+ * 1, bytes as a blob, 128-bit integers as hexadecimal text and maps or arrays as JSON. Without a path, or with an empty
+ * one, the whole record is returned as JSON. A missing field is NULL.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (2 or 3).
+ * @param argv          The address, the alias of the database and optionally the path.
+ */
+static void lookup_get(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    geoip_stats_counters *stats = geoip_stats_local(GEOIP_STAT_GET);
+    geoip_conn *conn = sqlite3_user_data(context);
+    uint64_t start = geoip_stats_now();
+    const char *segments[GEOIP_PATH_MAX + 1];
+    char path[256];
+    int nsegments = 0;
+    geoip_db *db;
+
+    if (!initialized) {
+        sqlite3_result_error(context, MSG_NOTINITIALIZED, -1);
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_ERROR);
+        return;
+    }
+
+    if ((db = geoip_db_find((const char *)sqlite3_value_text(argv[1]))) == NULL) {
+        sqlite3_result_error(context, MSG_UNKNOWNDB, -1);
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_ERROR);
+        return;
+    }
+
+    if (argc == 3 && sqlite3_value_type(argv[2]) != SQLITE_NULL) {
+        if (sqlite3_value_bytes(argv[2]) >= (int)sizeof(path)) {
+            sqlite3_result_error(context, "The path is too long", -1);
+            geoip_stats_end(stats, start, GEOIP_OUTCOME_ERROR);
+            return;
+        }
+
+        strcpy(path, (const char *)sqlite3_value_text(argv[2]));
+        for (char *segment = path; *segment != '\0'; ) {
+            if (nsegments == GEOIP_PATH_MAX) {
+                sqlite3_result_error(context, "The path has too many components", -1);
+                geoip_stats_end(stats, start, GEOIP_OUTCOME_ERROR);
+                return;
+            }
+
+            segments[nsegments++] = segment;
+            segment = strchr(segment, '.');
+            if (segment == NULL)
+                break;
+
+            *segment++ = '\0';
+        }
+    }
+    segments[nsegments] = NULL;
+
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_NOT_FOUND);
+        return;
+    }
+
+    const char *zIn = geoip_value_text(argv[0]);
+    MMDB_lookup_result_s result = {0};
+    geoip_addr addr;
+    int gai_error = geoip_value_address(argv[0], &addr);
+    int mmdb_error = gai_error == 0 ? geoip_lookup(db, &addr, &result, GEOIP_STAT_GET) : MMDB_SUCCESS;
+
+    if (gai_error != 0 || mmdb_error != MMDB_SUCCESS) {
+        geoip_stats_end(stats, start, lookup_failed(context, zIn, gai_error, mmdb_error, GEOIP_STAT_GET));
+        return;
+    }
+
+    if (!result.found_entry) {
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_NOT_FOUND);
+        return;
+    }
+
+    MMDB_entry_data_s entry_data = { .has_data = true, .offset = result.entry.offset, .type = MMDB_DATA_TYPE_MAP };
+    int status = MMDB_SUCCESS;
+
+    GEOIP_TRACE_DECODE_START(GEOIP_STAT_GET, result.entry.offset);
+    if (nsegments > 0)
+        status = MMDB_aget_value(&result.entry, &entry_data, segments);
+    GEOIP_TRACE_DECODE_END(GEOIP_STAT_GET, result.entry.offset, status);
+
+    if (status == MMDB_LOOKUP_PATH_DOES_NOT_MATCH_DATA_ERROR || (status == MMDB_SUCCESS && !entry_data.has_data)) {
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_NOT_FOUND);
+        return;
+    }
+
+    if (status == MMDB_SUCCESS) {
+        switch (entry_data.type) {
+        case MMDB_DATA_TYPE_UTF8_STRING:
+            sqlite3_result_text(context, entry_data.utf8_string, entry_data.data_size, SQLITE_TRANSIENT);
+            break;
+        case MMDB_DATA_TYPE_BYTES:
+            sqlite3_result_blob(context, entry_data.bytes, entry_data.data_size, SQLITE_TRANSIENT);
+            break;
+        case MMDB_DATA_TYPE_DOUBLE:
+            sqlite3_result_double(context, entry_data.double_value);
+            break;
+        case MMDB_DATA_TYPE_FLOAT:
+            sqlite3_result_double(context, entry_data.float_value);
+            break;
+        case MMDB_DATA_TYPE_UINT16:
+            sqlite3_result_int(context, entry_data.uint16);
+            break;
+        case MMDB_DATA_TYPE_UINT32:
+            sqlite3_result_int64(context, entry_data.uint32);
+            break;
+        case MMDB_DATA_TYPE_INT32:
+            sqlite3_result_int(context, entry_data.int32);
+            break;
+        case MMDB_DATA_TYPE_UINT64:
+            if (entry_data.uint64 <= INT64_MAX) {
+                sqlite3_result_int64(context, (sqlite3_int64)entry_data.uint64);
+            } else {
+                char number[24];
+                int length = snprintf(number, sizeof(number), "%llu", (unsigned long long)entry_data.uint64);
+
+                sqlite3_result_text(context, number, length, SQLITE_TRANSIENT);
+            }
+            break;
+        case MMDB_DATA_TYPE_BOOLEAN:
+            sqlite3_result_int(context, entry_data.boolean);
+            break;
+        default: {
+            /* Maps, arrays and 128-bit integers are written out the way "geoip_json" writes them. */
+            const char *json;
+            int length;
+
+            status = geoip_json_record(&conn->json, &db->mmdb, entry_data.offset, &json, &length);
+            if (status != MMDB_SUCCESS)
+                break;
+
+            if (entry_data.type == MMDB_DATA_TYPE_UINT128) {
+                sqlite3_result_text(context, json + 1, length - 2, SQLITE_TRANSIENT);
+            } else {
+                sqlite3_result_text(context, json, length, SQLITE_TRANSIENT);
+                sqlite3_result_subtype(context, GEOIP_JSON_SUBTYPE);
+            }
+            break;
+        }
+        }
+    }
+
+    if (status != MMDB_SUCCESS) {
+        check_lookup(context, zIn, 0, status);
+        geoip_stats_end(stats, start, GEOIP_OUTCOME_ERROR);
+        return;
+    }
+
+    geoip_stats_end(stats, start, GEOIP_OUTCOME_FOUND);
+}
+
+/**
+ * Explain the lookup of an address in one database.
+ * 
+ * The lookup goes through geoip_lookup() exactly like the other extension functions, the cache outcome is read back
+ * from the thread's "geoip_explain" counters. A lookup answered by the cache or rejected as non-public reports no node
+ * visited, since no walk took place. Every field the database serves is then decoded and formatted the way the
+ * single-field functions do it.
+ * 
+ * @param str       The JSON document being built.
+ * @param db        The database to search.
+ * @param addr      The parsed address.
+ * @param fields    The GEOIP_FUNCTION_* values of the fields served by the database.
+ * @param nfields   The number of fields.
+ */
+static void explain_database(sqlite3_str *str, geoip_db *db, const geoip_addr *addr, const int *fields, int nfields) {
+    geoip_stats_counters *stats = geoip_stats_local(GEOIP_STAT_EXPLAIN);
+    uint64_t hits = atomic_load_explicit(&stats->cache_hits, memory_order_relaxed);
+    uint64_t reserved = atomic_load_explicit(&stats->reserved, memory_order_relaxed);
+    MMDB_lookup_result_s result = {0};
+
+    uint64_t start = geoip_stats_now();
+    int mmdb_error = geoip_lookup(db, addr, &result, GEOIP_STAT_EXPLAIN);
+    uint64_t lookup_ns = geoip_stats_now() - start;
+    bool cache_hit = atomic_load_explicit(&stats->cache_hits, memory_order_relaxed) != hits;
+    bool rejected = atomic_load_explicit(&stats->reserved, memory_order_relaxed) != reserved;
+
+    sqlite3_str_appendf(str, "{\"database\":");
+    geoip_json_append_string(str, db->name, strlen(db->name));
+
+    if (mmdb_error != MMDB_SUCCESS) {
+        sqlite3_str_appendf(str, ",\"error\":");
+        geoip_json_append_string(str, MMDB_strerror(mmdb_error), strlen(MMDB_strerror(mmdb_error)));
+        sqlite3_str_appendf(str, ",\"lookup_ns\":%llu}", (unsigned long long)lookup_ns);
+        return;
+    }
+
+    int prefix_length = result.netmask;
+    if (addr->family == AF_INET && db->mmdb.metadata.ip_version == 6)
+        prefix_length = result.netmask > 96 ? result.netmask - 96 : 0;
+
+    int nodes_visited = rejected || cache_hit ? 0 : lookup_depth(db, addr, &result);
+    sqlite3_str_appendf(str, ",\"found\":%s,\"prefix_length\":%d,\"netmask\":%d,\"nodes_visited\":%d,\"cache_hit\":%s,\"lookup_ns\":%llu",
+        result.found_entry ? "true" : "false", prefix_length, result.netmask, nodes_visited,
+        cache_hit ? "true" : "false", (unsigned long long)lookup_ns);
+
+    if (!result.found_entry) {
+        sqlite3_str_appendchar(str, 1, '}');
+        return;
+    }
+
+    uint32_t span_start = result.entry.offset;
+    uint32_t span_end = result.entry.offset;
+    uint64_t data_bytes = 0, decode_ns = 0, marshal_ns = 0;
+
+    sqlite3_str_appendf(str, ",\"record_offset\":%u,\"fields\":[", result.entry.offset);
+
+    for (int i = 0; i < nfields; i++) {
+        MMDB_entry_data_s entry_data;
+        char zOut[4096];
+
+        start = geoip_stats_now();
+        int status = MMDB_aget_value(&result.entry, &entry_data, lookup_paths[fields[i]]);
+        uint64_t field_decode_ns = geoip_stats_now() - start;
+
+        start = geoip_stats_now();
+        const char *value = get_data(NULL, status, zOut, entry_data);
+        uint64_t field_marshal_ns = geoip_stats_now() - start;
+
+        decode_ns += field_decode_ns;
+        marshal_ns += field_marshal_ns;
+
+        sqlite3_str_appendf(str, "%s{\"field\":\"%s\",\"decoded\":%s", i == 0 ? "" : ",", lookup_names[fields[i]],
+            status == MMDB_SUCCESS && entry_data.has_data ? "true" : "false");
+
+        if (status == MMDB_SUCCESS && entry_data.has_data) {
+            uint32_t bytes = entry_data.offset_to_next > entry_data.offset ? entry_data.offset_to_next - entry_data.offset : 0;
+
+            data_bytes += bytes;
+            if (entry_data.offset < span_start)
+                span_start = entry_data.offset;
+            if (entry_data.offset_to_next > span_end)
+                span_end = entry_data.offset_to_next;
+
+            sqlite3_str_appendf(str, ",\"type\":\"%s\",\"offset\":%u,\"bytes\":%u,\"value\":",
+                MMDB_get_typestr(entry_data.type), entry_data.offset, bytes);
+            geoip_json_append_string(str, value, strlen(value));
+        } else if (status != MMDB_SUCCESS) {
+            sqlite3_str_appendf(str, ",\"error\":");
+            geoip_json_append_string(str, MMDB_strerror(status), strlen(MMDB_strerror(status)));
+        }
+
+        sqlite3_str_appendf(str, ",\"decode_ns\":%llu,\"marshal_ns\":%llu}",
+            (unsigned long long)field_decode_ns, (unsigned long long)field_marshal_ns);
+    }
+
+    sqlite3_str_appendf(str, "],\"data_bytes\":%llu,\"data_span\":%u,\"decode_ns\":%llu,\"marshal_ns\":%llu}",
+        (unsigned long long)data_bytes, span_end - span_start, (unsigned long long)decode_ns, (unsigned long long)marshal_ns);
+}
+
+/**
+ * Explain how an address is looked up in both MMDB databases.
+ * 
+ * This function handles the "geoip_explain" extension function and returns a JSON object describing the prefix that
+ * matched, the number of search tree nodes visited, whether the lookup cache answered, the fields decoded along with
+ * the data section bytes they occupy, and the time spent in every stage in nanoseconds.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (should be 1).
+ * @param argv          The contents of the arguments passed to the SQLite function.
+ */
+static void lookup_explain(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    assert(argc == 1);
+    static const int asn_fields[] = { GEOIP_FUNCTION_ASN_NUMBER, GEOIP_FUNCTION_ASN_ORGANIZATION };
+    static const int cnt_fields[] = {
+        GEOIP_FUNCTION_CONTINENT, GEOIP_FUNCTION_COUNTRY, GEOIP_FUNCTION_STATE,
+        GEOIP_FUNCTION_CITY, GEOIP_FUNCTION_ZIPCODE, GEOIP_FUNCTION_TIMEZONE
+    };
+    geoip_stats_counters *stats = geoip_stats_local(GEOIP_STAT_EXPLAIN);
+    uint64_t total = geoip_stats_now();
+    const char *zIn;
+
+    if (!initialized) {
+        sqlite3_result_error(context, MSG_NOTINITIALIZED, -1);
+        geoip_stats_end(stats, total, GEOIP_OUTCOME_ERROR);
+        return;
+    }
+
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        geoip_stats_end(stats, total, GEOIP_OUTCOME_NOT_FOUND);
+        return;
+    }
+
+    zIn = geoip_value_text(argv[0]);
+
+    geoip_addr addr;
+    uint64_t start = geoip_stats_now();
+    int gai_error = geoip_value_address(argv[0], &addr);
+    uint64_t parse_ns = geoip_stats_now() - start;
+
+    if (check_lookup(context, zIn, gai_error, MMDB_SUCCESS)) {
+        geoip_stats_end(stats, total, GEOIP_OUTCOME_ERROR);
+        return;
+    }
+
+    /* BLOB and integer input is reported the way it would have been written as text. */
+    char text[GEOIP_IP_TEXT];
+    if (sqlite3_value_type(argv[0]) != SQLITE_TEXT && geoip_format_address(&addr, text, sizeof(text)) >= 0)
+        zIn = text;
+
+    sqlite3_str *str = sqlite3_str_new(sqlite3_context_db_handle(context));
+
+    sqlite3_str_appendf(str, "{\"ip\":");
+    geoip_json_append_string(str, zIn, strlen(zIn));
+    sqlite3_str_appendf(str, ",\"family\":%d,\"class\":\"%s\",\"parse_ns\":%llu,\"databases\":[",
+        addr.family == AF_INET ? 4 : 6, geoip_class_name(geoip_class_of(&addr, NULL)), (unsigned long long)parse_ns);
+
+    explain_database(str, &db_asn, &addr, asn_fields, sizeof(asn_fields) / sizeof(asn_fields[0]));
+    sqlite3_str_appendchar(str, 1, ',');
+    explain_database(str, &db_cnt, &addr, cnt_fields, sizeof(cnt_fields) / sizeof(cnt_fields[0]));
+
+    sqlite3_str_appendf(str, "],\"total_ns\":%llu}", (unsigned long long)(geoip_stats_now() - total));
+
+    if (sqlite3_str_errcode(str) != SQLITE_OK) {
+        sqlite3_free(sqlite3_str_finish(str));
+        sqlite3_result_error_nomem(context);
+        geoip_stats_end(stats, total, GEOIP_OUTCOME_ERROR);
+        return;
+    }
+
+    int length = sqlite3_str_length(str);
+    sqlite3_result_text(context, sqlite3_str_finish(str), length, sqlite3_free);
+    sqlite3_result_subtype(context, GEOIP_JSON_SUBTYPE);
+    geoip_stats_end(stats, total, GEOIP_OUTCOME_FOUND);
+}
+
+/**
+ * Find the warm-start file of a database.
+ * 
+ * The file sits next to the MMDB file and is named after the alias, so aliases of the same file keep caches of their
+ * own. The alias is lowercased like the lookups compare it, and characters that do not belong in a file name are
+ * replaced with '_'.
+ * 
+ * @param db        The database.
+ * @param path      Receives the location of the warm-start file.
+ * @param size      The size of path.
+ * @return          0 on success, or -1 when the location does not fit.
+ */
+static int warm_path(const geoip_db *db, char *path, size_t size) {
+    const char *slash = strrchr(db->path, '/');
+    char name[GEOIP_ALIAS_MAX];
+    size_t i;
+
+    #ifdef _WIN32
+        const char *backslash = strrchr(db->path, '\\');
+        if (backslash != NULL && (slash == NULL || backslash > slash))
+            slash = backslash;
+    #endif
+
+    for (i = 0; db->alias[i] != '\0' && i < sizeof(name) - 1; i++) {
+        const unsigned char c = (unsigned char)db->alias[i];
+        name[i] = isalnum(c) || c == '-' || c == '_' ? (char)tolower(c) : '_';
+    }
+    name[i] = '\0';
+
+    const int directory = slash != NULL ? (int)(slash - db->path + 1) : 0;
+    const int length = snprintf(path, size, "%.*s%s%s", directory, db->path, name, GEOIP_WARM_SUFFIX);
+    return length >= 0 && (size_t)length < size ? 0 : -1;
+}
+
+/**
+ * Open an MMDB file and prepare its lookup cache.
+ * 
+ * When the open mode asks for it lookups are pointed at an in-memory copy of the file or a relayout of its search tree,
+ * and the search tree walks matching the final layout are picked. A warm-start file written for the same database build
+ * is attached to the cache when one exists for the alias next to the MMDB file.
+ * 
+ * @param db        The database to open, its path has been filled in by sqlite3_maxminddbext_init().
+ * @return          MMDB_SUCCESS or a libmaxminddb error code.
+ */
+static int open_database(geoip_db *db) {
+    int status = MMDB_open(db->path, MMDB_MODE_MMAP, &db->mmdb);
+    GEOIP_TRACE_DB_RELOAD(db->name, status);
+
+    if (status != MMDB_SUCCESS) {
+        fprintf(stderr, "Error (%d): %s on %s MMDB\n", status, MMDB_strerror(status), db->name);
+        return status;
+    }
+
+    /* A copy is only an optimization, lookups keep reading the file mapping when it cannot be made. */
+    if (geoip_mmap_copy(&db->map, &db->mmdb) != 0)
+        fprintf(stderr, "Warning: unable to copy the %s MMDB into memory, using the file mapping\n", db->name);
+
+    if (db->map.open_mode == GEOIP_OPEN_BLOCKED && geoip_tree_build(&db->tree, &db->mmdb) != 0)
+        fprintf(stderr, "Warning: unable to relay out the search tree of the %s MMDB, using the file mapping\n", db->name);
+
+    geoip_tree_select(db);
+
+    if (geoip_cache_init(&db->cache, db->cache_slots != 0 ? db->cache_slots : GEOIP_CACHE_SLOTS) != 0) {
+        geoip_tree_free(&db->tree);
+        geoip_mmap_release(&db->map, &db->mmdb);
+        MMDB_close(&db->mmdb);
+        fprintf(stderr, "Error: unable to allocate the lookup cache for the %s MMDB\n", db->name);
+        return MMDB_OUT_OF_MEMORY_ERROR;
+    }
+
+    char warmpath[PATH_MAX];
+    if (warm_path(db, warmpath, sizeof(warmpath)) == 0)
+        geoip_cache_load(&db->cache, warmpath, &db->mmdb);
+
+    geoip_mmap_opened(db);
+    return MMDB_SUCCESS;
+}
+
+/**
+ * Release everything opening a database acquired.
+ * 
+ * Nothing may be using the database any more. Must be called with the SQLITE_MUTEX_STATIC_APP1 mutex held.
+ * 
+ * @param db        The database to close, which may not have been opened.
+ */
+void geoip_db_release(geoip_db *db) {
+    geoip_mmap_stop(&db->map);
+
+    if (atomic_load_explicit(&db->state, memory_order_acquire) != GEOIP_DB_OPEN)
+        return;
+
+    geoip_cache_free(&db->cache);
+    geoip_tree_free(&db->tree);
+    geoip_index_release(db);
+    geoip_geo_release(db);
+    geoip_mmap_release(&db->map, &db->mmdb);
+    MMDB_close(&db->mmdb);
+    atomic_store_explicit(&db->state, GEOIP_DB_CLOSED, memory_order_release);
+}
+
+/**
+ * Make sure a database is open.
+ * 
+ * The first caller opens the file, exactly once for the lifetime of the process, while everybody racing it waits on
+ * the SQLITE_MUTEX_STATIC_APP1 mutex. Once the outcome is known it is read with a single acquire load, so the lookup
+ * path never takes the mutex. A failed open is not retried, every later call reports the same error.
+ * 
+ * @param db        The database to open.
+ * @return          MMDB_SUCCESS or the libmaxminddb error code of opening the file.
+ */
+int geoip_db_acquire(geoip_db *db) {
+    int state = atomic_load_explicit(&db->state, memory_order_acquire);
+
+    if (state == GEOIP_DB_OPEN)
+        return MMDB_SUCCESS;
+
+    if (state == GEOIP_DB_CLOSED) {
+        sqlite3_mutex *mutex = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP1);
+        sqlite3_mutex_enter(mutex);
+
+        if (atomic_load_explicit(&db->state, memory_order_relaxed) == GEOIP_DB_CLOSED) {
+            db->status = open_database(db);
+            atomic_store_explicit(&db->state, db->status == MMDB_SUCCESS ? GEOIP_DB_OPEN : GEOIP_DB_FAILED, memory_order_release);
+        }
+
+        sqlite3_mutex_leave(mutex);
+        state = atomic_load_explicit(&db->state, memory_order_acquire);
+    }
+
+    return state == GEOIP_DB_OPEN ? MMDB_SUCCESS : db->status;
+}
+
+/**
+ * A lookup cache on its way to its warm-start file.
+ */
+typedef struct warm_save {
+    char path[PATH_MAX];          /**< The location of the warm-start file. */
+    geoip_warm_snapshot snapshot; /**< The content of the file. */
+} warm_save;
+
+/**
+ * Copy the lookup caches of the open databases.
+ * 
+ * Must be called with the SQLITE_MUTEX_STATIC_APP1 mutex held. The copies are written by write_caches() once it is
+ * released, so the file I/O never holds up a lookup opening a database.
+ * 
+ * @param saves     Receives up to GEOIP_DB_MAX caches.
+ * @param all       Whether to copy the cache of every open database, or only of those opened with warm_start=1.
+ * @param failed    Set when a cache could not be copied.
+ * @return          The number of caches copied.
+ */
+static int snapshot_caches(warm_save *saves, bool all, bool *failed) {
+    int count = 0;
+
+    for (int i = 0; i < GEOIP_DB_MAX; i++) {
+        geoip_db *db = geoip_db_at(i);
+
+        if (db == NULL || atomic_load_explicit(&db->state, memory_order_acquire) != GEOIP_DB_OPEN ||
+            !(all || atomic_load_explicit(&db->warm_start, memory_order_relaxed)))
+            continue;
+
+        warm_save *save = &saves[count];
+        if (warm_path(db, save->path, sizeof(save->path)) != 0 ||
+            geoip_cache_snapshot(&db->cache, &db->mmdb, &save->snapshot) != 0) {
+            *failed = true;
+            continue;
+        }
+
+        count++;
+    }
+
+    return count;
+}
+
+/**
+ * Write the caches snapshot_caches() copied to their warm-start files.
+ * 
+ * Writers are serialized on the SQLITE_MUTEX_STATIC_APP3 mutex, as two of them may save the same database.
+ * 
+ * @param saves     The copied caches, their entries are released.
+ * @param count     The number of copied caches.
+ * @param failed    Set when a file could not be written.
+ * @return          The number of entries written.
+ */
+static sqlite3_int64 write_caches(warm_save *saves, int count, bool *failed) {
+    sqlite3_mutex *mutex = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP3);
+    sqlite3_int64 saved = 0;
+
+    sqlite3_mutex_enter(mutex);
+
+    for (int i = 0; i < count; i++) {
+        int written = geoip_cache_write(&saves[i].snapshot, saves[i].path);
+
+        if (written < 0)
+            *failed = true;
+        else
+            saved += written;
+    }
+
+    sqlite3_mutex_leave(mutex);
+    return saved;
+}
+
+/**
+ * Track a connection closing.
+ * 
+ * This is registered as the destructor of the "geoip" function, once the last connection using the extension closes
+ * any warmup thread is stopped, since the library may be unloaded next, the lookup caches of the databases opened with
+ * warm_start=1 are written to their warm-start files and the databases closed by "geoip_close" are released. The
+ * per-connection state every lookup function shares is freed as well.
+ * 
+ * @param pUserData The geoip_conn of the connection.
+ */
+static void connection_closed(void *pUserData) {
+    geoip_conn *conn = pUserData;
+
+    geoip_json_cache_clear(&conn->json);
+    sqlite3_free(conn);
+
+    sqlite3_mutex *mutex = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP1);
+    warm_save *saves = NULL;
+    int count = 0;
+    bool failed = false;
+
+    sqlite3_mutex_enter(mutex);
+
+    if (--connections == 0 && initialized) {
+        for (int i = 0; i < GEOIP_DB_MAX; i++) {
+            geoip_db *db = geoip_db_at(i);
+
+            if (db != NULL)
+                geoip_mmap_stop(&db->map);
+        }
+
+        /* Saving is best effort, a cache that cannot be copied is simply not saved. */
+        saves = sqlite3_malloc(GEOIP_DB_MAX * sizeof(warm_save));
+        if (saves != NULL)
+            count = snapshot_caches(saves, false, &failed);
+
+        geoip_registry_release();
+    }
+
+    sqlite3_mutex_leave(mutex);
+
+    if (saves != NULL) {
+        write_caches(saves, count, &failed);
+        sqlite3_free(saves);
+    }
+}
+
+static const char *const policy_names[GEOIP_POLICY_COUNT] = {
+    [GEOIP_POLICY_STRICT]   = "strict",
+    [GEOIP_POLICY_NULL]     = "null",
+    [GEOIP_POLICY_SENTINEL] = "sentinel"
+};
+
+/**
+ * Change what the lookup functions of this connection return for input that is not an address.
+ * 
+ * This function handles the "geoip_error_policy" extension function. The policy ('strict', 'null' or 'sentinel')
+ * applies to every lookup function, or only to the function named by the second argument. It returns the policy name.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (1 or 2).
+ * @param argv          The policy and optionally the name of a function.
+ */
+static void lookup_error_policy(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    geoip_conn *conn = sqlite3_user_data(context);
+    const char *name = (const char *)sqlite3_value_text(argv[0]);
+    int policy = -1;
+    int function = -1;
+
+    for (int i = 0; name != NULL && i < GEOIP_POLICY_COUNT; i++) {
+        if (sqlite3_stricmp(name, policy_names[i]) == 0)
+            policy = i;
+    }
+
+    if (policy < 0) {
+        sqlite3_result_error(context, "unknown error policy, expected 'strict', 'null' or 'sentinel'", -1);
+        return;
+    }
+
+    if (argc == 2) {
+        const char *fname = (const char *)sqlite3_value_text(argv[1]);
+
+        function = fname != NULL ? geoip_stats_find(fname) : -1;
+        if (function < 0) {
+            sqlite3_result_error(context, "unknown function, expected the name of a geoip lookup function", -1);
+            return;
+        }
+
+        conn->policy[function] = (uint8_t)policy;
+    } else {
+        memset(conn->policy, policy, sizeof(conn->policy));
+    }
+
+    sqlite3_result_text(context, policy_names[policy], -1, SQLITE_STATIC);
+}
+
+/**
+ * Change the text returned for input that is not an address under the 'sentinel' policy.
+ * 
+ * This function handles the "geoip_error_sentinel" extension function and returns the sentinel now in use, which is
+ * truncated to 63 bytes.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (should be 1).
+ * @param argv          The sentinel text.
+ */
+static void lookup_error_sentinel(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    assert(argc == 1);
+    geoip_conn *conn = sqlite3_user_data(context);
+    const char *sentinel = (const char *)sqlite3_value_text(argv[0]);
+
+    if (sentinel == NULL) {
+        sqlite3_result_error(context, "the sentinel cannot be NULL, use the 'null' policy instead", -1);
+        return;
+    }
+
+    snprintf(conn->sentinel, sizeof(conn->sentinel), "%s", sentinel);
+    sqlite3_result_text(context, conn->sentinel, -1, SQLITE_TRANSIENT);
+}
+
+/**
+ * Write the lookup caches of every open database to their warm-start files.
+ * 
+ * This function handles the "geoip_cache_save" extension function and returns the number of entries written. Unlike
+ * the save when the last connection closes, it saves the databases not opened with warm_start=1 as well.
+ * 
+ * @param context       The current SQLite3 function context structure/object.
+ * @param argc          The number of arguments passed to the SQLite function (should be 0).
+ * @param argv          The contents of the arguments passed to the SQLite function.
+ */
+static void lookup_cache_save(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    assert(argc == 0);
+    (void)argv;  /* Unused parameter */
+
+    if (!initialized) {
+        sqlite3_result_error(context, MSG_NOTINITIALIZED, -1);
+        return;
+    }
+
+    warm_save *saves = sqlite3_malloc(GEOIP_DB_MAX * sizeof(warm_save));
+    if (saves == NULL) {
+        sqlite3_result_error_nomem(context);
+        return;
+    }
+
+    sqlite3_mutex *mutex = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP1);
+    bool failed = false;
+
+    sqlite3_mutex_enter(mutex);
+    int count = snapshot_caches(saves, true, &failed);
+    sqlite3_mutex_leave(mutex);
+
+    sqlite3_int64 saved = write_caches(saves, count, &failed);
+    sqlite3_free(saves);
+
+    if (failed) {
+        sqlite3_result_error(context, "Unable to write the warm-start cache files", -1);
+        return;
+    }
+
+    sqlite3_result_int64(context, saved);
+}
+
+/**
+ * The SQLite3 hooking function.
+ * 
+ * This function serves as the entrypoint for all SQLite3 extensions.
+ * 
+ * @param db        The current SQLite3 database context.
+ * @param pzErrMsg  Receives the startup error message, when the location of the databases cannot be settled.
+ * @param pApi      Used to set up the necessary SQLite3 API functions within the scope of this extension.
+ * @return          An error code that SQLite will use to determine what went wrong (should be 0).
+ */
+DLLFUNC int sqlite3_maxminddbext_init(sqlite3 *db, char **pzErrMsg, const sqlite3_api_routines *pApi) {
+    int rc = SQLITE_OK;
+
+    SQLITE_EXTENSION_INIT2(pApi);
+
+    geoip_conn *conn = sqlite3_malloc(sizeof(geoip_conn));
+    if (conn == NULL)
+        return SQLITE_NOMEM;
+
+    memset(conn, 0, sizeof(*conn));
+    strcpy(conn->sentinel, "invalid");
+
+    /*
+     * The "geoip" function owns the connection state, its destructor runs even if registering fails, so the
+     * connection is counted beforehand. Registering it first keeps the state alive as long as any function using it.
+     */
+    sqlite3_mutex *mutex = sqlite3_mutex_alloc(SQLITE_MUTEX_STATIC_APP1);
+    sqlite3_mutex_enter(mutex);
+    connections++;
+    sqlite3_mutex_leave(mutex);
+
+    rc = sqlite3_create_function_v2(db, "geoip", 1, SQLITE_UTF8, conn, lookup_geoip, 0, 0, connection_closed);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_asn_number", 1, SQLITE_UTF8, conn, lookup_asn, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_asn_owner", 1, SQLITE_UTF8, conn, lookup_org, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_timezone", 1, SQLITE_UTF8, conn, lookup_tz, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_zipcode", 1, SQLITE_UTF8, conn, lookup_zip, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_continent", 1, SQLITE_UTF8, conn, lookup_continent, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_country", 1, SQLITE_UTF8, conn, lookup_country, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_state", 1, SQLITE_UTF8, conn, lookup_state, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_city", 1, SQLITE_UTF8, conn, lookup_city, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_json", 1, SQLITE_UTF8 | SQLITE_RESULT_SUBTYPE, conn, lookup_json, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_json", 2, SQLITE_UTF8 | SQLITE_RESULT_SUBTYPE, conn, lookup_json, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_get", 2, SQLITE_UTF8 | SQLITE_RESULT_SUBTYPE, conn, lookup_get, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_get", 3, SQLITE_UTF8 | SQLITE_RESULT_SUBTYPE, conn, lookup_get, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_in_country", -1, SQLITE_UTF8, conn, lookup_in_country, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_in_asn", -1, SQLITE_UTF8, conn, lookup_in_asn, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_in_continent", -1, SQLITE_UTF8, conn, lookup_in_continent, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_pack", 1, SQLITE_UTF8, conn, lookup_pack, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_record_id", 1, SQLITE_UTF8, conn, lookup_record_id, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_record_id", 2, SQLITE_UTF8, conn, lookup_record_id, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_latitude", 1, SQLITE_UTF8, conn, lookup_latitude, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_latitude", 2, SQLITE_UTF8, conn, lookup_latitude, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_longitude", 1, SQLITE_UTF8, conn, lookup_longitude, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_longitude", 2, SQLITE_UTF8, conn, lookup_longitude, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_accuracy_radius", 1, SQLITE_UTF8, conn, lookup_accuracy_radius, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_accuracy_radius", 2, SQLITE_UTF8, conn, lookup_accuracy_radius, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_error_policy", 1, SQLITE_UTF8, conn, lookup_error_policy, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_error_policy", 2, SQLITE_UTF8, conn, lookup_error_policy, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_error_sentinel", 1, SQLITE_UTF8, conn, lookup_error_sentinel, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_cache_save", 0, SQLITE_UTF8, 0, lookup_cache_save, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = sqlite3_create_function(db, "geoip_explain", 1, SQLITE_UTF8 | SQLITE_RESULT_SUBTYPE, 0, lookup_explain, 0, 0);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = geoip_stats_register(db);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = geoip_mmap_register(db);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = geoip_class_register(db);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = geoip_registry_register(db);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = geoip_records_register(db, conn);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = geoip_index_register(db);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = geoip_summary_register(db);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = geoip_geo_register(db);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = geoip_pack_register(db);
+    if (rc != SQLITE_OK) return rc;
+
+    rc = geoip_ip_register(db);
+    if (rc != SQLITE_OK) return rc;
+
+    sqlite3_mutex_enter(mutex);
+    if (initialized) {
+        sqlite3_mutex_leave(mutex);
+        return rc;
+    }
+
+    /* Only the location of the databases is settled here, each one is opened by the first function that needs it. */
+    char HOME[PATH_MAX];
+
+    #ifdef _WIN32
+        if (_getcwd(HOME, sizeof(HOME)) == NULL) {
+            perror("_getcwd() error");
+            sqlite3_mutex_leave(mutex);
+            return rc;
+        }
+    #else
+        if (getcwd(HOME, PATH_MAX) == NULL) {
+            perror("getcwd() error");
+            sqlite3_mutex_leave(mutex);
+            return rc;
+        }
+    #endif
+
+    int asn = snprintf(db_asn.path, sizeof(db_asn.path), "%s/%s", HOME, db_asn.filename);
+    int cnt = snprintf(db_cnt.path, sizeof(db_cnt.path), "%s/%s", HOME, db_cnt.filename);
+
+    if (asn < 0 || (size_t)asn >= sizeof(db_asn.path) || cnt < 0 || (size_t)cnt >= sizeof(db_cnt.path)) {
+        if (pzErrMsg != NULL)
+            *pzErrMsg = sqlite3_mprintf("The working directory %s is too long to hold the MMDB files", HOME);
+        sqlite3_mutex_leave(mutex);
+        return SQLITE_ERROR;
+    }
+
+    initialized = true;
 
+    sqlite3_mutex_leave(mutex);
     return rc;
 }
@@ -0,0 +1,55 @@
+-- Address encoding and network bounds, at the edges of both families.
+SELECT 'setup', geoip_reject_reserved(0) = 0;
+
+SELECT 'ip_to_blob ipv4', hex(ip_to_blob('1.2.3.4')) = '00000000000000000000FFFF01020304';
+SELECT 'ip_to_blob ipv4-mapped', ip_to_blob('::ffff:1.2.3.4') = ip_to_blob('1.2.3.4');
+SELECT 'ip_to_blob ipv6', hex(ip_to_blob('2001:db8::1')) = '20010DB8000000000000000000000001';
+SELECT 'blob_to_ip ipv4', blob_to_ip(ip_to_blob('1.2.3.4')) = '1.2.3.4';
+SELECT 'blob_to_ip ipv6', blob_to_ip(ip_to_blob('2001:db8::1')) = '2001:db8::1';
+SELECT 'ip_to_int min', ip_to_int('0.0.0.0') = 0;
+SELECT 'ip_to_int max', ip_to_int('255.255.255.255') = 4294967295;
+SELECT 'ip_to_int shorthand', ip_to_int('127.1') = ip_to_int('127.0.0.1');
+
+-- /0 spans the whole family, IPv4 living in ::ffff:0:0/96.
+SELECT 'cidr_start 0.0.0.0/0', cidr_start('0.0.0.0/0') = ip_to_blob('0.0.0.0');
+SELECT 'cidr_end 0.0.0.0/0', cidr_end('0.0.0.0/0') = ip_to_blob('255.255.255.255');
+SELECT 'cidr_start ::/0', cidr_start('::/0') = zeroblob(16);
+SELECT 'cidr_end ::/0', cidr_end('::/0') = x'ffffffffffffffffffffffffffffffff';
+SELECT 'ip_in_cidr ipv4 in 0.0.0.0/0', ip_in_cidr('203.0.113.7', '0.0.0.0/0') = 1;
+SELECT 'ip_in_cidr ipv6 in 0.0.0.0/0', ip_in_cidr('2001:db8::1', '0.0.0.0/0') = 0;
+SELECT 'ip_in_cidr ipv4 in ::/0', ip_in_cidr('203.0.113.7', '::/0') = 1;
+SELECT 'ip_in_cidr ipv6 in ::/0', ip_in_cidr('2001:db8::1', '::/0') = 1;
+
+-- A full length prefix holds exactly one address.
+SELECT 'cidr /32 start', cidr_start('10.1.2.3/32') = ip_to_blob('10.1.2.3');
+SELECT 'cidr /32 end', cidr_end('10.1.2.3/32') = ip_to_blob('10.1.2.3');
+SELECT 'cidr /128 start', cidr_start('2001:db8::1/128') = ip_to_blob('2001:db8::1');
+SELECT 'cidr /128 end', cidr_end('2001:db8::1/128') = ip_to_blob('2001:db8::1');
+SELECT 'ip_in_cidr /32', ip_in_cidr('10.1.2.3', '10.1.2.3/32') = 1;
+SELECT 'ip_in_cidr /32 next', ip_in_cidr('10.1.2.4', '10.1.2.3/32') = 0;
+SELECT 'ip_in_cidr /128', ip_in_cidr('2001:db8::1', '2001:db8::1/128') = 1;
+SELECT 'ip_in_cidr /128 next', ip_in_cidr('2001:db8::2', '2001:db8::1/128') = 0;
+
+-- Host bits past the prefix are ignored.
+SELECT 'cidr host bits start', cidr_start('10.1.2.99/24') = ip_to_blob('10.1.2.0');
+SELECT 'cidr host bits end', cidr_end('10.1.2.99/24') = ip_to_blob('10.1.2.255');
+SELECT 'ip_in_cidr host bits', ip_in_cidr('10.1.2.3', '10.1.2.99/24') = 1;
+
+-- IPv4-mapped addresses and networks are the IPv4 ones.
+SELECT 'ip_in_cidr mapped network', ip_in_cidr('10.1.2.3', '::ffff:10.0.0.0/104') = 1;
+SELECT 'ip_in_cidr mapped network outside', ip_in_cidr('11.1.2.3', '::ffff:10.0.0.0/104') = 0;
+SELECT 'ip_in_cidr mapped address', ip_in_cidr('::ffff:10.1.2.3', '10.0.0.0/8') = 1;
+SELECT 'cidr mapped start', cidr_start('::ffff:10.0.0.0/104') = cidr_start('10.0.0.0/8');
+SELECT 'cidr mapped end', cidr_end('::ffff:10.0.0.0/104') = cidr_end('10.0.0.0/8');
+SELECT 'ip_in_cidr blob', ip_in_cidr(ip_to_blob('10.1.2.3'), '10.0.0.0/8') = 1;
+SELECT 'ip_in_cidr int', ip_in_cidr(ip_to_int('10.1.2.3'), '10.0.0.0/8') = 1;
+
+-- Every generated network holds its bounds, and both map to its record.
+SELECT 'fixture bounds', network, ip_in_cidr(cidr_start(network), network) AND ip_in_cidr(cidr_end(network), network)
+    AND cidr_start(network) <= cidr_end(network)
+    FROM city_networks WHERE NOT (ip_in_cidr(cidr_start(network), network) AND ip_in_cidr(cidr_end(network), network)
+    AND cidr_start(network) <= cidr_end(network));
+SELECT 'fixture records', network, geoip_record_id(cidr_start(network)) = geoip_record_id(cidr_end(network))
+    FROM city_networks WHERE geoip_record_id(cidr_start(network)) IS NOT geoip_record_id(cidr_end(network))
+    OR geoip_record_id(cidr_start(network)) IS NULL;
+SELECT 'fixture networks checked', (SELECT count(*) FROM city_networks) = 50000;
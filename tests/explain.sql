@@ -0,0 +1,52 @@
+-- geoip_explain() describes the lookup of an address, a cold one walks the tree and a repeated one hits the cache.
+SELECT 'setup', geoip_reject_reserved(0) = 0;
+
+-- Public network starts of both families, nothing has looked them up before.
+CREATE TABLE nets AS
+    SELECT network, cidr_start(network) AS ip, CAST(substr(network, instr(network, '/') + 1) AS INTEGER) AS length,
+        instr(network, ':') = 0 AS v4
+    FROM city_networks WHERE geoip_ip_class(cidr_start(network)) = 'public' LIMIT 200;
+SELECT 'both families', sum(v4) > 0 AND sum(NOT v4) > 0 FROM nets;
+
+CREATE TABLE cold AS SELECT network, length, v4, geoip_explain(ip) AS e FROM nets;
+CREATE TABLE cached AS SELECT network, length, v4, geoip_explain(ip) AS e FROM nets;
+
+SELECT 'explain json', network, 0 FROM cold WHERE NOT json_valid(e)
+    OR json_extract(e, '$.class') <> 'public' OR json_extract(e, '$.family') <> CASE WHEN v4 THEN 4 ELSE 6 END
+    OR json_array_length(e, '$.databases') <> 2;
+
+-- The City lookup matched the network, the walk visited a node per bit of its prefix at most.
+SELECT 'cold', network, json_extract(e, '$.databases[1]'), 0 FROM cold
+    WHERE json_extract(e, '$.databases[1].found') IS NOT 1
+        OR json_extract(e, '$.databases[1].prefix_length') <> length
+        OR json_extract(e, '$.databases[1].netmask') <> length + CASE WHEN v4 THEN 96 ELSE 0 END
+        OR json_extract(e, '$.databases[1].cache_hit') IS NOT 0
+        OR json_extract(e, '$.databases[1].nodes_visited') NOT BETWEEN 1 AND json_extract(e, '$.databases[1].netmask');
+
+-- The same lookup again is answered by the cache without visiting a node, and matches the same record.
+SELECT 'cached', c.network, json_extract(c.e, '$.databases[1]'), 0 FROM cached c JOIN cold USING (network)
+    WHERE json_extract(c.e, '$.databases[1].cache_hit') IS NOT 1
+        OR json_extract(c.e, '$.databases[1].nodes_visited') <> 0
+        OR json_extract(c.e, '$.databases[1].found') IS NOT 1
+        OR json_extract(c.e, '$.databases[1].prefix_length') <> json_extract(cold.e, '$.databases[1].prefix_length')
+        OR json_extract(c.e, '$.databases[1].record_offset') <> json_extract(cold.e, '$.databases[1].record_offset');
+SELECT 'cached asn', network, 0 FROM cached
+    WHERE json_extract(e, '$.databases[0].cache_hit') IS NOT 1 OR json_extract(e, '$.databases[0].nodes_visited') <> 0;
+
+-- The fields are decoded by the same pipeline the lookup functions use.
+SELECT 'fields', n.network, 0 FROM nets n JOIN cold USING (network)
+    WHERE (SELECT json_extract(value, '$.value') FROM json_each(cold.e, '$.databases[1].fields')
+            WHERE json_extract(value, '$.field') = 'country') IS NOT geoip_country(n.ip)
+        OR (SELECT json_extract(value, '$.value') FROM json_each(cold.e, '$.databases[1].fields')
+            WHERE json_extract(value, '$.field') = 'timezone') IS NOT geoip_timezone(n.ip);
+
+-- Every stage is timed.
+SELECT 'timings', network, 0 FROM cold
+    WHERE json_extract(e, '$.total_ns') <= 0 OR json_extract(e, '$.databases[1].lookup_ns') <= 0
+        OR json_extract(e, '$.total_ns') < json_extract(e, '$.parse_ns');
+
+-- An address without a network is not found and decodes nothing, the second time from the cache too.
+SELECT 'not found', json_extract(geoip_explain('2001:db8::1'), '$.databases[1].found') = 0
+    AND json_extract(geoip_explain('2001:db8::1'), '$.databases[1].fields') IS NULL;
+SELECT 'not found cached', json_extract(geoip_explain('2001:db8::1'), '$.databases[1].cache_hit') = 1
+    AND json_extract(geoip_explain('2001:db8::1'), '$.databases[1].nodes_visited') = 0;
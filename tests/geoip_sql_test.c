@@ -0,0 +1,344 @@
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "sqlite3.h"
+
+/* The extension is linked in statically, so its entry point is called directly. */
+int sqlite3_maxminddbext_init(sqlite3 *db, char **pzErrMsg, const sqlite3_api_routines *pApi);
+
+/**
+ * The driver of the SQL behaviour tests.
+ *
+ * A script is a list of SQL statements run against the fixtures generated by mmdb_gen. The networks the fixtures were
+ * generated from are first loaded into the city_networks and asn_networks tables, one network in CIDR notation per
+ * row, so checks can compare what the functions return with what the databases are known to hold. Every row a
+ * statement returns is a check whose last column has to be 1, the columns before it name the check in the report. A
+ * statement can also select only the rows that went wrong with 0 as last column, and passes by returning none. A
+ * statement preceded by a "-- error: TEXT" comment line is a check that it fails with an error message containing
+ * TEXT. A "-- reconnect" comment line closes the connection before the statement that follows it and opens a new one,
+ * the tables of the script live in a database file and survive it. A script that checks nothing fails.
+ */
+
+static const char database[] = "geoip_sql_test.db";
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "Usage: %s --dir PATH SCRIPT\n"
+        "  --dir PATH         Directory holding the fixtures and their network lists\n"
+        "  SCRIPT             SQL file whose rows are checks\n",
+        argv0);
+}
+
+/**
+ * Read a whole file into memory.
+ *
+ * @param path      The file.
+ * @return          The NUL-terminated content, to be released with free(), or NULL.
+ */
+static char *read_file(const char *path) {
+    FILE *fp = fopen(path, "rb");
+    char *text = NULL;
+    long size;
+
+    if (fp == NULL)
+        return NULL;
+
+    if (fseek(fp, 0, SEEK_END) == 0 && (size = ftell(fp)) >= 0 && fseek(fp, 0, SEEK_SET) == 0 &&
+        (text = malloc((size_t)size + 1)) != NULL) {
+        size_t read = fread(text, 1, (size_t)size, fp);
+        text[read] = '\0';
+    }
+
+    fclose(fp);
+    return text;
+}
+
+/**
+ * Remove the warm-start files an earlier run left in the fixture directory, so every run starts with cold caches.
+ */
+static void remove_warm_files(void) {
+    DIR *dir = opendir(".");
+    struct dirent *entry;
+
+    if (dir == NULL)
+        return;
+
+    while ((entry = readdir(dir)) != NULL) {
+        size_t length = strlen(entry->d_name);
+
+        if (length > 5 && strcmp(entry->d_name + length - 5, ".warm") == 0)
+            remove(entry->d_name);
+    }
+
+    closedir(dir);
+}
+
+/**
+ * Load a network list written by mmdb_gen --list into a table.
+ *
+ * @param db        The connection.
+ * @param path      The network list.
+ * @param table     The table to create.
+ * @return          0 on success, -1 with the error printed.
+ */
+static int load_networks(sqlite3 *db, const char *path, const char *table) {
+    char sql[128], line[128];
+    sqlite3_stmt *stmt;
+    FILE *fp = fopen(path, "r");
+
+    if (fp == NULL) {
+        fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    snprintf(sql, sizeof(sql), "CREATE TABLE %s(network TEXT)", table);
+    if (sqlite3_exec(db, sql, NULL, NULL, NULL) != SQLITE_OK) {
+        fprintf(stderr, "%s\n", sqlite3_errmsg(db));
+        fclose(fp);
+        return -1;
+    }
+
+    snprintf(sql, sizeof(sql), "INSERT INTO %s VALUES (?)", table);
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        fprintf(stderr, "%s\n", sqlite3_errmsg(db));
+        fclose(fp);
+        return -1;
+    }
+
+    sqlite3_exec(db, "BEGIN", NULL, NULL, NULL);
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0')
+            continue;
+
+        sqlite3_bind_text(stmt, 1, line, -1, SQLITE_STATIC);
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+    }
+
+    sqlite3_finalize(stmt);
+    sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
+    fclose(fp);
+    return 0;
+}
+
+/**
+ * Find a comment line preceding a statement.
+ *
+ * @param sql       The text of the statement, starting with the comments before it.
+ * @param marker    The start of the comment line, such as "-- error:".
+ * @param text      Receives the rest of the comment line, or an empty string, may be NULL.
+ * @param size      The size of text.
+ * @return          1 when such a comment precedes the statement, 0 otherwise.
+ */
+static int directive(const char *sql, const char *marker, char *text, size_t size) {
+    const size_t prefix = strlen(marker);
+    int found = 0;
+
+    if (text != NULL)
+        text[0] = '\0';
+
+    for (;;) {
+        sql += strspn(sql, " \t\r\n");
+        if (strncmp(sql, "--", 2) != 0)
+            return found;
+
+        size_t length = strcspn(sql, "\r\n");
+        if (length >= prefix && strncmp(sql, marker, prefix) == 0) {
+            const char *rest = sql + prefix;
+            int n = (int)(length - prefix);
+
+            while (n > 0 && *rest == ' ')
+                rest++, n--;
+            if (text != NULL)
+                snprintf(text, size, "%.*s", n, rest);
+            found = 1;
+        }
+
+        sql += length;
+    }
+}
+
+/**
+ * Tell whether a file is mapped into the process.
+ *
+ * This handles the "mapped" SQL function scripts use to see when the extension releases a database file. It reads
+ * /proc/self/maps, so it works on Linux only.
+ *
+ * @param context   The SQLite3 function context.
+ * @param argc      The number of arguments (1).
+ * @param argv      The path of the file.
+ */
+static void mapped(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    (void)argc;
+    const char *path = (const char *)sqlite3_value_text(argv[0]);
+    char resolved[PATH_MAX], line[PATH_MAX + 128];
+    int found = 0;
+
+    if (path == NULL || realpath(path, resolved) == NULL) {
+        sqlite3_result_error(context, "mapped() needs an existing file", -1);
+        return;
+    }
+
+    FILE *fp = fopen("/proc/self/maps", "r");
+    if (fp == NULL) {
+        sqlite3_result_error(context, "mapped() needs /proc/self/maps", -1);
+        return;
+    }
+
+    while (!found && fgets(line, sizeof(line), fp) != NULL) {
+        line[strcspn(line, "\n")] = '\0';
+
+        const char *name = strchr(line, '/');
+        found = name != NULL && strcmp(name, resolved) == 0;
+    }
+
+    fclose(fp);
+    sqlite3_result_int(context, found);
+}
+
+/**
+ * Open the database file of the script and load the extension into the connection.
+ *
+ * @param db        Receives the connection.
+ * @return          0 on success, -1 with the error printed.
+ */
+static int open_connection(sqlite3 **db) {
+    char *errmsg = NULL;
+
+    if (sqlite3_open(database, db) != SQLITE_OK || sqlite3_maxminddbext_init(*db, &errmsg, NULL) != SQLITE_OK ||
+        sqlite3_create_function(*db, "mapped", 1, SQLITE_UTF8, NULL, mapped, NULL, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Unable to initialize the extension: %s\n", errmsg ? errmsg : sqlite3_errmsg(*db));
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Run every statement of a script and count the checks its rows make.
+ *
+ * @param db        The connection, replaced by a new one at every "-- reconnect".
+ * @param script    The SQL text.
+ * @param checks    Receives the number of checks.
+ * @param failed    Receives the number of failed checks.
+ * @return          0 when every statement ran, -1 with the error printed otherwise.
+ */
+static int run_script(sqlite3 **db, const char *script, int *checks, int *failed) {
+    const char *tail = script;
+
+    *checks = *failed = 0;
+
+    while (*tail != '\0') {
+        const char *sql = tail;
+        sqlite3_stmt *stmt;
+
+        if (sqlite3_prepare_v2(*db, sql, -1, &stmt, &tail) != SQLITE_OK) {
+            fprintf(stderr, "%s\nin: %.200s\n", sqlite3_errmsg(*db), sql);
+            return -1;
+        }
+
+        /* Whitespace and comments after the last statement. */
+        if (stmt == NULL)
+            break;
+
+        if (directive(sql, "-- reconnect", NULL, 0)) {
+            sqlite3_finalize(stmt);
+            sqlite3_close(*db);
+            if (open_connection(db) != 0 || sqlite3_prepare_v2(*db, sql, -1, &stmt, &tail) != SQLITE_OK) {
+                fprintf(stderr, "%s\nin: %.200s\n", sqlite3_errmsg(*db), sql);
+                return -1;
+            }
+        }
+
+        char expected[256];
+        directive(sql, "-- error:", expected, sizeof(expected));
+
+        int rc;
+        while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            const int last = sqlite3_column_count(stmt) - 1;
+
+            (*checks)++;
+            if (sqlite3_column_type(stmt, last) == SQLITE_INTEGER && sqlite3_column_int64(stmt, last) == 1)
+                continue;
+
+            (*failed)++;
+            printf("FAILED:");
+            for (int i = 0; i < last; i++) {
+                const unsigned char *text = sqlite3_column_text(stmt, i);
+                printf(" %s", text != NULL ? (const char *)text : "NULL");
+            }
+            printf("\n");
+        }
+
+        if (expected[0] != '\0') {
+            (*checks)++;
+            if (rc == SQLITE_DONE || strstr(sqlite3_errmsg(*db), expected) == NULL) {
+                (*failed)++;
+                printf("FAILED: expected the error '%s', got '%s'\nin: %.*s\n", expected,
+                    rc == SQLITE_DONE ? "no error" : sqlite3_errmsg(*db), (int)(tail - sql), sql);
+            }
+        } else if (rc != SQLITE_DONE) {
+            fprintf(stderr, "%s\nin: %.*s\n", sqlite3_errmsg(*db), (int)(tail - sql), sql);
+            sqlite3_finalize(stmt);
+            return -1;
+        }
+
+        sqlite3_finalize(stmt);
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const char *dir = NULL, *path = NULL;
+    sqlite3 *db;
+    int checks, failed;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc)
+            dir = argv[++i];
+        else if (argv[i][0] != '-' && path == NULL)
+            path = argv[i];
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (dir == NULL || path == NULL) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    char *script = read_file(path);
+    if (script == NULL) {
+        fprintf(stderr, "Unable to read %s\n", path);
+        return 1;
+    }
+
+    if (chdir(dir) != 0) {
+        fprintf(stderr, "Unable to enter %s: %s\n", dir, strerror(errno));
+        return 1;
+    }
+
+    remove(database);
+    remove_warm_files();
+    if (open_connection(&db) != 0)
+        return 1;
+
+    if (load_networks(db, "city-networks.txt", "city_networks") != 0 ||
+        load_networks(db, "asn-networks.txt", "asn_networks") != 0)
+        return 1;
+
+    int rc = run_script(&db, script, &checks, &failed);
+    printf("%s: %d checks, %d failed\n", path, checks, failed);
+
+    free(script);
+    sqlite3_close(db);
+    return rc != 0 || failed > 0 || checks == 0;
+}
@@ -0,0 +1,53 @@
+-- geoip_networks_near() finds every network in range, nearest first, across the antimeridian and the poles.
+SELECT 'setup', geoip_reject_reserved(0) = 0;
+
+CREATE TABLE located AS
+    SELECT network, geoip_record_id(cidr_start(network)) AS id, geoip_latitude(cidr_start(network)) AS latitude,
+        geoip_longitude(cidr_start(network)) AS longitude
+    FROM city_networks WHERE geoip_latitude(cidr_start(network)) IS NOT NULL;
+
+-- Half the circumference of the Earth reaches every point.
+CREATE TABLE everything AS SELECT * FROM geoip_networks_near(0, 0, 20040);
+
+SELECT 'everything count', (SELECT count(*) FROM everything) = (SELECT count(*) FROM located);
+SELECT 'everything networks', network, 0
+    FROM (SELECT network, id FROM located EXCEPT SELECT network, id FROM everything);
+SELECT 'everything coordinates', e.network, 0 FROM everything e JOIN located l USING (network)
+    WHERE e.latitude <> l.latitude OR e.longitude <> l.longitude;
+SELECT 'everything radius', network, 0
+    FROM everything WHERE accuracy_radius IS NOT geoip_accuracy_radius(cidr_start(network));
+
+-- Every point is searched with a radius reaching a handful of networks. The point west of the antimeridian only
+-- reaches networks east of it, and the one next to the north pole has to span every longitude.
+CREATE TABLE points (name TEXT, latitude REAL, longitude REAL, km REAL);
+INSERT INTO points
+    SELECT 'record', latitude, longitude, 800 FROM located ORDER BY network LIMIT 1;
+INSERT INTO points
+    SELECT 'antimeridian', latitude, -179.9, 4500 FROM located ORDER BY longitude DESC LIMIT 1;
+INSERT INTO points VALUES ('pole', 89.9, 0, 3500);
+
+-- One statement per point, so the rowids keep the order of the rows of every search.
+CREATE TABLE near (point TEXT, network TEXT, id INTEGER, latitude REAL, longitude REAL, distance REAL);
+INSERT INTO near SELECT 'record', n.network, n.id, n.latitude, n.longitude, n.distance
+    FROM points p, geoip_networks_near(p.latitude, p.longitude, p.km) n WHERE p.name = 'record';
+INSERT INTO near SELECT 'antimeridian', n.network, n.id, n.latitude, n.longitude, n.distance
+    FROM points p, geoip_networks_near(p.latitude, p.longitude, p.km) n WHERE p.name = 'antimeridian';
+INSERT INTO near SELECT 'pole', n.network, n.id, n.latitude, n.longitude, n.distance
+    FROM points p, geoip_networks_near(p.latitude, p.longitude, p.km) n WHERE p.name = 'pole';
+
+SELECT 'near rows', name, (SELECT count(*) FROM near WHERE point = name) > 0 FROM points;
+SELECT 'near order', point, network, 0
+    FROM (SELECT point, network, distance, lag(distance) OVER (PARTITION BY point ORDER BY rowid) AS previous FROM near)
+    WHERE distance < previous;
+SELECT 'near range', point, network, 0 FROM near JOIN points ON name = point WHERE distance > km;
+SELECT 'near own record', distance = 0 FROM near WHERE point = 'record' ORDER BY rowid LIMIT 1;
+SELECT 'near antimeridian', count(*) = (SELECT count(*) FROM near WHERE point = 'antimeridian') FROM near
+    WHERE point = 'antimeridian' AND longitude > 0;
+
+-- The networks found are exactly the ones a search of the whole Earth from the same point finds within range.
+CREATE TABLE far (point TEXT, network TEXT);
+INSERT INTO far SELECT p.name, n.network
+    FROM points p, geoip_networks_near(p.latitude, p.longitude, 20040) n WHERE n.distance <= p.km;
+
+SELECT 'near missing', point, network, 0 FROM (SELECT point, network FROM far EXCEPT SELECT point, network FROM near);
+SELECT 'near extra', point, network, 0 FROM (SELECT point, network FROM near EXCEPT SELECT point, network FROM far);
@@ -0,0 +1,40 @@
+-- geoip_pack() fingerprints read back through geoip_unpack_*() as what the databases hold.
+SELECT 'setup', geoip_reject_reserved(0) = 0;
+
+CREATE TABLE addrs AS
+    SELECT cidr_start(network) AS ip FROM city_networks
+    UNION SELECT cidr_end(network) FROM asn_networks
+    UNION SELECT ip_to_blob('2001:db8::1');
+
+CREATE TABLE packed AS
+    SELECT ip, geoip_pack(ip) AS fp, geoip_get(ip, 'city', 'continent.code') AS continent,
+        geoip_get(ip, 'city', 'country.iso_code') AS country, geoip_get(ip, 'city', 'city.geoname_id') AS city,
+        geoip_get(ip, 'city', 'subdivisions.0.geoname_id') AS subdivision,
+        geoip_get(ip, 'asn', 'autonomous_system_number') AS asn
+    FROM addrs;
+
+SELECT 'pack size', blob_to_ip(ip), 0 FROM packed
+    WHERE (typeof(fp) <> 'blob' OR length(fp) <> 20) AND (country IS NOT NULL OR asn IS NOT NULL);
+SELECT 'unpack continent', blob_to_ip(ip), 0 FROM packed WHERE geoip_unpack_continent(fp) IS NOT continent;
+SELECT 'unpack country', blob_to_ip(ip), 0 FROM packed WHERE geoip_unpack_country(fp) IS NOT country;
+SELECT 'unpack country id', blob_to_ip(ip), 0 FROM packed
+    WHERE geoip_unpack_country_id(fp) IS NOT (unicode(substr(country, 1, 1)) << 8 | unicode(substr(country, 2, 1)));
+SELECT 'unpack asn', blob_to_ip(ip), 0 FROM packed WHERE geoip_unpack_asn(fp) IS NOT asn;
+SELECT 'unpack city id', blob_to_ip(ip), 0 FROM packed WHERE geoip_unpack_city_id(fp) IS NOT city;
+SELECT 'unpack subdivision id', blob_to_ip(ip), 0 FROM packed WHERE geoip_unpack_subdivision_id(fp) IS NOT subdivision;
+
+-- mmdb_gen stamps its databases with a build_epoch of 1700000000, 2023-11-14 22:13:20, which packs as its day.
+SELECT 'unpack epoch', blob_to_ip(ip), 0 FROM packed
+    WHERE geoip_unpack_epoch(fp) <> 1699920000 OR geoip_unpack_epoch(fp, 'asn') <> 1699920000;
+
+SELECT 'packed countries', count(*) > 0 FROM packed WHERE geoip_unpack_country(fp) IS NOT NULL;
+SELECT 'packed asns', count(*) > 0 FROM packed WHERE geoip_unpack_asn(fp) IS NOT NULL;
+SELECT 'packed cities', count(*) > 0 FROM packed WHERE geoip_unpack_city_id(fp) IS NOT NULL;
+SELECT 'packed nothing', fp IS NULL AND geoip_unpack_country(fp) IS NULL
+    FROM packed WHERE ip = ip_to_blob('2001:db8::1');
+
+-- Fingerprints sort by continent, then country.
+SELECT 'pack order', blob_to_ip(ip), 0
+    FROM (SELECT ip, continent || country AS code, lag(continent || country) OVER (ORDER BY fp) AS previous FROM packed
+        WHERE country IS NOT NULL)
+    WHERE code < previous;
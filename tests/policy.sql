@@ -0,0 +1,67 @@
+-- geoip_error_policy() and geoip_error_sentinel() decide what lookups return for input that is not an address.
+SELECT 'setup', geoip_reject_reserved(0) = 0;
+
+-- An address the databases hold no network for is not found under every policy, a malformed one depends on it.
+CREATE TABLE inputs (kind TEXT, ip TEXT);
+INSERT INTO inputs VALUES ('unknown', '2001:db8::1'), ('malformed', 'not an address'), ('out of range', '999.1.1.1');
+
+-- The policy starts out strict.
+SELECT 'strict unknown', quote(geoip_country(ip)) = 'NULL' AND quote(geoip_city(ip)) = 'NULL'
+    AND quote(geoip_asn_number(ip)) = 'NULL' AND quote(geoip_json(ip)) = 'NULL'
+    AND quote(geoip_get(ip, 'city', 'country.iso_code')) = 'NULL' AND quote(geoip_latitude(ip)) = 'NULL'
+    AND geoip_in_country(ip, 'US') = 0
+    FROM inputs WHERE kind = 'unknown';
+-- error: Error from getaddrinfo for not an address
+SELECT geoip_country('not an address');
+-- error: Error from getaddrinfo for 999.1.1.1
+SELECT geoip_asn_number('999.1.1.1');
+-- error: Error from getaddrinfo for not an address
+SELECT geoip_get('not an address', 'city', 'country.iso_code');
+-- error: Error from getaddrinfo for not an address
+SELECT geoip_in_country('not an address', 'US');
+
+-- 'null' answers malformed input with NULL, every lookup function alike.
+SELECT 'set null', geoip_error_policy('null') = 'null';
+SELECT 'null ' || kind, quote(geoip_asn_number(ip)) = 'NULL' AND quote(geoip_asn_owner(ip)) = 'NULL'
+    AND quote(geoip_timezone(ip)) = 'NULL' AND quote(geoip_zipcode(ip)) = 'NULL'
+    AND quote(geoip_continent(ip)) = 'NULL' AND quote(geoip_country(ip)) = 'NULL'
+    AND quote(geoip_state(ip)) = 'NULL' AND quote(geoip_city(ip)) = 'NULL' AND quote(geoip(ip)) = 'NULL'
+    AND quote(geoip_json(ip)) = 'NULL' AND quote(geoip_get(ip, 'city')) = 'NULL'
+    AND quote(geoip_record_id(ip)) = 'NULL' AND quote(geoip_pack(ip)) = 'NULL'
+    AND quote(geoip_latitude(ip)) = 'NULL' AND quote(geoip_longitude(ip)) = 'NULL'
+    AND quote(geoip_accuracy_radius(ip)) = 'NULL'
+    FROM inputs;
+SELECT 'null predicates ' || kind, quote(geoip_in_country(ip, 'US')) = expected
+    AND quote(geoip_in_asn(ip, 13335)) = expected AND quote(geoip_in_continent(ip, 'EU')) = expected
+    FROM (SELECT kind, ip, CASE kind WHEN 'unknown' THEN '0' ELSE 'NULL' END AS expected FROM inputs);
+
+-- 'sentinel' answers malformed input with the sentinel text, 'invalid' by default, and still NULL when not found.
+SELECT 'set sentinel', geoip_error_policy('SENTINEL') = 'sentinel';
+SELECT 'sentinel ' || kind, expected, quote(geoip_asn_number(ip)) = expected AND quote(geoip_asn_owner(ip)) = expected
+    AND quote(geoip_timezone(ip)) = expected AND quote(geoip_zipcode(ip)) = expected
+    AND quote(geoip_continent(ip)) = expected AND quote(geoip_country(ip)) = expected
+    AND quote(geoip_state(ip)) = expected AND quote(geoip_city(ip)) = expected AND quote(geoip(ip)) = expected
+    AND quote(geoip_json(ip)) = expected AND quote(geoip_get(ip, 'city')) = expected
+    AND quote(geoip_record_id(ip)) = expected AND quote(geoip_pack(ip)) = expected
+    AND quote(geoip_latitude(ip)) = expected AND quote(geoip_longitude(ip)) = expected
+    AND quote(geoip_accuracy_radius(ip)) = expected
+    FROM (SELECT kind, ip, CASE kind WHEN 'unknown' THEN 'NULL' ELSE '''invalid''' END AS expected FROM inputs);
+SELECT 'set sentinel text', geoip_error_sentinel('bad input') = 'bad input';
+SELECT 'sentinel text', geoip_country('not an address') = 'bad input' AND geoip_city('999.1.1.1') = 'bad input';
+SELECT 'sentinel truncated', geoip_error_sentinel(printf('%.70c', 'x')) = printf('%.63c', 'x')
+    AND geoip_country('not an address') = printf('%.63c', 'x');
+
+-- A policy can be set for a single function.
+SELECT 'set strict', geoip_error_policy('strict') = 'strict';
+SELECT 'set null for geoip_city', geoip_error_policy('null', 'geoip_city') = 'null';
+SELECT 'null for geoip_city', quote(geoip_city('not an address')) = 'NULL';
+-- error: Error from getaddrinfo for not an address
+SELECT geoip_country('not an address');
+
+-- Only known policies and lookup functions are taken.
+-- error: unknown error policy
+SELECT geoip_error_policy('lenient');
+-- error: unknown function
+SELECT geoip_error_policy('null', 'ip_to_blob');
+-- error: the sentinel cannot be NULL
+SELECT geoip_error_sentinel(NULL);
@@ -0,0 +1,50 @@
+-- geoip_in_country(), geoip_in_asn() and geoip_in_continent() answer what geoip_get() reads from the record.
+SELECT 'setup', geoip_reject_reserved(0) = 0;
+
+CREATE TABLE addrs AS
+    SELECT cidr_start(network) AS ip FROM city_networks
+    UNION ALL SELECT cidr_end(network) FROM city_networks
+    UNION ALL SELECT cidr_start(network) FROM asn_networks
+    UNION ALL SELECT cidr_end(network) FROM asn_networks
+    UNION ALL SELECT ip_to_blob('2001:db8::1');
+
+CREATE TABLE facts AS
+    SELECT ip, geoip_get(ip, 'city', 'country.iso_code') AS country,
+        geoip_get(ip, 'city', 'continent.code') AS continent,
+        geoip_get(ip, 'asn', 'autonomous_system_number') AS asn
+    FROM addrs;
+
+-- The most common values, so members and non-members both come up.
+CREATE TABLE top AS SELECT
+    (SELECT country FROM facts WHERE country IS NOT NULL GROUP BY 1 ORDER BY count(*) DESC, 1 LIMIT 1) AS country1,
+    (SELECT country FROM facts WHERE country IS NOT NULL GROUP BY 1 ORDER BY count(*) DESC, 1 LIMIT 1, 1) AS country2,
+    (SELECT continent FROM facts WHERE continent IS NOT NULL GROUP BY 1 ORDER BY count(*) DESC, 1 LIMIT 1) AS continent,
+    (SELECT asn FROM facts WHERE asn IS NOT NULL GROUP BY 1 ORDER BY count(*) DESC, 1 LIMIT 1) AS asn1,
+    (SELECT asn FROM facts WHERE asn IS NOT NULL GROUP BY 1 ORDER BY count(*) DESC, 1 LIMIT 1, 1) AS asn2;
+
+-- Constant values, answered from the range list. Codes compare case-insensitively.
+SELECT 'in_country constant', blob_to_ip(ip), 0 FROM facts, top
+    WHERE geoip_in_country(ip, country1, lower(country2)) IS NOT coalesce(country IN (country1, country2), 0);
+SELECT 'in_continent constant', blob_to_ip(ip), 0 FROM facts, top
+    WHERE geoip_in_continent(ip, top.continent) IS NOT coalesce(facts.continent = top.continent, 0);
+SELECT 'in_asn constant', blob_to_ip(ip), 0 FROM facts, top
+    WHERE geoip_in_asn(ip, 'AS' || asn1, asn2) IS NOT coalesce(asn IN (asn1, asn2), 0);
+
+-- Values changing from row to row, answered by a lookup per row. A NULL value matches nothing.
+SELECT 'in_country per row', blob_to_ip(ip), 0
+    FROM facts WHERE geoip_in_country(ip, country) IS NOT (country IS NOT NULL);
+SELECT 'in_continent per row', blob_to_ip(ip), 0
+    FROM facts WHERE geoip_in_continent(ip, continent) IS NOT (continent IS NOT NULL);
+SELECT 'in_asn per row', blob_to_ip(ip), 0
+    FROM facts WHERE geoip_in_asn(ip, asn) IS NOT (asn IS NOT NULL);
+
+-- Runs of repeated values switch to the range list and back.
+SELECT 'in_country runs', blob_to_ip(ip), 0
+    FROM (SELECT * FROM facts ORDER BY country, ip) WHERE geoip_in_country(ip, country) IS NOT (country IS NOT NULL);
+SELECT 'in_asn runs', blob_to_ip(ip), 0
+    FROM (SELECT * FROM facts ORDER BY asn, ip) WHERE geoip_in_asn(ip, asn) IS NOT (asn IS NOT NULL);
+
+SELECT 'in_country members', count(*) > 0 FROM facts, top WHERE geoip_in_country(ip, country1);
+SELECT 'in_continent members', count(*) > 0 FROM facts, top WHERE geoip_in_continent(ip, top.continent);
+SELECT 'in_asn members', count(*) > 0 FROM facts, top WHERE geoip_in_asn(ip, asn1);
+SELECT 'outside every network', geoip_in_country('2001:db8::1', country1) = 0 FROM top;
@@ -0,0 +1,57 @@
+-- geoip_open() and geoip_close() manage the aliases of the process-wide database registry.
+SELECT 'setup', geoip_reject_reserved(0) = 0;
+
+-- Opening an alias again with the same file is a no-op, whatever its case, so every connection can run the same setup.
+SELECT 'open', geoip_open('extra', 'GeoLite2-City.mmdb') = 1;
+SELECT 'open again', geoip_open('extra', 'GeoLite2-City.mmdb') = 0 AND geoip_open('EXTRA', './GeoLite2-City.mmdb') = 0;
+SELECT 'alias looks up', geoip_get(cidr_start(network), 'extra', 'country.iso_code')
+    IS geoip_get(cidr_start(network), 'city', 'country.iso_code') FROM city_networks LIMIT 100;
+-- error: The alias extra is already taken by
+SELECT geoip_open('extra', 'GeoLite2-ASN.mmdb');
+-- error: Unable to open missing.mmdb
+SELECT geoip_open('missing', 'missing.mmdb');
+-- error: Unknown option 'slots'
+SELECT geoip_open('options', 'GeoLite2-City.mmdb', 'slots=4');
+-- error: The alias must be 1 to 31 characters long
+SELECT geoip_open(printf('%.32c', 'a'), 'GeoLite2-City.mmdb');
+SELECT 'failed opens register nothing', geoip_close('missing') = 0 AND geoip_close('options') = 0;
+
+-- The built-in databases keep their slots.
+-- error: The built-in databases cannot be closed
+SELECT geoip_close('city');
+-- error: The built-in databases cannot be closed
+SELECT geoip_close('ASN');
+
+-- A closed database stays mapped while other connections may be reading it, and is released once the last
+-- connection closes. Nothing looks up the built-in ASN database, so only 'retired' maps its file.
+SELECT 'not mapped', mapped('GeoLite2-ASN.mmdb') = 0;
+SELECT 'open retired', geoip_open('retired', 'GeoLite2-ASN.mmdb') = 1 AND mapped('GeoLite2-ASN.mmdb') = 1;
+SELECT 'closed but mapped', geoip_close('retired') = 1 AND mapped('GeoLite2-ASN.mmdb') = 1;
+-- reconnect
+SELECT 'released', mapped('GeoLite2-ASN.mmdb') = 0;
+
+-- A closed alias is unknown to lookups and free to name another file.
+SELECT 'close', geoip_close('extra') = 1 AND geoip_close('extra') = 0;
+-- error: Unknown database
+SELECT geoip_get('1.1.1.1', 'extra');
+SELECT 'reopen elsewhere', geoip_open('extra', 'GeoLite2-ASN.mmdb') = 1
+    AND geoip_get(cidr_start(network), 'extra', 'autonomous_system_number') > 0
+    FROM asn_networks LIMIT 1;
+SELECT 'close elsewhere', geoip_close('extra') = 1;
+
+-- Sixteen databases can be registered, the two built-in ones included.
+WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 14)
+    SELECT 'fill', i, geoip_open('slot' || i, 'GeoLite2-City.mmdb') = 1 FROM n;
+-- error: Too many databases are open
+SELECT geoip_open('slot15', 'GeoLite2-City.mmdb');
+SELECT 'full registry still reopens', geoip_open('slot14', 'GeoLite2-City.mmdb') = 0;
+SELECT 'free a slot', geoip_close('slot1') = 1 AND geoip_open('slot15', 'GeoLite2-City.mmdb') = 1;
+WITH RECURSIVE n(i) AS (SELECT 2 UNION ALL SELECT i + 1 FROM n WHERE i < 15)
+    SELECT 'empty', i, geoip_close('slot' || i) = 1 FROM n;
+
+-- Open aliases outlive the connection that opened them.
+SELECT 'open kept', geoip_open('kept', 'GeoLite2-City.mmdb') = 1;
+-- reconnect
+SELECT 'kept', geoip_open('kept', 'GeoLite2-City.mmdb') = 0
+    AND geoip_get(cidr_start(network), 'kept', 'location.latitude') IS geoip_latitude(cidr_start(network))
+    FROM city_networks LIMIT 100;
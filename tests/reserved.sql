@@ -0,0 +1,93 @@
+-- geoip_ip_class() names the special-purpose block of an address, geoip_reject_reserved() lets a database answer
+-- addresses in those blocks as not found without a lookup.
+SELECT 'setup', geoip_reject_reserved(0) = 0;
+
+-- Both ends of every block and the addresses just outside them.
+CREATE TABLE classes (ip TEXT, class TEXT);
+INSERT INTO classes VALUES
+    ('0.0.0.0', 'this-network'), ('0.255.255.255', 'this-network'), ('1.0.0.0', 'public'),
+    ('9.255.255.255', 'public'), ('10.0.0.0', 'private'), ('10.255.255.255', 'private'), ('11.0.0.0', 'public'),
+    ('100.63.255.255', 'public'), ('100.64.0.0', 'cgnat'), ('100.127.255.255', 'cgnat'), ('100.128.0.0', 'public'),
+    ('126.255.255.255', 'public'), ('127.0.0.0', 'loopback'), ('127.255.255.255', 'loopback'), ('128.0.0.0', 'public'),
+    ('169.253.255.255', 'public'), ('169.254.0.0', 'link-local'), ('169.254.255.255', 'link-local'),
+    ('169.255.0.0', 'public'), ('172.15.255.255', 'public'), ('172.16.0.0', 'private'),
+    ('172.31.255.255', 'private'), ('172.32.0.0', 'public'), ('191.255.255.255', 'public'), ('192.0.0.0', 'reserved'),
+    ('192.0.0.255', 'reserved'), ('192.0.1.0', 'public'), ('192.0.2.0', 'documentation'),
+    ('192.0.2.255', 'documentation'), ('192.0.3.0', 'public'), ('192.167.255.255', 'public'),
+    ('192.168.0.0', 'private'), ('192.168.255.255', 'private'), ('192.169.0.0', 'public'), ('198.17.255.255', 'public'),
+    ('198.18.0.0', 'benchmarking'), ('198.19.255.255', 'benchmarking'), ('198.20.0.0', 'public'),
+    ('198.51.100.0', 'documentation'), ('198.51.100.255', 'documentation'), ('198.51.101.0', 'public'),
+    ('203.0.113.0', 'documentation'), ('203.0.113.255', 'documentation'), ('203.0.114.0', 'public'),
+    ('223.255.255.255', 'public'), ('224.0.0.0', 'multicast'), ('239.255.255.255', 'multicast'),
+    ('240.0.0.0', 'reserved'), ('255.255.255.254', 'reserved'), ('255.255.255.255', 'broadcast'),
+    ('::', 'unspecified'), ('::1', 'loopback'), ('::2', 'public'), ('100::', 'reserved'),
+    ('100::ffff:ffff:ffff:ffff', 'reserved'), ('100:0:0:1::', 'public'), ('2001:1:ffff:ffff::', 'public'),
+    ('2001:2::', 'benchmarking'), ('2001:2:0:ffff:ffff:ffff:ffff:ffff', 'benchmarking'), ('2001:2:1::', 'public'),
+    ('2001:db7:ffff:ffff::', 'public'), ('2001:db8::', 'documentation'),
+    ('2001:db8:ffff:ffff:ffff:ffff:ffff:ffff', 'documentation'), ('2001:db9::', 'public'),
+    ('fbff:ffff:ffff:ffff:ffff:ffff:ffff:ffff', 'public'), ('fc00::', 'unique-local'),
+    ('fdff:ffff:ffff:ffff:ffff:ffff:ffff:ffff', 'unique-local'), ('fe00::', 'public'), ('fe80::', 'link-local'),
+    ('febf:ffff:ffff:ffff:ffff:ffff:ffff:ffff', 'link-local'), ('fec0::', 'public'),
+    ('feff:ffff:ffff:ffff:ffff:ffff:ffff:ffff', 'public'), ('ff00::', 'multicast'),
+    ('ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff', 'multicast');
+
+SELECT 'ip_class', ip, geoip_ip_class(ip), class, 0 FROM classes WHERE geoip_ip_class(ip) IS NOT class;
+SELECT 'ip_class blob', ip, 0 FROM classes WHERE geoip_ip_class(ip_to_blob(ip)) IS NOT class;
+SELECT 'ip_class int', ip, 0 FROM classes WHERE instr(ip, ':') = 0 AND geoip_ip_class(ip_to_int(ip)) IS NOT class;
+
+-- IPv4-mapped addresses belong to the block of their IPv4 address, the other IPv6 forms of IPv4 do not.
+SELECT 'ip_class mapped', ip, 0 FROM classes WHERE instr(ip, ':') = 0 AND geoip_ip_class('::ffff:' || ip) IS NOT class;
+SELECT 'ip_class mapped bounds', geoip_ip_class('::fffe:ffff:ffff') = 'public'
+    AND geoip_ip_class('::1:0:0:0') = 'public' AND geoip_ip_class('64:ff9b::a00:1') = 'public';
+
+SELECT 'ip_class null', geoip_ip_class(NULL) IS NULL;
+-- error: Error from getaddrinfo for not an address
+SELECT geoip_ip_class('not an address');
+
+-- Addresses of non-public blocks the fixture City database holds networks for, and public ones.
+CREATE TABLE reserved (ip TEXT, id INTEGER);
+INSERT INTO reserved SELECT blob_to_ip(cidr_start(network)), geoip_record_id(cidr_start(network)) FROM city_networks
+    WHERE geoip_ip_class(cidr_start(network)) <> 'public';
+CREATE TABLE public (ip TEXT, id INTEGER);
+INSERT INTO public SELECT blob_to_ip(cidr_start(network)), geoip_record_id(cidr_start(network)) FROM city_networks
+    WHERE geoip_ip_class(cidr_start(network)) = 'public' LIMIT 1000;
+
+SELECT 'reserved networks', count(*) > 100 AND count(*) = count(id) FROM reserved;
+SELECT 'mapped found alike', ip, 0 FROM reserved WHERE geoip_record_id('::ffff:' || ip) IS NOT id;
+
+-- Turning rejection on for the City database answers them as not found, cached results included, and leaves public
+-- addresses and the ASN database alone.
+SELECT 'reject city', geoip_reject_reserved(1, 'city') = 1 AND geoip_reject_reserved(NULL, 'asn') = 0
+    AND geoip_reject_reserved() = 1;
+SELECT 'rejected', ip, 0 FROM reserved
+    WHERE geoip_record_id(ip) IS NOT NULL OR geoip_country(ip) IS NOT NULL OR geoip_in_country(ip, 'US') <> 0
+        OR geoip_record_id('::ffff:' || ip) IS NOT NULL OR geoip_record_id(ip_to_blob(ip)) IS NOT NULL;
+SELECT 'public kept', ip, 0 FROM public WHERE geoip_record_id(ip) IS NOT id;
+SELECT 'asn not rejected', count(geoip_asn_number(ip)) > 0 FROM reserved;
+
+-- A rejected lookup walks no node and reports the prefix of the block, IPv6 blocks alike.
+SELECT 'explain rejected', ip, 0 FROM (SELECT column1 AS ip, column2 AS length FROM (VALUES
+        ('10.1.2.3', 8), ('::ffff:192.168.1.1', 112), ('fe80::1', 10), ('fc00::1', 7), ('2001:db8::1', 32)))
+    WHERE json_extract(geoip_explain(ip), '$.databases[1].found') IS NOT 0
+        OR json_extract(geoip_explain(ip), '$.databases[1].nodes_visited') <> 0
+        OR json_extract(geoip_explain(ip), '$.databases[1].prefix_length') <> length;
+
+-- Turning it off again gives the records back, and the walk runs for addresses no lookup has cached yet.
+SELECT 'unreject', geoip_reject_reserved(0, 'city') = 0;
+SELECT 'found again', ip, 0 FROM reserved WHERE geoip_record_id(ip) IS NOT id;
+SELECT 'explain walked', json_extract(geoip_explain('fe80::2'), '$.databases[1].nodes_visited') > 0;
+
+-- Without a database both built-in ones change.
+SELECT 'reject both', geoip_reject_reserved(1) = 1 AND geoip_reject_reserved(NULL, 'asn') = 1;
+SELECT 'asn rejected', count(geoip_asn_number(ip)) = 0 FROM reserved;
+SELECT 'unreject both', geoip_reject_reserved(0) = 0 AND geoip_reject_reserved(NULL, 'asn') = 0;
+
+-- Databases opened under an alias reject only when their options say so.
+SELECT 'open', geoip_open('rejecting', 'GeoLite2-City.mmdb', 'reject_reserved=1') = 1
+    AND geoip_reject_reserved(NULL, 'rejecting') = 1;
+SELECT 'alias rejected', ip, 0 FROM reserved WHERE geoip_get(ip, 'rejecting') IS NOT NULL;
+SELECT 'alias public', ip, 0 FROM public WHERE geoip_get(ip, 'rejecting') IS NULL;
+SELECT 'alias off', geoip_reject_reserved(0, 'rejecting') = 0 AND geoip_reject_reserved(NULL, 'city') = 0;
+SELECT 'alias found', ip, 0 FROM reserved WHERE geoip_get(ip, 'rejecting') IS NULL;
+-- error: Unknown database
+SELECT geoip_reject_reserved(1, 'nowhere');
@@ -0,0 +1,47 @@
+-- geoip_stats counts every call of every lookup function by outcome, along with the latency of the calls.
+SELECT 'setup', geoip_reject_reserved(0) = 0;
+
+CREATE TABLE before AS SELECT * FROM geoip_stats;
+SELECT 'functions', count(*) = 20 AND count(DISTINCT function) = 20 FROM before;
+
+-- A public network start, looked up once by nothing but this sequence.
+CREATE TABLE found AS SELECT cidr_start(network) AS ip FROM city_networks
+    WHERE geoip_ip_class(cidr_start(network)) = 'public' AND instr(network, ':') = 0 LIMIT 1;
+
+-- Walked and cached, then answered by the cache, for an address with a record and one without.
+SELECT 'miss', geoip_timezone(ip) IS NOT NULL FROM found;
+SELECT 'hit', geoip_timezone(ip) IS NOT NULL FROM found;
+SELECT 'not found', geoip_timezone('2001:db8::1') IS NULL;
+SELECT 'not found hit', geoip_timezone('2001:db8::1') IS NULL;
+
+-- Rejected without a walk, NULL input, and malformed input under the strict and the null policy.
+SELECT 'reject', geoip_reject_reserved(1) = 1;
+SELECT 'reserved', geoip_timezone('10.9.9.9') IS NULL;
+SELECT 'null input', geoip_timezone(NULL) IS NULL;
+-- error: Error from getaddrinfo for nope
+SELECT geoip_timezone('nope');
+SELECT 'set null', geoip_error_policy('null') = 'null';
+SELECT 'invalid', geoip_timezone('nope') IS NULL AND geoip_timezone(x'0102') IS NULL;
+
+SELECT 'counters', s.calls - b.calls, s.not_found - b.not_found, s.errors - b.errors,
+    s.cache_hits - b.cache_hits, s.cache_misses - b.cache_misses, s.reserved - b.reserved, s.invalid - b.invalid,
+    s.calls - b.calls = 9 AND s.not_found - b.not_found = 4 AND s.errors - b.errors = 1
+        AND s.cache_hits - b.cache_hits = 2 AND s.cache_misses - b.cache_misses = 2
+        AND s.reserved - b.reserved = 1 AND s.invalid - b.invalid = 2
+    FROM geoip_stats s JOIN before b USING (function) WHERE function = 'geoip_timezone';
+
+-- Functions looking up several databases count once per call, and nothing else moved.
+SELECT 'in_country', geoip_in_country(ip, 'US', 'DE', 'FR') IN (0, 1) FROM found;
+SELECT 'in_country counted', s.calls - b.calls = 1 AND s.cache_hits - b.cache_hits = 1
+    FROM geoip_stats s JOIN before b USING (function) WHERE function = 'geoip_in_country';
+SELECT 'untouched', function, 0 FROM geoip_stats s JOIN before b USING (function)
+    WHERE function NOT IN ('geoip_timezone', 'geoip_in_country') AND s.calls <> b.calls;
+
+-- Every call lands in one histogram bucket, the percentiles are bucket bounds taken from it.
+SELECT 'histogram', function, 0 FROM geoip_stats
+    WHERE NOT json_valid(histogram) OR (SELECT coalesce(sum(value), 0) FROM json_each(histogram)) <> calls;
+SELECT 'percentiles', function, 0 FROM geoip_stats
+    WHERE calls > 0 AND NOT (p50_ns > 0 AND p50_ns <= p99_ns AND p99_ns <= p999_ns
+        AND p999_ns <= (SELECT max(CAST(key AS INTEGER)) FROM json_each(histogram))
+        AND p50_ns IN (SELECT CAST(key AS INTEGER) FROM json_each(histogram)));
+SELECT 'idle', function, 0 FROM geoip_stats WHERE calls = 0 AND (histogram <> '{}' OR p50_ns <> 0);
@@ -0,0 +1,52 @@
+-- geoip_cidr_summary() adds up the generated networks under a prefix.
+SELECT 'setup', geoip_reject_reserved(0) = 0;
+
+-- The generated networks with their prefix length, leaving out IPv6 ones wider than the /64 ones.
+CREATE TABLE nets AS
+    SELECT network, CAST(substr(network, instr(network, '/') + 1) AS INTEGER) AS len, network LIKE '%:%' AS v6,
+        geoip_get(cidr_start(network), 'city', 'country.iso_code') AS country,
+        geoip_record_id(cidr_start(network)) AS id
+    FROM city_networks
+    WHERE network NOT LIKE '%:%' OR network LIKE '%/64';
+
+-- A generated network summarises to its own record.
+CREATE TABLE single AS
+    SELECT n.network, n.len, n.v6, n.country, s.value, s.addresses, s.share, s.networks, s.records
+    FROM (SELECT * FROM nets WHERE NOT v6 LIMIT 200) n, geoip_cidr_summary(n.network) s;
+INSERT INTO single
+    SELECT n.network, n.len, n.v6, n.country, s.value, s.addresses, s.share, s.networks, s.records
+    FROM (SELECT * FROM nets WHERE v6 LIMIT 200) n, geoip_cidr_summary(n.network) s;
+
+SELECT 'single rows', network, 0 FROM single GROUP BY network HAVING count(*) <> 1;
+SELECT 'single networks', count(DISTINCT network) = 400 FROM single;
+SELECT 'single value', network, 0 FROM single WHERE value IS NOT country;
+-- The 2^64 addresses of an IPv6 /64 no longer fit in an INTEGER, a power of two is exact as a REAL.
+SELECT 'single addresses', network, 0
+    FROM single WHERE addresses <> (CASE WHEN v6 THEN (1 << 62) * 4.0 ELSE 1 << (32 - len) END);
+SELECT 'single types', network, 0 FROM single WHERE typeof(addresses) <> (CASE WHEN v6 THEN 'real' ELSE 'integer' END);
+SELECT 'single share', network, 0 FROM single WHERE share <> 1.0;
+SELECT 'single counts', network, 0 FROM single WHERE networks <> 1 OR records <> 1;
+
+-- The /8 holding the most generated networks, checked against an aggregation of the networks under it.
+CREATE TABLE wide AS
+    SELECT substr(network, 1, instr(network, '.') - 1) || '.0.0.0/8' AS network FROM nets
+    WHERE NOT v6 GROUP BY 1 ORDER BY count(*) DESC, 1 LIMIT 1;
+
+CREATE TABLE expected AS
+    SELECT n.country AS value, sum(1 << (32 - n.len)) AS addresses, count(*) AS networks,
+        count(DISTINCT n.id) AS records
+    FROM nets n, wide w WHERE NOT n.v6 AND ip_in_cidr(cidr_start(n.network), w.network) GROUP BY n.country;
+
+CREATE TABLE actual AS
+    SELECT s.value, s.addresses, s.share, s.networks, s.records FROM wide w, geoip_cidr_summary(w.network) s;
+
+SELECT 'wide networks', count(*) > 50
+    FROM nets n, wide w WHERE NOT n.v6 AND ip_in_cidr(cidr_start(n.network), w.network);
+SELECT 'wide missing', value, addresses, 0 FROM (SELECT value, addresses, networks, records FROM expected
+    EXCEPT SELECT value, addresses, networks, records FROM actual);
+SELECT 'wide extra', value, addresses, 0 FROM (SELECT value, addresses, networks, records FROM actual
+    EXCEPT SELECT value, addresses, networks, records FROM expected);
+SELECT 'wide share', value, 0 FROM actual WHERE share <> addresses / 16777216.0;
+SELECT 'wide order', value, 0
+    FROM (SELECT value, addresses, lag(addresses) OVER (ORDER BY rowid) AS previous FROM actual)
+    WHERE addresses > previous;
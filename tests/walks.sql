@@ -0,0 +1,43 @@
+-- Every layout of the search tree answers every address like the others, for every record size.
+SELECT 'setup', geoip_reject_reserved(0) = 0;
+
+-- Each database is opened once per layout: walked through the file mapping by the kernel specialised for its record
+-- size, copied, and relaid out into cache-line-sized blocks.
+CREATE TABLE dbs (file TEXT, name TEXT, v6 INTEGER);
+INSERT INTO dbs VALUES ('walk-24.mmdb', 'w24', 1), ('walk-28.mmdb', 'w28', 1), ('walk-32.mmdb', 'w32', 1),
+    ('walk-v4.mmdb', 'wv4', 0);
+
+SELECT 'open ' || name, geoip_open(name || '_mmap', file, 'mode=mmap') >= 0
+    AND geoip_open(name || '_tree', file, 'mode=tree') >= 0 AND geoip_open(name || '_blocked', file, 'mode=blocked') >= 0
+    FROM dbs;
+
+-- A relayout that fails its check against the file falls back to the mapping, which would compare nothing.
+SELECT 'blocked in use ' || name, json_extract(geoip_residency(name || '_blocked'), '$.open_mode') = 'blocked'
+    AND json_extract(geoip_residency(name || '_blocked'), '$.blocked_bytes') > 0
+    FROM dbs;
+
+-- The networks of every database as listed by a walk over its whole tree, which every lookup has to agree with.
+CREATE TABLE networks (name TEXT, network TEXT, id INTEGER);
+INSERT INTO networks SELECT d.name, n.network, n.id FROM dbs d, geoip_networks_near(0, 0, 20040, d.name || '_mmap') n;
+
+SELECT 'networks ' || name, (SELECT count(*) FROM networks n WHERE n.name = d.name) > 10000 FROM dbs d;
+
+-- The bounds of every network, and random addresses that mostly fall between the networks.
+CREATE TABLE addrs (name TEXT, ip BLOB, id INTEGER);
+INSERT INTO addrs SELECT name, cidr_start(network), id FROM networks;
+INSERT INTO addrs SELECT name, cidr_end(network), id FROM networks;
+WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 20000)
+    INSERT INTO addrs SELECT d.name, ip_to_blob(abs(random()) % 4294967296), NULL FROM dbs d, n;
+WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 20000)
+    INSERT INTO addrs SELECT d.name, randomblob(16), NULL FROM dbs d, n WHERE d.v6;
+
+CREATE TABLE found AS
+    SELECT name, ip, id, geoip_record_id(ip, name || '_mmap') AS mmap, geoip_record_id(ip, name || '_tree') AS tree,
+        geoip_record_id(ip, name || '_blocked') AS blocked
+    FROM addrs;
+
+SELECT 'layouts agree', name, blob_to_ip(ip), 0 FROM found WHERE mmap IS NOT tree OR mmap IS NOT blocked;
+SELECT 'networks found', name, blob_to_ip(ip), 0 FROM found WHERE id IS NOT NULL AND mmap IS NOT id;
+SELECT 'random found ' || name,
+    (SELECT count(*) FROM found f WHERE f.name = d.name AND f.id IS NULL AND f.mmap IS NOT NULL) > 0
+    FROM dbs d;
@@ -0,0 +1,40 @@
+-- Lookup caches are saved to warm-start files named after the alias of their database, and loaded again when a
+-- database is opened under that alias.
+SELECT 'setup', geoip_reject_reserved(0) = 0;
+
+CREATE TABLE addrs AS SELECT cidr_start(network) AS ip FROM city_networks LIMIT 1000;
+CREATE TABLE hits (n INTEGER);
+
+-- Only the databases opened with warm_start=1 are saved when the last connection closes.
+SELECT 'open', geoip_open('warm', 'GeoLite2-City.mmdb', 'warm_start=1') = 1
+    AND geoip_open('Odd/Name', 'GeoLite2-City.mmdb', 'warm_start=1') = 1
+    AND geoip_open('cold', 'GeoLite2-City.mmdb', 'warm_start=0') = 1;
+SELECT 'looked up', count(geoip_get(ip, 'warm')) = 1000 AND count(geoip_get(ip, 'Odd/Name')) = 1000
+    AND count(geoip_get(ip, 'cold')) = 1000
+    FROM addrs;
+-- error: Invalid value '2' for option 'warm_start'
+SELECT geoip_open('bad', 'GeoLite2-City.mmdb', 'warm_start=2');
+
+-- reconnect
+SELECT 'reopen', geoip_close('warm') = 1 AND geoip_close('Odd/Name') = 1 AND geoip_close('cold') = 1
+    AND geoip_open('warm', 'GeoLite2-City.mmdb') = 1 AND geoip_open('Odd/Name', 'GeoLite2-City.mmdb') = 1
+    AND geoip_open('cold', 'GeoLite2-City.mmdb') = 1;
+SELECT 'files loaded', mapped('warm.warm') = 1 AND mapped('odd_name.warm') = 1;
+
+-- The lookups of the saved addresses are answered by the loaded files, the unsaved database walks its tree again. A
+-- few addresses share a slot of the direct-mapped cache with another one and were not saved.
+INSERT INTO hits SELECT cache_hits FROM geoip_stats WHERE function = 'geoip_get';
+SELECT 'cold walked', count(geoip_get(ip, 'cold')) = 1000 FROM addrs;
+SELECT 'cold not saved', cache_hits = (SELECT n FROM hits) FROM geoip_stats WHERE function = 'geoip_get';
+SELECT 'warm found', count(geoip_get(ip, 'warm')) = 1000 AND count(geoip_get(ip, 'Odd/Name')) = 1000 FROM addrs;
+SELECT 'warm hits', cache_hits - (SELECT n FROM hits) BETWEEN 1950 AND 2000 FROM geoip_stats WHERE function = 'geoip_get';
+SELECT 'warm records', ip, 0 FROM addrs WHERE geoip_get(ip, 'warm') IS NOT geoip_get(ip, 'cold');
+
+-- geoip_cache_save() saves every open database right away.
+SELECT 'explicit save', geoip_cache_save() > 2900;
+SELECT 'reopen cold', geoip_close('cold') = 1 AND geoip_open('cold', 'GeoLite2-City.mmdb') = 1
+    AND mapped('cold.warm') = 1;
+DELETE FROM hits;
+INSERT INTO hits SELECT cache_hits FROM geoip_stats WHERE function = 'geoip_get';
+SELECT 'cold saved', count(geoip_get(ip, 'cold')) = 1000 FROM addrs;
+SELECT 'cold hits', cache_hits - (SELECT n FROM hits) BETWEEN 975 AND 1000 FROM geoip_stats WHERE function = 'geoip_get';
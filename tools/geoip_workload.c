@@ -0,0 +1,84 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "workload.h"
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "Writes a stream of IP addresses, one per line.\n"
+        "  --output FILE      Write to FILE instead of standard output\n"
+        "  --replay FILE      Replay addresses from FILE, one per line\n"
+        "  --replay-sqlite DB Replay addresses from a column of a SQLite database, see --table and --column\n"
+        "  --table NAME       Table to replay from (default: ips)\n"
+        "  --column NAME      Column to replay from (default: ip)\n",
+        argv0);
+    workload_usage(stderr);
+}
+
+int main(int argc, char **argv) {
+    workload_options options;
+    workload w;
+    const char *output = NULL, *replay = NULL, *replay_sqlite = NULL, *table = "ips", *column = "ip";
+    char error[256];
+    bool count_set = false;
+    int rc;
+
+    workload_defaults(&options);
+
+    for (int i = 1; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (value == NULL) {
+            usage(argv[0]);
+            return 1;
+        }
+
+        if (strcmp(argv[i], "--output") == 0)
+            output = value;
+        else if (strcmp(argv[i], "--replay") == 0)
+            replay = value;
+        else if (strcmp(argv[i], "--replay-sqlite") == 0)
+            replay_sqlite = value;
+        else if (strcmp(argv[i], "--table") == 0)
+            table = value;
+        else if (strcmp(argv[i], "--column") == 0)
+            column = value;
+        else if (!workload_parse_option(&options, argv[i], value)) {
+            usage(argv[0]);
+            return 1;
+        }
+
+        count_set |= strcmp(argv[i], "--count") == 0;
+        i++;
+    }
+
+    /* Replays keep their own length unless a count was asked for. */
+    if (replay != NULL)
+        rc = workload_replay_file(replay, count_set ? options.count : 0, &w, error, sizeof(error));
+    else if (replay_sqlite != NULL)
+        rc = workload_replay_sqlite(replay_sqlite, table, column, count_set ? options.count : 0, &w, error, sizeof(error));
+    else
+        rc = workload_generate(&options, &w, error, sizeof(error));
+
+    if (rc != 0) {
+        fprintf(stderr, "%s\n", error);
+        return 1;
+    }
+
+    FILE *fp = output != NULL ? fopen(output, "w") : stdout;
+    if (fp == NULL) {
+        fprintf(stderr, "Unable to create %s\n", output);
+        workload_free(&w);
+        return 1;
+    }
+
+    for (size_t i = 0; i < w.count; i++)
+        fprintf(fp, "%s\n", w.ips[i]);
+
+    if (fp != stdout)
+        fclose(fp);
+
+    workload_free(&w);
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include <stdlib.h>
+#include <string.h>
+#include "mmdb_writer.h"
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "Usage: %s [options] OUTPUT.mmdb\n"
+        "  --kind city|asn        Shape of the data records (default: city)\n"
+        "  --networks N           Number of networks in the search tree (default: 100000)\n"
+        "  --fanout N             Number of networks sharing one data record (default: 4 for city, 32 for asn)\n"
+        "  --record-size 24|28|32 Search tree record size in bits (default: 28 for city, 24 for asn)\n"
+        "  --ip-version 4|6       Build an IPv4-only or an IPv6 search tree (default: 6)\n"
+        "  --ipv6-share F         Fraction of IPv6 networks in an IPv6 tree (default: 0.25)\n"
+        "  --v4-prefixes SPEC     IPv4 prefix length weights, e.g. 16:2,24:60,32:5\n"
+        "  --v6-prefixes SPEC     IPv6 prefix length weights, e.g. 32:10,48:50,64:15\n"
+        "  --seed N               Generator seed, equal seeds produce identical files (default: 1)\n"
+        "  --build-epoch N        build_epoch written to the metadata (default: 1700000000)\n"
+        "  --list FILE            Write every generated network to FILE as address/prefix\n",
+        argv0);
+}
+
+int main(int argc, char **argv) {
+    mmdb_writer_options options;
+    const char *output = NULL, *list = NULL, *v4 = NULL, *v6 = NULL;
+    char error[256];
+    int kind = MMDB_WRITER_CITY;
+
+    /* The kind decides the defaults, so it is looked up before anything else. */
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--kind") == 0 && strcmp(argv[i + 1], "asn") == 0)
+            kind = MMDB_WRITER_ASN;
+    }
+
+    mmdb_writer_defaults(&options, kind);
+
+    for (int i = 1; i < argc; i++) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (argv[i][0] != '-') {
+            output = argv[i];
+            continue;
+        }
+
+        if (value == NULL) {
+            usage(argv[0]);
+            return 1;
+        }
+
+        if (strcmp(argv[i], "--kind") == 0) {
+            if (strcmp(value, "city") != 0 && strcmp(value, "asn") != 0) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--networks") == 0)
+            options.networks = strtoull(value, NULL, 10);
+        else if (strcmp(argv[i], "--fanout") == 0)
+            options.fanout = strtoull(value, NULL, 10);
+        else if (strcmp(argv[i], "--record-size") == 0)
+            options.record_size = atoi(value);
+        else if (strcmp(argv[i], "--ip-version") == 0)
+            options.ip_version = atoi(value);
+        else if (strcmp(argv[i], "--ipv6-share") == 0)
+            options.ipv6_share = atof(value);
+        else if (strcmp(argv[i], "--v4-prefixes") == 0)
+            v4 = value;
+        else if (strcmp(argv[i], "--v6-prefixes") == 0)
+            v6 = value;
+        else if (strcmp(argv[i], "--seed") == 0)
+            options.seed = strtoull(value, NULL, 10);
+        else if (strcmp(argv[i], "--build-epoch") == 0)
+            options.build_epoch = strtoull(value, NULL, 10);
+        else if (strcmp(argv[i], "--list") == 0)
+            list = value;
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+
+        i++;
+    }
+
+    if (output == NULL) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (v4 != NULL && mmdb_writer_parse_prefixes(v4, options.v4_prefixes, &options.v4_prefix_count, 32) != 0) {
+        fprintf(stderr, "Invalid IPv4 prefix distribution \"%s\"\n", v4);
+        return 1;
+    }
+
+    if (v6 != NULL && mmdb_writer_parse_prefixes(v6, options.v6_prefixes, &options.v6_prefix_count, 128) != 0) {
+        fprintf(stderr, "Invalid IPv6 prefix distribution \"%s\"\n", v6);
+        return 1;
+    }
+
+    if (list != NULL && (options.network_list = fopen(list, "w")) == NULL) {
+        fprintf(stderr, "Unable to create %s\n", list);
+        return 1;
+    }
+
+    int rc = mmdb_writer_write(&options, output, error, sizeof(error));
+
+    if (options.network_list != NULL)
+        fclose(options.network_list);
+
+    if (rc != 0) {
+        fprintf(stderr, "%s\n", error);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,878 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mmdb_writer.h"
+
+#ifdef _WIN32
+#   include <Ws2tcpip.h>
+#else
+#   include <arpa/inet.h>
+#endif
+
+#define METADATA_MARKER      "\xAB\xCD\xEFMaxMind.com" /**< The marker libmaxminddb searches for at the end of the file. */
+#define DATA_SEPARATOR_SIZE  16                          /**< The zero bytes between the search tree and the data section. */
+#define TREE_EMPTY           0u                          /**< A child that holds nothing, node 0 is the root so it is never a child. */
+#define TREE_DATA            0x80000000u                 /**< A child that points at a data record, the low bits hold the record index. */
+#define STRING_DEDUP_MIN     4                           /**< Shorter strings are cheaper to repeat than to point at. */
+
+/**
+ * The data types of the MaxMind DB format.
+ */
+enum {
+    TYPE_POINTER = 1,
+    TYPE_UTF8_STRING = 2,
+    TYPE_DOUBLE = 3,
+    TYPE_UINT16 = 5,
+    TYPE_UINT32 = 6,
+    TYPE_MAP = 7,
+    TYPE_UINT64 = 9,
+    TYPE_ARRAY = 11
+};
+
+/**
+ * A growable byte buffer.
+ */
+typedef struct writer_buf {
+    uint8_t *data;    /**< The bytes written so far. */
+    size_t size;      /**< The number of bytes written. */
+    size_t capacity;  /**< The allocated size of data. */
+    bool failed;      /**< Set once an allocation failed, every later write is dropped. */
+} writer_buf;
+
+/**
+ * A hash set of the strings already in the data section, so repeated strings become pointers.
+ */
+typedef struct writer_strings {
+    char **keys;        /**< The strings, NULL for free slots. */
+    uint32_t *offsets;  /**< The data section offset of every string. */
+    size_t count;       /**< The number of strings stored. */
+    size_t capacity;    /**< The number of slots, always a power of two. */
+} writer_strings;
+
+/**
+ * The search tree while it is being built, every node holds its left and right child.
+ */
+typedef struct writer_tree {
+    uint32_t (*nodes)[2]; /**< The nodes, node 0 is the root. */
+    size_t count;         /**< The number of nodes. */
+    size_t capacity;      /**< The allocated number of nodes. */
+} writer_tree;
+
+/**
+ * A country used to fill City-shaped records.
+ */
+typedef struct writer_country {
+    const char *iso_code;
+    const char *name;
+    const char *continent_code;
+    const char *continent_name;
+    const char *time_zone;
+    double latitude;
+    double longitude;
+} writer_country;
+
+static const writer_country countries[] = {
+    { "US", "United States",  "NA", "North America", "America/Chicago",     39.76,  -98.50 },
+    { "CA", "Canada",         "NA", "North America", "America/Toronto",     56.13, -106.35 },
+    { "BR", "Brazil",         "SA", "South America", "America/Sao_Paulo",  -14.24,  -51.93 },
+    { "GB", "United Kingdom", "EU", "Europe",        "Europe/London",       54.00,   -2.00 },
+    { "DE", "Germany",        "EU", "Europe",        "Europe/Berlin",       51.30,    9.49 },
+    { "FR", "France",         "EU", "Europe",        "Europe/Paris",        46.23,    2.21 },
+    { "NL", "Netherlands",    "EU", "Europe",        "Europe/Amsterdam",    52.38,    4.90 },
+    { "RU", "Russia",         "EU", "Europe",        "Europe/Moscow",       55.75,   37.62 },
+    { "IN", "India",          "AS", "Asia",          "Asia/Kolkata",        20.59,   78.96 },
+    { "CN", "China",          "AS", "Asia",          "Asia/Shanghai",       35.86,  104.20 },
+    { "JP", "Japan",          "AS", "Asia",          "Asia/Tokyo",          36.20,  138.25 },
+    { "AU", "Australia",      "OC", "Oceania",       "Australia/Sydney",   -25.27,  133.78 },
+    { "ZA", "South Africa",   "AF", "Africa",        "Africa/Johannesburg", -30.56,  22.94 },
+    { "NG", "Nigeria",        "AF", "Africa",        "Africa/Lagos",         9.08,    8.68 }
+};
+
+#define COUNTRY_COUNT (sizeof(countries) / sizeof(countries[0]))
+
+/**
+ * A small, fast and deterministic pseudo-random generator (splitmix64).
+ * 
+ * @param state The generator state.
+ * @return      The next pseudo-random value.
+ */
+static uint64_t writer_random(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Draw a uniformly distributed number between 0 and 1.
+ * 
+ * @param state The generator state.
+ * @return      A number in [0, 1).
+ */
+static double writer_uniform(uint64_t *state) {
+    return (double)(writer_random(state) >> 11) / (double)(1ULL << 53);
+}
+
+static void buf_put(writer_buf *buf, const void *bytes, size_t size) {
+    if (buf->failed)
+        return;
+
+    if (buf->size + size > buf->capacity) {
+        size_t capacity = buf->capacity ? buf->capacity : 4096;
+        uint8_t *data;
+
+        while (capacity < buf->size + size)
+            capacity *= 2;
+
+        data = realloc(buf->data, capacity);
+        if (data == NULL) {
+            buf->failed = true;
+            return;
+        }
+
+        buf->data = data;
+        buf->capacity = capacity;
+    }
+
+    memcpy(buf->data + buf->size, bytes, size);
+    buf->size += size;
+}
+
+/**
+ * Write a control byte, the extended type byte where needed and the size bytes.
+ * 
+ * @param buf   The buffer to write to.
+ * @param type  The TYPE_* value.
+ * @param size  The payload size, or the number of entries of a map or array.
+ */
+static void enc_control(writer_buf *buf, int type, size_t size) {
+    uint8_t bytes[5];
+    size_t n = 1;
+
+    bytes[0] = (uint8_t)((type <= 7 ? type : 0) << 5);
+    if (type > 7)
+        bytes[n++] = (uint8_t)(type - 7);
+
+    if (size < 29) {
+        bytes[0] |= (uint8_t)size;
+    } else if (size < 285) {
+        bytes[0] |= 29;
+        bytes[n++] = (uint8_t)(size - 29);
+    } else if (size < 65821) {
+        bytes[0] |= 30;
+        bytes[n++] = (uint8_t)((size - 285) >> 8);
+        bytes[n++] = (uint8_t)(size - 285);
+    } else {
+        bytes[0] |= 31;
+        bytes[n++] = (uint8_t)((size - 65821) >> 16);
+        bytes[n++] = (uint8_t)((size - 65821) >> 8);
+        bytes[n++] = (uint8_t)(size - 65821);
+    }
+
+    buf_put(buf, bytes, n);
+}
+
+static void enc_uint(writer_buf *buf, int type, uint64_t value) {
+    uint8_t bytes[8];
+    size_t n = 0;
+
+    for (uint64_t v = value; v != 0; v >>= 8)
+        n++;
+
+    for (size_t i = 0; i < n; i++)
+        bytes[i] = (uint8_t)(value >> (8 * (n - 1 - i)));
+
+    enc_control(buf, type, n);
+    buf_put(buf, bytes, n);
+}
+
+static void enc_double(writer_buf *buf, double value) {
+    uint8_t bytes[8];
+    uint64_t bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+    for (int i = 0; i < 8; i++)
+        bytes[i] = (uint8_t)(bits >> (56 - 8 * i));
+
+    enc_control(buf, TYPE_DOUBLE, 8);
+    buf_put(buf, bytes, 8);
+}
+
+static void enc_pointer(writer_buf *buf, uint32_t offset) {
+    uint8_t bytes[5];
+
+    if (offset < 2048) {
+        bytes[0] = (uint8_t)(TYPE_POINTER << 5 | (offset >> 8));
+        bytes[1] = (uint8_t)offset;
+        buf_put(buf, bytes, 2);
+    } else if (offset < 2048 + 524288) {
+        offset -= 2048;
+        bytes[0] = (uint8_t)(TYPE_POINTER << 5 | 1 << 3 | (offset >> 16));
+        bytes[1] = (uint8_t)(offset >> 8);
+        bytes[2] = (uint8_t)offset;
+        buf_put(buf, bytes, 3);
+    } else if (offset < 526336 + 134217728) {
+        offset -= 526336;
+        bytes[0] = (uint8_t)(TYPE_POINTER << 5 | 2 << 3 | (offset >> 24));
+        bytes[1] = (uint8_t)(offset >> 16);
+        bytes[2] = (uint8_t)(offset >> 8);
+        bytes[3] = (uint8_t)offset;
+        buf_put(buf, bytes, 4);
+    } else {
+        bytes[0] = (uint8_t)(TYPE_POINTER << 5 | 3 << 3);
+        bytes[1] = (uint8_t)(offset >> 24);
+        bytes[2] = (uint8_t)(offset >> 16);
+        bytes[3] = (uint8_t)(offset >> 8);
+        bytes[4] = (uint8_t)offset;
+        buf_put(buf, bytes, 5);
+    }
+}
+
+static uint32_t strings_hash(const char *s) {
+    uint32_t hash = 2166136261u;
+
+    while (*s)
+        hash = (hash ^ (uint8_t)*s++) * 16777619u;
+
+    return hash;
+}
+
+/**
+ * Find the slot of a string, or the free slot it would go into.
+ * 
+ * @param strings   The string set.
+ * @param s         The string to find.
+ * @return          The slot index.
+ */
+static size_t strings_slot(const writer_strings *strings, const char *s) {
+    size_t mask = strings->capacity - 1;
+    size_t slot = strings_hash(s) & mask;
+
+    while (strings->keys[slot] != NULL && strcmp(strings->keys[slot], s) != 0)
+        slot = (slot + 1) & mask;
+
+    return slot;
+}
+
+static bool strings_grow(writer_strings *strings) {
+    writer_strings grown = { 0 };
+
+    grown.capacity = strings->capacity ? strings->capacity * 2 : 1024;
+    grown.keys = calloc(grown.capacity, sizeof(char *));
+    grown.offsets = calloc(grown.capacity, sizeof(uint32_t));
+    if (grown.keys == NULL || grown.offsets == NULL) {
+        free(grown.keys);
+        free(grown.offsets);
+        return false;
+    }
+
+    for (size_t i = 0; i < strings->capacity; i++) {
+        if (strings->keys[i] == NULL)
+            continue;
+
+        size_t slot = strings_slot(&grown, strings->keys[i]);
+        grown.keys[slot] = strings->keys[i];
+        grown.offsets[slot] = strings->offsets[i];
+    }
+
+    grown.count = strings->count;
+    free(strings->keys);
+    free(strings->offsets);
+    *strings = grown;
+    return true;
+}
+
+static void strings_free(writer_strings *strings) {
+    for (size_t i = 0; i < strings->capacity; i++)
+        free(strings->keys[i]);
+
+    free(strings->keys);
+    free(strings->offsets);
+}
+
+/**
+ * Write a string, or a pointer to an earlier copy of it.
+ * 
+ * @param buf       The buffer to write to.
+ * @param strings   The strings already written to buf, NULL to never emit pointers.
+ * @param s         The string.
+ */
+static void enc_string(writer_buf *buf, writer_strings *strings, const char *s) {
+    size_t length = strlen(s);
+    size_t slot = 0;
+
+    if (strings != NULL && length >= STRING_DEDUP_MIN) {
+        if ((strings->count + 1) * 2 > strings->capacity && !strings_grow(strings)) {
+            buf->failed = true;
+            return;
+        }
+
+        slot = strings_slot(strings, s);
+        if (strings->keys[slot] != NULL) {
+            enc_pointer(buf, strings->offsets[slot]);
+            return;
+        }
+
+        strings->keys[slot] = strdup(s);
+        if (strings->keys[slot] == NULL) {
+            buf->failed = true;
+            return;
+        }
+
+        strings->offsets[slot] = (uint32_t)buf->size;
+        strings->count++;
+    }
+
+    enc_control(buf, TYPE_UTF8_STRING, length);
+    buf_put(buf, s, length);
+}
+
+/**
+ * Write a { "en": name } map.
+ */
+static void enc_names(writer_buf *buf, writer_strings *strings, const char *name) {
+    enc_control(buf, TYPE_MAP, 1);
+    enc_string(buf, strings, "en");
+    enc_string(buf, strings, name);
+}
+
+/**
+ * Write a GeoLite2-City shaped record.
+ * 
+ * @param buf       The data section.
+ * @param strings   The strings already in the data section.
+ * @param state     The generator state.
+ */
+static void enc_city_record(writer_buf *buf, writer_strings *strings, uint64_t *state) {
+    const writer_country *country = &countries[writer_random(state) % COUNTRY_COUNT];
+    uint32_t city = (uint32_t)(writer_random(state) % 20000);
+    uint32_t region = city % 500;
+    char name[32], code[16];
+
+    enc_control(buf, TYPE_MAP, 7);
+
+    enc_string(buf, strings, "city");
+    enc_control(buf, TYPE_MAP, 2);
+    enc_string(buf, strings, "geoname_id");
+    enc_uint(buf, TYPE_UINT32, 1000000 + city);
+    snprintf(name, sizeof(name), "City %u", city);
+    enc_string(buf, strings, "names");
+    enc_names(buf, strings, name);
+
+    enc_string(buf, strings, "continent");
+    enc_control(buf, TYPE_MAP, 2);
+    enc_string(buf, strings, "code");
+    enc_string(buf, strings, country->continent_code);
+    enc_string(buf, strings, "names");
+    enc_names(buf, strings, country->continent_name);
+
+    enc_string(buf, strings, "country");
+    enc_control(buf, TYPE_MAP, 2);
+    enc_string(buf, strings, "iso_code");
+    enc_string(buf, strings, country->iso_code);
+    enc_string(buf, strings, "names");
+    enc_names(buf, strings, country->name);
+
+    enc_string(buf, strings, "location");
+    enc_control(buf, TYPE_MAP, 4);
+    enc_string(buf, strings, "accuracy_radius");
+    enc_uint(buf, TYPE_UINT16, 1 + writer_random(state) % 1000);
+    enc_string(buf, strings, "latitude");
+    enc_double(buf, country->latitude + (writer_uniform(state) - 0.5) * 10.0);
+    enc_string(buf, strings, "longitude");
+    enc_double(buf, country->longitude + (writer_uniform(state) - 0.5) * 10.0);
+    enc_string(buf, strings, "time_zone");
+    enc_string(buf, strings, country->time_zone);
+
+    enc_string(buf, strings, "postal");
+    enc_control(buf, TYPE_MAP, 1);
+    enc_string(buf, strings, "code");
+    snprintf(code, sizeof(code), "%05u", (uint32_t)(writer_random(state) % 100000));
+    enc_string(buf, strings, code);
+
+    enc_string(buf, strings, "registered_country");
+    enc_control(buf, TYPE_MAP, 2);
+    enc_string(buf, strings, "iso_code");
+    enc_string(buf, strings, country->iso_code);
+    enc_string(buf, strings, "names");
+    enc_names(buf, strings, country->name);
+
+    enc_string(buf, strings, "subdivisions");
+    enc_control(buf, TYPE_ARRAY, 1);
+    enc_control(buf, TYPE_MAP, 2);
+    snprintf(code, sizeof(code), "R%u", region);
+    enc_string(buf, strings, "iso_code");
+    enc_string(buf, strings, code);
+    snprintf(name, sizeof(name), "Region %u", region);
+    enc_string(buf, strings, "names");
+    enc_names(buf, strings, name);
+}
+
+/**
+ * Write a GeoLite2-ASN shaped record.
+ * 
+ * @param buf       The data section.
+ * @param strings   The strings already in the data section.
+ * @param state     The generator state.
+ */
+static void enc_asn_record(writer_buf *buf, writer_strings *strings, uint64_t *state) {
+    uint32_t asn = 1 + (uint32_t)(writer_random(state) % 400000);
+    char name[32];
+
+    snprintf(name, sizeof(name), "Synthetic Network %u", asn % 50000);
+
+    enc_control(buf, TYPE_MAP, 2);
+    enc_string(buf, strings, "autonomous_system_number");
+    enc_uint(buf, TYPE_UINT32, asn);
+    enc_string(buf, strings, "autonomous_system_organization");
+    enc_string(buf, strings, name);
+}
+
+/**
+ * Append a node to the search tree.
+ * 
+ * @param tree  The search tree.
+ * @return      The index of the node, or TREE_DATA when out of memory.
+ */
+static uint32_t tree_node(writer_tree *tree) {
+    if (tree->count == tree->capacity) {
+        size_t capacity = tree->capacity ? tree->capacity * 2 : 65536;
+        uint32_t (*nodes)[2];
+
+        if (capacity >= TREE_DATA)
+            return TREE_DATA;
+
+        nodes = realloc(tree->nodes, capacity * sizeof(*nodes));
+        if (nodes == NULL)
+            return TREE_DATA;
+
+        tree->nodes = nodes;
+        tree->capacity = capacity;
+    }
+
+    tree->nodes[tree->count][0] = TREE_EMPTY;
+    tree->nodes[tree->count][1] = TREE_EMPTY;
+    return (uint32_t)tree->count++;
+}
+
+static inline int address_bit(const uint8_t *bytes, unsigned int bit) {
+    return (bytes[bit >> 3] >> (7 - (bit & 7))) & 1;
+}
+
+/**
+ * Walk a path from the root, creating the nodes that are missing.
+ * 
+ * @param tree      The search tree.
+ * @param bytes     The 16 byte address of the path.
+ * @param first     The first bit to follow, 96 for an IPv4-only tree.
+ * @param depth     The number of bits to follow.
+ * @param node      Receives the node whose child the last bit selects.
+ * @return          0 when the path is free, 1 when an existing network covers it, -1 when out of memory.
+ */
+static int tree_path(writer_tree *tree, const uint8_t *bytes, unsigned int first, unsigned int depth, uint32_t *node) {
+    uint32_t current = 0;
+
+    for (unsigned int i = 0; i + 1 < depth; i++) {
+        uint32_t *child = &tree->nodes[current][address_bit(bytes, first + i)];
+
+        if (*child & TREE_DATA)
+            return 1;
+
+        if (*child == TREE_EMPTY) {
+            uint32_t created = tree_node(tree);
+
+            if (created == TREE_DATA)
+                return -1;
+
+            /* tree_node() may have moved the nodes */
+            child = &tree->nodes[current][address_bit(bytes, first + i)];
+            *child = created;
+        }
+
+        current = *child;
+    }
+
+    *node = current;
+    return 0;
+}
+
+/**
+ * Place a network in the search tree.
+ * 
+ * @param tree      The search tree.
+ * @param bytes     The 16 byte network address.
+ * @param first     The first bit of the address the tree starts at.
+ * @param depth     The prefix length relative to first.
+ * @param record    The index of the data record of the network.
+ * @return          0 when placed, 1 when it overlaps an existing network, -1 when out of memory.
+ */
+static int tree_insert(writer_tree *tree, const uint8_t *bytes, unsigned int first, unsigned int depth, uint32_t record) {
+    uint32_t node;
+    int rc = tree_path(tree, bytes, first, depth, &node);
+
+    if (rc != 0)
+        return rc;
+
+    uint32_t *child = &tree->nodes[node][address_bit(bytes, first + depth - 1)];
+    if (*child != TREE_EMPTY)
+        return 1;
+
+    *child = TREE_DATA | record;
+    return 0;
+}
+
+/**
+ * Create the IPv4 subtree at ::/96 and alias ::ffff:0:0/96 to it, the way MaxMind's own databases do.
+ * 
+ * @param tree  The search tree.
+ * @return      0 on success, -1 when out of memory.
+ */
+static int tree_ipv4_alias(writer_tree *tree) {
+    uint8_t mapped[16] = { [10] = 0xFF, [11] = 0xFF };
+    uint8_t zero[16] = { 0 };
+    uint32_t node, ipv4_root, alias;
+
+    if (tree_path(tree, zero, 0, 96, &node) != 0 || (ipv4_root = tree_node(tree)) == TREE_DATA)
+        return -1;
+
+    tree->nodes[node][0] = ipv4_root;
+
+    if (tree_path(tree, mapped, 0, 96, &alias) != 0)
+        return -1;
+
+    tree->nodes[alias][1] = ipv4_root;
+    return 0;
+}
+
+/**
+ * Draw a prefix length from a distribution.
+ * 
+ * @param prefixes  The distribution.
+ * @param count     The number of entries in prefixes.
+ * @param state     The generator state.
+ * @return          The prefix length.
+ */
+static unsigned int pick_prefix(const mmdb_writer_prefix *prefixes, size_t count, uint64_t *state) {
+    double total = 0.0, target;
+
+    for (size_t i = 0; i < count; i++)
+        total += prefixes[i].weight;
+
+    target = writer_uniform(state) * total;
+    for (size_t i = 0; i < count; i++) {
+        if (target < prefixes[i].weight)
+            return prefixes[i].length;
+
+        target -= prefixes[i].weight;
+    }
+
+    return prefixes[count - 1].length;
+}
+
+static void mask_address(uint8_t *bytes, unsigned int bits) {
+    for (unsigned int i = 0; i < 16; i++) {
+        if (bits >= 8 * (i + 1))
+            continue;
+
+        bytes[i] &= bits > 8 * i ? (uint8_t)(0xFF << (8 - (bits - 8 * i))) : 0;
+    }
+}
+
+static void write_network_list(FILE *fp, const uint8_t *bytes, bool ipv4, unsigned int length) {
+    char buffer[INET6_ADDRSTRLEN];
+
+    inet_ntop(ipv4 ? AF_INET : AF_INET6, ipv4 ? bytes + 12 : bytes, buffer, sizeof(buffer));
+    fprintf(fp, "%s/%u\n", buffer, length);
+}
+
+/**
+ * Write the metadata section.
+ * 
+ * @param buf           The buffer to write to.
+ * @param options       The parameters of the database.
+ * @param node_count    The number of search tree nodes.
+ */
+static void enc_metadata(writer_buf *buf, const mmdb_writer_options *options, uint32_t node_count) {
+    const char *type = options->kind == MMDB_WRITER_ASN ? "GeoLite2-ASN" : "GeoLite2-City";
+
+    buf_put(buf, METADATA_MARKER, sizeof(METADATA_MARKER) - 1);
+    enc_control(buf, TYPE_MAP, 9);
+    enc_string(buf, NULL, "binary_format_major_version");
+    enc_uint(buf, TYPE_UINT16, 2);
+    enc_string(buf, NULL, "binary_format_minor_version");
+    enc_uint(buf, TYPE_UINT16, 0);
+    enc_string(buf, NULL, "build_epoch");
+    enc_uint(buf, TYPE_UINT64, options->build_epoch);
+    enc_string(buf, NULL, "database_type");
+    enc_string(buf, NULL, type);
+    enc_string(buf, NULL, "description");
+    enc_control(buf, TYPE_MAP, 1);
+    enc_string(buf, NULL, "en");
+    enc_string(buf, NULL, "Synthetic database generated by mmdb_gen");
+    enc_string(buf, NULL, "ip_version");
+    enc_uint(buf, TYPE_UINT16, (uint64_t)options->ip_version);
+    enc_string(buf, NULL, "languages");
+    enc_control(buf, TYPE_ARRAY, 1);
+    enc_string(buf, NULL, "en");
+    enc_string(buf, NULL, "node_count");
+    enc_uint(buf, TYPE_UINT32, node_count);
+    enc_string(buf, NULL, "record_size");
+    enc_uint(buf, TYPE_UINT16, (uint64_t)options->record_size);
+}
+
+/**
+ * Serialize the search tree.
+ * 
+ * @param fp            The file to write to.
+ * @param tree          The search tree.
+ * @param record_size   The record size in bits.
+ * @param offsets       The data section offset of every record.
+ * @return              0 on success, -1 on a write error.
+ */
+static int write_tree(FILE *fp, const writer_tree *tree, int record_size, const uint32_t *offsets) {
+    uint32_t node_count = (uint32_t)tree->count;
+
+    for (size_t i = 0; i < tree->count; i++) {
+        uint32_t value[2];
+        uint8_t bytes[8];
+        size_t n = 0;
+
+        for (int side = 0; side < 2; side++) {
+            uint32_t child = tree->nodes[i][side];
+
+            if (child == TREE_EMPTY)
+                value[side] = node_count;
+            else if (child & TREE_DATA)
+                value[side] = node_count + DATA_SEPARATOR_SIZE + offsets[child & ~TREE_DATA];
+            else
+                value[side] = child;
+        }
+
+        switch (record_size) {
+            case 24:
+                for (int side = 0; side < 2; side++) {
+                    bytes[n++] = (uint8_t)(value[side] >> 16);
+                    bytes[n++] = (uint8_t)(value[side] >> 8);
+                    bytes[n++] = (uint8_t)value[side];
+                }
+                break;
+            case 28:
+                bytes[n++] = (uint8_t)(value[0] >> 16);
+                bytes[n++] = (uint8_t)(value[0] >> 8);
+                bytes[n++] = (uint8_t)value[0];
+                bytes[n++] = (uint8_t)(((value[0] >> 24) & 0x0F) << 4 | ((value[1] >> 24) & 0x0F));
+                bytes[n++] = (uint8_t)(value[1] >> 16);
+                bytes[n++] = (uint8_t)(value[1] >> 8);
+                bytes[n++] = (uint8_t)value[1];
+                break;
+            default:
+                for (int side = 0; side < 2; side++) {
+                    bytes[n++] = (uint8_t)(value[side] >> 24);
+                    bytes[n++] = (uint8_t)(value[side] >> 16);
+                    bytes[n++] = (uint8_t)(value[side] >> 8);
+                    bytes[n++] = (uint8_t)value[side];
+                }
+                break;
+        }
+
+        if (fwrite(bytes, 1, n, fp) != n)
+            return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Fill in the default parameters of a database.
+ * 
+ * @param options   The parameters to initialize.
+ * @param kind      MMDB_WRITER_CITY or MMDB_WRITER_ASN.
+ */
+void mmdb_writer_defaults(mmdb_writer_options *options, int kind) {
+    static const mmdb_writer_prefix v4[] = { { 16, 2 }, { 20, 8 }, { 22, 15 }, { 24, 60 }, { 28, 10 }, { 32, 5 } };
+    static const mmdb_writer_prefix v6[] = { { 32, 10 }, { 40, 10 }, { 48, 50 }, { 56, 15 }, { 64, 15 } };
+
+    memset(options, 0, sizeof(*options));
+    options->kind = kind;
+    options->networks = 100000;
+    options->fanout = kind == MMDB_WRITER_ASN ? 32 : 4;
+    options->record_size = kind == MMDB_WRITER_ASN ? 24 : 28;
+    options->ip_version = 6;
+    options->ipv6_share = 0.25;
+    options->seed = 1;
+    options->build_epoch = 1700000000;
+
+    memcpy(options->v4_prefixes, v4, sizeof(v4));
+    options->v4_prefix_count = sizeof(v4) / sizeof(v4[0]);
+    memcpy(options->v6_prefixes, v6, sizeof(v6));
+    options->v6_prefix_count = sizeof(v6) / sizeof(v6[0]);
+}
+
+/**
+ * Parse a prefix length distribution such as "16:1,24:8,32:1".
+ * 
+ * @param spec          The comma separated length:weight pairs.
+ * @param prefixes      Receives the distribution, at least MMDB_WRITER_MAX_PREFIXES entries.
+ * @param count         Receives the number of entries.
+ * @param max_length    The longest prefix allowed, 32 or 128.
+ * @return              0 on success, -1 when spec is malformed.
+ */
+int mmdb_writer_parse_prefixes(const char *spec, mmdb_writer_prefix *prefixes, size_t *count, unsigned int max_length) {
+    const char *p = spec;
+
+    *count = 0;
+    while (*p != '\0') {
+        char *end;
+        unsigned long length = strtoul(p, &end, 10);
+        double weight;
+
+        if (end == p || *end != ':' || length == 0 || length > max_length || *count == MMDB_WRITER_MAX_PREFIXES)
+            return -1;
+
+        p = end + 1;
+        weight = strtod(p, &end);
+        if (end == p || weight < 0.0 || (*end != ',' && *end != '\0'))
+            return -1;
+
+        prefixes[*count].length = (unsigned int)length;
+        prefixes[(*count)++].weight = weight;
+        p = *end == ',' ? end + 1 : end;
+    }
+
+    return *count ? 0 : -1;
+}
+
+/**
+ * Generate a database and write it to a file.
+ * 
+ * @param options       The parameters of the database.
+ * @param path          The file to write.
+ * @param error         Receives a message when the database could not be written.
+ * @param error_size    The size of the error buffer.
+ * @return              0 on success, -1 on failure.
+ */
+int mmdb_writer_write(const mmdb_writer_options *options, const char *path, char *error, size_t error_size) {
+    writer_tree tree = { 0 };
+    writer_buf data = { 0 }, metadata = { 0 };
+    writer_strings strings = { 0 };
+    uint32_t *offsets = NULL;
+    uint64_t state = options->seed, records, placed = 0, attempts = 0;
+    unsigned int first = options->ip_version == 4 ? 96 : 0;
+    FILE *fp = NULL;
+    int rc = -1;
+
+    if (options->record_size != 24 && options->record_size != 28 && options->record_size != 32) {
+        snprintf(error, error_size, "Unsupported record size %d", options->record_size);
+        return -1;
+    }
+
+    if ((options->ip_version != 4 && options->ip_version != 6) || options->networks == 0 || options->fanout == 0 ||
+        options->v4_prefix_count == 0 || (options->ip_version == 6 && options->v6_prefix_count == 0)) {
+        snprintf(error, error_size, "Invalid database parameters");
+        return -1;
+    }
+
+    records = (options->networks + options->fanout - 1) / options->fanout;
+    if (records >= TREE_DATA || (offsets = malloc(records * sizeof(uint32_t))) == NULL) {
+        snprintf(error, error_size, "Too many data records");
+        return -1;
+    }
+
+    if (tree_node(&tree) == TREE_DATA || (options->ip_version == 6 && tree_ipv4_alias(&tree) != 0)) {
+        snprintf(error, error_size, "Out of memory");
+        goto cleanup;
+    }
+
+    /* Give up when a fresh network overlaps an existing one far more often than it can be placed. */
+    while (placed < options->networks && attempts++ < options->networks * 16 + 1024) {
+        bool ipv6 = options->ip_version == 6 && writer_uniform(&state) < options->ipv6_share;
+        unsigned int length = ipv6 ? pick_prefix(options->v6_prefixes, options->v6_prefix_count, &state)
+                                   : pick_prefix(options->v4_prefixes, options->v4_prefix_count, &state);
+        uint64_t hi = writer_random(&state), lo = writer_random(&state);
+        uint64_t record = placed / options->fanout;
+        uint8_t bytes[16];
+        int inserted;
+
+        for (int i = 0; i < 8; i++) {
+            bytes[i] = (uint8_t)(hi >> (56 - 8 * i));
+            bytes[8 + i] = (uint8_t)(lo >> (56 - 8 * i));
+        }
+
+        if (ipv6) {
+            bytes[0] = 0x20 | (bytes[0] & 0x1F); /* Keep to 2000::/3, clear of the IPv4 subtree and its alias */
+            mask_address(bytes, length);
+        } else {
+            memset(bytes, 0, 12);
+            mask_address(bytes, 96 + length);
+        }
+
+        inserted = tree_insert(&tree, bytes, first, ipv6 ? length : 96 + length - first, (uint32_t)record);
+        if (inserted < 0) {
+            snprintf(error, error_size, "Out of memory");
+            goto cleanup;
+        } else if (inserted > 0) {
+            continue;
+        }
+
+        if (placed % options->fanout == 0) {
+            offsets[record] = (uint32_t)data.size;
+            if (options->kind == MMDB_WRITER_ASN)
+                enc_asn_record(&data, &strings, &state);
+            else
+                enc_city_record(&data, &strings, &state);
+        }
+
+        if (options->network_list != NULL)
+            write_network_list(options->network_list, bytes, !ipv6, length);
+
+        placed++;
+    }
+
+    if (placed < options->networks) {
+        snprintf(error, error_size, "Only %llu of %llu networks fit, the prefix length distribution is too narrow",
+            (unsigned long long)placed, (unsigned long long)options->networks);
+        goto cleanup;
+    }
+
+    enc_metadata(&metadata, options, (uint32_t)tree.count);
+    if (data.failed || metadata.failed) {
+        snprintf(error, error_size, "Out of memory");
+        goto cleanup;
+    }
+
+    if ((uint64_t)tree.count + DATA_SEPARATOR_SIZE + data.size >= (1ULL << options->record_size)) {
+        snprintf(error, error_size, "%zu nodes and %zu bytes of data do not fit in %d bit records", tree.count, data.size, options->record_size);
+        goto cleanup;
+    }
+
+    fp = fopen(path, "wb");
+    if (fp == NULL) {
+        snprintf(error, error_size, "Unable to create %s", path);
+        goto cleanup;
+    }
+
+    static const uint8_t separator[DATA_SEPARATOR_SIZE] = { 0 };
+    if (write_tree(fp, &tree, options->record_size, offsets) != 0 ||
+        fwrite(separator, 1, sizeof(separator), fp) != sizeof(separator) ||
+        fwrite(data.data, 1, data.size, fp) != data.size ||
+        fwrite(metadata.data, 1, metadata.size, fp) != metadata.size) {
+        snprintf(error, error_size, "Unable to write %s", path);
+        goto cleanup;
+    }
+
+    rc = 0;
+
+cleanup:
+    if (fp != NULL && fclose(fp) != 0 && rc == 0) {
+        snprintf(error, error_size, "Unable to write %s", path);
+        rc = -1;
+    }
+
+    free(tree.nodes);
+    free(data.data);
+    free(metadata.data);
+    free(offsets);
+    strings_free(&strings);
+    return rc;
+}
@@ -0,0 +1,49 @@
+#ifndef MMDB_WRITER_H
+#define MMDB_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define MMDB_WRITER_MAX_PREFIXES 129 /**< Every prefix length from /0 to /128. */
+
+/**
+ * The shape of the generated database.
+ */
+enum {
+    MMDB_WRITER_CITY,   /**< Records shaped like GeoLite2-City: continent, country, subdivisions, city, location and postal. */
+    MMDB_WRITER_ASN     /**< Records shaped like GeoLite2-ASN: autonomous_system_number and autonomous_system_organization. */
+};
+
+/**
+ * The relative weight of one prefix length in the generated networks.
+ */
+typedef struct mmdb_writer_prefix {
+    unsigned int length; /**< The prefix length, relative to the address family (at most 32 for IPv4, 128 for IPv6). */
+    double weight;       /**< The relative frequency of this prefix length. */
+} mmdb_writer_prefix;
+
+/**
+ * The parameters of a generated database, see mmdb_writer_defaults() for the default values.
+ */
+typedef struct mmdb_writer_options {
+    int kind;                                           /**< MMDB_WRITER_CITY or MMDB_WRITER_ASN. */
+    uint64_t networks;                                  /**< The number of networks to place in the search tree. */
+    uint64_t fanout;                                    /**< The number of networks sharing one data record. */
+    int record_size;                                    /**< The search tree record size in bits: 24, 28 or 32. */
+    int ip_version;                                     /**< 4 for an IPv4-only tree, 6 for an IPv6 tree that also holds IPv4 under ::/96. */
+    double ipv6_share;                                  /**< The fraction of networks that are IPv6, only used when ip_version is 6. */
+    mmdb_writer_prefix v4_prefixes[MMDB_WRITER_MAX_PREFIXES]; /**< The prefix length distribution of IPv4 networks. */
+    size_t v4_prefix_count;                             /**< The number of entries in v4_prefixes. */
+    mmdb_writer_prefix v6_prefixes[MMDB_WRITER_MAX_PREFIXES]; /**< The prefix length distribution of IPv6 networks. */
+    size_t v6_prefix_count;                             /**< The number of entries in v6_prefixes. */
+    uint64_t seed;                                      /**< The seed of the generator, equal seeds produce identical files. */
+    uint64_t build_epoch;                               /**< The build_epoch written to the metadata. */
+    FILE *network_list;                                 /**< When set, every placed network is written to it as "address/prefix". */
+} mmdb_writer_options;
+
+void mmdb_writer_defaults(mmdb_writer_options *options, int kind);
+int mmdb_writer_parse_prefixes(const char *spec, mmdb_writer_prefix *prefixes, size_t *count, unsigned int max_length);
+int mmdb_writer_write(const mmdb_writer_options *options, const char *path, char *error, size_t error_size);
+
+#endif /* MMDB_WRITER_H */
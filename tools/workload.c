@@ -0,0 +1,544 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sqlite3.h"
+#include "workload.h"
+
+#ifdef _WIN32
+#   include <Ws2tcpip.h>
+#else
+#   include <arpa/inet.h>
+#endif
+
+#define WORKLOAD_MAX_LINE 256 /**< The longest line accepted from a replay or networks file. */
+
+/**
+ * A prefix the universe of addresses is clustered into.
+ */
+typedef struct workload_prefix {
+    uint8_t bytes[16];      /**< The network address, IPv4 stored in the last 4 bytes. */
+    unsigned int length;    /**< The prefix length relative to the family. */
+    bool ipv4;              /**< Whether this is an IPv4 prefix. */
+} workload_prefix;
+
+/**
+ * The kinds of malformed input mixed into a stream.
+ */
+static const char *const invalid_inputs[] = {
+    "", "not-an-ip", "256.1.1.1", "1.2.3", "1.2.3.4.5", "::g", "2001:db8:::1", " 10.0.0.1", "10.0.0.1/24", "0x7f.0.0.1"
+};
+
+/**
+ * A small, fast and deterministic pseudo-random generator (splitmix64).
+ * 
+ * @param state The generator state.
+ * @return      The next pseudo-random value.
+ */
+static uint64_t workload_random(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static double workload_uniform(uint64_t *state) {
+    return (double)(workload_random(state) >> 11) / (double)(1ULL << 53);
+}
+
+/**
+ * Fill the host bits of an address below a prefix with random bits.
+ * 
+ * @param bytes     The 16 byte address, IPv4 in the last 4 bytes.
+ * @param prefix    The prefix to keep.
+ * @param state     The generator state.
+ */
+static void random_host(uint8_t *bytes, const workload_prefix *prefix, uint64_t *state) {
+    unsigned int first = prefix->ipv4 ? 96 + prefix->length : prefix->length;
+    uint64_t hi = workload_random(state), lo = workload_random(state);
+
+    memcpy(bytes, prefix->bytes, 16);
+    for (unsigned int bit = first; bit < 128; bit++) {
+        uint64_t r = bit < 64 ? hi >> (63 - bit) : lo >> (127 - bit);
+
+        if (r & 1)
+            bytes[bit >> 3] |= (uint8_t)(0x80 >> (bit & 7));
+        else
+            bytes[bit >> 3] &= (uint8_t)~(0x80 >> (bit & 7));
+    }
+}
+
+/**
+ * Add one to an address, wrapping within its family.
+ * 
+ * @param bytes The 16 byte address.
+ * @param ipv4  Whether only the last 4 bytes are significant.
+ */
+static void next_address(uint8_t *bytes, bool ipv4) {
+    for (int i = 15; i >= (ipv4 ? 12 : 0); i--) {
+        if (++bytes[i] != 0)
+            break;
+    }
+}
+
+static char *format_address(const uint8_t *bytes, bool ipv4) {
+    char buffer[INET6_ADDRSTRLEN];
+
+    inet_ntop(ipv4 ? AF_INET : AF_INET6, ipv4 ? bytes + 12 : bytes, buffer, sizeof(buffer));
+    return strdup(buffer);
+}
+
+/**
+ * Read the prefixes to cluster around from a file of "address/prefix" lines.
+ * 
+ * @param path      The file to read.
+ * @param prefixes  Receives the prefixes.
+ * @param count     Receives the number of prefixes.
+ * @return          0 on success, -1 on failure.
+ */
+static int load_prefixes(const char *path, workload_prefix **prefixes, size_t *count) {
+    FILE *fp = fopen(path, "r");
+    char line[WORKLOAD_MAX_LINE];
+    size_t capacity = 0;
+
+    *prefixes = NULL;
+    *count = 0;
+    if (fp == NULL)
+        return -1;
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        workload_prefix prefix = { 0 };
+        char *slash = strchr(line, '/');
+
+        if (slash == NULL)
+            continue;
+
+        *slash = '\0';
+        prefix.length = (unsigned int)atoi(slash + 1);
+        prefix.ipv4 = inet_pton(AF_INET, line, prefix.bytes + 12) == 1;
+        if (!prefix.ipv4 && inet_pton(AF_INET6, line, prefix.bytes) != 1)
+            continue;
+
+        if (*count == capacity) {
+            workload_prefix *grown = realloc(*prefixes, (capacity ? capacity * 2 : 1024) * sizeof(workload_prefix));
+
+            if (grown == NULL)
+                break;
+
+            *prefixes = grown;
+            capacity = capacity ? capacity * 2 : 1024;
+        }
+
+        (*prefixes)[(*count)++] = prefix;
+    }
+
+    fclose(fp);
+    return *count ? 0 : -1;
+}
+
+/**
+ * Generate random cluster prefixes in the global unicast space.
+ * 
+ * @param options   The shape of the stream.
+ * @param state     The generator state.
+ * @return          The prefixes, or NULL when out of memory.
+ */
+static workload_prefix *random_prefixes(const workload_options *options, uint64_t *state) {
+    workload_prefix *prefixes = calloc(options->prefixes, sizeof(workload_prefix));
+    workload_prefix any = { 0 };
+
+    if (prefixes == NULL)
+        return NULL;
+
+    for (size_t i = 0; i < options->prefixes; i++) {
+        workload_prefix *prefix = &prefixes[i];
+
+        prefix->ipv4 = workload_uniform(state) >= options->ipv6_share;
+        prefix->length = prefix->ipv4 ? options->v4_prefix : options->v6_prefix;
+
+        any.ipv4 = prefix->ipv4;
+        random_host(prefix->bytes, &any, state);
+        if (prefix->ipv4) {
+            memset(prefix->bytes, 0, 12);
+            prefix->bytes[12] = (uint8_t)(1 + prefix->bytes[12] % 223); /* Stay clear of 0/8 and multicast */
+        } else {
+            prefix->bytes[0] = 0x20 | (prefix->bytes[0] & 0x1F);
+        }
+    }
+
+    return prefixes;
+}
+
+/**
+ * Build the cumulative Zipf distribution over ranks 1 to n.
+ * 
+ * @param n         The number of ranks.
+ * @param exponent  The Zipf exponent.
+ * @return          The cumulative weights, or NULL when out of memory.
+ */
+static double *zipf_cdf(size_t n, double exponent) {
+    double *cdf = malloc(n * sizeof(double));
+    double total = 0.0;
+
+    if (cdf == NULL)
+        return NULL;
+
+    for (size_t i = 0; i < n; i++) {
+        total += 1.0 / pow((double)(i + 1), exponent);
+        cdf[i] = total;
+    }
+
+    for (size_t i = 0; i < n; i++)
+        cdf[i] /= total;
+
+    return cdf;
+}
+
+static size_t zipf_draw(const double *cdf, size_t n, uint64_t *state) {
+    double u = workload_uniform(state);
+    size_t lo = 0, hi = n - 1;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (cdf[mid] < u)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/**
+ * Fill in the default shape of a stream.
+ * 
+ * @param options   The options to initialize.
+ */
+void workload_defaults(workload_options *options) {
+    memset(options, 0, sizeof(*options));
+    options->count = 100000;
+    options->seed = 1;
+    options->distinct = 50000;
+    options->zipf = 1.0;
+    options->prefixes = 2000;
+    options->v4_prefix = 24;
+    options->v6_prefix = 48;
+    options->ipv6_share = 0.2;
+    options->invalid_rate = 0.0;
+    options->scan_rate = 0.0;
+    options->scan_length = 256;
+}
+
+/**
+ * Apply one command line option of the synthetic generator.
+ * 
+ * @param options   The options to update.
+ * @param name      The option name, such as "--zipf".
+ * @param value     The option value.
+ * @return          1 when the option was applied, 0 when it is not a generator option.
+ */
+int workload_parse_option(workload_options *options, const char *name, const char *value) {
+    if (strcmp(name, "--count") == 0)
+        options->count = strtoull(value, NULL, 10);
+    else if (strcmp(name, "--seed") == 0)
+        options->seed = strtoull(value, NULL, 10);
+    else if (strcmp(name, "--distinct") == 0)
+        options->distinct = strtoull(value, NULL, 10);
+    else if (strcmp(name, "--zipf") == 0)
+        options->zipf = atof(value);
+    else if (strcmp(name, "--prefixes") == 0)
+        options->prefixes = strtoull(value, NULL, 10);
+    else if (strcmp(name, "--v4-prefix") == 0)
+        options->v4_prefix = (unsigned int)atoi(value);
+    else if (strcmp(name, "--v6-prefix") == 0)
+        options->v6_prefix = (unsigned int)atoi(value);
+    else if (strcmp(name, "--ipv6-share") == 0)
+        options->ipv6_share = atof(value);
+    else if (strcmp(name, "--invalid-rate") == 0)
+        options->invalid_rate = atof(value);
+    else if (strcmp(name, "--scan-rate") == 0)
+        options->scan_rate = atof(value);
+    else if (strcmp(name, "--scan-length") == 0)
+        options->scan_length = strtoull(value, NULL, 10);
+    else if (strcmp(name, "--networks") == 0)
+        options->networks_path = value;
+    else
+        return 0;
+
+    return 1;
+}
+
+/**
+ * Describe the options understood by workload_parse_option().
+ * 
+ * @param fp    The stream to write to.
+ */
+void workload_usage(FILE *fp) {
+    fprintf(fp,
+        "  --count N          Number of addresses in the stream (default: 100000)\n"
+        "  --seed N           Generator seed, equal seeds produce identical streams (default: 1)\n"
+        "  --distinct N       Number of distinct addresses (default: 50000)\n"
+        "  --zipf S           Zipf exponent of address popularity, 0 for uniform (default: 1.0)\n"
+        "  --prefixes N       Number of prefixes the addresses cluster into (default: 2000)\n"
+        "  --v4-prefix N      Length of random IPv4 cluster prefixes (default: 24)\n"
+        "  --v6-prefix N      Length of random IPv6 cluster prefixes (default: 48)\n"
+        "  --ipv6-share F     Fraction of IPv6 addresses (default: 0.2)\n"
+        "  --invalid-rate F   Fraction of malformed input (default: 0)\n"
+        "  --scan-rate F      Probability of starting a sequential scan burst (default: 0)\n"
+        "  --scan-length N    Addresses per scan burst (default: 256)\n"
+        "  --networks FILE    Cluster around the networks listed by \"mmdb_gen --list\" instead of random prefixes\n");
+}
+
+/**
+ * Generate a synthetic lookup stream.
+ * 
+ * @param options       The shape of the stream.
+ * @param out           Receives the stream, release it with workload_free().
+ * @param error         Receives a message on failure.
+ * @param error_size    The size of the error buffer.
+ * @return              0 on success, -1 on failure.
+ */
+int workload_generate(const workload_options *options, workload *out, char *error, size_t error_size) {
+    workload_prefix *prefixes = NULL;
+    uint8_t (*universe)[16] = NULL;
+    bool *universe_v4 = NULL;
+    double *cdf = NULL;
+    size_t prefix_count = options->prefixes;
+    uint64_t state = options->seed;
+    int rc = -1;
+
+    memset(out, 0, sizeof(*out));
+    if (options->count == 0 || options->distinct == 0 || (options->networks_path == NULL && options->prefixes == 0)) {
+        snprintf(error, error_size, "Invalid workload parameters");
+        return -1;
+    }
+
+    if (options->networks_path != NULL) {
+        if (load_prefixes(options->networks_path, &prefixes, &prefix_count) != 0) {
+            snprintf(error, error_size, "Unable to read networks from %s", options->networks_path);
+            goto cleanup;
+        }
+    } else if ((prefixes = random_prefixes(options, &state)) == NULL) {
+        snprintf(error, error_size, "Out of memory");
+        goto cleanup;
+    }
+
+    universe = malloc(options->distinct * sizeof(*universe));
+    universe_v4 = malloc(options->distinct * sizeof(bool));
+    cdf = zipf_cdf(options->distinct, options->zipf);
+    out->ips = calloc(options->count, sizeof(char *));
+    if (universe == NULL || universe_v4 == NULL || cdf == NULL || out->ips == NULL) {
+        snprintf(error, error_size, "Out of memory");
+        goto cleanup;
+    }
+
+    for (size_t i = 0; i < options->distinct; i++) {
+        const workload_prefix *prefix = &prefixes[workload_random(&state) % prefix_count];
+
+        random_host(universe[i], prefix, &state);
+        universe_v4[i] = prefix->ipv4;
+    }
+
+    while (out->count < options->count) {
+        if (workload_uniform(&state) < options->invalid_rate) {
+            out->ips[out->count] = strdup(invalid_inputs[workload_random(&state) % (sizeof(invalid_inputs) / sizeof(invalid_inputs[0]))]);
+        } else if (workload_uniform(&state) < options->scan_rate) {
+            size_t i = workload_random(&state) % options->distinct;
+            uint8_t bytes[16];
+
+            memcpy(bytes, universe[i], 16);
+            for (size_t n = 0; n < options->scan_length && out->count < options->count; n++) {
+                out->ips[out->count] = format_address(bytes, universe_v4[i]);
+                if (out->ips[out->count++] == NULL)
+                    goto oom;
+
+                next_address(bytes, universe_v4[i]);
+            }
+            continue;
+        } else {
+            size_t i = zipf_draw(cdf, options->distinct, &state);
+
+            out->ips[out->count] = format_address(universe[i], universe_v4[i]);
+        }
+
+        if (out->ips[out->count++] == NULL)
+            goto oom;
+    }
+
+    rc = 0;
+    goto cleanup;
+
+oom:
+    snprintf(error, error_size, "Out of memory");
+
+cleanup:
+    if (rc != 0)
+        workload_free(out);
+
+    free(prefixes);
+    free(universe);
+    free(universe_v4);
+    free(cdf);
+    return rc;
+}
+
+/**
+ * Append an address to a replayed stream.
+ * 
+ * @param out       The stream.
+ * @param capacity  The allocated size of the stream.
+ * @param ip        The address.
+ * @return          0 on success, -1 when out of memory.
+ */
+static int workload_append(workload *out, size_t *capacity, const char *ip) {
+    if (out->count == *capacity) {
+        size_t grown = *capacity ? *capacity * 2 : 4096;
+        char **ips = realloc(out->ips, grown * sizeof(char *));
+
+        if (ips == NULL)
+            return -1;
+
+        out->ips = ips;
+        *capacity = grown;
+    }
+
+    out->ips[out->count] = strdup(ip);
+    return out->ips[out->count++] == NULL ? -1 : 0;
+}
+
+/**
+ * Repeat a replayed stream until it holds count addresses.
+ * 
+ * @param out       The stream.
+ * @param capacity  The allocated size of the stream.
+ * @param count     The requested size, 0 to keep the stream as it is.
+ * @return          0 on success, -1 when out of memory.
+ */
+static int workload_repeat(workload *out, size_t *capacity, size_t count) {
+    size_t original = out->count;
+
+    if (count != 0 && out->count > count) {
+        for (size_t i = count; i < out->count; i++)
+            free(out->ips[i]);
+
+        out->count = count;
+    }
+
+    for (size_t i = 0; count != 0 && out->count < count; i++) {
+        if (workload_append(out, capacity, out->ips[i % original]) != 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Replay a stream from a file holding one address per line.
+ * 
+ * @param path          The file to read.
+ * @param count         The size of the stream, the file is repeated or truncated to fit, 0 to use it as is.
+ * @param out           Receives the stream, release it with workload_free().
+ * @param error         Receives a message on failure.
+ * @param error_size    The size of the error buffer.
+ * @return              0 on success, -1 on failure.
+ */
+int workload_replay_file(const char *path, size_t count, workload *out, char *error, size_t error_size) {
+    FILE *fp = fopen(path, "r");
+    char line[WORKLOAD_MAX_LINE];
+    size_t capacity = 0;
+
+    memset(out, 0, sizeof(*out));
+    if (fp == NULL) {
+        snprintf(error, error_size, "Unable to open %s", path);
+        return -1;
+    }
+
+    while ((count == 0 || out->count < count) && fgets(line, sizeof(line), fp) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+
+        if (workload_append(out, &capacity, line) != 0)
+            break;
+    }
+
+    fclose(fp);
+
+    if (out->count == 0 || workload_repeat(out, &capacity, count) != 0) {
+        snprintf(error, error_size, out->count ? "Out of memory" : "No addresses in %s", path);
+        workload_free(out);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Replay a stream from a column of an existing SQLite table, NULL values become empty strings.
+ * 
+ * @param path          The SQLite database, opened read-only.
+ * @param table         The table to read.
+ * @param column        The column holding the addresses.
+ * @param count         The size of the stream, the rows are repeated or truncated to fit, 0 to use them as they are.
+ * @param out           Receives the stream, release it with workload_free().
+ * @param error         Receives a message on failure.
+ * @param error_size    The size of the error buffer.
+ * @return              0 on success, -1 on failure.
+ */
+int workload_replay_sqlite(const char *path, const char *table, const char *column, size_t count, workload *out, char *error, size_t error_size) {
+    sqlite3 *db = NULL;
+    sqlite3_stmt *stmt = NULL;
+    char *sql = NULL;
+    size_t capacity = 0;
+    int rc = -1;
+
+    memset(out, 0, sizeof(*out));
+    if (sqlite3_open_v2(path, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+        snprintf(error, error_size, "Unable to open %s: %s", path, sqlite3_errmsg(db));
+        goto cleanup;
+    }
+
+    sql = sqlite3_mprintf("SELECT \"%w\" FROM \"%w\"", column, table);
+    if (sql == NULL || sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        snprintf(error, error_size, "%s", sqlite3_errmsg(db));
+        goto cleanup;
+    }
+
+    while ((count == 0 || out->count < count) && sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *ip = (const char *)sqlite3_column_text(stmt, 0);
+
+        if (workload_append(out, &capacity, ip ? ip : "") != 0)
+            break;
+    }
+
+    if (out->count == 0 || workload_repeat(out, &capacity, count) != 0) {
+        snprintf(error, error_size, out->count ? "Out of memory" : "No rows in %s.%s", table, column);
+        goto cleanup;
+    }
+
+    rc = 0;
+
+cleanup:
+    if (rc != 0)
+        workload_free(out);
+
+    sqlite3_free(sql);
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    return rc;
+}
+
+/**
+ * Release a stream.
+ * 
+ * @param w The stream.
+ */
+void workload_free(workload *w) {
+    for (size_t i = 0; i < w->count; i++)
+        free(w->ips[i]);
+
+    free(w->ips);
+    w->ips = NULL;
+    w->count = 0;
+}
@@ -0,0 +1,46 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * The shape of a generated lookup stream, see workload_defaults() for the default values.
+ * 
+ * Addresses are drawn from a universe of distinct addresses whose popularity follows a Zipf distribution. The universe
+ * is clustered into a limited number of prefixes, either random ones or the networks of an existing database as
+ * written by "mmdb_gen --list", so neighbouring addresses share most of their tree walk like real traffic does.
+ */
+typedef struct workload_options {
+    size_t count;               /**< The number of addresses to generate. */
+    uint64_t seed;              /**< The generator seed, equal seeds produce identical streams. */
+    size_t distinct;            /**< The number of distinct addresses in the universe. */
+    double zipf;                /**< The Zipf exponent of address popularity, 0 for uniform. */
+    size_t prefixes;            /**< The number of prefixes the universe is clustered into. */
+    unsigned int v4_prefix;     /**< The length of random IPv4 cluster prefixes. */
+    unsigned int v6_prefix;     /**< The length of random IPv6 cluster prefixes. */
+    double ipv6_share;          /**< The fraction of IPv6 addresses in the universe. */
+    double invalid_rate;        /**< The fraction of the stream replaced by malformed input. */
+    double scan_rate;           /**< The probability that an address starts a scan burst. */
+    size_t scan_length;         /**< The number of consecutive addresses in a scan burst. */
+    const char *networks_path;  /**< A file of "address/prefix" lines to cluster around instead of random prefixes, or NULL. */
+} workload_options;
+
+/**
+ * A stream of textual addresses.
+ */
+typedef struct workload {
+    char **ips;     /**< The addresses, malformed input included. */
+    size_t count;   /**< The number of addresses. */
+} workload;
+
+void workload_defaults(workload_options *options);
+int workload_parse_option(workload_options *options, const char *name, const char *value);
+void workload_usage(FILE *fp);
+int workload_generate(const workload_options *options, workload *out, char *error, size_t error_size);
+int workload_replay_file(const char *path, size_t count, workload *out, char *error, size_t error_size);
+int workload_replay_sqlite(const char *path, const char *table, const char *column, size_t count, workload *out, char *error, size_t error_size);
+void workload_free(workload *w);
+
+#endif /* WORKLOAD_H */